@@ -22,6 +22,7 @@ THE SOFTWARE.
 
 #include "alloc.h"
 #include <assert.h>
+#include "env.h"
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -80,6 +81,45 @@ static void *mmap_wrap (size_t size, int shared)
     return ptr;
 }
 
+/**
+ * Like mmap_wrap(), but try to back the memory with 2 MB pages.  Explicit
+ * (hugetlbfs) pages are tried first if the user asked for them.  Otherwise,
+ * or if none are reserved, the block is aligned to a 2 MB boundary and
+ * advised for transparent huge pages.  If the kernel won't cooperate, the
+ * memory is still perfectly good 4K pages.  size must be a multiple of
+ * HUGEPAGESIZE.
+ */
+static void *mmap_wrap_huge (size_t size, int shared)
+{
+    char *ptr, *aligned;
+
+    assert(size % HUGEPAGESIZE == 0);
+
+    if (HUGE_PAGES_EXPLICIT == g_forkscan_huge_pages) {
+        ptr = mmap(NULL, size,
+                   PROT_READ | PROT_WRITE,
+                   MAP_ANONYMOUS | MAP_HUGETLB
+                   | (shared ? MAP_SHARED : MAP_PRIVATE),
+                   -1, 0);
+        if (MAP_FAILED != ptr) return ptr;
+        // No reserved huge pages.  Fall back to THP.
+    }
+
+    // THP only backs 2 MB-aligned extents, and mmap() makes no promises
+    // about alignment.  Over-allocate and trim the ends.
+    ptr = (char*)mmap_wrap(size + HUGEPAGESIZE, shared);
+    aligned = (char*)HUGEALIGN((size_t)ptr + HUGEPAGESIZE - 1);
+    if (aligned > ptr) {
+        munmap(ptr, aligned - ptr);
+    }
+    munmap(aligned + size, (ptr + HUGEPAGESIZE) - aligned);
+
+    // Failure just means no THP (e.g., shmem THP is disabled).
+    madvise(aligned, size, MADV_HUGEPAGE);
+
+    return aligned;
+}
+
 /**
  * Wrapper for munmap to be symetrical with mmap/mmap_wrap.
  */
@@ -242,13 +282,16 @@ static mem_range_t metadata_break_range (mem_range_t *big_range)
     return ret;
 }
 
-static void *alloc_mmap (size_t size, const char *reason, int shared)
+static void *alloc_mmap (size_t size, const char *reason, int shared,
+                         int huge, int inherit)
 {
     memory_metadata_t *meta = metadata_new();
     assert(size % PAGESIZE == 0);
     assert(meta);
     meta->length = size;
-    meta->addr = mmap_wrap(size, shared);
+    meta->addr = huge && g_forkscan_huge_pages != HUGE_PAGES_OFF
+        ? mmap_wrap_huge(size, shared)
+        : mmap_wrap(size, shared);
     meta->reason = reason;
     assert(meta->addr && meta->addr != MAP_FAILED);
     metadata_insert(meta);
@@ -256,6 +299,10 @@ static void *alloc_mmap (size_t size, const char *reason, int shared)
         forkscan_diagnostic("mprotect failed %s:%d\n",
                             __FILE__, __LINE__);
     }
+    // The scan's child never looks at this memory.  fork() would copy its
+    // page tables, and every sibling would copy them again, for nothing.
+    // Failure only costs fork time.
+    if (!inherit) madvise(meta->addr, size, MADV_DONTFORK);
     return meta->addr;
 }
 
@@ -270,7 +317,8 @@ static void *alloc_mmap (size_t size, const char *reason, int shared)
  */
 void *forkscan_alloc_mmap (size_t size, const char *reason)
 {
-    return alloc_mmap(size, reason, /*shared=*/0);
+    return alloc_mmap(size, reason, /*shared=*/0, /*huge=*/0,
+                      /*inherit=*/1);
 }
 
 /**
@@ -281,7 +329,93 @@ void *forkscan_alloc_mmap (size_t size, const char *reason)
  */
 void *forkscan_alloc_mmap_shared (size_t size, const char *reason)
 {
-    return alloc_mmap(size, reason, /*shared=*/1);
+    return alloc_mmap(size, reason, /*shared=*/1, /*huge=*/0,
+                      /*inherit=*/1);
+}
+
+/**
+ * Round size up to the granularity used by the huge-page allocators:
+ * 2 MB if huge pages are enabled, the regular page size otherwise.
+ */
+size_t forkscan_alloc_huge_round (size_t size)
+{
+    size_t granularity = g_forkscan_huge_pages != HUGE_PAGES_OFF
+        ? HUGEPAGESIZE : PAGESIZE;
+    return (size + granularity - 1) & ~(granularity - 1);
+}
+
+/**
+ * Like forkscan_alloc_mmap(), but the memory is backed by huge pages where
+ * the system supports them.  size should come from
+ * forkscan_alloc_huge_round().
+ * @return The allocated memory.
+ */
+void *forkscan_alloc_mmap_huge (size_t size, const char *reason)
+{
+    return alloc_mmap(size, reason, /*shared=*/0, /*huge=*/1,
+                      /*inherit=*/1);
+}
+
+/**
+ * Like forkscan_alloc_mmap_shared(), but the memory is backed by huge pages
+ * where the system supports them.  size should come from
+ * forkscan_alloc_huge_round().
+ * @return The allocated memory.
+ */
+void *forkscan_alloc_mmap_shared_huge (size_t size, const char *reason)
+{
+    return alloc_mmap(size, reason, /*shared=*/1, /*huge=*/1,
+                      /*inherit=*/1);
+}
+
+/**
+ * Like forkscan_alloc_mmap(), but for memory only the parent process uses.
+ * The snapshot child doesn't get it at all.
+ * @return The allocated memory.
+ */
+void *forkscan_alloc_mmap_parent (size_t size, const char *reason)
+{
+    return alloc_mmap(size, reason, /*shared=*/0, /*huge=*/0,
+                      /*inherit=*/0);
+}
+
+/**
+ * Like forkscan_alloc_mmap_huge(), but for memory only the parent process
+ * uses.  The snapshot child doesn't get it at all.
+ * @return The allocated memory.
+ */
+void *forkscan_alloc_mmap_parent_huge (size_t size, const char *reason)
+{
+    return alloc_mmap(size, reason, /*shared=*/0, /*huge=*/1,
+                      /*inherit=*/0);
+}
+
+/**
+ * Change whether the snapshot child gets a block from forkscan_alloc_mmap()
+ * and friends.  Takes effect at the next fork().
+ */
+void forkscan_alloc_set_inherited (void *ptr, int inherited)
+{
+    memory_metadata_t *curr;
+    size_t length = 0;
+
+    assert(ptr);
+
+    pthread_mutex_lock(&list_lock);
+    curr = alloc_list;
+    do {
+        if (curr->addr == ptr) {
+            length = curr->length;
+            break;
+        }
+        curr = curr->next;
+    } while (curr != alloc_list);
+    pthread_mutex_unlock(&list_lock);
+
+    if (0 == length) {
+        forkscan_fatal("lost track of memory.\n");
+    }
+    madvise(ptr, length, inherited ? MADV_DOFORK : MADV_DONTFORK);
 }
 
 /**
@@ -54,6 +54,48 @@ void *forkscan_alloc_mmap (size_t size, const char *reason);
  */
 void *forkscan_alloc_mmap_shared (size_t size, const char *reason);
 
+/**
+ * Round size up to the granularity used by the huge-page allocators:
+ * 2 MB if huge pages are enabled, the regular page size otherwise.
+ */
+size_t forkscan_alloc_huge_round (size_t size);
+
+/**
+ * Like forkscan_alloc_mmap(), but the memory is backed by huge pages where
+ * the system supports them.  size should come from
+ * forkscan_alloc_huge_round().
+ * @return The allocated memory.
+ */
+void *forkscan_alloc_mmap_huge (size_t size, const char *reason);
+
+/**
+ * Like forkscan_alloc_mmap_shared(), but the memory is backed by huge pages
+ * where the system supports them.  size should come from
+ * forkscan_alloc_huge_round().
+ * @return The allocated memory.
+ */
+void *forkscan_alloc_mmap_shared_huge (size_t size, const char *reason);
+
+/**
+ * Like forkscan_alloc_mmap(), but for memory only the parent process uses.
+ * The snapshot child doesn't get it at all, so fork() doesn't pay for it.
+ * @return The allocated memory.
+ */
+void *forkscan_alloc_mmap_parent (size_t size, const char *reason);
+
+/**
+ * Like forkscan_alloc_mmap_huge(), but for memory only the parent process
+ * uses.
+ * @return The allocated memory.
+ */
+void *forkscan_alloc_mmap_parent_huge (size_t size, const char *reason);
+
+/**
+ * Change whether the snapshot child gets a block from forkscan_alloc_mmap()
+ * and friends.  Takes effect at the next fork().
+ */
+void forkscan_alloc_set_inherited (void *ptr, int inherited);
+
 /**
  * munmap() for the Forkscan system.
  */
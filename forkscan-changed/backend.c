@@ -0,0 +1,326 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#define _GNU_SOURCE // For RTLD_DEFAULT.
+#include <assert.h>
+#include "backend.h"
+#include <dlfcn.h>
+#include "heap.h"
+#include "include/forkscan.h"
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+
+/****************************************************************************/
+/*                         Defines, typedefs, etc.                          */
+/****************************************************************************/
+
+#define LOOKUP(handle, var, sym) (*(void**)&(var) = dlsym(handle, sym))
+
+static const char env_allocator[] = "FORKSCAN_ALLOCATOR";
+
+/****************************************************************************/
+/*                                 Globals                                  */
+/****************************************************************************/
+
+forkscan_allocator_t g_forkscan_allocator = {
+    "forkscan",
+    forkscan_heap_malloc,
+    forkscan_heap_free,
+    forkscan_heap_usable_size,
+    NULL,
+    forkscan_heap_free_batch,
+    forkscan_heap_usable_size_batch,
+};
+
+/****************************************************************************/
+/*                                 Adapters                                 */
+/****************************************************************************/
+
+/* Each adapter fills in an allocator and returns 1, or returns 0 if the
+   library isn't loaded in this process. */
+
+static int adapter_forkscan (forkscan_allocator_t *a)
+{
+    a->name = "forkscan";
+    a->malloc = forkscan_heap_malloc;
+    a->free = forkscan_heap_free;
+    a->usable_size = forkscan_heap_usable_size;
+    a->free_batch = forkscan_heap_free_batch;
+    a->usable_size_batch = forkscan_heap_usable_size_batch;
+    return 1;
+}
+
+static int adapter_glibc (forkscan_allocator_t *a)
+{
+    // Ask libc itself, in case malloc has been interposed.
+    void *libc = dlopen("libc.so.6", RTLD_LAZY | RTLD_NOLOAD);
+    if (NULL == libc) return 0;
+
+    a->name = "glibc";
+    LOOKUP(libc, a->malloc, "malloc");
+    LOOKUP(libc, a->free, "free");
+    LOOKUP(libc, a->usable_size, "malloc_usable_size");
+    // glibc's free_sized() wants the requested size, which we don't have.
+    dlclose(libc);
+    return 1;
+}
+
+static void *(*g_mallocx) (size_t, int);
+static void (*g_dallocx) (void *, int);
+static size_t (*g_sallocx) (const void *, int);
+static void (*g_sdallocx) (void *, size_t, int);
+
+static void *jemalloc_malloc (size_t size)
+{
+    return g_mallocx(size ? size : 1, 0);
+}
+
+static void jemalloc_free (void *ptr)
+{
+    if (ptr) g_dallocx(ptr, 0);
+}
+
+static size_t jemalloc_usable_size (void *ptr)
+{
+    return g_sallocx(ptr, 0);
+}
+
+static void jemalloc_free_sized (void *ptr, size_t size)
+{
+    g_sdallocx(ptr, size, 0);
+}
+
+static int adapter_jemalloc (forkscan_allocator_t *a)
+{
+    if (!LOOKUP(RTLD_DEFAULT, g_mallocx, "mallocx")
+        || !LOOKUP(RTLD_DEFAULT, g_dallocx, "dallocx")
+        || !LOOKUP(RTLD_DEFAULT, g_sallocx, "sallocx")
+        || !LOOKUP(RTLD_DEFAULT, g_sdallocx, "sdallocx")) {
+        return 0;
+    }
+    a->name = "jemalloc";
+    a->malloc = jemalloc_malloc;
+    a->free = jemalloc_free;
+    a->usable_size = jemalloc_usable_size;
+    a->free_sized = jemalloc_free_sized;
+    return 1;
+}
+
+static int adapter_tcmalloc (forkscan_allocator_t *a)
+{
+    if (!LOOKUP(RTLD_DEFAULT, a->malloc, "tc_malloc")
+        || !LOOKUP(RTLD_DEFAULT, a->free, "tc_free")
+        || !LOOKUP(RTLD_DEFAULT, a->usable_size, "tc_malloc_size")) {
+        return 0;
+    }
+    a->name = "tcmalloc";
+    LOOKUP(RTLD_DEFAULT, a->free_sized, "tc_free_sized");
+    return 1;
+}
+
+static int adapter_mimalloc (forkscan_allocator_t *a)
+{
+    if (!LOOKUP(RTLD_DEFAULT, a->malloc, "mi_malloc")
+        || !LOOKUP(RTLD_DEFAULT, a->free, "mi_free")
+        || !LOOKUP(RTLD_DEFAULT, a->usable_size, "mi_usable_size")) {
+        return 0;
+    }
+    a->name = "mimalloc";
+    LOOKUP(RTLD_DEFAULT, a->free_sized, "mi_free_size");
+    return 1;
+}
+
+#ifdef FORKSCAN_SUPERMALLOC
+extern void *__super_malloc (size_t);
+extern void __super_free (void *);
+extern size_t __super_malloc_usable_size (void *);
+
+static int adapter_supermalloc (forkscan_allocator_t *a)
+{
+    a->name = "supermalloc";
+    a->malloc = __super_malloc;
+    a->free = __super_free;
+    a->usable_size = __super_malloc_usable_size;
+    return 1;
+}
+#endif
+
+typedef struct adapter_t adapter_t;
+
+struct adapter_t {
+    const char *name;
+    int (*init) (forkscan_allocator_t *);
+};
+
+static const adapter_t g_adapters[] = {
+    { "forkscan", adapter_forkscan },
+    { "glibc", adapter_glibc },
+    { "jemalloc", adapter_jemalloc },
+    { "tcmalloc", adapter_tcmalloc },
+    { "mimalloc", adapter_mimalloc },
+#ifdef FORKSCAN_SUPERMALLOC
+    { "supermalloc", adapter_supermalloc },
+#endif
+};
+
+#define N_ADAPTERS (int)(sizeof(g_adapters) / sizeof(g_adapters[0]))
+
+__attribute__((constructor (102)))
+static void backend_init ()
+{
+    const char *env = getenv(env_allocator);
+    int i;
+
+#ifdef FORKSCAN_SUPERMALLOC
+    if (NULL == env) env = "supermalloc";
+#endif
+    if (NULL == env) return;
+
+    for (i = 0; i < N_ADAPTERS; ++i) {
+        if (0 != strcmp(env, g_adapters[i].name)) continue;
+        forkscan_allocator_t a = { 0 };
+        if (g_adapters[i].init(&a)) {
+            g_forkscan_allocator = a;
+        } else {
+            forkscan_diagnostic("warning: %s = %s\n"
+                                "  But %s is not loaded.  "
+                                "Using the Forkscan heap.\n",
+                                env_allocator, env, env);
+        }
+        return;
+    }
+    forkscan_diagnostic("warning: %s = %s\n"
+                        "  Unknown allocator.  Using the Forkscan heap.\n",
+                        env_allocator, env);
+}
+
+/****************************************************************************/
+/*                                Interface                                 */
+/****************************************************************************/
+
+/**
+ * Zero and free the n (at most RELEASE_BATCH) reclaimed pointers in ptrs,
+ * using the allocator's batch and sized entry points where it has them.
+ * Returns the number of bytes freed.
+ */
+size_t forkscan_backend_release (void **ptrs, size_t n)
+{
+    const forkscan_allocator_t *a = &g_forkscan_allocator;
+    size_t sizes[RELEASE_BATCH];
+    size_t i, bytes = 0;
+
+    assert(n <= RELEASE_BATCH);
+
+    if (a->usable_size_batch) {
+        a->usable_size_batch(ptrs, sizes, n);
+    } else {
+        for (i = 0; i < n; ++i) sizes[i] = a->usable_size(ptrs[i]);
+    }
+
+    // FIXME: What about this memset?  Does it save time
+    // to have it on or off?
+    for (i = 0; i < n; ++i) {
+        memset(ptrs[i], 0x0, sizes[i]);
+        bytes += sizes[i];
+    }
+
+    if (a->free_batch) {
+        a->free_batch(ptrs, n);
+    } else if (a->free_sized) {
+        for (i = 0; i < n; ++i) a->free_sized(ptrs[i], sizes[i]);
+    } else {
+        for (i = 0; i < n; ++i) a->free(ptrs[i]);
+    }
+    return bytes;
+}
+
+/**
+ * Return the total usable size of the n live pointers in ptrs.
+ */
+size_t forkscan_backend_usable_bytes (void **ptrs, size_t n)
+{
+    const forkscan_allocator_t *a = &g_forkscan_allocator;
+    size_t sizes[RELEASE_BATCH];
+    size_t i, bytes = 0;
+
+    while (n > 0) {
+        size_t batch = MIN_OF(n, RELEASE_BATCH);
+        if (a->usable_size_batch) {
+            a->usable_size_batch(ptrs, sizes, batch);
+        } else {
+            for (i = 0; i < batch; ++i) sizes[i] = a->usable_size(ptrs[i]);
+        }
+        for (i = 0; i < batch; ++i) bytes += sizes[i];
+        ptrs += batch;
+        n -= batch;
+    }
+    return bytes;
+}
+
+/**
+ * Set the allocator for Forkscan to use: malloc, free, malloc_usable_size.
+ */
+__attribute__((visibility("default")))
+void forkscan_set_allocator (void *(*alloc) (size_t),
+                             void (*dealloc) (void *),
+                             size_t (*usable_size) (void *))
+{
+    forkscan_allocator_t a = { "user", alloc, dealloc, usable_size };
+    g_forkscan_allocator = a;
+}
+
+/**
+ * Set the allocator for Forkscan to use, including the optional batch and
+ * sized entry points.  Returns zero on success, non-zero if a required
+ * entry is missing.
+ */
+__attribute__((visibility("default")))
+int forkscan_set_allocator_ex (const struct forkscan_allocator *allocator)
+{
+    if (NULL == allocator || NULL == allocator->malloc
+        || NULL == allocator->free || NULL == allocator->usable_size) {
+        return -1;
+    }
+
+    forkscan_allocator_t a = {
+        allocator->name ? allocator->name : "user",
+        allocator->malloc,
+        allocator->free,
+        allocator->usable_size,
+        allocator->free_sized,
+        allocator->free_batch,
+        allocator->usable_size_batch,
+    };
+    g_forkscan_allocator = a;
+    return 0;
+}
+
+/**
+ * Return the name of the allocator Forkscan is using.
+ */
+__attribute__((visibility("default")))
+const char *forkscan_get_allocator_name ()
+{
+    return g_forkscan_allocator.name;
+}
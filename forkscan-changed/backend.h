@@ -0,0 +1,71 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/* Module Description:
+   The allocator Forkscan hands out memory from and frees reclaimed memory
+   back to.  An allocator is a table of functions: malloc, free, and
+   usable_size are required; free_sized, free_batch, and usable_size_batch
+   are optional and let the reclaimer pass along what it knows.  Adapters
+   for the built-in heap, glibc, jemalloc, tcmalloc, mimalloc, and (when
+   built with it) SuperMalloc are looked up with dlsym() so none of them is
+   a link-time dependency.  FORKSCAN_ALLOCATOR picks one by name.
+ */
+
+#ifndef _BACKEND_H_
+#define _BACKEND_H_
+
+#include <stddef.h>
+
+typedef struct forkscan_allocator_t forkscan_allocator_t;
+
+/** Must match struct forkscan_allocator in forkscan.h.  free_sized is
+ *  passed the usable size, not the requested size.
+ */
+struct forkscan_allocator_t {
+    const char *name;
+    void *(*malloc) (size_t);
+    void (*free) (void *);
+    size_t (*usable_size) (void *);
+    void (*free_sized) (void *, size_t);
+    void (*free_batch) (void **, size_t);
+    void (*usable_size_batch) (void **, size_t *, size_t);
+};
+
+// Most pointers forkscan_backend_release() takes at once.
+#define RELEASE_BATCH 64
+
+// The allocator in use.
+extern forkscan_allocator_t g_forkscan_allocator;
+
+/**
+ * Zero and free the n (at most RELEASE_BATCH) reclaimed pointers in ptrs,
+ * using the allocator's batch and sized entry points where it has them.
+ * Returns the number of bytes freed.
+ */
+size_t forkscan_backend_release (void **ptrs, size_t n);
+
+/**
+ * Return the total usable size of the n live pointers in ptrs.
+ */
+size_t forkscan_backend_usable_bytes (void **ptrs, size_t n);
+
+#endif // !defined _BACKEND_H_
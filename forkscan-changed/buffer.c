@@ -25,10 +25,20 @@ THE SOFTWARE.
 #include "buffer.h"
 #include "env.h"
 #include <pthread.h>
+#include "stats.h"
+#include <sys/mman.h>
 #include "util.h"
 
-#define STACKSIZE (2 * 1024 * 1024)
-#define NSTACKS 16
+// An overflow runs into this PROT_NONE page instead of another mapping.
+#define STACK_GUARD_SIZE PAGESIZE
+
+// How far below its stack pointer a trimmed thread keeps its pages, so
+// shallow calls right after a trim don't fault.
+#define STACK_TRIM_SLACK (64 * 1024)
+
+// Buffers give the addr_buffer_t a page to itself.
+_Static_assert(sizeof(addr_buffer_t) <= PAGESIZE,
+               "addr_buffer_t has outgrown its header page");
 
 static int g_default_capacity;
 static pthread_mutex_t g_reclaimer_list_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -41,6 +51,12 @@ static pthread_mutex_t g_retiree_mutex = PTHREAD_MUTEX_INITIALIZER;
 static addr_buffer_t *g_available_aggregates;
 static pthread_mutex_t g_aa_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+// Stacks of exited threads, waiting for reuse.  The pages are discarded, so
+// nothing can be linked through them.
+static char *g_free_stacks[MAX_STACK_POOL];
+static int g_n_free_stacks;
+static pthread_mutex_t g_stack_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 #include <stdio.h>
 addr_buffer_t *forkscan_make_reclaimer_buffer ()
 {
@@ -64,8 +80,9 @@ addr_buffer_t *forkscan_make_reclaimer_buffer ()
     if (0 == g_default_capacity) {
         g_default_capacity = g_forkscan_ptrs_per_thread * MAX_THREAD_COUNT;
     }
-    size_t sz = g_default_capacity * sizeof(size_t) + PAGESIZE;
-    char *raw_mem = forkscan_alloc_mmap(sz, "reclaimer");
+    size_t sz = forkscan_alloc_huge_round(g_default_capacity * sizeof(size_t)
+                                          + PAGESIZE);
+    char *raw_mem = forkscan_alloc_mmap_parent_huge(sz, "reclaimer");
 
     //   0 - 4095: Reserved page for the addr_buffer_t struct.
     //   4096 -  : Address list.
@@ -83,10 +100,11 @@ addr_buffer_t *forkscan_make_aggregate_buffer (int capacity)
 {
     addr_buffer_t *ab;
 
-    // Round capacity up to the nearest page size.
-    if (capacity & (PAGESIZE / sizeof(size_t) - 1)) {
-        capacity -= capacity & (PAGESIZE / sizeof(size_t) - 1);
-        capacity += PAGESIZE / sizeof(size_t);
+    // Round capacity up so the address array fills whole (huge) pages.
+    size_t addrs_per_chunk = forkscan_alloc_huge_round(1) / sizeof(size_t);
+    if (capacity & (addrs_per_chunk - 1)) {
+        capacity -= capacity & (addrs_per_chunk - 1);
+        capacity += addrs_per_chunk;
     }
 
     if (g_available_aggregates != NULL) {
@@ -103,6 +121,7 @@ addr_buffer_t *forkscan_make_aggregate_buffer (int capacity)
             pthread_mutex_unlock(&g_aa_mutex);
             ab->n_addrs = 0;
             assert(ab->ref_count == 0);
+            forkscan_alloc_set_inherited(ab, 1);
             return ab;
         }
         // None of the available buffers were big enough, and all were
@@ -117,26 +136,24 @@ addr_buffer_t *forkscan_make_aggregate_buffer (int capacity)
     // How many pages of memory are needed to store the minimap?
     size_t pages_of_minimap = ((pages_of_addrs * sizeof(size_t))
                                + PAGESIZE - sizeof(size_t)) / PAGESIZE;
-    // Total pages needed is the number of pages for the addresses, plus the
-    // number of pages needed for the minimap, plus one (for the
-    // addr_buffer_t).
-    char *p =
-        (char*)forkscan_alloc_mmap_shared((pages_of_addrs     // addr array.
-                                           + pages_of_minimap // minimap.
-                                           + 1)               // struct page.
-                                          * PAGESIZE,
-                                          "aggregate");
+    // The header is one page for the addr_buffer_t plus the minimap.  It is
+    // padded out so the address array starts on a (huge) page boundary and
+    // binary searches over it don't straddle extra TLB entries.
+    size_t header_sz =
+        forkscan_alloc_huge_round((pages_of_minimap + 1) * PAGESIZE);
+    size_t addrs_sz = forkscan_alloc_huge_round(pages_of_addrs * PAGESIZE);
+    char *p = (char*)forkscan_alloc_mmap_shared_huge(header_sz + addrs_sz,
+                                                     "aggregate");
 
     // Perform assignments as offsets into the block that was bulk-allocated.
     size_t offset = 0;
     ab = (addr_buffer_t*)p;
     offset += PAGESIZE;
 
-    ab->addrs = (size_t*)(p + offset);
-    offset += pages_of_addrs * PAGESIZE;
-
     ab->minimap = (size_t*)(p + offset);
-    offset += pages_of_minimap * PAGESIZE;
+    offset = header_sz;
+
+    ab->addrs = (size_t*)(p + offset);
 
     ab->capacity = capacity;
     ab->is_aggregate = 1;
@@ -145,6 +162,21 @@ addr_buffer_t *forkscan_make_aggregate_buffer (int capacity)
     return ab;
 }
 
+void forkscan_buffer_generate_minimap (addr_buffer_t *ab)
+{
+    size_t i;
+
+    assert(ab);
+    assert(ab->addrs);
+    assert(ab->minimap);
+
+    ab->n_minimap = 0;
+    for (i = 0; i < ab->n_addrs; i += (PAGESIZE / sizeof(size_t))) {
+        ab->minimap[ab->n_minimap] = ab->addrs[i];
+        ++ab->n_minimap;
+    }
+}
+
 void forkscan_release_buffer (addr_buffer_t *ab)
 {
     assert(ab != g_first_retiree_buffer);
@@ -156,6 +188,8 @@ void forkscan_release_buffer (addr_buffer_t *ab)
         g_reclaimer_list = ab;
         pthread_mutex_unlock(&g_reclaimer_list_lock);
     } else {
+        // Nobody reads a spare aggregate until it is handed out again.
+        forkscan_alloc_set_inherited(ab, 0);
         pthread_mutex_lock(&g_aa_mutex);
         ab->next = g_available_aggregates;
         g_available_aggregates = ab;
@@ -168,6 +202,7 @@ void forkscan_buffer_push_back (addr_buffer_t *ab)
     ab->ref_count = 1;
     ab->free_idx = 0;
     ab->next = NULL;
+    ab->pushed_ns = forkscan_util_nanotime();
 
     pthread_mutex_lock(&g_retiree_mutex);
     if (NULL == g_last_retiree_buffer) {
@@ -215,41 +250,77 @@ addr_buffer_t *forkscan_buffer_get_retiree_buffer ()
     return ret;
 }
 
+/**
+ * Return the sequence number of the oldest buffer still waiting to be
+ * freed, or (size_t)-1 if there is none.
+ */
+size_t forkscan_buffer_oldest_retiree_seq ()
+{
+    size_t ret = (size_t)-1;
+    if (NULL == g_first_retiree_buffer) return ret;
+    pthread_mutex_lock(&g_retiree_mutex);
+    if (NULL != g_first_retiree_buffer) {
+        ret = g_first_retiree_buffer->seq;
+    }
+    pthread_mutex_unlock(&g_retiree_mutex);
+    return ret;
+}
+
 void forkscan_buffer_unref_buffer (addr_buffer_t *ab)
 {
     pthread_mutex_lock(&g_retiree_mutex);
     if (0 == --ab->ref_count) {
         if (ab->free_idx >= ab->n_addrs) {
+            // Every pointer in it has been freed or kept.
+            forkscan_record_phase(PHASE_FREE,
+                                  forkscan_util_nanotime() - ab->pushed_ns);
             forkscan_release_buffer(ab);
         }
     }
     pthread_mutex_unlock(&g_retiree_mutex);
 }
 
+// We can make this a static variable since it will only ever be used in
+// sequential reclamation iterations.
+static addr_buffer_t *g_deadrefs;
+
 /**
- * Return a set of dead references (that might otherwise lead to false
- * positives).  This takes no lock and should not be called when other
- * threads could be acting on the list.
+ * Allocate the dead reference buffer if it doesn't exist yet, and return
+ * how many addresses it can hold.  Allocating takes a lock, so this has to
+ * be called before the other threads are stopped for the fork.
  */
-addr_buffer_t *forkscan_buffer_get_dead_references ()
+size_t forkscan_buffer_dead_references_capacity ()
 {
-    // We can make *ret a static variable since it will only ever be used
-    // in sequential reclamation iterations.
-    static addr_buffer_t *ret = NULL;
+    addr_buffer_t *ret = g_deadrefs;
     if (NULL == ret) {
         assert(g_default_capacity > 0);
-        size_t sz = g_default_capacity * sizeof(size_t) + PAGESIZE;
+        size_t sz = forkscan_alloc_huge_round(g_default_capacity
+                                              * sizeof(size_t) + PAGESIZE);
         // mmap_shared to avoid the cost of COW.  This also needs to change
         // if iterations are ever done in parallel.
-        char *raw_mem = forkscan_alloc_mmap_shared(sz, "deadrefs");
+        char *raw_mem = forkscan_alloc_mmap_shared_huge(sz, "deadrefs");
         ret = (addr_buffer_t*)raw_mem;
         ret->addrs = (size_t*)&raw_mem[PAGESIZE];
         ret->n_addrs = 0;
         ret->capacity = g_default_capacity;
         ret->is_aggregate = 0;
         ret->ref_count = 0;
+        g_deadrefs = ret;
     }
+    return ret->capacity;
+}
+
+/**
+ * Return a set of dead references (that might otherwise lead to false
+ * positives).  This takes no lock and should not be called when other
+ * threads could be acting on the list.  The buffer must already exist; see
+ * forkscan_buffer_dead_references_capacity().
+ */
+addr_buffer_t *forkscan_buffer_get_dead_references ()
+{
+    addr_buffer_t *ret = g_deadrefs;
 
+    assert(ret);
     ret->n_addrs = 0;
 
     // CAUTION: This loop assumes nobody is messing with retirees at just
@@ -272,15 +343,54 @@ addr_buffer_t *forkscan_buffer_get_dead_references ()
     return ret;
 }
 
-DEFINE_POOL_ALLOC(stack, STACKSIZE, NSTACKS, forkscan_alloc_mmap)
-
 void *forkscan_buffer_makestack (size_t *stacksize)
 {
-    *stacksize = STACKSIZE;
-    return pool_alloc_stack();
+    char *stack = NULL;
+
+    *stacksize = g_forkscan_stack_size;
+
+    pthread_mutex_lock(&g_stack_mutex);
+    if (g_n_free_stacks > 0) stack = g_free_stacks[--g_n_free_stacks];
+    pthread_mutex_unlock(&g_stack_mutex);
+    if (NULL != stack) return stack;
+
+    // Each stack gets a mapping of its own, so a thread that has exited
+    // costs nothing once its pages are gone.
+    stack = (char*)forkscan_alloc_mmap(STACK_GUARD_SIZE
+                                       + g_forkscan_stack_size, "stack");
+    if (0 != mprotect(stack, STACK_GUARD_SIZE, PROT_NONE)) {
+        forkscan_fatal("unable to protect the stack guard page.\n");
+    }
+    // A huge page would commit 2 MB at the first touch.  Failure just means
+    // THP isn't there to get in the way.
+    madvise(stack + STACK_GUARD_SIZE, g_forkscan_stack_size,
+            MADV_NOHUGEPAGE);
+    return stack + STACK_GUARD_SIZE;
 }
 
 void forkscan_buffer_freestack (void *p)
 {
-    pool_free_stack(p);
+    char *stack = (char*)p;
+
+    // Whatever the last thread left there would otherwise be copied by every
+    // fork and scanned as roots once another thread gets the stack.
+    madvise(stack, g_forkscan_stack_size, MADV_DONTNEED);
+
+    pthread_mutex_lock(&g_stack_mutex);
+    if (g_n_free_stacks < g_forkscan_stack_pool) {
+        g_free_stacks[g_n_free_stacks++] = stack;
+        stack = NULL;
+    }
+    pthread_mutex_unlock(&g_stack_mutex);
+
+    if (NULL != stack) forkscan_alloc_munmap(stack - STACK_GUARD_SIZE);
+}
+
+void forkscan_buffer_trimstack (char *low, char *sp)
+{
+    size_t high;
+
+    if (sp - low <= STACK_TRIM_SLACK) return;
+    high = PAGEALIGN((size_t)(sp - STACK_TRIM_SLACK));
+    if (high > (size_t)low) madvise(low, high - (size_t)low, MADV_DONTNEED);
 }
@@ -23,6 +23,8 @@ THE SOFTWARE.
 #ifndef _BUFFER_H_
 #define _BUFFER_H_
 
+#include "env.h"
+#include <stdint.h>
 #include <sys/types.h>
 
 #define MAX_CHILDREN 16
@@ -33,6 +35,20 @@ enum sibling_mode_t { SIBLING_MODE_MARKING,
                       SIBLING_MODE_DONE };
 
 typedef struct addr_buffer_t addr_buffer_t;
+typedef struct sibling_stats_t sibling_stats_t;
+
+/** What one scanner process did during an iteration.  Each sibling fills
+ *  in its own slot, a cache line apiece, in the shared buffer header.
+ */
+struct sibling_stats_t {
+    size_t bytes_scanned;
+    size_t ranges;      // Ranges claimed from root_counter.
+    size_t candidates;  // Scanned words in range of a retiree.
+    size_t hits;        // Distinct candidates that referred to one.
+    size_t flushes;     // Lookaside list lookups.
+    size_t marks;       // Retirees marked, as roots or by tracing.
+    uint64_t busy_ns;
+} __attribute__((aligned(64)));
 
 struct addr_buffer_t {
     addr_buffer_t *next;
@@ -54,12 +70,43 @@ struct addr_buffer_t {
     // want to free the unreferenced nodes.
     volatile int ref_count;
     volatile int free_idx;
+
+    // Sequence number of the newest submission this buffer holds pointers
+    // from.
+    size_t seq;
+
+    // Every submission up to this one is fully in this buffer or an older
+    // one.  Behind seq when a domain couldn't be drained completely.
+    size_t done_seq;
+
+    // Where the pointers drained from each reclamation domain are in a
+    // reclaimer buffer.
+    int domain_start[MAX_DOMAINS];
+    int domain_count[MAX_DOMAINS];
+
+    // Filled in by each scanner sibling for the parent to collect.
+    int n_siblings;
+    sibling_stats_t siblings[MAX_CHILDREN];
+
+    // How long the child's phases took, in ns, and when it started and
+    // finished.  The buffer is shared with the child, so this is how the
+    // parent finds out.
+    volatile uint64_t sort_ns, root_scan_ns, mark_ns, started_ns, done_ns;
+
+    // When the pointers became available for freeing.
+    uint64_t pushed_ns;
 };
 
 addr_buffer_t *forkscan_make_reclaimer_buffer ();
 
 addr_buffer_t *forkscan_make_aggregate_buffer (int capacity);
 
+/**
+ * Build the first-level index the scanner searches: the first address on
+ * each page of the (sorted) address list.
+ */
+void forkscan_buffer_generate_minimap (addr_buffer_t *ab);
+
 void forkscan_release_buffer (addr_buffer_t *ab);
 
 void forkscan_buffer_push_back (addr_buffer_t *ab);
@@ -68,13 +115,33 @@ void forkscan_buffer_pop_retiree_buffer (addr_buffer_t *ab);
 
 addr_buffer_t *forkscan_buffer_get_retiree_buffer ();
 
+/**
+ * Return the sequence number of the oldest buffer still waiting to be
+ * freed, or (size_t)-1 if there is none.
+ */
+size_t forkscan_buffer_oldest_retiree_seq ();
+
 void forkscan_buffer_unref_buffer (addr_buffer_t *ab);
 
+size_t forkscan_buffer_dead_references_capacity ();
 addr_buffer_t *forkscan_buffer_get_dead_references ();
 
+/**
+ * Return a thread stack of *stacksize bytes, with a guard page below it.
+ */
 void *forkscan_buffer_makestack (size_t *stacksize);
 
+/**
+ * Return a stack from forkscan_buffer_makestack() once its thread is gone.
+ * Its pages are discarded, so the next thread to get it starts clean.
+ */
 void forkscan_buffer_freestack (void *p);
 
+/**
+ * Discard the pages of a stack from low up to a safe distance below sp.
+ * Only the thread that owns the stack may call this.
+ */
+void forkscan_buffer_trimstack (char *low, char *sp);
+
 #endif // !defined _BUFFER_H_
 
@@ -0,0 +1,339 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#define _GNU_SOURCE // For dladdr().
+#include "alloc.h"
+#include "callsite.h"
+#include <dlfcn.h>
+#include "include/forkscan.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+
+/****************************************************************************/
+/*                         Defines, typedefs, etc.                          */
+/****************************************************************************/
+
+#define MAX_CALLSITES 1024 // A power of 2.
+#define MAX_TRACKED (16 * 1024)
+#define MAX_PRINTED_CALLSITES 20
+
+// A tracked retiree that no scan has seen in this many iterations was freed
+// some other way (by epochs) and is forgotten.
+#define STALE_ITERATIONS 64
+
+typedef struct callsite_t callsite_t;
+typedef struct tracked_t tracked_t;
+
+struct callsite_t {
+    volatile size_t pc;
+    volatile size_t samples;
+    volatile size_t bytes;
+    // Kept by the GC thread, under g_tracked_lock.
+    size_t freed;
+    size_t survivals;
+    size_t max_survived;
+};
+
+/** A sampled retiree that hasn't been freed yet.
+ */
+struct tracked_t {
+    size_t ptr;
+    int site;
+    int survived; // Scans it has survived.
+    int unseen;   // Iterations that didn't scan it.
+};
+
+/****************************************************************************/
+/*                                 Globals                                  */
+/****************************************************************************/
+
+__thread int forkscan_callsite_countdown;
+static __thread uint32_t t_random;
+
+// mmap'd, so the scan doesn't see the tracked pointers and keep them alive.
+static callsite_t *g_sites;
+static tracked_t *g_tracked;
+static int g_n_tracked;
+static size_t g_dropped;
+static pthread_mutex_t g_tracked_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/****************************************************************************/
+/*                             Helper functions                             */
+/****************************************************************************/
+
+/** Return the slot for pc, claiming one if pc is new.  -1 if the table is
+ *  full.
+ */
+static int find_site (size_t pc)
+{
+    size_t i = (pc * 0x9E3779B97F4A7C15ULL) >> 32;
+    int probes;
+
+    for (probes = 0; probes < MAX_CALLSITES; ++probes, ++i) {
+        callsite_t *site = &g_sites[i & (MAX_CALLSITES - 1)];
+        size_t cur = site->pc;
+        if (cur == pc) return i & (MAX_CALLSITES - 1);
+        if (0 == cur) {
+            cur = __sync_val_compare_and_swap(&site->pc, 0, pc);
+            if (0 == cur || cur == pc) return i & (MAX_CALLSITES - 1);
+        }
+    }
+    return -1;
+}
+
+/** xorshift32, seeded per thread.
+ */
+static uint32_t next_random ()
+{
+    uint32_t x = t_random;
+    if (0 == x) x = (uint32_t)forkscan_util_nanotime() | 1;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return t_random = x;
+}
+
+/** Return the index of ptr in the sorted (and marked) list of retirees,
+ *  or -1.
+ */
+static int find_retiree (size_t ptr, addr_buffer_t *ab)
+{
+    int min = 0, max = ab->n_addrs;
+
+    while (min < max) {
+        int mid = (min + max) / 2;
+        if (PTR_MASK(ab->addrs[mid]) < ptr) min = mid + 1;
+        else max = mid;
+    }
+    return min < ab->n_addrs && PTR_MASK(ab->addrs[min]) == ptr ? min : -1;
+}
+
+/** Describe pc as "symbol+offset (object)", or "object+offset" if the
+ *  symbol isn't exported.
+ */
+static void symbolize (size_t pc, char *buf, size_t size)
+{
+    Dl_info info;
+    const char *object, *c;
+
+    // pc - 1 is inside the call instruction, in case the call was the last
+    // thing in the function.
+    if (0 == dladdr((void*)(pc - 1), &info) || NULL == info.dli_fname) {
+        snprintf(buf, size, "0x%zx", pc);
+        return;
+    }
+    object = strrchr(info.dli_fname, '/');
+    object = object ? object + 1 : info.dli_fname;
+    if (info.dli_sname) {
+        snprintf(buf, size, "%s+0x%zx (%s)", info.dli_sname,
+                 pc - (size_t)info.dli_saddr, object);
+    } else {
+        snprintf(buf, size, "%s+0x%zx", object,
+                 pc - (size_t)info.dli_fbase);
+    }
+    // Keep the name safe to use as a Prometheus label.
+    for (c = buf; *c; ++c) {
+        if ('"' == *c || '\\' == *c) buf[c - buf] = '_';
+    }
+}
+
+static int compare_samples (const void *a, const void *b)
+{
+    size_t x = ((const struct forkscan_callsite*)a)->samples;
+    size_t y = ((const struct forkscan_callsite*)b)->samples;
+    return x < y ? 1 : (x > y ? -1 : 0);
+}
+
+__attribute__((constructor (102)))
+static void callsite_init ()
+{
+    if (0 == g_forkscan_retire_sampling) return;
+
+    g_sites = forkscan_alloc_mmap_parent(PAGEALIGN(MAX_CALLSITES
+                                                   * sizeof(callsite_t)
+                                                   + PAGESIZE - 1),
+                                         "retire call sites");
+    g_tracked = forkscan_alloc_mmap_parent(PAGEALIGN(MAX_TRACKED
+                                                     * sizeof(tracked_t)
+                                                     + PAGESIZE - 1),
+                                           "tracked retirees");
+}
+
+/****************************************************************************/
+/*                            Internal interface                            */
+/****************************************************************************/
+
+/**
+ * Charge ptr to the call site that returns to pc, and pick the calling
+ * thread's next sampling interval.
+ */
+void forkscan_callsite_sample (void *ptr, void *pc)
+{
+    int rate = g_forkscan_retire_sampling;
+    int site;
+
+    // Anywhere from 1 to 2 * rate - 1 retires from now, so sampling doesn't
+    // fall into step with a loop in the program.
+    forkscan_callsite_countdown = 1 + next_random() % (2 * rate - 1);
+
+    site = find_site((size_t)pc);
+    if (site < 0) {
+        __sync_fetch_and_add(&g_dropped, 1);
+        return;
+    }
+    __sync_fetch_and_add(&g_sites[site].samples, 1);
+    __sync_fetch_and_add(&g_sites[site].bytes, MALLOC_USABLE_SIZE(ptr));
+
+    pthread_mutex_lock(&g_tracked_lock);
+    if (g_n_tracked < MAX_TRACKED) {
+        tracked_t *t = &g_tracked[g_n_tracked++];
+        t->ptr = (size_t)ptr;
+        t->site = site;
+        t->survived = 0;
+        t->unseen = 0;
+    }
+    pthread_mutex_unlock(&g_tracked_lock);
+}
+
+/**
+ * Count which tracked retirees survived the scan of working_data and stop
+ * tracking the ones it freed.  Called by the GC thread once the child is
+ * done, before any of working_data is freed.
+ */
+void forkscan_callsite_note_results (addr_buffer_t *working_data)
+{
+    int i = 0;
+
+    if (NULL == g_tracked) return;
+
+    pthread_mutex_lock(&g_tracked_lock);
+    while (i < g_n_tracked) {
+        tracked_t *t = &g_tracked[i];
+        callsite_t *site = &g_sites[t->site];
+        int loc = find_retiree(t->ptr, working_data);
+        if (loc < 0) {
+            // Not submitted yet.
+            if (++t->unseen <= STALE_ITERATIONS) {
+                ++i;
+                continue;
+            }
+        } else if (working_data->addrs[loc] & 0x1) {
+            ++t->survived;
+            ++site->survivals;
+            t->unseen = 0;
+            ++i;
+            continue;
+        } else {
+            ++site->freed;
+            site->max_survived = MAX_OF(site->max_survived, t->survived);
+        }
+        *t = g_tracked[--g_n_tracked];
+    }
+    pthread_mutex_unlock(&g_tracked_lock);
+}
+
+/**
+ * Print the busiest call sites.
+ */
+void forkscan_callsite_print ()
+{
+    struct forkscan_callsite sites[MAX_PRINTED_CALLSITES];
+    int i, n;
+
+    if (NULL == g_sites) return;
+
+    n = forkscan_get_callsites(sites, MAX_PRINTED_CALLSITES);
+    for (i = 0; i < n; ++i) {
+        struct forkscan_callsite *s = &sites[i];
+        printf("retire-site: %zu retired %zu bytes survived %.2f"
+               " (max %zu) %s\n", s->retired, s->bytes,
+               s->freed ? (double)s->survivals / s->freed : 0.0,
+               s->max_survived, s->symbol);
+    }
+    if (g_dropped) {
+        printf("retire-site: %zu samples from sites past the first %d\n",
+               g_dropped, MAX_CALLSITES);
+    }
+}
+
+/****************************************************************************/
+/*                            Exported functions                            */
+/****************************************************************************/
+
+/**
+ * Copy up to max of the call sites that retired the most, busiest first,
+ * into sites and return the number copied.
+ */
+__attribute__((visibility("default")))
+int forkscan_get_callsites (struct forkscan_callsite *sites, int max)
+{
+    static struct forkscan_callsite all[MAX_CALLSITES];
+    static int index[MAX_CALLSITES]; // Slot in g_sites -> entry in all.
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    size_t rate = g_forkscan_retire_sampling;
+    int i, n = 0;
+
+    if (NULL == g_sites || max <= 0) return 0;
+
+    pthread_mutex_lock(&lock);
+    pthread_mutex_lock(&g_tracked_lock);
+    for (i = 0; i < MAX_CALLSITES; ++i) {
+        callsite_t *site = &g_sites[i];
+        index[i] = -1;
+        if (0 == site->samples) continue;
+        index[i] = n;
+        struct forkscan_callsite *s = &all[n++];
+        s->pc = (void*)site->pc;
+        s->samples = site->samples;
+        s->retired = site->samples * rate;
+        s->bytes = site->bytes * rate;
+        s->freed = site->freed;
+        s->survivals = site->survivals;
+        s->max_survived = site->max_survived;
+        s->symbol[0] = '\0';
+    }
+    // The ones still alive count toward the maximum, too.
+    for (i = 0; i < g_n_tracked; ++i) {
+        tracked_t *t = &g_tracked[i];
+        int j = index[t->site];
+        if (j >= 0) {
+            all[j].max_survived = MAX_OF(all[j].max_survived,
+                                         (size_t)t->survived);
+        }
+    }
+    pthread_mutex_unlock(&g_tracked_lock);
+
+    qsort(all, n, sizeof(all[0]), compare_samples);
+    n = MIN_OF(n, max);
+    for (i = 0; i < n; ++i) {
+        sites[i] = all[i];
+        symbolize((size_t)sites[i].pc, sites[i].symbol,
+                  sizeof(sites[i].symbol));
+    }
+    pthread_mutex_unlock(&lock);
+
+    return n;
+}
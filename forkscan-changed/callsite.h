@@ -0,0 +1,68 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/* Module Description:
+   Retire call-site profiling.  With FORKSCAN_RETIRE_SAMPLING=n, about one
+   call in n to a retire function is sampled: each thread counts down a
+   randomized interval, so a sample costs nothing until it is due.  A
+   sample charges the retiree and its size to the caller's return address
+   and keeps track of the retiree until a scan frees it.  The GC thread
+   counts how many iterations each tracked retiree survives.  Addresses are
+   only turned into symbols when somebody asks for a report.
+ */
+
+#ifndef _CALLSITE_H_
+#define _CALLSITE_H_
+
+#include "buffer.h"
+#include "env.h"
+
+extern __thread int forkscan_callsite_countdown;
+
+/**
+ * Return non-zero if the calling thread's next retire should be sampled.
+ */
+static inline int forkscan_callsite_due ()
+{
+    return __builtin_expect(g_forkscan_retire_sampling != 0, 0)
+        && --forkscan_callsite_countdown <= 0;
+}
+
+/**
+ * Charge ptr to the call site that returns to pc, and pick the calling
+ * thread's next sampling interval.
+ */
+void forkscan_callsite_sample (void *ptr, void *pc);
+
+/**
+ * Count which tracked retirees survived the scan of working_data and stop
+ * tracking the ones it freed.  Called by the GC thread once the child is
+ * done, before any of working_data is freed.
+ */
+void forkscan_callsite_note_results (addr_buffer_t *working_data);
+
+/**
+ * Print the busiest call sites.
+ */
+void forkscan_callsite_print ();
+
+#endif // !defined _CALLSITE_H_
@@ -26,12 +26,19 @@ THE SOFTWARE.
 #include "child.h"
 #include "env.h"
 #include <errno.h>
+#include "forkscan.h"
+#include "heap.h"
 #include <malloc.h>
+#include "policy.h"
 #include "proc.h"
 #include <pthread.h>
+#include "retention.h"
+#include "snapshot.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/wait.h>
+#include "trace.h"
 #include <unistd.h>
 
 #include "avl.h"
@@ -47,28 +54,128 @@ THE SOFTWARE.
 #define MAX_RANGE_SIZE (8 * 1024 * 1024)
 #define MEMORY_THRESHOLD (1024 * 1024 * 16)
 
+// The scanning loops are instantiated once per combination of these, so
+// the default configuration pays nothing for the options.
+#define SCAN_TAG_MASK    0x1 // Clear the configured tag bits from words.
+#define SCAN_SIGN_EXTEND 0x2 // ...and sign-extend the top address bit.
+#define SCAN_INTERIOR    0x4 // Match pointers into the middle of retirees.
+#define N_SCAN_MODES     8
+
 typedef struct trace_stats_t trace_stats_t;
+typedef struct scanner_t scanner_t;
 
 struct trace_stats_t
 {
     size_t min, max;
 };
 
+struct scanner_t
+{
+    const char *name;
+    void (*find_roots) (size_t low, size_t high,
+                        addr_buffer_t *ab, addr_buffer_t *deadrefs);
+    void (*lookup_lookaside_list) (addr_buffer_t *ab, trace_stats_t *ts);
+};
+
 static mem_range_t g_ranges[MAX_MARK_AND_SWEEP_RANGES];
 static int g_n_ranges;
 static size_t g_bytes_to_scan;
 static size_t g_lookaside_list[LOOKASIDE_SZ];
 static int g_lookaside_count = 0;
 
-#ifdef TIMING
-static size_t g_total_sort;
-static size_t g_total_lookaside;
-#endif
+// Usable size of each retiree, parallel to the sorted address list, and of
+// each dead reference.  Asking the allocator once up front is cheaper than
+// asking every time the scan steps over or marks one, and a replay can
+// supply them without the allocator.
+static size_t *g_sizes;
+static size_t *g_dead_sizes;
+
+// Where g_sizes goes.  The GC thread allocates it, since the child can't
+// take the lock forkscan_alloc_mmap() needs: a thread that was stopped for
+// the fork may have been holding it.
+static size_t *g_sizes_buf;
+static size_t g_sizes_capacity;
+
+// Tag configuration for SCAN_TAG_MASK: the bits of a word that are kept,
+// and, for SCAN_SIGN_EXTEND, how many high bits to replace with copies of
+// the top address bit.
+static size_t g_tag_mask;
+static int g_tag_shift;
+
+static const scanner_t *g_scanner;
+static int g_scan_mode;
+
+// Time this process has spent marking from its lookaside list, in ns.
+static uint64_t g_mark_ns;
+
+// This process's counters, copied to its slot in the buffer at the end.
+static sibling_stats_t g_sib;
 
-static int is_ref (addr_buffer_t *ab, int loc, size_t cmp)
+// The snapshot being replayed, if this isn't a real scanner process.
+static snapshot_t *g_replay;
+
+/** Return the index of the retiree cmp points to, or -1 if there isn't
+ *  one.  loc is from one of the searches below, so the retiree's base is
+ *  at loc or just before it.  Without interior pointers, only the base
+ *  address counts.
+ */
+static inline __attribute__((always_inline))
+int is_ref (addr_buffer_t *ab, int loc, size_t cmp, const int mode)
 {
     assert(loc >= 0);
-    return PTR_MASK(ab->addrs[loc]) == cmp;
+    if (!(mode & SCAN_INTERIOR)) {
+        return PTR_MASK(ab->addrs[loc]) == cmp ? loc : -1;
+    }
+
+    if (loc >= ab->n_addrs) loc = ab->n_addrs - 1;
+    size_t base = PTR_MASK(ab->addrs[loc]);
+    if (base > cmp) {
+        if (0 == loc) return -1;
+        base = PTR_MASK(ab->addrs[--loc]);
+    }
+    return cmp - base < g_sizes[loc] ? loc : -1;
+}
+
+/** Turn a scanned word into the address it would refer to.  By default
+ *  that only strips the two low-order bits, which catches pointers hidden
+ *  by overloading them.
+ */
+static inline __attribute__((always_inline))
+size_t canonicalize (size_t word, const int mode)
+{
+    if (mode & SCAN_SIGN_EXTEND) {
+        return (size_t)((long)(word << g_tag_shift) >> g_tag_shift)
+            & g_tag_mask;
+    }
+    if (mode & SCAN_TAG_MASK) return word & g_tag_mask;
+    return PTR_MASK(word);
+}
+
+/** Set the range of values that could refer to a retiree.
+ */
+static void trace_stats_init (trace_stats_t *ts, addr_buffer_t *ab)
+{
+    ts->min = PTR_MASK(ab->addrs[0]);
+    ts->max = PTR_MASK(ab->addrs[ab->n_addrs - 1]);
+    if (g_scan_mode & SCAN_INTERIOR) ts->max += g_sizes[ab->n_addrs - 1] - 1;
+}
+
+/** Record the size of every retiree and dead reference.  Both lists have to
+ *  be sorted already.
+ */
+static void record_sizes (addr_buffer_t *ab, addr_buffer_t *deadrefs)
+{
+    int i;
+
+    assert(ab->n_addrs + deadrefs->n_addrs <= g_sizes_capacity);
+    g_sizes = g_sizes_buf;
+    g_dead_sizes = g_sizes + ab->n_addrs;
+    for (i = 0; i < ab->n_addrs; ++i) {
+        g_sizes[i] = MALLOC_USABLE_SIZE((void*)PTR_MASK(ab->addrs[i]));
+    }
+    for (i = 0; i < deadrefs->n_addrs; ++i) {
+        g_dead_sizes[i] = MALLOC_USABLE_SIZE((void*)deadrefs->addrs[i]);
+    }
 }
 
 /****************************************************************************/
@@ -144,19 +251,25 @@ static int addr_find_hint (size_t val, addr_buffer_t *ab, int hint)
     return addr_find(val, ab);
 }
 
-static inline void recursive_mark (size_t addr,
-                                   addr_buffer_t *ab,
-                                   trace_stats_t *ts)
+/** Mark whatever the retiree at index from refers to.
+ */
+static inline __attribute__((always_inline))
+void mark_from (int from,
+                addr_buffer_t *ab,
+                trace_stats_t *ts,
+                const int mode,
+                void (*recursive_mark) (int, addr_buffer_t*,
+                                        trace_stats_t*))
 {
-    size_t *ptr = (size_t*)PTR_MASK(addr);
-    size_t n_vals = MALLOC_USABLE_SIZE(ptr) / sizeof(size_t);
+    size_t *ptr = (size_t*)PTR_MASK(ab->addrs[from]);
+    size_t n_vals = g_sizes[from] / sizeof(size_t);
     size_t i;
 
     for (i = 0; i < n_vals; ++i) {
-        size_t val = PTR_MASK(ptr[i]);
+        size_t val = canonicalize(ptr[i], mode);
         if (val < ts->min || val > ts->max) continue;
-        int loc = addr_find(val, ab);
-        if (is_ref(ab, loc, val)) {
+        int loc = is_ref(ab, addr_find(val, ab), val, mode);
+        if (loc >= 0) {
             // Found a hit inside our pool.
             size_t target = ab->addrs[loc];
             if (target & 0x1) {
@@ -167,30 +280,28 @@ static inline void recursive_mark (size_t addr,
             // Technically a race condition, but anybody racing with us is
             // trying to write the same value:
             ab->addrs[loc] = target | 0x1;
-            recursive_mark(PTR_MASK(addr), ab, ts);
+            ++g_sib.marks;
+            recursive_mark(loc, ab, ts);
         }
     }
 }
 
-static void lookup_lookaside_list (addr_buffer_t *ab,
-                                   trace_stats_t *ts)
+static inline __attribute__((always_inline))
+void lookup_lookaside (addr_buffer_t *ab,
+                       trace_stats_t *ts,
+                       const int mode,
+                       void (*recursive_mark) (int, addr_buffer_t*,
+                                               trace_stats_t*))
 {
     int i;
     size_t cmp = 0;
     int savings;
+    uint64_t start = forkscan_util_nanotime();
 
-#ifdef TIMING
-    size_t start_sort, end_sort;
-    size_t start_lookaside, end_lookaside;
-    start_sort = forkscan_rdtsc();
-#endif
+    TRACE(LOOKASIDE, TRACE_BEGIN, g_lookaside_count);
+    ++g_sib.flushes;
+    g_sib.candidates += g_lookaside_count;
     forkscan_util_avl_sort(g_lookaside_list, g_lookaside_count);
-#ifdef TIMING
-    end_sort = forkscan_rdtsc();
-    g_total_sort += end_sort - start_sort;
-
-    start_lookaside = end_sort;
-#endif
 
     savings = forkscan_util_compact(g_lookaside_list, g_lookaside_count);
     g_lookaside_count -= savings;
@@ -201,18 +312,21 @@ static void lookup_lookaside_list (addr_buffer_t *ab,
         cmp = g_lookaside_list[i];
         int loc = addr_find_hint(cmp, ab, cached_loc);
         cached_loc = loc;
-        if (is_ref(ab, loc, cmp)) {
+        loc = is_ref(ab, loc, cmp, mode);
+        if (loc >= 0) {
             // It's a pointer somewhere into the allocated region of memory.
             size_t addr = ab->addrs[loc];
+            ++g_sib.hits;
             if (!(addr & 0x1)) {
                 // No need to be atomic.  Any processes racing with us are
                 // trying to write the same value.
                 ab->addrs[loc] = addr | 0x1;
-                recursive_mark(addr, ab, ts);
+                ++g_sib.marks;
+                recursive_mark(loc, ab, ts);
             }
         }
 #ifndef NDEBUG
-        else {
+        else if (0 == mode) {
             int loc2 = binary_search(cmp, ab->addrs,
                                      0, ab->n_addrs);
             // FIXME: Assert does not catch all bad cases.
@@ -221,12 +335,28 @@ static void lookup_lookaside_list (addr_buffer_t *ab,
 #endif
     }
 
-#ifdef TIMING
-    end_lookaside = forkscan_rdtsc();
-    g_total_lookaside += end_lookaside - start_lookaside;
-#endif
-
     g_lookaside_count = 0;
+    g_mark_ns += forkscan_util_nanotime() - start;
+    TRACE(LOOKASIDE, TRACE_END, 0);
+}
+
+static void atomic_max (volatile uint64_t *dst, uint64_t value)
+{
+    uint64_t old;
+    while ((old = *dst) < value) {
+        if (__sync_bool_compare_and_swap(dst, old, value)) break;
+    }
+}
+
+static inline void update_addr_loc (int *idx, size_t *addr,
+                                    addr_buffer_t *buf)
+{
+    ++*idx;
+    if (buf->n_addrs > *idx) {
+        *addr = PTR_MASK(buf->addrs[*idx]);
+    } else {
+        *addr = (size_t)-1;
+    }
 }
 
 /**
@@ -235,31 +365,23 @@ static void lookup_lookaside_list (addr_buffer_t *ab,
  * will later be used as a basis for determining reachability of the rest of
  * the nodes.
  */
-static void find_roots (size_t low,
-                        size_t high,
-                        addr_buffer_t *ab,
-                        addr_buffer_t *deadrefs)
+static inline __attribute__((always_inline))
+void scan_for_roots (size_t low,
+                     size_t high,
+                     addr_buffer_t *ab,
+                     addr_buffer_t *deadrefs,
+                     const int mode,
+                     void (*lookup_lookaside_list) (addr_buffer_t*,
+                                                    trace_stats_t*))
 {
     int pool_idx, dead_idx = 0;
     size_t pool_addr, dead_addr;
     size_t guarded_addr;
     trace_stats_t ts;
 
-    ts.min = PTR_MASK(ab->addrs[0]);
-    ts.max = PTR_MASK(ab->addrs[ab->n_addrs - 1]);
-
+    trace_stats_init(&ts, ab);
     assert(ts.min <= ts.max);
 
-    void update_addr_loc (int *idx, size_t *addr, addr_buffer_t *buf)
-    {
-        ++*idx;
-        if (buf->n_addrs > *idx) {
-            *addr = PTR_MASK(buf->addrs[*idx]);
-        } else {
-            *addr = (size_t)-1;
-        }
-    }
-
     // Figure out where to start the search.  Any memory is a potential ptr
     // to one of our addresses, but we avoid searching memory we're tracking
     // because that will be done during mark.  The "pool_addr" indicates the
@@ -267,7 +389,7 @@ static void find_roots (size_t low,
     pool_idx = addr_find(low, ab);
     pool_addr = PTR_MASK(ab->addrs[pool_idx]);
     if (pool_addr <= low) {
-        size_t sz = MALLOC_USABLE_SIZE((void*)pool_addr);
+        size_t sz = g_sizes[pool_idx];
         if (pool_addr + sz > low) low = pool_addr + sz;
         update_addr_loc(&pool_idx, &pool_addr, ab);
     }
@@ -277,7 +399,7 @@ static void find_roots (size_t low,
         dead_addr = deadrefs->addrs[dead_idx];
         assert(0 == (dead_addr & 0x3));
         if (dead_addr <= low) {
-            size_t sz = MALLOC_USABLE_SIZE((void*)dead_addr);
+            size_t sz = g_dead_sizes[dead_idx];
             if (dead_addr + sz > low) low = dead_addr + sz;
             update_addr_loc(&dead_idx, &dead_addr, deadrefs);
             assert(low <= pool_addr);
@@ -291,9 +413,7 @@ static void find_roots (size_t low,
         assert((next_stopping_point & 0x3) == 0);
         assert(next_stopping_point >= low);
         for ( ; low < next_stopping_point; low += sizeof(size_t)) {
-            size_t cmp = PTR_MASK(*(size_t*)low);
-            // PTR_MASK catches pointers that have been hidden through
-            // overloading the two low-order bits.
+            size_t cmp = canonicalize(*(size_t*)low, mode);
 
             if (cmp < ts.min || cmp > ts.max) continue; // Out-of-range.
 
@@ -308,11 +428,12 @@ static void find_roots (size_t low,
 
         assert(low == next_stopping_point);
         if (next_stopping_point == guarded_addr) {
-            low += MALLOC_USABLE_SIZE((void*)guarded_addr);
             if (guarded_addr == pool_addr) {
+                low += g_sizes[pool_idx];
                 update_addr_loc(&pool_idx, &pool_addr, ab);
             } else {
                 assert(deadrefs);
+                low += g_dead_sizes[dead_idx];
                 update_addr_loc(&dead_idx, &dead_addr, deadrefs);
             }
             guarded_addr = MIN_OF(pool_addr, dead_addr);
@@ -322,26 +443,130 @@ static void find_roots (size_t low,
     }
 }
 
-/**
- * Determine whether a "path" is the location of the given library.
- *
- * @return 1 if it is the library location, zero otherwise.
+/** Instantiate the scanning loops for one mode.
+ */
+#define DEFINE_SCANNER(name, mode)                                      \
+    static void recursive_mark_##name (int from,                        \
+                                       addr_buffer_t *ab,               \
+                                       trace_stats_t *ts)               \
+    {                                                                   \
+        mark_from(from, ab, ts, mode, recursive_mark_##name);           \
+    }                                                                   \
+    static void lookup_lookaside_list_##name (addr_buffer_t *ab,        \
+                                              trace_stats_t *ts)        \
+    {                                                                   \
+        lookup_lookaside(ab, ts, mode, recursive_mark_##name);          \
+    }                                                                   \
+    static void find_roots_##name (size_t low, size_t high,             \
+                                   addr_buffer_t *ab,                   \
+                                   addr_buffer_t *deadrefs)             \
+    {                                                                   \
+        scan_for_roots(low, high, ab, deadrefs, mode,                   \
+                       lookup_lookaside_list_##name);                   \
+    }
+
+DEFINE_SCANNER(exact, 0)
+DEFINE_SCANNER(interior, SCAN_INTERIOR)
+DEFINE_SCANNER(masked, SCAN_TAG_MASK)
+DEFINE_SCANNER(masked_interior, SCAN_TAG_MASK | SCAN_INTERIOR)
+DEFINE_SCANNER(canonical, SCAN_TAG_MASK | SCAN_SIGN_EXTEND)
+DEFINE_SCANNER(canonical_interior,
+               SCAN_TAG_MASK | SCAN_SIGN_EXTEND | SCAN_INTERIOR)
+
+#define SCANNER(name)                                                   \
+    { #name, find_roots_##name, lookup_lookaside_list_##name }
+
+static const scanner_t g_scanners[N_SCAN_MODES] = {
+    [0] = SCANNER(exact),
+    [SCAN_INTERIOR] = SCANNER(interior),
+    [SCAN_TAG_MASK] = SCANNER(masked),
+    [SCAN_TAG_MASK | SCAN_INTERIOR] = SCANNER(masked_interior),
+    [SCAN_TAG_MASK | SCAN_SIGN_EXTEND] = SCANNER(canonical),
+    [SCAN_TAG_MASK | SCAN_SIGN_EXTEND | SCAN_INTERIOR] =
+        SCANNER(canonical_interior),
+};
+
+/** Pick the scanning loops for the configured tag bits and pointer mode.
  */
-static int is_lib (const char *library, const char *path)
-{
-    if ('/' != path[0]) return 0;
-
-    int len = strlen(library);
-    ++path;
-    while (1) {
-        if ('\0' == path[0]) return 0;
-        ++path;
-        if (0 == strncmp(library, path, len)
-            && ('.' == path[len] || '-' == path[len])) {
-            return 1;
+static void select_scanner ()
+{
+    int mode = g_forkscan_interior_pointers ? SCAN_INTERIOR : 0;
+    int low_bits = g_forkscan_tag_low_bits;
+    int high_bits = g_forkscan_tag_high_bits;
+
+    g_tag_mask = ~(((size_t)1 << low_bits) - 1);
+    g_tag_shift = high_bits;
+    if (high_bits > 0 && g_forkscan_tag_sign_extend) {
+        mode |= SCAN_TAG_MASK | SCAN_SIGN_EXTEND;
+    } else if (high_bits > 0 || low_bits != 2) {
+        g_tag_mask &= ~(size_t)0 >> high_bits;
+        mode |= SCAN_TAG_MASK;
+    }
+
+    g_scan_mode = mode;
+    g_scanner = &g_scanners[mode];
+}
+
+/** Queue [low, high) for scanning, in pieces no bigger than MAX_RANGE_SIZE.
+ */
+static void add_range (size_t low, size_t high, void *bytes)
+{
+    g_bytes_to_scan += high - low;
+    *(size_t*)bytes += high - low;
+    while (low + MAX_RANGE_SIZE < high) {
+        g_ranges[g_n_ranges].low = low;
+        g_ranges[g_n_ranges].high = low + MAX_RANGE_SIZE;
+        low += MAX_RANGE_SIZE;
+        ++g_n_ranges;
+    }
+    g_ranges[g_n_ranges].low = low;
+    g_ranges[g_n_ranges].high = high;
+    if (++g_n_ranges >= MAX_MARK_AND_SWEEP_RANGES) {
+        forkscan_fatal("Too many memory ranges.\n");
+    }
+}
+
+/** Queue the parts of a non-heap region that the scan policy allows and
+ *  that Forkscan didn't allocate for itself.
+ */
+static void add_region (size_t low,
+                        size_t high,
+                        const char *bits,
+                        const char *path)
+{
+    if (low >= high) return;
+    if (!forkscan_policy_should_scan(low, high, bits, path)) {
+        // Excluded by the user's scan policy or one of its defaults.
+        return;
+    }
+
+    /* It looks like we've applied all of the criteria and have found a range
+       that we want to scan, right?  Not quite.  What about memory allocated
+       by _this_ module?  Unfortunately, we cannot apply a simple comparison
+       of this range with any specific memory we've mmap'd.
+       The /proc/<pid>/maps file consolidates ranges if it can so we
+       (potentially) have a range that needs to be turned into Swiss Cheese of
+       sub-ranges that we actually want to look at. */
+
+    mem_range_t big_range = { low, high };
+    size_t region_bytes = 0;
+    while (big_range.low != big_range.high) {
+        mem_range_t next = forkscan_alloc_next_subrange(&big_range);
+        if (next.low != next.high) {
+            // This is a region of memory we want to scan.
+            add_range(next.low, next.high, &region_bytes);
         }
-        while ('\0' != path[0] && '/' != path[0]) ++path;
     }
+    if (region_bytes > 0) {
+        forkscan_policy_report_region(low, high, region_bytes, path);
+    }
+}
+
+static void find_heap_roots (size_t low, size_t high, void *arg)
+{
+    addr_buffer_t **bufs = (addr_buffer_t**)arg;
+    g_sib.bytes_scanned += high - low;
+    g_scanner->find_roots(low, high, bufs[0], bufs[1]);
 }
 
 static int collect_ranges (void *p,
@@ -372,22 +597,6 @@ static int collect_ranges (void *p,
         // section. (See: libio/stdfiles.c in glibc)
         return 1;
     }
-    if (is_lib("libc", path)) {
-        // Part of the Forkscan module memory.  It's clean.
-        return 1;
-    }
-    if (is_lib("libdl", path)) {
-        // Part of the Forkscan module memory.  It's clean.
-        return 1;
-    }
-    if (is_lib("libforkscan", path)) {
-        // Part of the Forkscan module memory.  It's clean.
-        return 1;
-    }
-    if (bits[3] == 's') {
-        // Shared writable memory.  This is probably the commq.
-        return 1;
-    }
     if (0 == memcmp(path, "[stack:", 7)) {
         // Our stack.  Don't check that.  Note: This is not one of the other
         // threads' stacks because in the child process, there is only one
@@ -395,36 +604,212 @@ static int collect_ranges (void *p,
         return 1;
     }
 
-    /* It looks like we've applied all of the criteria and have found a range
-       that we want to scan, right?  Not quite.  What about memory allocated
-       by _this_ module?  Unfortunately, we cannot apply a simple comparison
-       of this range with any specific memory we've mmap'd.
-       The /proc/<pid>/maps file consolidates ranges if it can so we
-       (potentially) have a range that needs to be turned into Swiss Cheese of
-       sub-ranges that we actually want to look at. */
+    // The Forkscan heap may share a mapping with its anonymous neighbors.
+    // It is always scanned, but only where chunks have been carved up;
+    // the chunk headers tell us where that is.
+    mem_range_t heap = forkscan_heap_range();
+    if (heap.low < high && heap.high > low) {
+        size_t heap_bytes = 0;
+        forkscan_heap_for_each_extent(low, high, add_range, &heap_bytes);
+        if (heap_bytes > 0) {
+            forkscan_policy_report_region(MAX_OF(low, heap.low),
+                                          MIN_OF(high, heap.high),
+                                          heap_bytes, "[forkscan heap]");
+        }
+        add_region(low, MIN_OF(high, heap.low), bits, path);
+        add_region(MAX_OF(low, heap.high), high, bits, path);
+    } else {
+        add_region(low, high, bits, path);
+    }
 
-    mem_range_t big_range = { low, high };
-    while (big_range.low != big_range.high) {
-        mem_range_t next = forkscan_alloc_next_subrange(&big_range);
-        if (next.low != next.high) {
-            // This is a region of memory we want to scan.
-            g_bytes_to_scan += next.high - next.low;
-            while (next.low + MAX_RANGE_SIZE < next.high) {
-                g_ranges[g_n_ranges] = next;
-                g_ranges[g_n_ranges].high = next.low + MAX_RANGE_SIZE;
-                next.low += MAX_RANGE_SIZE;
-                ++g_n_ranges;
-            }
-            g_ranges[g_n_ranges++] = next;
-            if (g_n_ranges >= MAX_MARK_AND_SWEEP_RANGES) {
-                forkscan_fatal("Too many memory ranges.\n");
-            }
+    return 1;
+}
+
+/****************************************************************************/
+/*                          Retention diagnostics.                          */
+/****************************************************************************/
+
+// The table being filled in and the values that could refer to a sample.
+static retention_table_t *g_retention;
+static size_t g_retention_min, g_retention_max;
+
+/** Take an evenly spaced sample of the retirees the scan marked.
+ */
+static void choose_retention_samples (addr_buffer_t *ab)
+{
+    retention_table_t *t = g_retention;
+    size_t survivors = 0, seen = 0, stride;
+    int i;
+
+    for (i = 0; i < ab->n_addrs; ++i) {
+        if (ab->addrs[i] & 0x1) ++survivors;
+    }
+    t->survivors = survivors;
+    t->n_samples = 0;
+    if (0 == survivors) return;
+
+    stride = (survivors + MAX_RETENTION_SAMPLES - 1) / MAX_RETENTION_SAMPLES;
+    for (i = 0; i < ab->n_addrs && t->n_samples < MAX_RETENTION_SAMPLES; ++i) {
+        if (!(ab->addrs[i] & 0x1) || seen++ % stride) continue;
+        retention_sample_t *s = &t->samples[t->n_samples++];
+        s->retiree = PTR_MASK(ab->addrs[i]);
+        s->size = g_sizes[i];
+        s->root = 0;
+        s->kind = RETAINED_BY_UNKNOWN;
+        s->thread = 0;
+        s->region[0] = '\0';
+    }
+    g_retention_min = t->samples[0].retiree;
+    g_retention_max = g_scan_mode & SCAN_INTERIOR
+        ? t->samples[t->n_samples - 1].retiree
+          + t->samples[t->n_samples - 1].size - 1
+        : t->samples[t->n_samples - 1].retiree;
+}
+
+/** Return the sample val refers to, or NULL.
+ */
+static retention_sample_t *find_sample (size_t val)
+{
+    retention_table_t *t = g_retention;
+    int min = 0, max = t->n_samples;
+
+    while (min < max) {
+        int mid = (min + max) / 2;
+        if (t->samples[mid].retiree <= val) min = mid + 1;
+        else max = mid;
+    }
+    if (0 == min) return NULL;
+
+    retention_sample_t *s = &t->samples[min - 1];
+    if (val == s->retiree) return s;
+    if ((g_scan_mode & SCAN_INTERIOR) && val - s->retiree < s->size) return s;
+    return NULL;
+}
+
+/** Return 1 if addr is inside one of the sorted objects in ab, or, if
+ *  marked_only is set, inside one the scan marked.
+ */
+static int inside_object (size_t addr, addr_buffer_t *ab, int marked_only)
+{
+    if (0 == ab->n_addrs) return 0;
+
+    // Or in the flag bits, so a marked base still sorts below addr.
+    int loc = binary_search(addr | 0x3, ab->addrs, 0, ab->n_addrs);
+    size_t base = PTR_MASK(ab->addrs[loc]);
+    if (base > addr) {
+        if (0 == loc) return 0;
+        base = PTR_MASK(ab->addrs[--loc]);
+    }
+    if (marked_only && !(ab->addrs[loc] & 0x1)) return 0;
+    return addr - base < MALLOC_USABLE_SIZE((void*)base);
+}
+
+/** The word at addr refers to sample s.  Keep it if it's the first root
+ *  found for s.  A marked retiree only counts until a root turns up.
+ */
+static void note_root (retention_sample_t *s, size_t addr,
+                       addr_buffer_t *ab, addr_buffer_t *deadrefs)
+{
+    if (inside_object(addr, deadrefs, 0)) return;
+    if (inside_object(addr, ab, 0)) {
+        if (0 == s->root && inside_object(addr, ab, 1)) {
+            s->root = addr;
+            s->kind = RETAINED_BY_RETIREE;
         }
+        // An unmarked retiree keeps nothing alive.
+        return;
+    }
+
+    s->root = addr;
+    s->kind = RETAINED_BY_UNKNOWN; // Until the memory map says otherwise.
+    s->region[0] = '\0';
+    if (forkscan_heap_contains(addr)) {
+        s->kind = RETAINED_BY_HEAP;
+        strcpy(s->region, "[forkscan heap]");
+        return;
     }
 
+    thread_list_t *tl = forkscan_proc_get_thread_list();
+    thread_data_t *td;
+    for (td = tl->head; NULL != td; td = td->next) {
+        if (addr >= (size_t)td->user_stack_low
+            && addr < (size_t)td->user_stack_high) {
+            s->kind = RETAINED_BY_STACK;
+            s->thread = (unsigned long)td->self;
+            strcpy(s->region, "[thread stack]");
+            return;
+        }
+    }
+}
+
+static void find_retention_roots (size_t low, size_t high, void *arg)
+{
+    addr_buffer_t **bufs = (addr_buffer_t**)arg;
+
+    for ( ; low < high; low += sizeof(size_t)) {
+        size_t val = canonicalize(*(size_t*)low, g_scan_mode);
+        if (val < g_retention_min || val > g_retention_max) continue;
+
+        retention_sample_t *s = find_sample(val);
+        if (NULL == s) continue;
+        if (s->root && RETAINED_BY_RETIREE != s->kind) continue;
+        note_root(s, low, bufs[0], bufs[1]);
+    }
+}
+
+/** Name the mapping each unclassified root is in.
+ */
+static int classify_roots (void *p,
+                           size_t low,
+                           size_t high,
+                           const char *bits,
+                           const char *path)
+{
+    int i;
+
+    for (i = 0; i < g_retention->n_samples; ++i) {
+        retention_sample_t *s = &g_retention->samples[i];
+        if (RETAINED_BY_UNKNOWN != s->kind || s->root < low
+            || s->root >= high) {
+            continue;
+        }
+        if (0 == strcmp(path, "[stack]")) s->kind = RETAINED_BY_STACK;
+        else if (0 == strcmp(path, "[heap]")) s->kind = RETAINED_BY_HEAP;
+        else if (path[0] && path[0] != '[') s->kind = RETAINED_BY_DATA;
+        else s->kind = RETAINED_BY_ANON;
+        strncpy(s->region, path, RETENTION_REGION_SIZE - 1);
+        s->region[RETENTION_REGION_SIZE - 1] = '\0';
+    }
     return 1;
 }
 
+/** For a sample of the survivors, find the first word in the scanned
+ *  ranges that refers to each and where it lives.  Marking has to be
+ *  finished.
+ */
+static void explain_survivors (addr_buffer_t *ab, addr_buffer_t *deadrefs)
+{
+    addr_buffer_t *bufs[2] = { ab, deadrefs };
+    int rid;
+
+    TRACE(RETENTION, TRACE_BEGIN, 0);
+    choose_retention_samples(ab);
+    if (g_retention->n_samples > 0) {
+        for (rid = 0; rid < g_n_ranges; ++rid) {
+            if (forkscan_heap_contains(g_ranges[rid].low)) {
+                forkscan_heap_for_each_live_run(g_ranges[rid].low,
+                                                g_ranges[rid].high,
+                                                find_retention_roots, &bufs);
+            } else {
+                find_retention_roots(g_ranges[rid].low, g_ranges[rid].high,
+                                     &bufs);
+            }
+        }
+        forkscan_proc_map_iterate(classify_roots, NULL);
+    }
+    TRACE(RETENTION, TRACE_END, g_retention->n_samples);
+}
+
 /** Gather the user stack range info and include it in the search.
  */
 static void add_stack_ranges ()
@@ -435,54 +820,77 @@ static void add_stack_ranges ()
     thread_data_t *td;
     for (td = tl->head; NULL != td; td = td->next) {
         if (td->stack_is_ours) {
-            g_bytes_to_scan += td->user_stack_high - td->user_stack_low;
+            size_t low = (size_t)td->user_stack_low;
+            size_t high = (size_t)td->user_stack_high;
+            size_t sp = (size_t)td->stack_sp;
+            // Below where the thread stopped for this snapshot, its stack is
+            // dead.  A thread that didn't stop (it hadn't started yet) gets
+            // the whole stack scanned.
+            if (td->stack_sp_seq == g_cleanup_counter
+                && sp > low && sp < high) {
+                low = sp & ~(sizeof(size_t) - 1);
+            }
+            g_bytes_to_scan += high - low;
             // Let each scanner do a whole stack, no matter how big it is.
-            g_ranges[g_n_ranges].high = (size_t)td->user_stack_high;
-            g_ranges[g_n_ranges].low = (size_t)td->user_stack_low;
+            g_ranges[g_n_ranges].high = high;
+            g_ranges[g_n_ranges].low = low;
             ++g_n_ranges;
+            forkscan_policy_report_region(low, high, high - low,
+                                          "[thread stack]");
         }
     }
 }
 
-void forkscan_child (addr_buffer_t *ab, addr_buffer_t *deadrefs, int fd)
+/** Scan one of the collected ranges.  The Forkscan heap is only walked
+ *  where objects are live.
+ */
+static void scan_live_range (int rid, addr_buffer_t **bufs)
 {
-    assert(ab);
-    assert(deadrefs);
-
-    // Scan memory for references.
-    g_bytes_to_scan = 0;
-    forkscan_proc_map_iterate(collect_ranges, NULL);
-    add_stack_ranges();
-    ab->completed_children = 0;
-    ab->cutoff_reached = 0;
-    ab->round = 0;
-
-    int n_siblings = MIN_OF(g_forkscan_max_children,
-                            g_bytes_to_scan / MEMORY_THRESHOLD);
-    n_siblings = MIN_OF(n_siblings, g_n_ranges);
-    n_siblings = MAX_OF(n_siblings, 1);
-
-    ab->sibling_mode = SIBLING_MODE_MARKING;
-    ab->root_counter = 0;
-    ab->roots_completed = 0;
+    if (forkscan_heap_contains(g_ranges[rid].low)) {
+        // Skip over the free objects.
+        forkscan_heap_for_each_live_run(g_ranges[rid].low,
+                                        g_ranges[rid].high,
+                                        find_heap_roots, bufs);
+    } else {
+        g_sib.bytes_scanned += g_ranges[rid].high - g_ranges[rid].low;
+        g_scanner->find_roots(g_ranges[rid].low, g_ranges[rid].high,
+                              bufs[0], bufs[1]);
+    }
+}
 
-    trace_stats_t ts;
-    ts.min = PTR_MASK(ab->addrs[0]);
-    ts.max = PTR_MASK(ab->addrs[ab->n_addrs - 1]);
+/** Fork the other n_siblings - 1 scanner processes and return which one
+ *  this is.  The caller is the last.
+ */
+static int fork_siblings (int n_siblings)
+{
+    int sibling_id;
 
-    int sibling_id = 0;
     for (sibling_id = 0; sibling_id < n_siblings - 1; ++sibling_id) {
-        if (fork() == 0) break;
+        if (fork() == 0) {
+            forkscan_trace_forked();
+            break;
+        }
     }
+    return sibling_id;
+}
 
-#ifdef TIMING
-    size_t start, end;
-    start = forkscan_rdtsc();
-#endif
+/** Claim ranges and scan them with scan_range until there are none left,
+ *  then fill in this sibling's slot.  Return 1 in the sibling that
+ *  completed the last range.
+ */
+static int scan_ranges (addr_buffer_t *ab, addr_buffer_t *deadrefs,
+                        int sibling_id,
+                        void (*scan_range) (int rid, addr_buffer_t **bufs))
+{
+    trace_stats_t ts;
+    trace_stats_init(&ts, ab);
+
+    uint64_t start = forkscan_util_nanotime();
+    TRACE(SCAN, TRACE_BEGIN, sibling_id);
 
     // Scan this child's ranges of memory, looking for roots into our pool.
+    addr_buffer_t *bufs[2] = { ab, deadrefs };
     int rid;
-    size_t total_memory = 0;
     int roots_completed = 0;
     while ((rid = __sync_fetch_and_add(&ab->root_counter, 1)) < g_n_ranges) {
         // Okay, so this looks bad.  Contention on ab->root_counter?  Well,
@@ -490,35 +898,232 @@ void forkscan_child (addr_buffer_t *ab, addr_buffer_t *deadrefs, int fd)
         // to be done in root finding.
         //
         // Will's judgment: This is okay.
-        find_roots(g_ranges[rid].low, g_ranges[rid].high, ab, deadrefs);
-        total_memory += g_ranges[rid].high - g_ranges[rid].low;
+        scan_range(rid, bufs);
         ++roots_completed;
     }
 
     if (g_lookaside_count > 0) {
         // Catch any remainders.
-        lookup_lookaside_list(ab, &ts);
+        g_scanner->lookup_lookaside_list(ab, &ts);
     }
+    TRACE(SCAN, TRACE_END, g_sib.bytes_scanned);
+
+    // Fill in our slot before counting our ranges as done, so it's complete
+    // by the time the parent hears from the last sibling.
+    uint64_t elapsed = forkscan_util_nanotime() - start;
+    g_sib.ranges = roots_completed;
+    g_sib.busy_ns = elapsed;
+    ab->siblings[sibling_id] = g_sib;
 
     int total_roots =
         __sync_fetch_and_add(&ab->roots_completed, roots_completed)
         + roots_completed;
 
-#ifdef TIMING
-    end = forkscan_rdtsc();
-    fprintf(stderr, "find_roots took %zu ms.  (mem: 0x%zx, sort: %zu, la: %zu)\n",
-            end - start,
-            total_memory,
-            g_total_sort,
-            g_total_lookaside);
-    start = end;
-#endif
+    // Report the slowest sibling's times: that's what the parent waited on.
+    uint64_t scan_ns = elapsed > g_mark_ns ? elapsed - g_mark_ns : 0;
+    atomic_max(&ab->root_scan_ns, scan_ns);
+    atomic_max(&ab->mark_ns, g_mark_ns);
+
+    return total_roots == g_n_ranges;
+}
 
-    if (total_roots == g_n_ranges) {
+void forkscan_child_prepare (size_t n_addrs)
+{
+    if (n_addrs <= g_sizes_capacity) return;
+    if (g_sizes_buf) forkscan_alloc_munmap(g_sizes_buf);
+    size_t sz = PAGEALIGN(n_addrs * sizeof(size_t) + PAGESIZE - 1);
+    g_sizes_buf = (size_t*)forkscan_alloc_mmap(sz, "retiree sizes");
+    g_sizes_capacity = sz / sizeof(size_t);
+}
+
+void forkscan_child (addr_buffer_t *ab, addr_buffer_t *deadrefs, int fd)
+{
+    assert(ab);
+    assert(deadrefs);
+
+    // Scan memory for references.
+    g_bytes_to_scan = 0;
+    forkscan_proc_map_iterate(collect_ranges, NULL);
+    add_stack_ranges();
+    // After collecting ranges, so the scan doesn't cover the sizes.
+    record_sizes(ab, deadrefs);
+    select_scanner();
+    ab->completed_children = 0;
+    ab->cutoff_reached = 0;
+    ab->round = 0;
+
+    int n_siblings = MIN_OF(g_forkscan_max_children,
+                            g_bytes_to_scan / MEMORY_THRESHOLD);
+    n_siblings = MIN_OF(n_siblings, g_n_ranges);
+    n_siblings = MAX_OF(n_siblings, 1);
+
+    ab->sibling_mode = SIBLING_MODE_MARKING;
+    ab->root_counter = 0;
+    ab->roots_completed = 0;
+    ab->n_siblings = n_siblings;
+
+    int sibling_id = fork_siblings(n_siblings);
+    if (scan_ranges(ab, deadrefs, sibling_id, scan_live_range)) {
         // This child completed the final range.  It gets to notify the parent
         // that scanning is complete.
+        g_retention = forkscan_retention_table();
+        if (g_retention) explain_survivors(ab, deadrefs);
+        ab->done_ns = forkscan_util_nanotime();
+
+        const char *path = forkscan_snapshot_path();
+        if (path) {
+            snapshot_header_t h;
+            memset(&h, 0, sizeof(h));
+            h.mode = g_scan_mode;
+            h.tag_mask = g_tag_mask;
+            h.tag_shift = g_tag_shift;
+            h.n_siblings = n_siblings;
+            h.bytes_to_scan = g_bytes_to_scan;
+            forkscan_snapshot_write(path, &h, ab, g_sizes, deadrefs,
+                                    g_dead_sizes, g_ranges, g_n_ranges);
+        }
+
         if (sizeof(size_t) != write(fd, &g_bytes_to_scan, sizeof(size_t))) {
             forkscan_fatal("Failed to write to parent.\n");
         }
     }
 }
+
+/****************************************************************************/
+/*                                 Replay.                                  */
+/****************************************************************************/
+
+/** Scan a range of the snapshot being replayed the way the child did: heap
+ *  ranges only where objects were live.
+ */
+static void scan_replay_range (int rid, addr_buffer_t **bufs)
+{
+    snapshot_range_t *r = &g_replay->ranges[rid];
+    int i;
+
+    if (!(r->flags & SNAPSHOT_RANGE_HEAP)) {
+        g_sib.bytes_scanned += r->high - r->low;
+        g_scanner->find_roots(r->low, r->high, bufs[0], bufs[1]);
+        return;
+    }
+    for (i = 0; i < r->n_runs; ++i) {
+        find_heap_roots(r->runs[i].low, r->runs[i].high, bufs);
+    }
+}
+
+const char *forkscan_child_kernel_name (int mode)
+{
+    if (mode < 0 || mode >= N_SCAN_MODES || NULL == g_scanners[mode].name) {
+        return "unknown";
+    }
+    return g_scanners[mode].name;
+}
+
+int forkscan_child_replay (snapshot_t *s, const char *kernel, int n_siblings)
+{
+    int mode = s->header.mode;
+    int i;
+
+    if (kernel) {
+        for (mode = 0; mode < N_SCAN_MODES; ++mode) {
+            if (g_scanners[mode].name
+                && 0 == strcmp(kernel, g_scanners[mode].name)) break;
+        }
+        if (N_SCAN_MODES == mode) return -1;
+    }
+    if (s->header.n_ranges > MAX_MARK_AND_SWEEP_RANGES) return -1;
+
+    g_scan_mode = mode;
+    g_scanner = &g_scanners[mode];
+    g_tag_mask = s->header.tag_mask;
+    g_tag_shift = s->header.tag_shift;
+    g_sizes = s->sizes;
+    g_dead_sizes = s->dead_sizes;
+    g_n_ranges = s->header.n_ranges;
+    for (i = 0; i < g_n_ranges; ++i) {
+        g_ranges[i].low = s->ranges[i].low;
+        g_ranges[i].high = s->ranges[i].high;
+    }
+    g_replay = s;
+
+    n_siblings = MIN_OF(n_siblings, MAX_CHILDREN);
+    n_siblings = MIN_OF(n_siblings, g_n_ranges);
+    n_siblings = MAX_OF(n_siblings, 1);
+
+    addr_buffer_t *ab = s->ab;
+    ab->root_counter = 0;
+    ab->roots_completed = 0;
+    ab->root_scan_ns = ab->mark_ns = 0;
+    ab->n_siblings = n_siblings;
+    memset(ab->siblings, 0, sizeof(ab->siblings));
+    memset(&g_sib, 0, sizeof(g_sib));
+    g_mark_ns = 0;
+    g_lookaside_count = 0;
+
+    int sibling_id = fork_siblings(n_siblings);
+    scan_ranges(ab, s->deadrefs, sibling_id, scan_replay_range);
+    if (sibling_id != n_siblings - 1) _exit(0);
+
+    // The caller is the last sibling; wait for the rest to finish.
+    while (wait(NULL) > 0 || EINTR == errno) continue;
+    return n_siblings;
+}
+
+/****************************************************************************/
+/*                          Microbenchmark hooks.                           */
+/****************************************************************************/
+
+// These run the scanner's kernels in an ordinary process, on buffers and
+// memory the caller sets up, so microbench.c can time them without an
+// iteration (or a fork) around them.
+
+void forkscan_child_kernels_init (addr_buffer_t *ab, addr_buffer_t *deadrefs)
+{
+    select_scanner();
+    forkscan_child_prepare(ab->n_addrs + deadrefs->n_addrs);
+    record_sizes(ab, deadrefs);
+    g_lookaside_count = 0;
+}
+
+int forkscan_child_addr_find (size_t val, addr_buffer_t *ab)
+{
+    return addr_find(val, ab);
+}
+
+int forkscan_child_addr_find_hint (size_t val, addr_buffer_t *ab, int hint)
+{
+    return addr_find_hint(val, ab, hint);
+}
+
+void forkscan_child_find_roots (size_t low, size_t high,
+                                addr_buffer_t *ab, addr_buffer_t *deadrefs)
+{
+    addr_buffer_t *bufs[2] = { ab, deadrefs };
+    trace_stats_t ts;
+
+    if (forkscan_heap_contains(low)) {
+        forkscan_heap_for_each_live_run(low, high, find_heap_roots, &bufs);
+    } else {
+        g_scanner->find_roots(low, high, ab, deadrefs);
+    }
+    if (g_lookaside_count > 0) {
+        trace_stats_init(&ts, ab);
+        g_scanner->lookup_lookaside_list(ab, &ts);
+    }
+}
+
+void forkscan_child_lookup_lookaside (addr_buffer_t *ab,
+                                      const size_t *vals, int n)
+{
+    trace_stats_t ts;
+
+    trace_stats_init(&ts, ab);
+    while (n > 0) {
+        int batch = MIN_OF(n, LOOKASIDE_SZ);
+        memcpy(g_lookaside_list, vals, batch * sizeof(size_t));
+        g_lookaside_count = batch;
+        g_scanner->lookup_lookaside_list(ab, &ts);
+        vals += batch;
+        n -= batch;
+    }
+}
@@ -25,7 +25,36 @@ THE SOFTWARE.
 
 #include "buffer.h"
 #include "queue.h"
+#include "snapshot.h"
+
+/* Make room for the sizes of n_addrs retirees and dead references.  Called
+   by the GC thread before it stops the other threads for the fork, since
+   the child can't allocate. */
+void forkscan_child_prepare (size_t n_addrs);
 
 void forkscan_child (addr_buffer_t *ab, addr_buffer_t *deadrefs, int fd);
 
+/* Scan a loaded snapshot in this process, with n_siblings scanner processes
+   as a child would, leaving the marks in s->ab.  kernel names the scanning
+   loops to use ("exact", "interior", "masked", "masked_interior",
+   "canonical" or "canonical_interior"), or NULL for the ones the snapshot
+   was taken with.  Returns the number of siblings used, or -1 if kernel
+   isn't known or the snapshot has too many ranges. */
+int forkscan_child_replay (snapshot_t *s, const char *kernel, int n_siblings);
+
+/* The name of the scanning loops a snapshot's mode selects. */
+const char *forkscan_child_kernel_name (int mode);
+
+/* The scanner's kernels, for microbench.c.  forkscan_child_kernels_init()
+   sets up the scanning mode for a sorted buffer with its minimap and a
+   sorted buffer of dead references; the rest behave as they do inside a
+   scanner process, marking what they find. */
+void forkscan_child_kernels_init (addr_buffer_t *ab, addr_buffer_t *deadrefs);
+int forkscan_child_addr_find (size_t val, addr_buffer_t *ab);
+int forkscan_child_addr_find_hint (size_t val, addr_buffer_t *ab, int hint);
+void forkscan_child_find_roots (size_t low, size_t high,
+                                addr_buffer_t *ab, addr_buffer_t *deadrefs);
+void forkscan_child_lookup_lookaside (addr_buffer_t *ab,
+                                      const size_t *vals, int n);
+
 #endif // !defined _CHILD_H_
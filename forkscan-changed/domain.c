@@ -0,0 +1,434 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "alloc.h"
+#include <assert.h>
+#include "domain.h"
+#include "include/forkscan.h"
+#include "metautil.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+
+/****************************************************************************/
+/*                         Defines, typedefs, etc.                          */
+/****************************************************************************/
+
+#define DOMAIN_BLOCK_SIZE PAGESIZE
+#define DOMAIN_BLOCK_PTRS                                               \
+    ((DOMAIN_BLOCK_SIZE - 3 * sizeof(size_t)) / sizeof(void*))
+
+// A thread hands its block to the domain once it holds this fraction of
+// the budget, so small budgets aren't hidden in thread-local blocks.
+#define BLOCK_BUDGET_SHIFT 3
+
+typedef struct domain_block_t domain_block_t;
+
+/** A batch of one thread's retirees for one domain.  Blocks are Forkscan's
+ *  own memory, so the scan never sees the pointers in them.
+ */
+struct domain_block_t {
+    domain_block_t *next;
+    size_t n;
+    size_t bytes;
+    void *ptrs[DOMAIN_BLOCK_PTRS];
+};
+
+struct forkscan_domain {
+    int id;
+    char name[32];
+    size_t budget;
+    int priority;
+
+    pthread_mutex_t lock;
+    domain_block_t *pending_head, *pending_tail;
+    volatile size_t pending_bytes;
+    volatile int flush_requested;
+
+    // Statistics.
+    volatile size_t retired;
+    volatile size_t retired_bytes;
+    size_t snapshots;
+    size_t scanned;
+    size_t survived;
+};
+
+/****************************************************************************/
+/*                                 Globals                                  */
+/****************************************************************************/
+
+DEFINE_POOL_ALLOC(domainblock, DOMAIN_BLOCK_SIZE, 64,
+                  forkscan_alloc_mmap_parent)
+
+// Slot 0 is never handed out.  It stands for the default retire queues and
+// takes the retirees of exiting threads, with a zero budget.
+static struct forkscan_domain g_domains[MAX_DOMAINS] = {
+    [0] = { .name = "default", .lock = PTHREAD_MUTEX_INITIALIZER },
+};
+static volatile int g_n_domains = 1;
+static pthread_mutex_t g_domains_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread domain_block_t *t_blocks[MAX_DOMAINS];
+
+// GC thread only: the pointers drained into the current snapshot, each
+// tagged with its domain id, sorted.
+static size_t *g_tagged;
+static size_t g_n_tagged, g_tagged_capacity;
+
+// Reclaimer only: the oldest submission that left domain pointers behind
+// for lack of room, or 0.  Completion can't pass it until they're drained.
+static size_t g_backlog_seq;
+
+/****************************************************************************/
+/*                            Helper functions.                             */
+/****************************************************************************/
+
+/** Move a thread's block to the domain's pending list.
+ */
+static void flush_block (struct forkscan_domain *d, domain_block_t *b)
+{
+    b->next = NULL;
+    pthread_mutex_lock(&d->lock);
+    if (d->pending_tail) d->pending_tail->next = b;
+    else d->pending_head = b;
+    d->pending_tail = b;
+    d->pending_bytes += b->bytes;
+    pthread_mutex_unlock(&d->lock);
+
+    __sync_fetch_and_add(&d->retired, b->n);
+    __sync_fetch_and_add(&d->retired_bytes, b->bytes);
+}
+
+static int is_due (struct forkscan_domain *d)
+{
+    return d->pending_head != NULL
+        && (d->flush_requested || d->budget == 0
+            || d->pending_bytes >= d->budget);
+}
+
+static int compare_priority (const void *a, const void *b)
+{
+    const struct forkscan_domain *da = *(struct forkscan_domain**)a;
+    const struct forkscan_domain *db = *(struct forkscan_domain**)b;
+    return db->priority - da->priority;
+}
+
+static int compare_addr (const void *a, const void *b)
+{
+    size_t x = *(const size_t*)a, y = *(const size_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+/** Return the domain id of addr, or 0 if it wasn't drained from a domain
+ *  in this snapshot.
+ */
+static int tagged_lookup (size_t addr)
+{
+    size_t lo = 0, hi = g_n_tagged;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        size_t cmp = g_tagged[mid] & ~DOMAIN_ID_MASK;
+        if (cmp == addr) return g_tagged[mid] & DOMAIN_ID_MASK;
+        if (cmp < addr) lo = mid + 1;
+        else hi = mid;
+    }
+    return 0;
+}
+
+/****************************************************************************/
+/*                           Internal interface                             */
+/****************************************************************************/
+
+/**
+ * Queue ptr in domain d for the calling thread.  Returns 0 if the domain is
+ * within budget, 1 if it is due for reclamation, and 2 if it is so far
+ * over budget that the caller should wait for reclamation to catch up.
+ */
+int forkscan_domain_push (struct forkscan_domain *d, void *ptr)
+{
+    domain_block_t *b = t_blocks[d->id];
+
+    assert(0 == ((size_t)ptr & DOMAIN_ID_MASK));
+
+    if (NULL == b) {
+        b = t_blocks[d->id] = (domain_block_t*)pool_alloc_domainblock();
+        b->n = 0;
+        b->bytes = 0;
+    }
+    b->ptrs[b->n++] = ptr;
+    b->bytes += MALLOC_USABLE_SIZE(ptr);
+
+    // A zero budget never asks for reclamation.  Its blocks are handed
+    // over when full and wait for whatever snapshot comes next.
+    if (b->n == DOMAIN_BLOCK_PTRS
+        || (d->budget > 0
+            && b->bytes >= (d->budget >> BLOCK_BUDGET_SHIFT))) {
+        t_blocks[d->id] = NULL;
+        flush_block(d, b);
+    }
+
+    if (0 == d->budget) return 0;
+    if (d->pending_bytes >= 2 * d->budget) return 2;
+    return d->pending_bytes >= d->budget ? 1 : 0;
+}
+
+/**
+ * Return 1 if the domain is so far over budget that retiring threads
+ * should wait, zero otherwise.
+ */
+int forkscan_domain_over_limit (struct forkscan_domain *d)
+{
+    return d->budget > 0 && d->pending_bytes >= 2 * d->budget;
+}
+
+/**
+ * Move the pointers of every domain that is due into ab, after the ones
+ * already there, record where each domain's pointers are, and set
+ * ab->done_seq.  Called by the reclaimer thread.
+ */
+void forkscan_domain_drain (addr_buffer_t *ab)
+{
+    struct forkscan_domain *due[MAX_DOMAINS];
+    int i, n_due = 0, n_domains = g_n_domains, left_behind = 0;
+
+    memset(ab->domain_count, 0, sizeof(ab->domain_count));
+
+    for (i = 0; i < n_domains; ++i) {
+        if (is_due(&g_domains[i])) due[n_due++] = &g_domains[i];
+    }
+
+    // Highest priority first, in case they don't all fit.
+    qsort(due, n_due, sizeof(due[0]), compare_priority);
+
+    for (i = 0; i < n_due; ++i) {
+        struct forkscan_domain *d = due[i];
+        domain_block_t *b, *rest = NULL;
+        size_t bytes = 0;
+
+        pthread_mutex_lock(&d->lock);
+        b = d->pending_head;
+        d->pending_head = d->pending_tail = NULL;
+        d->pending_bytes = 0;
+        d->flush_requested = 0;
+        pthread_mutex_unlock(&d->lock);
+
+        ab->domain_start[d->id] = ab->n_addrs;
+        while (b) {
+            domain_block_t *next = b->next;
+            if (ab->n_addrs + b->n > ab->capacity) {
+                // Out of room.  The rest waits for the next snapshot.
+                rest = b;
+                break;
+            }
+            memcpy(&ab->addrs[ab->n_addrs], b->ptrs, b->n * sizeof(void*));
+            ab->n_addrs += b->n;
+            pool_free_domainblock(b);
+            b = next;
+        }
+        ab->domain_count[d->id] = ab->n_addrs - ab->domain_start[d->id];
+
+        if (rest) {
+            domain_block_t *tail = rest;
+            for (b = rest; b; b = b->next) {
+                bytes += b->bytes;
+                tail = b;
+            }
+            // Whoever was promised these pointers is still waiting, so
+            // the next snapshot takes them whatever the budget says.
+            pthread_mutex_lock(&d->lock);
+            tail->next = d->pending_head;
+            d->pending_head = rest;
+            if (NULL == d->pending_tail) d->pending_tail = tail;
+            d->pending_bytes += bytes;
+            d->flush_requested = 1;
+            pthread_mutex_unlock(&d->lock);
+            left_behind = 1;
+        }
+    }
+
+    // A ticket taken before this submission may cover the pointers left
+    // behind, so it isn't done until a later snapshot drains them all.
+    if (left_behind) {
+        if (0 == g_backlog_seq) g_backlog_seq = ab->seq;
+    } else g_backlog_seq = 0;
+    ab->done_seq = g_backlog_seq ? g_backlog_seq - 1 : ab->seq;
+}
+
+/**
+ * Hand the calling thread's partly-filled domain queues to their domains
+ * and have the next snapshot drain them.  Returns 1 if any domain now has
+ * pointers waiting for that snapshot, zero otherwise.
+ */
+int forkscan_domain_flush_thread ()
+{
+    int i, ret = 0, n_domains = g_n_domains;
+
+    for (i = 0; i < n_domains; ++i) {
+        struct forkscan_domain *d = &g_domains[i];
+        if (t_blocks[i]) {
+            flush_block(d, t_blocks[i]);
+            t_blocks[i] = NULL;
+        }
+        if (d->pending_head) {
+            d->flush_requested = 1;
+            ret = 1;
+        }
+    }
+    return ret;
+}
+
+/**
+ * Queue ptr, retired by a thread that can no longer hand it to the scanner
+ * itself, for the next snapshot.  Call forkscan_domain_flush_thread() when
+ * done.
+ */
+void forkscan_domain_orphan (void *ptr)
+{
+    forkscan_domain_push(&g_domains[0], ptr);
+}
+
+/**
+ * Record which domain each pointer in the submitted buffers came from.
+ * Called by the GC thread right after forking, while the child scans.
+ */
+void forkscan_domain_note_snapshot (addr_buffer_t *submitted)
+{
+    addr_buffer_t *ab;
+    size_t needed = 0;
+    int i;
+
+    g_n_tagged = 0;
+    if (g_n_domains <= 1) return;
+
+    for (ab = submitted; ab; ab = ab->next) {
+        for (i = 1; i < MAX_DOMAINS; ++i) needed += ab->domain_count[i];
+    }
+    if (0 == needed) return;
+
+    if (needed > g_tagged_capacity) {
+        if (g_tagged) forkscan_alloc_munmap(g_tagged);
+        g_tagged_capacity = forkscan_alloc_huge_round(needed * sizeof(size_t))
+            / sizeof(size_t);
+        g_tagged = forkscan_alloc_mmap_parent(g_tagged_capacity
+                                              * sizeof(size_t),
+                                              "domain tags");
+    }
+
+    int serviced[MAX_DOMAINS] = { 0 };
+    for (ab = submitted; ab; ab = ab->next) {
+        for (i = 1; i < MAX_DOMAINS; ++i) {
+            int j, start = ab->domain_start[i], count = ab->domain_count[i];
+            for (j = 0; j < count; ++j) {
+                g_tagged[g_n_tagged++] = ab->addrs[start + j] | i;
+            }
+            serviced[i] += count;
+        }
+    }
+    for (i = 1; i < MAX_DOMAINS; ++i) {
+        if (0 == serviced[i]) continue;
+        ++g_domains[i].snapshots;
+        g_domains[i].scanned += serviced[i];
+    }
+
+    qsort(g_tagged, g_n_tagged, sizeof(size_t), compare_addr);
+}
+
+/**
+ * Credit survivors of the scan back to their domains.  Called by the GC
+ * thread once the child is done with working_data.
+ */
+void forkscan_domain_note_results (addr_buffer_t *working_data)
+{
+    int i;
+
+    if (0 == g_n_tagged) return;
+
+    for (i = 0; i < working_data->n_addrs; ++i) {
+        size_t addr = working_data->addrs[i];
+        if (0 == (addr & 0x1)) continue;
+        int id = tagged_lookup(PTR_MASK(addr));
+        if (id) ++g_domains[id].survived;
+    }
+    g_n_tagged = 0;
+}
+
+/****************************************************************************/
+/*                            Exported functions                            */
+/****************************************************************************/
+
+/**
+ * Create a reclamation domain.  See forkscan.h.
+ */
+__attribute__((visibility("default")))
+forkscan_domain_t *forkscan_domain_create (const char *name,
+                                           size_t byte_budget,
+                                           int priority)
+{
+    struct forkscan_domain *d = NULL;
+
+    pthread_mutex_lock(&g_domains_lock);
+    if (g_n_domains < MAX_DOMAINS) {
+        d = &g_domains[g_n_domains];
+        memset(d, 0, sizeof(*d));
+        d->id = g_n_domains;
+        strncpy(d->name, name ? name : "", sizeof(d->name) - 1);
+        d->budget = byte_budget;
+        d->priority = priority;
+        pthread_mutex_init(&d->lock, NULL);
+        __sync_synchronize();
+        ++g_n_domains;
+    }
+    pthread_mutex_unlock(&g_domains_lock);
+
+    return d;
+}
+
+/**
+ * Change a domain's byte budget and priority.
+ */
+__attribute__((visibility("default")))
+void forkscan_domain_set_budget (forkscan_domain_t *d,
+                                 size_t byte_budget,
+                                 int priority)
+{
+    d->budget = byte_budget;
+    d->priority = priority;
+}
+
+/**
+ * Copy the domain's statistics into *stats.
+ */
+__attribute__((visibility("default")))
+void forkscan_domain_get_stats (forkscan_domain_t *d,
+                                struct forkscan_domain_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    memcpy(stats->name, d->name, sizeof(stats->name));
+    stats->retired = d->retired;
+    stats->retired_bytes = d->retired_bytes;
+    stats->pending_bytes = d->pending_bytes;
+    stats->snapshots = d->snapshots;
+    stats->scanned = d->scanned;
+    stats->survived = d->survived;
+    stats->freed = d->scanned - d->survived;
+}
@@ -0,0 +1,92 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/* Module Description:
+   Reclamation domains.  A domain collects the retirees of one data
+   structure in its own queue, with its own byte budget and priority, so a
+   churny structure can be reclaimed aggressively while a quiet one waits.
+   Domains don't get their own iterations.  Whenever a snapshot is taken,
+   for whatever reason, every domain that is due is drained into it,
+   highest priority first.  The GC thread keeps a sorted list of which
+   domain each drained pointer came from so it can credit frees and
+   survivors back to the right domain.
+ */
+
+#ifndef _DOMAIN_H_
+#define _DOMAIN_H_
+
+#include "buffer.h"
+#include "env.h"
+#include <stddef.h>
+
+// Domain ids fit in the low three bits of an aligned address.
+#define DOMAIN_ID_MASK ((size_t)(MAX_DOMAINS - 1))
+
+struct forkscan_domain;
+
+/**
+ * Queue ptr in domain d for the calling thread.  Returns 0 if the domain is
+ * within budget, 1 if it is due for reclamation, and 2 if it is so far
+ * over budget that the caller should wait for reclamation to catch up.
+ */
+int forkscan_domain_push (struct forkscan_domain *d, void *ptr);
+
+/**
+ * Return 1 if the domain is so far over budget that retiring threads
+ * should wait, zero otherwise.
+ */
+int forkscan_domain_over_limit (struct forkscan_domain *d);
+
+/**
+ * Move the pointers of every domain that is due into ab, after the ones
+ * already there, and record where each domain's pointers are.  Called by
+ * the reclaimer thread.
+ */
+void forkscan_domain_drain (addr_buffer_t *ab);
+
+/**
+ * Hand the calling thread's partly-filled domain queues to their domains
+ * and have the next snapshot drain them.  Returns 1 if any domain now has
+ * pointers waiting for that snapshot, zero otherwise.
+ */
+int forkscan_domain_flush_thread ();
+
+/**
+ * Queue ptr, retired by a thread that can no longer hand it to the scanner
+ * itself, for the next snapshot.  Call forkscan_domain_flush_thread() when
+ * done.
+ */
+void forkscan_domain_orphan (void *ptr);
+
+/**
+ * Record which domain each pointer in the submitted buffers came from.
+ * Called by the GC thread right after forking, while the child scans.
+ */
+void forkscan_domain_note_snapshot (addr_buffer_t *submitted);
+
+/**
+ * Credit survivors of the scan back to their domains.  Called by the GC
+ * thread once the child is done with working_data.
+ */
+void forkscan_domain_note_results (addr_buffer_t *working_data);
+
+#endif // !defined _DOMAIN_H_
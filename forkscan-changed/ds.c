@@ -0,0 +1,77 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "ds.h"
+#include "include/forkscan.h"
+
+/****************************************************************************/
+/*                                Reclaimers                                */
+/****************************************************************************/
+
+void forkscan_ds_reclaimer_init (struct forkscan_ds_reclaimer *dst,
+                                 const struct forkscan_ds_reclaimer *src)
+{
+    if (src) {
+        *dst = *src;
+    } else {
+        // NULL functions select forkscan_retire() and forkscan_retire_bulk()
+        // without going through a pointer.
+        dst->retire = NULL;
+        dst->retire_bulk = NULL;
+        dst->ctx = NULL;
+    }
+}
+
+void forkscan_ds_retire (const struct forkscan_ds_reclaimer *r, void *ptr)
+{
+    if (r->retire) r->retire(ptr, r->ctx);
+    else forkscan_retire(ptr);
+}
+
+void forkscan_ds_retire_bulk (const struct forkscan_ds_reclaimer *r,
+                              void **ptrs, size_t n)
+{
+    if (n == 1) {
+        forkscan_ds_retire(r, ptrs[0]);
+    } else if (r->retire_bulk) {
+        r->retire_bulk(ptrs, n, r->ctx);
+    } else if (r->retire) {
+        size_t i;
+        for (i = 0; i < n; ++i) r->retire(ptrs[i], r->ctx);
+    } else {
+        // Without a finalizer, this can't fail.
+        forkscan_retire_bulk(ptrs, n, NULL, NULL);
+    }
+}
+
+static void domain_retire (void *ptr, void *ctx)
+{
+    forkscan_domain_retire((forkscan_domain_t*)ctx, ptr);
+}
+
+void forkscan_ds_domain_reclaimer (struct forkscan_ds_reclaimer *r,
+                                   forkscan_domain_t *d)
+{
+    r->retire = domain_retire;
+    r->retire_bulk = NULL;
+    r->ctx = d;
+}
@@ -0,0 +1,117 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _DS_H_
+#define _DS_H_
+
+#include "include/forkscan_ds.h"
+#include <stdint.h>
+
+/**
+ * Internals shared by the structures in libforkscan_ds.  The sorted list
+ * and the hash map use the same list code: the hash map's entries and
+ * bucket markers are nodes of one list in split order, and the plain list
+ * orders its nodes by key.
+ */
+
+/****************************************************************************/
+/*                         Defines, typedefs, etc.                          */
+/****************************************************************************/
+
+// Set in a node's next pointer once the node has been removed.
+#define DS_MARK ((uintptr_t)1)
+#define DS_PTR(v) ((void*)((uintptr_t)(v) & ~DS_MARK))
+
+#define DS_LOAD(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define DS_CAS(ptr, compare, swap)                      \
+    __sync_bool_compare_and_swap((ptr), (compare), (swap))
+
+typedef struct ds_node_t ds_node_t;
+
+struct ds_node_t {
+    uint64_t order;  // Sorted on (order, key).
+    long key;
+    void *value;
+    uintptr_t next;  // Successor, with DS_MARK once this node is removed.
+};
+
+/****************************************************************************/
+/*                                Reclaimers                                */
+/****************************************************************************/
+
+/**
+ * Copy src into dst, or clear dst for the Forkscan defaults if src is
+ * NULL.
+ */
+void forkscan_ds_reclaimer_init (struct forkscan_ds_reclaimer *dst,
+                                 const struct forkscan_ds_reclaimer *src);
+
+/**
+ * Retire one unlinked node through r.
+ */
+void forkscan_ds_retire (const struct forkscan_ds_reclaimer *r, void *ptr);
+
+/**
+ * Retire n nodes that were unlinked together through r.  ptrs may be
+ * cleared.
+ */
+void forkscan_ds_retire_bulk (const struct forkscan_ds_reclaimer *r,
+                              void **ptrs, size_t n);
+
+/****************************************************************************/
+/*                             Harris-Michael list                          */
+/****************************************************************************/
+
+/**
+ * Insert (order, key) with the given value into the list that follows
+ * head.  Returns 1 if a new node was linked, 0 if a node with the same
+ * order and key was already there, and -1 if out of memory.  Unless out
+ * of memory, stores the new or existing node in *node (if node isn't
+ * NULL).
+ */
+int forkscan_ds_lcore_insert (const struct forkscan_ds_reclaimer *r,
+                              uintptr_t *head, uint64_t order, long key,
+                              void *value, ds_node_t **node);
+
+/**
+ * Remove the node with the given order and key from the list that follows
+ * head.  Returns 1 and stores its value in *value (if value isn't NULL)
+ * if it was there, 0 otherwise.
+ */
+int forkscan_ds_lcore_remove (const struct forkscan_ds_reclaimer *r,
+                              uintptr_t *head, uint64_t order, long key,
+                              void **value);
+
+/**
+ * Look up the node with the given order and key without writing anything.
+ * Returns 1 and stores its value in *value (if value isn't NULL) if it is
+ * there, 0 otherwise.
+ */
+int forkscan_ds_lcore_lookup (uintptr_t *head, uint64_t order, long key,
+                              void **value);
+
+/**
+ * Free first and every node after it.  Only for lists no thread can reach.
+ */
+void forkscan_ds_lcore_free_all (ds_node_t *first);
+
+#endif // !defined _DS_H_
@@ -0,0 +1,273 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <assert.h>
+#include "ds.h"
+#include "include/forkscan.h"
+#include <string.h>
+
+/****************************************************************************/
+/*                         Defines, typedefs, etc.                          */
+/****************************************************************************/
+
+// Average entries per bucket before the table doubles.
+#define LOAD_FACTOR 2
+
+// Buckets live in segments that are allocated as the table grows and
+// never move: segment 0 holds buckets [0, 2^MIN_BITS), and segment s > 0
+// holds [2^(MIN_BITS + s - 1), 2^(MIN_BITS + s)).
+#define MIN_BITS 6
+#define MAX_SEGMENTS 32
+#define MAX_BUCKETS ((size_t)1 << (MIN_BITS + MAX_SEGMENTS - 1))
+
+// The entry count is split over this many cache lines so that updates
+// from different threads don't contend on it.  A thread checks the total
+// against the table size once every COUNT_CHECK updates to its stripe.
+#define COUNT_STRIPES 16
+#define COUNT_CHECK 64
+
+typedef struct count_stripe_t count_stripe_t;
+
+struct count_stripe_t {
+    long n;
+    char pad[64 - sizeof(long)];
+};
+
+struct forkscan_ds_hash {
+    size_t size;  // Buckets in use, a power of two.  Only grows.
+    count_stripe_t count[COUNT_STRIPES];
+    ds_node_t *root;  // Bucket 0's marker, the head of the whole list.
+    uintptr_t *segments[MAX_SEGMENTS];
+    struct forkscan_ds_reclaimer r;
+};
+
+/****************************************************************************/
+/*                                 Globals                                  */
+/****************************************************************************/
+
+static int g_next_stripe;
+static __thread int t_stripe = -1;
+
+/****************************************************************************/
+/*                             Helper functions                             */
+/****************************************************************************/
+
+static uint64_t hash_key (long key)
+{
+    // The splitmix64 finalizer, so that nearby keys land far apart.
+    uint64_t x = (uint64_t)key;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+static uint64_t reverse_bits (uint64_t x)
+{
+    x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+    x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+    x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    return __builtin_bswap64(x);
+}
+
+/** An entry's place in the list: its hash reversed, so each bucket's
+ *  entries follow the bucket's marker, with the low bit set so that it
+ *  sorts after any marker with the same prefix.
+ */
+static uint64_t entry_order (uint64_t hash)
+{
+    return reverse_bits(hash | (1ULL << 63));
+}
+
+static uint64_t marker_order (size_t bucket)
+{
+    return reverse_bits(bucket);
+}
+
+static long *my_count (forkscan_ds_hash_t *h)
+{
+    if (t_stripe < 0) {
+        t_stripe = __sync_fetch_and_add(&g_next_stripe, 1) % COUNT_STRIPES;
+    }
+    return &h->count[t_stripe].n;
+}
+
+static long total_count (forkscan_ds_hash_t *h)
+{
+    long total = 0;
+    int i;
+    for (i = 0; i < COUNT_STRIPES; ++i) total += DS_LOAD(&h->count[i].n);
+    return total;
+}
+
+/** Return the slot that holds bucket's marker, allocating its segment if
+ *  need be.  NULL if out of memory.
+ */
+static uintptr_t *bucket_slot (forkscan_ds_hash_t *h, size_t bucket)
+{
+    size_t seg, offset, len;
+    if (bucket < ((size_t)1 << MIN_BITS)) {
+        seg = 0;
+        offset = bucket;
+        len = (size_t)1 << MIN_BITS;
+    } else {
+        int bit = 63 - __builtin_clzll(bucket);
+        seg = bit - MIN_BITS + 1;
+        len = (size_t)1 << bit;
+        offset = bucket - len;
+    }
+    assert(seg < MAX_SEGMENTS);
+
+    uintptr_t *segment = DS_LOAD(&h->segments[seg]);
+    if (segment == NULL) {
+        uintptr_t *fresh = forkscan_malloc(len * sizeof(uintptr_t));
+        if (fresh == NULL) return NULL;
+        memset(fresh, 0, len * sizeof(uintptr_t));
+        if (!DS_CAS(&h->segments[seg], NULL, fresh)) forkscan_free(fresh);
+        segment = DS_LOAD(&h->segments[seg]);
+    }
+    return &segment[offset];
+}
+
+/** Return bucket's marker, inserting it (and its parent's, recursively)
+ *  if this is the bucket's first use.  NULL if out of memory.
+ */
+static ds_node_t *bucket_marker (forkscan_ds_hash_t *h, size_t bucket)
+{
+    uintptr_t *slot = bucket_slot(h, bucket);
+    if (slot == NULL) return NULL;
+    ds_node_t *marker = (ds_node_t*)DS_LOAD(slot);
+    if (marker != NULL) return marker;
+
+    // A bucket splits off its parent, the bucket without its top bit, so
+    // its marker goes into the parent's part of the list.  Racing threads
+    // find the same marker node and all store it.
+    size_t parent = bucket & ~((size_t)1 << (63 - __builtin_clzll(bucket)));
+    ds_node_t *parent_marker = bucket_marker(h, parent);
+    if (parent_marker == NULL) return NULL;
+    if (forkscan_ds_lcore_insert(&h->r, &parent_marker->next,
+                                 marker_order(bucket), 0, NULL, &marker) < 0) {
+        return NULL;
+    }
+    __atomic_store_n(slot, (uintptr_t)marker, __ATOMIC_RELEASE);
+    return marker;
+}
+
+/****************************************************************************/
+/*                                Interface                                 */
+/****************************************************************************/
+
+forkscan_ds_hash_t *forkscan_ds_hash_create
+(size_t capacity, const struct forkscan_ds_reclaimer *r)
+{
+    forkscan_ds_hash_t *h = forkscan_malloc(sizeof(forkscan_ds_hash_t));
+    if (h == NULL) return NULL;
+    memset(h, 0, sizeof(forkscan_ds_hash_t));
+    forkscan_ds_reclaimer_init(&h->r, r);
+
+    h->size = (size_t)1 << MIN_BITS;
+    while (h->size < capacity / LOAD_FACTOR && h->size < MAX_BUCKETS) {
+        h->size <<= 1;
+    }
+
+    h->root = forkscan_malloc(sizeof(ds_node_t));
+    if (h->root == NULL) {
+        forkscan_free(h);
+        return NULL;
+    }
+    h->root->order = marker_order(0);
+    h->root->key = 0;
+    h->root->value = NULL;
+    h->root->next = 0;
+
+    uintptr_t *slot = bucket_slot(h, 0);
+    if (slot == NULL) {
+        forkscan_ds_hash_destroy(h);
+        return NULL;
+    }
+    *slot = (uintptr_t)h->root;
+    return h;
+}
+
+void forkscan_ds_hash_destroy (forkscan_ds_hash_t *h)
+{
+    // Every entry and marker is on the list that starts at the root.
+    int i;
+    forkscan_ds_lcore_free_all(h->root);
+    for (i = 0; i < MAX_SEGMENTS; ++i) {
+        if (h->segments[i]) forkscan_free(h->segments[i]);
+    }
+    forkscan_free(h);
+}
+
+int forkscan_ds_hash_insert (forkscan_ds_hash_t *h, long key, void *value)
+{
+    uint64_t hash = hash_key(key);
+    size_t size = DS_LOAD(&h->size);
+    ds_node_t *marker = bucket_marker(h, hash & (size - 1));
+    if (marker == NULL) return -1;
+
+    int ret = forkscan_ds_lcore_insert(&h->r, &marker->next,
+                                       entry_order(hash), key, value, NULL);
+    if (ret == 1) {
+        long n = __sync_add_and_fetch(my_count(h), 1);
+        if (n % COUNT_CHECK == 0 && size < MAX_BUCKETS
+            && total_count(h) > (long)(size * LOAD_FACTOR)) {
+            // Losing this race means another thread doubled it already.
+            DS_CAS(&h->size, size, size * 2);
+        }
+    }
+    return ret;
+}
+
+int forkscan_ds_hash_remove (forkscan_ds_hash_t *h, long key, void **value)
+{
+    uint64_t hash = hash_key(key);
+    size_t size = DS_LOAD(&h->size);
+    ds_node_t *marker = bucket_marker(h, hash & (size - 1));
+    if (marker == NULL) {
+        // Out of memory for a new bucket.  Its parent's marker precedes the
+        // same entries, just further back.
+        marker = h->root;
+    }
+
+    int ret = forkscan_ds_lcore_remove(&h->r, &marker->next,
+                                       entry_order(hash), key, value);
+    if (ret) __sync_fetch_and_sub(my_count(h), 1);
+    return ret;
+}
+
+int forkscan_ds_hash_lookup (forkscan_ds_hash_t *h, long key, void **value)
+{
+    uint64_t hash = hash_key(key);
+    size_t size = DS_LOAD(&h->size);
+    ds_node_t *marker = bucket_marker(h, hash & (size - 1));
+    if (marker == NULL) marker = h->root;
+    return forkscan_ds_lcore_lookup(&marker->next, entry_order(hash), key,
+                                    value);
+}
+
+size_t forkscan_ds_hash_count (forkscan_ds_hash_t *h)
+{
+    // A remove can be counted before the insert it undid.
+    long count = total_count(h);
+    return count < 0 ? 0 : (size_t)count;
+}
@@ -0,0 +1,216 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "ds.h"
+#include "include/forkscan.h"
+
+/****************************************************************************/
+/*                         Defines, typedefs, etc.                          */
+/****************************************************************************/
+
+// A search cuts out at most this many consecutive removed nodes with one
+// CAS.  Whatever is left of a longer run is cut out by the next search.
+#define UNLINK_MAX 32
+
+struct forkscan_ds_list {
+    uintptr_t head;
+    struct forkscan_ds_reclaimer r;
+};
+
+/****************************************************************************/
+/*                             Helper functions                             */
+/****************************************************************************/
+
+static int is_before (ds_node_t *node, uint64_t order, long key)
+{
+    return node->order < order || (node->order == order && node->key < key);
+}
+
+/** Position *prev_out and *cur_out around (order, key), unlinking and
+ *  retiring removed nodes along the way.  Return true if cur holds the
+ *  key.
+ */
+static int find (const struct forkscan_ds_reclaimer *r, uintptr_t *head,
+                 uint64_t order, long key,
+                 uintptr_t **prev_out, ds_node_t **cur_out)
+{
+ retry:;
+    uintptr_t *prev = head;
+    ds_node_t *cur = DS_PTR(DS_LOAD(prev));
+    while (cur != NULL) {
+        uintptr_t next = DS_LOAD(&cur->next);
+        if (next & DS_MARK) {
+            // A removed node's next pointer never changes, so the whole run
+            // of removed nodes starting at cur can be cut out at once, and
+            // whoever does it owns all of them.
+            void *run[UNLINK_MAX];
+            size_t n = 0;
+            ds_node_t *succ = cur;
+            do {
+                run[n++] = succ;
+                succ = DS_PTR(next);
+                if (succ == NULL) break;
+                next = DS_LOAD(&succ->next);
+            } while ((next & DS_MARK) && n < UNLINK_MAX);
+
+            if (!DS_CAS(prev, (uintptr_t)cur, (uintptr_t)succ)) goto retry;
+            forkscan_ds_retire_bulk(r, run, n);
+            cur = succ;
+            continue;
+        }
+        if (!is_before(cur, order, key)) {
+            *prev_out = prev;
+            *cur_out = cur;
+            return cur->order == order && cur->key == key;
+        }
+        prev = &cur->next;
+        cur = (ds_node_t*)next;
+    }
+    *prev_out = prev;
+    *cur_out = NULL;
+    return 0;
+}
+
+static uint64_t list_order (long key)
+{
+    // Flip the sign bit so unsigned order matches signed keys.
+    return (uint64_t)key ^ (1ULL << 63);
+}
+
+/****************************************************************************/
+/*                                List core                                 */
+/****************************************************************************/
+
+int forkscan_ds_lcore_insert (const struct forkscan_ds_reclaimer *r,
+                              uintptr_t *head, uint64_t order, long key,
+                              void *value, ds_node_t **node)
+{
+    ds_node_t *new_node = NULL;
+    for (;;) {
+        uintptr_t *prev;
+        ds_node_t *cur;
+        if (find(r, head, order, key, &prev, &cur)) {
+            // Never published, so it can go straight back.
+            if (new_node) forkscan_free(new_node);
+            if (node) *node = cur;
+            return 0;
+        }
+        if (new_node == NULL) {
+            new_node = forkscan_malloc(sizeof(ds_node_t));
+            if (new_node == NULL) return -1;
+            new_node->order = order;
+            new_node->key = key;
+            new_node->value = value;
+        }
+        new_node->next = (uintptr_t)cur;
+        if (DS_CAS(prev, (uintptr_t)cur, (uintptr_t)new_node)) {
+            if (node) *node = new_node;
+            return 1;
+        }
+    }
+}
+
+int forkscan_ds_lcore_remove (const struct forkscan_ds_reclaimer *r,
+                              uintptr_t *head, uint64_t order, long key,
+                              void **value)
+{
+    for (;;) {
+        uintptr_t *prev;
+        ds_node_t *cur;
+        if (!find(r, head, order, key, &prev, &cur)) return 0;
+
+        uintptr_t next = DS_LOAD(&cur->next);
+        if (next & DS_MARK) continue;
+        if (!DS_CAS(&cur->next, next, next | DS_MARK)) continue;
+
+        // Logically removed.  Try to unlink it; if that fails, a find() will
+        // do it (and retire it) on our behalf.
+        if (value) *value = cur->value;
+        if (DS_CAS(prev, (uintptr_t)cur, next)) {
+            forkscan_ds_retire(r, cur);
+        } else {
+            find(r, head, order, key, &prev, &cur);
+        }
+        return 1;
+    }
+}
+
+int forkscan_ds_lcore_lookup (uintptr_t *head, uint64_t order, long key,
+                              void **value)
+{
+    ds_node_t *cur = DS_PTR(DS_LOAD(head));
+    while (cur != NULL && is_before(cur, order, key)) {
+        cur = DS_PTR(DS_LOAD(&cur->next));
+    }
+    if (cur == NULL || cur->order != order || cur->key != key
+        || (DS_LOAD(&cur->next) & DS_MARK)) {
+        return 0;
+    }
+    if (value) *value = cur->value;
+    return 1;
+}
+
+void forkscan_ds_lcore_free_all (ds_node_t *first)
+{
+    while (first != NULL) {
+        ds_node_t *next = DS_PTR(first->next);
+        forkscan_free(first);
+        first = next;
+    }
+}
+
+/****************************************************************************/
+/*                                Interface                                 */
+/****************************************************************************/
+
+forkscan_ds_list_t *forkscan_ds_list_create
+(const struct forkscan_ds_reclaimer *r)
+{
+    forkscan_ds_list_t *l = forkscan_malloc(sizeof(forkscan_ds_list_t));
+    if (l == NULL) return NULL;
+    l->head = 0;
+    forkscan_ds_reclaimer_init(&l->r, r);
+    return l;
+}
+
+void forkscan_ds_list_destroy (forkscan_ds_list_t *l)
+{
+    forkscan_ds_lcore_free_all(DS_PTR(l->head));
+    forkscan_free(l);
+}
+
+int forkscan_ds_list_insert (forkscan_ds_list_t *l, long key, void *value)
+{
+    return forkscan_ds_lcore_insert(&l->r, &l->head, list_order(key), key,
+                                    value, NULL);
+}
+
+int forkscan_ds_list_remove (forkscan_ds_list_t *l, long key, void **value)
+{
+    return forkscan_ds_lcore_remove(&l->r, &l->head, list_order(key), key,
+                                    value);
+}
+
+int forkscan_ds_list_lookup (forkscan_ds_list_t *l, long key, void **value)
+{
+    return forkscan_ds_lcore_lookup(&l->head, list_order(key), key, value);
+}
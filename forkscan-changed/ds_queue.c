@@ -0,0 +1,176 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <assert.h>
+#include "ds.h"
+#include "include/forkscan.h"
+
+/****************************************************************************/
+/*                         Defines, typedefs, etc.                          */
+/****************************************************************************/
+
+#define SEGMENT FORKSCAN_DS_QUEUE_SEGMENT
+
+// Left in a slot by a consumer that got there before its producer, so the
+// producer moves on to another slot.
+#define TAKEN ((void*)1)
+
+// A retired segment's next pointer is stored inverted, so the scan doesn't
+// see it.  Otherwise each retired segment would keep the one after it
+// alive and the queue would free one segment per snapshot.  The inverted
+// value is never NULL, and it tells a thread still holding the segment
+// that the head has moved on.
+#define HIDE(seg) ((qsegment_t*)~(uintptr_t)(seg))
+#define IS_HIDDEN(seg) ((uintptr_t)(seg) > ~(uintptr_t)0 >> 1)
+
+typedef struct qsegment_t qsegment_t;
+
+struct qsegment_t {
+    size_t deqidx;
+    char pad0[64 - sizeof(size_t)];
+    void *items[SEGMENT];
+    size_t enqidx;
+    qsegment_t *next;
+};
+
+struct forkscan_ds_queue {
+    qsegment_t *head;
+    char pad0[64 - sizeof(qsegment_t*)];
+    qsegment_t *tail;
+    char pad1[64 - sizeof(qsegment_t*)];
+    struct forkscan_ds_reclaimer r;
+};
+
+/****************************************************************************/
+/*                             Helper functions                             */
+/****************************************************************************/
+
+/** A new segment, with item in its first slot if item isn't NULL.
+ */
+static qsegment_t *new_segment (void *item)
+{
+    qsegment_t *seg = forkscan_malloc(sizeof(qsegment_t));
+    if (seg == NULL) return NULL;
+    int i;
+    for (i = 0; i < SEGMENT; ++i) seg->items[i] = NULL;
+    seg->items[0] = item;
+    seg->deqidx = 0;
+    seg->enqidx = item ? 1 : 0;
+    seg->next = NULL;
+    return seg;
+}
+
+/****************************************************************************/
+/*                                Interface                                 */
+/****************************************************************************/
+
+forkscan_ds_queue_t *forkscan_ds_queue_create
+(const struct forkscan_ds_reclaimer *r)
+{
+    forkscan_ds_queue_t *q = forkscan_malloc(sizeof(forkscan_ds_queue_t));
+    if (q == NULL) return NULL;
+    q->head = q->tail = new_segment(NULL);
+    if (q->head == NULL) {
+        forkscan_free(q);
+        return NULL;
+    }
+    forkscan_ds_reclaimer_init(&q->r, r);
+    return q;
+}
+
+void forkscan_ds_queue_destroy (forkscan_ds_queue_t *q)
+{
+    qsegment_t *seg = q->head;
+    while (seg != NULL) {
+        qsegment_t *next = seg->next;
+        forkscan_free(seg);
+        seg = next;
+    }
+    forkscan_free(q);
+}
+
+int forkscan_ds_queue_enqueue (forkscan_ds_queue_t *q, void *item)
+{
+    assert(item != NULL && item != TAKEN);
+    for (;;) {
+        qsegment_t *tail = DS_LOAD(&q->tail);
+        size_t idx = __sync_fetch_and_add(&tail->enqidx, 1);
+        if (idx < SEGMENT) {
+            if (DS_CAS(&tail->items[idx], NULL, item)) return 0;
+            continue;
+        }
+
+        // The segment is full.  Append a new one with the item in it, or
+        // help whoever already did.
+        if (tail != DS_LOAD(&q->tail)) continue;
+        qsegment_t *next = DS_LOAD(&tail->next);
+        if (IS_HIDDEN(next)) {
+            // The segment was retired after we read the tail.  The head
+            // never passes the tail, so the tail has moved on already.
+            continue;
+        } else if (next == NULL) {
+            qsegment_t *seg = new_segment(item);
+            if (seg == NULL) return -1;
+            if (DS_CAS(&tail->next, NULL, seg)) {
+                DS_CAS(&q->tail, tail, seg);
+                return 0;
+            }
+            forkscan_free(seg);
+        } else {
+            DS_CAS(&q->tail, tail, next);
+        }
+    }
+}
+
+void *forkscan_ds_queue_dequeue (forkscan_ds_queue_t *q)
+{
+    for (;;) {
+        qsegment_t *head = DS_LOAD(&q->head);
+        if (DS_LOAD(&head->deqidx) >= DS_LOAD(&head->enqidx)
+            && DS_LOAD(&head->next) == NULL) {
+            return NULL;
+        }
+
+        size_t idx = __sync_fetch_and_add(&head->deqidx, 1);
+        if (idx >= SEGMENT) {
+            // Every slot has been claimed, so no one will touch this
+            // segment's items again.  Whoever moves the head past it
+            // retires it.
+            qsegment_t *next = DS_LOAD(&head->next);
+            if (next == NULL) return NULL;
+            if (IS_HIDDEN(next)) continue; // Somebody else moved the head.
+            // Don't leave the tail behind on a retired segment: a producer
+            // would still append to it.  Like Michael and Scott's queue,
+            // help the tail along first.
+            if (DS_LOAD(&q->tail) == head) DS_CAS(&q->tail, head, next);
+            if (DS_CAS(&q->head, head, next)) {
+                __atomic_store_n(&head->next, HIDE(next), __ATOMIC_RELEASE);
+                forkscan_ds_retire(&q->r, head);
+            }
+            continue;
+        }
+
+        void *item = __atomic_exchange_n(&head->items[idx], TAKEN,
+                                         __ATOMIC_SEQ_CST);
+        if (item != NULL) return item;
+    }
+}
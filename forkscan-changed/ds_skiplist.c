@@ -0,0 +1,254 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <assert.h>
+#include "ds.h"
+#include "include/forkscan.h"
+#include <limits.h>
+
+/****************************************************************************/
+/*                         Defines, typedefs, etc.                          */
+/****************************************************************************/
+
+#define MAX_LEVEL 24
+
+typedef struct snode_t snode_t;
+
+struct snode_t {
+    long key;
+    void *value;
+    int top;
+    uintptr_t next[];  // With DS_MARK once removed at that level.
+};
+
+struct forkscan_ds_skiplist {
+    snode_t *head;  // LONG_MIN
+    snode_t *tail;  // LONG_MAX
+    struct forkscan_ds_reclaimer r;
+};
+
+/****************************************************************************/
+/*                                 Globals                                  */
+/****************************************************************************/
+
+static __thread uint64_t t_level_seed;
+
+/****************************************************************************/
+/*                             Helper functions                             */
+/****************************************************************************/
+
+static snode_t *new_node (long key, void *value, int top)
+{
+    snode_t *node = forkscan_malloc(sizeof(snode_t)
+                                    + top * sizeof(node->next[0]));
+    if (node == NULL) return NULL;
+    node->key = key;
+    node->value = value;
+    node->top = top;
+    int i;
+    for (i = 0; i < top; ++i) node->next[i] = 0;
+    return node;
+}
+
+/** Geometric level with p = 1/2.
+ */
+static int random_level ()
+{
+    if (t_level_seed == 0) t_level_seed = (uintptr_t)&t_level_seed | 1;
+    t_level_seed ^= t_level_seed << 13;
+    t_level_seed ^= t_level_seed >> 7;
+    t_level_seed ^= t_level_seed << 17;
+    return 1 + __builtin_ctzll(t_level_seed | (1ULL << (MAX_LEVEL - 1)));
+}
+
+/** Fill preds and succs around key at every level, unlinking removed
+ *  nodes.  Return true if an unremoved node holding key was found.
+ */
+static int find (forkscan_ds_skiplist_t *sl, long key,
+                 snode_t **preds, snode_t **succs)
+{
+ retry:;
+    snode_t *pred = sl->head;
+    int lvl;
+    for (lvl = MAX_LEVEL - 1; lvl >= 0; --lvl) {
+        snode_t *cur = DS_PTR(DS_LOAD(&pred->next[lvl]));
+        for (;;) {
+            uintptr_t succ = DS_LOAD(&cur->next[lvl]);
+            while (succ & DS_MARK) {
+                if (!DS_CAS(&pred->next[lvl], (uintptr_t)cur,
+                            succ & ~DS_MARK)) {
+                    goto retry;
+                }
+                cur = DS_PTR(succ);
+                succ = DS_LOAD(&cur->next[lvl]);
+            }
+            if (cur->key >= key) break;
+            pred = cur;
+            cur = (snode_t*)succ;
+        }
+        preds[lvl] = pred;
+        succs[lvl] = cur;
+    }
+    return succs[0]->key == key;
+}
+
+/****************************************************************************/
+/*                                Interface                                 */
+/****************************************************************************/
+
+forkscan_ds_skiplist_t *forkscan_ds_skiplist_create
+(const struct forkscan_ds_reclaimer *r)
+{
+    forkscan_ds_skiplist_t *sl =
+        forkscan_malloc(sizeof(forkscan_ds_skiplist_t));
+    if (sl == NULL) return NULL;
+    sl->head = new_node(LONG_MIN, NULL, MAX_LEVEL);
+    sl->tail = new_node(LONG_MAX, NULL, MAX_LEVEL);
+    if (sl->head == NULL || sl->tail == NULL) {
+        if (sl->head) forkscan_free(sl->head);
+        if (sl->tail) forkscan_free(sl->tail);
+        forkscan_free(sl);
+        return NULL;
+    }
+    int i;
+    for (i = 0; i < MAX_LEVEL; ++i) sl->head->next[i] = (uintptr_t)sl->tail;
+    forkscan_ds_reclaimer_init(&sl->r, r);
+    return sl;
+}
+
+void forkscan_ds_skiplist_destroy (forkscan_ds_skiplist_t *sl)
+{
+    // Every node is on level 0, including the tail.
+    snode_t *node = sl->head;
+    while (node != NULL) {
+        snode_t *next = DS_PTR(node->next[0]);
+        forkscan_free(node);
+        node = next;
+    }
+    forkscan_free(sl);
+}
+
+int forkscan_ds_skiplist_insert (forkscan_ds_skiplist_t *sl, long key,
+                                 void *value)
+{
+    snode_t *preds[MAX_LEVEL], *succs[MAX_LEVEL];
+    snode_t *node = NULL;
+    assert(key != LONG_MIN && key != LONG_MAX);
+
+    for (;;) {
+        if (find(sl, key, preds, succs)) {
+            // Never published, so it can go straight back.
+            if (node) forkscan_free(node);
+            return 0;
+        }
+        if (node == NULL) {
+            node = new_node(key, value, random_level());
+            if (node == NULL) return -1;
+        }
+        int i;
+        for (i = 0; i < node->top; ++i) node->next[i] = (uintptr_t)succs[i];
+        if (DS_CAS(&preds[0]->next[0], (uintptr_t)succs[0],
+                   (uintptr_t)node)) {
+            break;
+        }
+    }
+
+    // Present from here on.  Link the upper levels, giving up as soon as a
+    // remover has started marking them.
+    int lvl;
+    for (lvl = 1; lvl < node->top; ++lvl) {
+        for (;;) {
+            uintptr_t next = DS_LOAD(&node->next[lvl]);
+            if (next & DS_MARK) return 1;
+            if (next != (uintptr_t)succs[lvl]
+                && !DS_CAS(&node->next[lvl], next, (uintptr_t)succs[lvl])) {
+                return 1;
+            }
+            if (DS_CAS(&preds[lvl]->next[lvl], (uintptr_t)succs[lvl],
+                       (uintptr_t)node)) {
+                break;
+            }
+            find(sl, key, preds, succs);
+            if (succs[0] != node) return 1;
+        }
+    }
+    return 1;
+}
+
+int forkscan_ds_skiplist_remove (forkscan_ds_skiplist_t *sl, long key,
+                                 void **value)
+{
+    snode_t *preds[MAX_LEVEL], *succs[MAX_LEVEL];
+    assert(key != LONG_MIN && key != LONG_MAX);
+
+    if (!find(sl, key, preds, succs)) return 0;
+    snode_t *node = succs[0];
+
+    int lvl;
+    for (lvl = node->top - 1; lvl >= 1; --lvl) {
+        uintptr_t next = DS_LOAD(&node->next[lvl]);
+        while (!(next & DS_MARK)) {
+            if (DS_CAS(&node->next[lvl], next, next | DS_MARK)) break;
+            next = DS_LOAD(&node->next[lvl]);
+        }
+    }
+
+    uintptr_t next = DS_LOAD(&node->next[0]);
+    for (;;) {
+        if (next & DS_MARK) return 0; // Someone else removed it.
+        if (DS_CAS(&node->next[0], next, next | DS_MARK)) break;
+        next = DS_LOAD(&node->next[0]);
+    }
+
+    // Newer nodes with the same key sit in front of this one, so search
+    // past the key to be sure it is gone from every level.
+    if (value) *value = node->value;
+    find(sl, key + 1, preds, succs);
+    forkscan_ds_retire(&sl->r, node);
+    return 1;
+}
+
+int forkscan_ds_skiplist_lookup (forkscan_ds_skiplist_t *sl, long key,
+                                 void **value)
+{
+    snode_t *pred = sl->head;
+    snode_t *cur = NULL;
+    int lvl;
+    assert(key != LONG_MIN && key != LONG_MAX);
+
+    for (lvl = MAX_LEVEL - 1; lvl >= 0; --lvl) {
+        cur = DS_PTR(DS_LOAD(&pred->next[lvl]));
+        for (;;) {
+            uintptr_t succ = DS_LOAD(&cur->next[lvl]);
+            while (succ & DS_MARK) {
+                cur = DS_PTR(succ);
+                succ = DS_LOAD(&cur->next[lvl]);
+            }
+            if (cur->key >= key) break;
+            pred = cur;
+            cur = (snode_t*)succ;
+        }
+    }
+    if (cur->key != key) return 0;
+    if (value) *value = cur->value;
+    return 1;
+}
@@ -22,6 +22,8 @@ THE SOFTWARE.
 
 #include "buffer.h"
 #include "env.h"
+#include <limits.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include "util.h"
 
@@ -31,14 +33,50 @@ THE SOFTWARE.
 #define MAX_PTRS_PER_THREAD (1024 * 1024)
 #define MIN_PTRS_PER_THREAD 1024
 
+#define DEFAULT_HEAP_RESERVE_GB 64
+
+#define DEFAULT_EPOCH_LIMBO 16
+
+#define DEFAULT_TAG_LOW_BITS 2
+
+#define DEFAULT_STACK_SIZE_KB 2048
+#define MAX_STACK_SIZE_KB (1024 * 1024)
+#define DEFAULT_STACK_POOL 16
+
 static const char env_ptrs_per_thread[] = "FORKSCAN_PTRS_PER_THREAD";
 
 static const char env_report_statistics[] = "FORKSCAN_REPORT_STATS";
 
+static const char env_report_regions[] = "FORKSCAN_REPORT_REGIONS";
+
 static const char env_throttling_queue[] = "FORKSCAN_THROTTLING_QUEUE";
 
 static const char env_max_children[] = "FORKSCAN_MAX_CHILDREN";
 
+static const char env_huge_pages[] = "FORKSCAN_HUGE_PAGES";
+
+static const char env_heap_reserve_gb[] = "FORKSCAN_HEAP_RESERVE_GB";
+
+static const char env_epoch[] = "FORKSCAN_EPOCH";
+
+static const char env_epoch_limbo[] = "FORKSCAN_EPOCH_LIMBO";
+
+static const char env_interior_pointers[] = "FORKSCAN_INTERIOR_POINTERS";
+
+static const char env_tag_low_bits[] = "FORKSCAN_TAG_LOW_BITS";
+
+static const char env_tag_high_bits[] = "FORKSCAN_TAG_HIGH_BITS";
+
+static const char env_tag_sign_extend[] = "FORKSCAN_TAG_SIGN_EXTEND";
+
+static const char env_retention[] = "FORKSCAN_RETENTION";
+
+static const char env_retire_sampling[] = "FORKSCAN_RETIRE_SAMPLING";
+
+static const char env_stack_size_kb[] = "FORKSCAN_STACK_SIZE_KB";
+
+static const char env_stack_pool[] = "FORKSCAN_STACK_POOL";
+
 // # of ptrs a thread can "save up" before initiating a collection run.
 // The number of pointers per thread should be a power of 2 because we use
 // this number to do masking (to avoid the costly modulo operation).
@@ -47,12 +85,57 @@ int g_forkscan_ptrs_per_thread;
 // Whether to report application statistics before the program terminates.
 int g_forkscan_report_statistics;
 
+// Whether the child reports bytes scanned per memory region.
+int g_forkscan_report_regions;
+
 // How many collects can queue up before user threads get throttled.
 int g_forkscan_throttling_queue;
 
 // Maximum number of children to fork to participate in a scan of memory.
 int g_forkscan_max_children;
 
+// Whether Forkscan's big internal buffers are backed by huge pages.
+int g_forkscan_huge_pages;
+
+// Address space reserved for the Forkscan heap, in GB.
+int g_forkscan_heap_reserve_gb;
+
+// Whether retirees are freed by epochs when possible.  Can be changed at
+// run time with forkscan_set_epoch_mode().
+volatile int g_forkscan_epoch_mode;
+
+// How many retirees a thread lets pile up waiting for a lagging reader
+// before it hands them to the scanner.
+int g_forkscan_epoch_limbo;
+
+// Whether the scan recognizes pointers into the middle of retirees, not just
+// to their base addresses.  Can be changed at run time with
+// forkscan_set_interior_pointers().
+volatile int g_forkscan_interior_pointers;
+
+// Tag bits the scan ignores in a word.  By default the two low-order bits,
+// which lock-free code commonly uses for marks.  Can be changed with
+// forkscan_set_tag_bits().
+volatile int g_forkscan_tag_low_bits;
+volatile int g_forkscan_tag_high_bits;
+volatile int g_forkscan_tag_sign_extend;
+
+// Every how many iterations the child samples survivors and finds what
+// refers to them.  0 turns the diagnostics off.
+int g_forkscan_retention;
+
+// Roughly one retire in this many is charged to its caller's return
+// address.  0 turns call-site profiling off.
+int g_forkscan_retire_sampling;
+
+// Stacks Forkscan allocates for threads are this many bytes, not counting
+// the guard page.
+size_t g_forkscan_stack_size;
+
+// Up to this many stacks of exited threads are kept, their pages discarded,
+// for new threads to reuse.
+int g_forkscan_stack_pool;
+
 /** Parse an integer from a string.  0 if val is NULL.
  */
 static int get_int (const char *val, int default_val)
@@ -111,6 +194,14 @@ static void env_init ()
         if (report_statistics != 0) g_forkscan_report_statistics = 1;
     }
 
+    {
+        int report_regions;
+        // Whether the child reports bytes scanned per region.  Printed with
+        // the statistics.
+        report_regions = get_int(getenv(env_report_regions), 0);
+        if (report_regions != 0) g_forkscan_report_regions = 1;
+    }
+
     {
         int throttling_queue;
         throttling_queue = get_int(getenv(env_throttling_queue),
@@ -136,4 +227,128 @@ static void env_init ()
         }
         g_forkscan_max_children = max_children;
     }
+
+    {
+        // 0 = off, 1 = transparent huge pages (default), 2 = explicit
+        // huge pages from the hugetlbfs reserve, with THP as a fallback.
+        int huge_pages;
+        huge_pages = get_int(getenv(env_huge_pages),
+                             HUGE_PAGES_TRANSPARENT);
+        if (huge_pages < HUGE_PAGES_OFF || huge_pages > HUGE_PAGES_EXPLICIT) {
+            forkscan_diagnostic("warning: %s = %s\n"
+                                "  Expected 0 (off), 1 (transparent), "
+                                "or 2 (explicit)\n",
+                                env_huge_pages,
+                                getenv(env_huge_pages));
+            huge_pages = HUGE_PAGES_TRANSPARENT;
+        }
+        g_forkscan_huge_pages = huge_pages;
+    }
+
+    {
+        // Only address space; memory is committed as it is used.
+        int heap_reserve_gb;
+        heap_reserve_gb = get_int(getenv(env_heap_reserve_gb),
+                                  DEFAULT_HEAP_RESERVE_GB);
+        if (heap_reserve_gb <= 0) {
+            heap_reserve_gb = DEFAULT_HEAP_RESERVE_GB;
+        }
+        g_forkscan_heap_reserve_gb = heap_reserve_gb;
+    }
+
+    {
+        int epoch;
+        // Free retirees by epochs when readers announce themselves, and
+        // fall back to scanning only when a reader lags.
+        epoch = get_int(getenv(env_epoch), 0);
+        if (epoch != 0) g_forkscan_epoch_mode = 1;
+    }
+
+    {
+        // In units of 1024 pointers, like FORKSCAN_PTRS_PER_THREAD.
+        int epoch_limbo;
+        epoch_limbo = get_int(getenv(env_epoch_limbo), DEFAULT_EPOCH_LIMBO);
+        if (epoch_limbo <= 0) {
+            epoch_limbo = DEFAULT_EPOCH_LIMBO;
+        }
+        if (epoch_limbo > MAX_PTRS_PER_THREAD / 1024) {
+            epoch_limbo = MAX_PTRS_PER_THREAD / 1024;
+        }
+        g_forkscan_epoch_limbo = epoch_limbo * 1024;
+    }
+
+    {
+        int interior_pointers;
+        interior_pointers = get_int(getenv(env_interior_pointers), 0);
+        if (interior_pointers != 0) g_forkscan_interior_pointers = 1;
+    }
+
+    {
+        // Retirees are at least 16-byte aligned, so up to 4 low bits can
+        // hold a tag.  x86-64 leaves the top 16 bits of a pointer unused.
+        int low_bits, high_bits, sign_extend;
+        low_bits = get_int(getenv(env_tag_low_bits), DEFAULT_TAG_LOW_BITS);
+        if (low_bits < 0 || low_bits > MAX_TAG_LOW_BITS) {
+            forkscan_diagnostic("warning: %s = %s\n"
+                                "  Expected 0 to %d\n",
+                                env_tag_low_bits,
+                                getenv(env_tag_low_bits),
+                                MAX_TAG_LOW_BITS);
+            low_bits = DEFAULT_TAG_LOW_BITS;
+        }
+        high_bits = get_int(getenv(env_tag_high_bits), 0);
+        if (high_bits < 0 || high_bits > MAX_TAG_HIGH_BITS) {
+            forkscan_diagnostic("warning: %s = %s\n"
+                                "  Expected 0 to %d\n",
+                                env_tag_high_bits,
+                                getenv(env_tag_high_bits),
+                                MAX_TAG_HIGH_BITS);
+            high_bits = 0;
+        }
+        sign_extend = get_int(getenv(env_tag_sign_extend), 0);
+        g_forkscan_tag_low_bits = low_bits;
+        g_forkscan_tag_high_bits = high_bits;
+        g_forkscan_tag_sign_extend = sign_extend != 0;
+    }
+
+    {
+        int retention;
+        // Each sampled iteration costs another scan of memory.
+        retention = get_int(getenv(env_retention), 0);
+        g_forkscan_retention = retention > 0 ? retention : 0;
+    }
+
+    {
+        int sampling;
+        sampling = get_int(getenv(env_retire_sampling), 0);
+        g_forkscan_retire_sampling = sampling > 0 ? sampling : 0;
+    }
+
+    {
+        // Only address space; a stack's pages are committed as the thread
+        // touches them.
+        int stack_size_kb;
+        stack_size_kb = get_int(getenv(env_stack_size_kb),
+                                DEFAULT_STACK_SIZE_KB);
+        if (stack_size_kb < PTHREAD_STACK_MIN / 1024
+            || stack_size_kb > MAX_STACK_SIZE_KB) {
+            forkscan_diagnostic("warning: %s = %s\n"
+                                "  Expected %d to %d\n",
+                                env_stack_size_kb,
+                                getenv(env_stack_size_kb),
+                                (int)(PTHREAD_STACK_MIN / 1024),
+                                MAX_STACK_SIZE_KB);
+            stack_size_kb = DEFAULT_STACK_SIZE_KB;
+        }
+        g_forkscan_stack_size = (stack_size_kb * (size_t)1024 + PAGESIZE - 1)
+            & ~(PAGESIZE - 1);
+    }
+
+    {
+        int stack_pool;
+        stack_pool = get_int(getenv(env_stack_pool), DEFAULT_STACK_POOL);
+        if (stack_pool < 0) stack_pool = 0;
+        if (stack_pool > MAX_STACK_POOL) stack_pool = MAX_STACK_POOL;
+        g_forkscan_stack_pool = stack_pool;
+    }
 }
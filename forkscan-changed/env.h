@@ -23,8 +23,14 @@ THE SOFTWARE.
 #ifndef _ENV_H_
 #define _ENV_H_ 1
 
+#include <stddef.h>
+
 #define MAX_THREAD_COUNT 256
 
+// Reclamation domains, counting domain 0, the default per-thread retire
+// queues.  Must be a power of 2, no more than 8.
+#define MAX_DOMAINS 8
+
 // # of ptrs a thread can "save up" before initiating a collection run.
 // The number of pointers per thread should be a power of 2 because we use
 // this number to do masking (to avoid the costly modulo operation).
@@ -33,10 +39,52 @@ extern int g_forkscan_ptrs_per_thread;
 // Whether to report application statistics before the program terminates.
 extern int g_forkscan_report_statistics;
 
+// Whether the child reports bytes scanned per memory region.
+extern int g_forkscan_report_regions;
+
 // How many collects can queue up before user threads get throttled.
 extern int g_forkscan_throttling_queue;
 
 // Maximum number of children to fork to participate in a scan of memory.
 extern int g_forkscan_max_children;
 
+// Whether Forkscan's big internal buffers are backed by huge pages.
+enum { HUGE_PAGES_OFF,          // Plain 4K pages.
+       HUGE_PAGES_TRANSPARENT,  // 2 MB-aligned and madvise()'d for THP.
+       HUGE_PAGES_EXPLICIT };   // MAP_HUGETLB, falling back to THP.
+extern int g_forkscan_huge_pages;
+
+// Address space reserved for the Forkscan heap, in GB.
+extern int g_forkscan_heap_reserve_gb;
+
+// Whether forkscan_retire() frees through the epoch fast path.
+extern volatile int g_forkscan_epoch_mode;
+
+// Retirees a thread holds in epoch limbo before handing them to the scanner.
+extern int g_forkscan_epoch_limbo;
+
+// Whether a pointer into the middle of a retiree keeps it alive.
+extern volatile int g_forkscan_interior_pointers;
+
+// Tag bits stripped from scanned words before they're compared with
+// retirees: this many low bits and high bits, and whether the high bits are
+// replaced by sign extension instead of zeros.
+#define MAX_TAG_LOW_BITS 4
+#define MAX_TAG_HIGH_BITS 16
+extern volatile int g_forkscan_tag_low_bits;
+extern volatile int g_forkscan_tag_high_bits;
+extern volatile int g_forkscan_tag_sign_extend;
+
+// Sample why retirees survive every this many iterations (0 = never).
+extern int g_forkscan_retention;
+
+// Sample about one retire in this many by call site (0 = never).
+extern int g_forkscan_retire_sampling;
+
+// Size in bytes of the stacks Forkscan gives new threads, and how many
+// stacks of exited threads are kept for reuse.
+#define MAX_STACK_POOL MAX_THREAD_COUNT
+extern size_t g_forkscan_stack_size;
+extern int g_forkscan_stack_pool;
+
 #endif // !defined _ENV_H_
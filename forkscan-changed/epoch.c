@@ -0,0 +1,393 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "alloc.h"
+#include <assert.h>
+#include "env.h"
+#include "epoch.h"
+#include "include/forkscan.h"
+#include "metautil.h"
+#include <pthread.h>
+#include "util.h"
+
+/****************************************************************************/
+/*                         Defines, typedefs, etc.                          */
+/****************************************************************************/
+
+#define EPOCH_BAG_SIZE PAGESIZE
+#define EPOCH_BAG_PTRS                                                  \
+    ((EPOCH_BAG_SIZE - 3 * sizeof(size_t)) / sizeof(void*))
+
+// A thread tries to advance the epoch this often, in retirees.  It also
+// tries whenever a bag fills.
+#define ADVANCE_INTERVAL 64
+
+// Slot value of a thread outside any critical section.
+#define QUIESCENT 0
+
+typedef struct epoch_bag_t epoch_bag_t;
+typedef struct epoch_slot_t epoch_slot_t;
+
+/** A batch of one thread's retirees from one epoch.  An epoch that sees
+ *  many retirees gets a chain of them.  Bags are Forkscan's own memory, so
+ *  the scan never sees the pointers in them.
+ */
+struct epoch_bag_t {
+    epoch_bag_t *next;
+    size_t epoch;
+    size_t n;
+    void *ptrs[EPOCH_BAG_PTRS];
+};
+
+/** A thread's announced epoch, on its own cache line.
+ */
+struct epoch_slot_t {
+    volatile size_t epoch;
+    volatile int in_use;
+    char pad[CACHELINESIZE - sizeof(size_t) - sizeof(int)];
+};
+
+/****************************************************************************/
+/*                                 Globals                                  */
+/****************************************************************************/
+
+DEFINE_POOL_ALLOC(epochbag, EPOCH_BAG_SIZE, 16,
+                  forkscan_alloc_mmap_parent)
+
+// Starts at 1 so that no live epoch looks QUIESCENT.
+static volatile size_t g_epoch = 1;
+
+static epoch_slot_t g_slots[MAX_THREAD_COUNT]
+__attribute__((aligned(CACHELINESIZE)));
+static volatile int g_n_slots;
+
+// Bags left behind by exited threads, freed by whoever advances the epoch.
+static epoch_bag_t *g_orphans;
+static pthread_mutex_t g_orphans_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static volatile size_t g_freed, g_handed_off;
+
+static __thread int t_slot = -1;
+static __thread int t_depth;
+static __thread size_t t_n_retired;
+static __thread epoch_bag_t *t_bags[3];  // Chains, one per live epoch.
+static __thread size_t t_limbo;          // Pointers in t_bags.
+static __thread epoch_bag_t *t_stalled;
+
+/****************************************************************************/
+/*                            Helper functions.                             */
+/****************************************************************************/
+
+static epoch_slot_t *get_slot ()
+{
+    int i;
+
+    if (t_slot >= 0) return &g_slots[t_slot];
+
+    for (i = 0; i < MAX_THREAD_COUNT; ++i) {
+        if (0 == g_slots[i].in_use
+            && __sync_bool_compare_and_swap(&g_slots[i].in_use, 0, 1)) {
+            break;
+        }
+    }
+    if (i == MAX_THREAD_COUNT) {
+        forkscan_fatal("Out of epoch slots (max %d threads).\n",
+                       MAX_THREAD_COUNT);
+    }
+    t_slot = i;
+
+    int n;
+    while ((n = g_n_slots) <= i) {
+        __sync_bool_compare_and_swap(&g_n_slots, n, i + 1);
+    }
+    return &g_slots[i];
+}
+
+static void release_bag (epoch_bag_t *b)
+{
+    size_t i;
+    for (i = 0; i < b->n; i += RELEASE_BATCH) {
+        forkscan_util_release_batch(&b->ptrs[i],
+                                    MIN_OF(RELEASE_BATCH, b->n - i));
+    }
+    __sync_fetch_and_add(&g_freed, b->n);
+    b->n = 0;
+}
+
+/** Free the orphaned bags that are safe at epoch e.
+ */
+static void free_orphans (size_t e)
+{
+    epoch_bag_t *b, **prev, *safe = NULL;
+
+    if (0 != pthread_mutex_trylock(&g_orphans_lock)) return;
+    prev = &g_orphans;
+    while (NULL != (b = *prev)) {
+        if (b->epoch + 2 <= e) {
+            *prev = b->next;
+            b->next = safe;
+            safe = b;
+        } else prev = &b->next;
+    }
+    pthread_mutex_unlock(&g_orphans_lock);
+
+    while (NULL != (b = safe)) {
+        safe = b->next;
+        release_bag(b);
+        pool_free_epochbag(b);
+    }
+}
+
+/** Advance the global epoch if every thread in a critical section has
+ *  seen the current one.  Returns the epoch afterwards.
+ */
+static size_t try_advance ()
+{
+    size_t e = g_epoch;
+    int i, n = g_n_slots;
+
+    for (i = 0; i < n; ++i) {
+        size_t announced = g_slots[i].epoch;
+        if (QUIESCENT != announced && announced != e) return e;
+    }
+    if (__sync_bool_compare_and_swap(&g_epoch, e, e + 1)) {
+        if (g_orphans) free_orphans(e + 1);
+    }
+    return g_epoch;
+}
+
+/** Free the calling thread's chains that are safe at epoch e.  The first
+ *  bag of each chain is kept for reuse.
+ */
+static void free_safe_bags (size_t e)
+{
+    int i;
+    for (i = 0; i < 3; ++i) {
+        epoch_bag_t *b = t_bags[i], *next;
+        if (NULL == b || 0 == b->n || b->epoch + 2 > e) continue;
+        t_limbo -= b->n;
+        release_bag(b);
+        next = b->next;
+        b->next = NULL;
+        while (NULL != (b = next)) {
+            next = b->next;
+            t_limbo -= b->n;
+            release_bag(b);
+            pool_free_epochbag(b);
+        }
+    }
+}
+
+/** Move every non-empty chain to the stalled list.
+ */
+static void stall_bags ()
+{
+    int i;
+    for (i = 0; i < 3; ++i) {
+        epoch_bag_t *b = t_bags[i], *tail;
+        if (NULL == b || 0 == b->n) continue;
+        for (tail = b; tail->next; tail = tail->next);
+        tail->next = t_stalled;
+        t_stalled = b;
+        t_bags[i] = NULL;
+    }
+    t_limbo = 0;
+}
+
+/****************************************************************************/
+/*                           Internal interface                             */
+/****************************************************************************/
+
+/**
+ * Put ptr in the calling thread's limbo bag for the current epoch and free
+ * any bags that are now safe.  Returns 1 if some bags are stalled and
+ * should be handed off with forkscan_epoch_handoff(), zero otherwise.
+ */
+int forkscan_epoch_retire (void *ptr)
+{
+    size_t e = g_epoch;
+    epoch_bag_t *b;
+
+    // The bag for this epoch last held epoch e - 3 or older, so it's safe.
+    free_safe_bags(e);
+
+    b = t_bags[e % 3];
+    if (NULL == b || b->n == EPOCH_BAG_PTRS) {
+        epoch_bag_t *full = b;
+        b = t_bags[e % 3] = (epoch_bag_t*)pool_alloc_epochbag();
+        b->next = full;
+        b->n = 0;
+    }
+    assert(0 == b->n || b->epoch == e);
+    b->epoch = e;
+    b->ptrs[b->n++] = ptr;
+    ++t_limbo;
+
+    if (++t_n_retired % ADVANCE_INTERVAL == 0) {
+        free_safe_bags(try_advance());
+    }
+
+    if (t_limbo >= (size_t)g_forkscan_epoch_limbo) {
+        free_safe_bags(try_advance());
+        if (t_limbo >= (size_t)g_forkscan_epoch_limbo) {
+            // The epoch won't move: somebody is lagging.  Give up on
+            // waiting for them and let the scanner prove these are dead.
+            stall_bags();
+        }
+    }
+
+    return NULL != t_stalled;
+}
+
+/**
+ * Try to advance the epoch far enough to free all of the calling thread's
+ * limbo bags.  Whatever is left is marked stalled.  Returns 1 if there is
+ * anything to hand off, zero otherwise.
+ */
+int forkscan_epoch_flush ()
+{
+    size_t e;
+    int i;
+
+    // Two steps frees everything, if no reader is in the way.
+    for (i = 0; i < 2; ++i) {
+        e = try_advance();
+        free_safe_bags(e);
+    }
+    stall_bags();
+    return NULL != t_stalled;
+}
+
+/**
+ * Return 1 if the calling thread has pointers in its limbo bags or stalled
+ * bags, zero otherwise.
+ */
+int forkscan_epoch_pending ()
+{
+    return t_limbo > 0 || NULL != t_stalled;
+}
+
+/**
+ * Pass every pointer in the calling thread's stalled bags to retire, and
+ * recycle the bags.  Must not be called from inside the allocator, since
+ * retire may wait on a reclamation iteration.
+ */
+void forkscan_epoch_handoff (void (*retire) (void *ptr))
+{
+    epoch_bag_t *b;
+
+    while (NULL != (b = t_stalled)) {
+        size_t i;
+        t_stalled = b->next;
+        for (i = 0; i < b->n; ++i) retire(b->ptrs[i]);
+        __sync_fetch_and_add(&g_handed_off, b->n);
+        pool_free_epochbag(b);
+    }
+}
+
+/**
+ * Give the exiting thread's limbo bags to whoever advances the epoch next,
+ * and release its announcement slot.
+ */
+void forkscan_epoch_thread_exit ()
+{
+    epoch_bag_t *b, *mine = NULL, *last = NULL;
+    int i;
+
+    stall_bags();
+    while (NULL != (b = t_stalled)) {
+        t_stalled = b->next;
+        b->next = mine;
+        mine = b;
+        if (NULL == last) last = b;
+    }
+    for (i = 0; i < 3; ++i) {
+        // Only empty bags are left.
+        if (t_bags[i]) pool_free_epochbag(t_bags[i]);
+        t_bags[i] = NULL;
+    }
+
+    if (mine) {
+        pthread_mutex_lock(&g_orphans_lock);
+        last->next = g_orphans;
+        g_orphans = mine;
+        pthread_mutex_unlock(&g_orphans_lock);
+    }
+
+    if (t_slot >= 0) {
+        g_slots[t_slot].epoch = QUIESCENT;
+        __sync_synchronize();
+        g_slots[t_slot].in_use = 0;
+        t_slot = -1;
+    }
+    t_depth = 0;
+}
+
+size_t forkscan_epoch_freed ()
+{
+    return g_freed;
+}
+
+size_t forkscan_epoch_handed_off ()
+{
+    return g_handed_off;
+}
+
+/****************************************************************************/
+/*                            Exported functions                            */
+/****************************************************************************/
+
+/**
+ * Begin a read-side critical section.  See forkscan.h.
+ */
+__attribute__((visibility("default")))
+void forkscan_enter ()
+{
+    if (0 == t_depth++) {
+        epoch_slot_t *slot = get_slot();
+        // The announcement has to be visible before we read any shared
+        // pointer, or a retirer could miss us.
+        __atomic_store_n(&slot->epoch, g_epoch, __ATOMIC_SEQ_CST);
+    }
+}
+
+/**
+ * End a read-side critical section.  See forkscan.h.
+ */
+__attribute__((visibility("default")))
+void forkscan_exit ()
+{
+    assert(t_depth > 0);
+    if (0 == --t_depth) {
+        __atomic_store_n(&g_slots[t_slot].epoch, QUIESCENT,
+                         __ATOMIC_RELEASE);
+    }
+}
+
+/**
+ * Turn the epoch fast path on (1) or off (0).  See forkscan.h.
+ */
+__attribute__((visibility("default")))
+void forkscan_set_epoch_mode (int enable)
+{
+    g_forkscan_epoch_mode = enable != 0;
+}
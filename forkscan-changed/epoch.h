@@ -0,0 +1,79 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/* Module Description:
+   Epoch-based fast path.  Threads that announce their critical sections
+   with forkscan_enter()/forkscan_exit() let retirees be freed as soon as
+   the global epoch has moved two steps past them, with no fork and no
+   scan.  Each thread keeps three limbo bags, one per live epoch.  When a
+   bag fills and the epoch can't advance because some reader is lagging,
+   the bag is marked stalled and the frontend hands its pointers to the
+   regular Forkscan retire queue, so a stalled reader never holds up
+   reclamation for long.
+ */
+
+#ifndef _EPOCH_H_
+#define _EPOCH_H_
+
+#include <stddef.h>
+
+/**
+ * Put ptr in the calling thread's limbo bag for the current epoch and free
+ * any bags that are now safe.  Returns 1 if some bags are stalled and
+ * should be handed off with forkscan_epoch_handoff(), zero otherwise.
+ */
+int forkscan_epoch_retire (void *ptr);
+
+/**
+ * Try to advance the epoch far enough to free all of the calling thread's
+ * limbo bags.  Whatever is left is marked stalled.  Returns 1 if there is
+ * anything to hand off, zero otherwise.
+ */
+int forkscan_epoch_flush ();
+
+/**
+ * Return 1 if the calling thread has pointers in its limbo bags or stalled
+ * bags, zero otherwise.
+ */
+int forkscan_epoch_pending ();
+
+/**
+ * Pass every pointer in the calling thread's stalled bags to retire, and
+ * recycle the bags.  Must not be called from inside the allocator, since
+ * retire may wait on a reclamation iteration.
+ */
+void forkscan_epoch_handoff (void (*retire) (void *ptr));
+
+/**
+ * Give the exiting thread's limbo bags to whoever advances the epoch next,
+ * and release its announcement slot.
+ */
+void forkscan_epoch_thread_exit ();
+
+/**
+ * Statistics: pointers freed by the fast path, and pointers handed off to
+ * the scanner.
+ */
+size_t forkscan_epoch_freed ();
+size_t forkscan_epoch_handed_off ();
+
+#endif // !defined _EPOCH_H_
@@ -0,0 +1,248 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <assert.h>
+#include "finalize.h"
+#include <pthread.h>
+#include <stdint.h>
+#include "util.h"
+
+/****************************************************************************/
+/*                         Defines, typedefs, etc.                          */
+/****************************************************************************/
+
+#define MAX_FINALIZER_FNS 256
+
+#define STRIPE_BITS 8
+#define BUCKETS_PER_STRIPE_BITS 6
+#define N_STRIPES (1 << STRIPE_BITS)
+#define BUCKETS_PER_STRIPE (1 << BUCKETS_PER_STRIPE_BITS)
+
+typedef struct fin_node_t fin_node_t;
+
+/** Side table entry.  Nodes live in the scanned heap so ctx keeps whatever
+ *  it points to alive.  The key is the complement of the object's address
+ *  so the entry itself doesn't.
+ */
+struct fin_node_t {
+    fin_node_t *next;
+    size_t key;
+    void *ctx;
+    uint8_t fn;
+};
+
+typedef struct stripe_t stripe_t;
+
+struct stripe_t {
+    pthread_mutex_t lock;
+    fin_node_t *buckets[BUCKETS_PER_STRIPE];
+} __attribute__((aligned(64)));
+
+typedef struct pending_t pending_t;
+
+struct pending_t {
+    void *ptr;
+    void *ctx;
+    int fn;
+};
+
+/****************************************************************************/
+/*                                 Globals                                  */
+/****************************************************************************/
+
+volatile size_t g_finalizers_pending;
+
+static forkscan_finalizer_t g_fns[MAX_FINALIZER_FNS];
+static volatile int g_n_fns;
+static pthread_mutex_t g_fns_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static stripe_t g_stripes[N_STRIPES];
+
+static __thread int t_in_finalizer;
+static __thread fin_node_t *t_deferred;
+
+/****************************************************************************/
+/*                            Helper functions.                             */
+/****************************************************************************/
+
+__attribute__((constructor))
+static void finalize_init ()
+{
+    int i;
+    for (i = 0; i < N_STRIPES; ++i) {
+        pthread_mutex_init(&g_stripes[i].lock, NULL);
+    }
+}
+
+/** Return the index of fn in the function table, adding it if needed.  -1
+ *  if the table is full.
+ */
+static int intern_fn (forkscan_finalizer_t fn)
+{
+    int i, n = g_n_fns;
+
+    for (i = 0; i < n; ++i) {
+        if (g_fns[i] == fn) return i;
+    }
+
+    pthread_mutex_lock(&g_fns_lock);
+    for (i = 0; i < g_n_fns; ++i) {
+        if (g_fns[i] == fn) break;
+    }
+    if (i == g_n_fns) {
+        if (i == MAX_FINALIZER_FNS) {
+            i = -1;
+        } else {
+            g_fns[i] = fn;
+            __sync_synchronize();
+            ++g_n_fns;
+        }
+    }
+    pthread_mutex_unlock(&g_fns_lock);
+
+    return i;
+}
+
+static inline size_t hash (size_t addr)
+{
+    return ((addr >> 4) * 0x9E3779B97F4A7C15ULL)
+        >> (64 - STRIPE_BITS - BUCKETS_PER_STRIPE_BITS);
+}
+
+/** Remove the entry for ptr from the side table and return it, or NULL.
+ */
+static fin_node_t *take (void *ptr)
+{
+    size_t h = hash((size_t)ptr);
+    stripe_t *stripe = &g_stripes[h >> BUCKETS_PER_STRIPE_BITS];
+    fin_node_t **prev, *node;
+
+    pthread_mutex_lock(&stripe->lock);
+    prev = &stripe->buckets[h & (BUCKETS_PER_STRIPE - 1)];
+    for (node = *prev; NULL != node; prev = &node->next, node = *prev) {
+        if (node->key == ~(size_t)ptr) {
+            *prev = node->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&stripe->lock);
+
+    return node;
+}
+
+/****************************************************************************/
+/*                                Interface                                 */
+/****************************************************************************/
+
+/**
+ * Record that fn(ptr, ctx) should run before ptr is freed.  Returns zero on
+ * success, non-zero if too many distinct finalizer functions are in use.
+ */
+int forkscan_finalize_register (void *ptr, forkscan_finalizer_t fn,
+                                void *ctx)
+{
+    int idx = intern_fn(fn);
+    if (idx < 0) return -1;
+
+    fin_node_t *node = (fin_node_t*)MALLOC(sizeof(fin_node_t));
+    node->key = ~(size_t)ptr;
+    node->ctx = ctx;
+    node->fn = (uint8_t)idx;
+
+    size_t h = hash((size_t)ptr);
+    stripe_t *stripe = &g_stripes[h >> BUCKETS_PER_STRIPE_BITS];
+    pthread_mutex_lock(&stripe->lock);
+    node->next = stripe->buckets[h & (BUCKETS_PER_STRIPE - 1)];
+    stripe->buckets[h & (BUCKETS_PER_STRIPE - 1)] = node;
+    pthread_mutex_unlock(&stripe->lock);
+
+    __sync_fetch_and_add(&g_finalizers_pending, 1);
+    return 0;
+}
+
+/**
+ * Run the finalizers registered for any of the n pointers in ptrs.  Called
+ * on reclaimed pointers just before they are released.
+ */
+void forkscan_finalize_run (void **ptrs, size_t n)
+{
+    pending_t pending[RELEASE_BATCH];
+    size_t i, n_pending = 0;
+
+    assert(n <= RELEASE_BATCH);
+
+    // Pull all the entries first so the stripe locks aren't held, and
+    // aren't retaken, while user code runs.
+    for (i = 0; i < n; ++i) {
+        fin_node_t *node = take(ptrs[i]);
+        if (NULL == node) continue;
+        pending[n_pending].ptr = ptrs[i];
+        pending[n_pending].ctx = node->ctx;
+        pending[n_pending].fn = node->fn;
+        ++n_pending;
+        FREE(node);
+    }
+    if (0 == n_pending) return;
+    __sync_fetch_and_sub(&g_finalizers_pending, n_pending);
+
+    ++t_in_finalizer;
+    for (i = 0; i < n_pending; ++i) {
+        g_fns[pending[i].fn](pending[i].ptr, pending[i].ctx);
+    }
+    --t_in_finalizer;
+}
+
+/**
+ * Return 1 if the calling thread is running finalizers, zero otherwise.
+ */
+int forkscan_finalize_in_progress ()
+{
+    return t_in_finalizer > 0;
+}
+
+/**
+ * Queue a pointer that a finalizer retired.  It is handed to the retire
+ * path once the finalizers are done.
+ */
+void forkscan_finalize_defer_retire (void *ptr)
+{
+    fin_node_t *node = (fin_node_t*)MALLOC(sizeof(fin_node_t));
+    node->key = ~(size_t)ptr;
+    node->next = t_deferred;
+    t_deferred = node;
+}
+
+/**
+ * Pop a pointer queued by forkscan_finalize_defer_retire(), or return NULL
+ * if there is none.
+ */
+void *forkscan_finalize_pop_deferred ()
+{
+    fin_node_t *node = t_deferred;
+    void *ptr;
+
+    if (NULL == node) return NULL;
+    t_deferred = node->next;
+    ptr = (void*)~node->key;
+    FREE(node);
+    return ptr;
+}
@@ -0,0 +1,73 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/* Module Description:
+   Finalizers for retired objects.  forkscan_retire_with_finalizer() records
+   a (function, context) pair for an object in a side table keyed by its
+   address, and the thread that eventually frees the object runs the
+   function first, while the object's contents are still intact.  Function
+   pointers are interned in a small table so each entry only carries an
+   index.  Nothing is looked up on the free path unless some finalizer is
+   pending.
+ */
+
+#ifndef _FINALIZE_H_
+#define _FINALIZE_H_
+
+#include <stddef.h>
+
+typedef void (*forkscan_finalizer_t) (void *ptr, void *ctx);
+
+// Number of finalizers that have been registered but not run.
+extern volatile size_t g_finalizers_pending;
+
+/**
+ * Record that fn(ptr, ctx) should run before ptr is freed.  Returns zero on
+ * success, non-zero if too many distinct finalizer functions are in use.
+ */
+int forkscan_finalize_register (void *ptr, forkscan_finalizer_t fn,
+                                void *ctx);
+
+/**
+ * Run the finalizers registered for any of the n pointers in ptrs.  Called
+ * on reclaimed pointers just before they are released.
+ */
+void forkscan_finalize_run (void **ptrs, size_t n);
+
+/**
+ * Return 1 if the calling thread is running finalizers, zero otherwise.
+ */
+int forkscan_finalize_in_progress ();
+
+/**
+ * Queue a pointer that a finalizer retired.  It is handed to the retire
+ * path once the finalizers are done.
+ */
+void forkscan_finalize_defer_retire (void *ptr);
+
+/**
+ * Pop a pointer queued by forkscan_finalize_defer_retire(), or return NULL
+ * if there is none.
+ */
+void *forkscan_finalize_pop_deferred ();
+
+#endif // !defined _FINALIZE_H_
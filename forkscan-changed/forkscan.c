@@ -24,20 +24,30 @@ THE SOFTWARE.
 #include "avl.h"
 #include "alloc.h"
 #include <assert.h>
+#include "callsite.h"
 #include "child.h"
+#include "domain.h"
 #include "env.h"
+#include "epoch.h"
 #include <fcntl.h>
 #include "forkscan.h"
 #include <malloc.h>
+#include "policy.h"
 #include "proc.h"
 #include <pthread.h>
 #include "queue.h"
+#include "retention.h"
+#include "snapshot.h"
 #include <setjmp.h>
 #include <stdio.h>
+#include "stats.h"
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/time.h>
 #include "thread.h"
+#include <time.h>
+#include "trace.h"
 #include <unistd.h>
 #include "util.h"
 
@@ -89,28 +99,26 @@ static pthread_mutex_t g_client_waiting_lock;
 static pthread_cond_t g_client_waiting_cond;
 
 static volatile int g_received_signal;
-static volatile size_t g_cleanup_counter;
 static enum { GC_NOT_WAITING,
               GC_WAITING_FOR_WORK } g_gc_waiting = GC_WAITING_FOR_WORK;
-static size_t g_scan_max;
-static double g_total_fork_time;
 static pid_t child_pid;
 
-size_t g_total_wait_time_ms = 0;
 
-static void generate_minimap (addr_buffer_t *ab)
-{
-    size_t i;
+// Submissions of retired pointers to the GC thread are numbered from 1.
+// A submission is complete once an iteration has scanned it.
+volatile size_t g_submit_seq;
+volatile size_t g_completed_seq;
 
-    assert(ab);
-    assert(ab->addrs);
-    assert(ab->minimap);
+volatile size_t g_cleanup_counter;
 
-    ab->n_minimap = 0;
-    for (i = 0; i < ab->n_addrs; i += (PAGESIZE / sizeof(size_t))) {
-        ab->minimap[ab->n_minimap] = ab->addrs[i];
-        ++ab->n_minimap;
-    }
+
+/** Minor page faults taken by the whole process so far.
+ */
+static size_t minor_faults ()
+{
+    struct rusage ru;
+    if (0 != getrusage(RUSAGE_SELF, &ru)) return 0;
+    return ru.ru_minflt;
 }
 
 static addr_buffer_t *aggregate_addrs (addr_buffer_t *old,
@@ -164,10 +172,37 @@ static void reclaim_iteration (addr_buffer_t *ab)
 {
     addr_buffer_t *working_data;
     addr_buffer_t *deadrefs = NULL;
+    addr_buffer_t *tmp;
     int sig_count;
     int pipefd[2];
+    size_t n_addrs = g_uncollected_data ? g_uncollected_data->n_addrs : 0;
+    size_t seq = ab->seq; // ab is the newest submission.
+
+    for (tmp = ab; tmp != NULL; tmp = tmp->next) n_addrs += tmp->n_addrs;
+    if (0 == n_addrs) {
+        // Nothing to do.  This happens when a reclaim is forced just to make
+        // sure earlier submissions are complete.
+        while (ab) {
+            tmp = ab->next;
+            forkscan_release_buffer(ab);
+            ab = tmp;
+        }
+        return;
+    }
+
+    TRACE(ITERATION, TRACE_BEGIN, n_addrs);
+
+    // Count the new retirees before they're freed out from under us.
+    iteration_stats_t it = { 0 };
+    it.retired = n_addrs;
+    if (g_uncollected_data) it.retired -= g_uncollected_data->n_addrs;
+    for (tmp = ab; tmp != NULL; tmp = tmp->next) {
+        it.retired_bytes +=
+            forkscan_backend_usable_bytes((void**)tmp->addrs, tmp->n_addrs);
+    }
 
     working_data = aggregate_addrs(g_uncollected_data, ab);
+    working_data->seq = seq;
     g_uncollected_data = NULL;
 
     // Open a pipe for communication between parent and child.
@@ -177,44 +212,77 @@ static void reclaim_iteration (addr_buffer_t *ab)
 
     // Send out signals.  When everybody is waiting at the line, fork the
     // process for the snapshot.
-    size_t start, end;
+    uint64_t start, signaled, quiesced, forked;
+    forkscan_policy_prepare_report();
+    forkscan_retention_prepare();
+    forkscan_snapshot_prepare();
+    // The child can't allocate, so it gets its memory now.  Once the other
+    // threads are stopped, one of them may hold forkscan_alloc_mmap()'s lock.
+    forkscan_child_prepare(working_data->n_addrs
+                           + forkscan_buffer_dead_references_capacity());
+    working_data->root_scan_ns = working_data->mark_ns = 0;
+    working_data->started_ns = 0;
     g_received_signal = 0;
-    start = forkscan_rdtsc();
+    start = forkscan_util_nanotime();
     sig_count = forkscan_proc_signal(SIGFORKSCAN);
+    signaled = forkscan_util_nanotime();
+    TRACE(SIGNAL, TRACE_INSTANT, sig_count);
+    TRACE(QUIESCE, TRACE_BEGIN, 0);
     while (g_received_signal < sig_count) pthread_yield();
+    quiesced = forkscan_util_nanotime();
+    TRACE(QUIESCE, TRACE_END, 0);
     deadrefs = forkscan_buffer_get_dead_references();
+    TRACE(FORK, TRACE_BEGIN, 0);
     child_pid = fork();
 
     if (child_pid == -1) {
         forkscan_fatal("Collection failed (fork).\n");
     } else if (child_pid == 0) {
+        working_data->started_ns = forkscan_util_nanotime();
+        forkscan_trace_forked();
+
         // Sort the addresses and generate the minimap for the scanner.
+        TRACE(SORT, TRACE_BEGIN, working_data->n_addrs);
+        uint64_t sort_start = forkscan_util_nanotime();
         forkscan_util_avl_sort(working_data->addrs, working_data->n_addrs);
         assert_monotonicity(working_data->addrs, working_data->n_addrs);
-        generate_minimap(working_data);
+        forkscan_buffer_generate_minimap(working_data);
         if (deadrefs->n_addrs > 1) {
             // No minimap for deadrefs.
             forkscan_util_avl_sort(deadrefs->addrs, deadrefs->n_addrs);
             assert_monotonicity(deadrefs->addrs, deadrefs->n_addrs);
         }
+        working_data->sort_ns = forkscan_util_nanotime() - sort_start;
+        TRACE(SORT, TRACE_END, 0);
 
         // Child: Scan memory, pass pointers back to the parent to free, pass
         // remaining pointers back, and exit.
         close(pipefd[PIPE_READ]);
         forkscan_child(working_data, deadrefs, pipefd[PIPE_WRITE]);
         close(pipefd[PIPE_WRITE]);
-        exit(0);
+        // _exit(), so the child doesn't flush the stdio buffers it
+        // inherited.  The parent will.
+        _exit(0);
     }
 
     ++g_cleanup_counter;
     close(pipefd[PIPE_WRITE]);
-    end = forkscan_rdtsc();
-    g_total_fork_time += end - start;
+    forked = forkscan_util_nanotime();
+    TRACE(FORK, TRACE_END, child_pid);
+    size_t faults = minor_faults();
+    it.pause_ns = forked - start;
+    forkscan_record_phase(PHASE_SIGNAL, signaled - start);
+    forkscan_record_phase(PHASE_QUIESCE, quiesced - signaled);
+    forkscan_record_phase(PHASE_FORK, forked - quiesced);
+
+    // Sort out which domains the new pointers came from while the child
+    // scans.
+    forkscan_domain_note_snapshot(ab);
 
     // Free up unnecessary space.
     assert(ab);
     while (ab) {
-        addr_buffer_t *tmp = ab->next;
+        tmp = ab->next;
         forkscan_release_buffer(ab);
         ab = tmp;
     }
@@ -225,14 +293,40 @@ static void reclaim_iteration (addr_buffer_t *ab)
                                sizeof(size_t))) {
         forkscan_fatal("Failed to read from child.\n");
     }
-    if (bytes_scanned > g_scan_max) g_scan_max = bytes_scanned;
+    uint64_t heard = forkscan_util_nanotime();
+    TRACE(RESULT, TRACE_INSTANT, bytes_scanned);
+    it.parent_faults = minor_faults() - faults;
+    it.bytes_scanned = bytes_scanned;
+    it.n_siblings = working_data->n_siblings;
+    it.siblings = working_data->siblings;
     close(pipefd[PIPE_READ]);
 
+    uint64_t started = working_data->started_ns;
+    uint64_t done = working_data->done_ns;
+    it.signal_ns = signaled - start;
+    it.quiesce_ns = quiesced - signaled;
+    it.fork_ns = forked - quiesced;
+    it.child_start_ns = started > quiesced ? started - quiesced : 0;
+    it.sort_ns = working_data->sort_ns;
+    it.root_scan_ns = working_data->root_scan_ns;
+    it.mark_ns = working_data->mark_ns;
+    it.scan_ns = done > started ? done - started : 0;
+    it.result_ns = heard > done ? heard - done : 0;
+    forkscan_record_phase(PHASE_SORT, it.sort_ns);
+    forkscan_record_phase(PHASE_ROOT_SCAN, it.root_scan_ns);
+    forkscan_record_phase(PHASE_MARK, it.mark_ns);
+    forkscan_record_phase(PHASE_RESULT, it.result_ns);
+    forkscan_policy_collect_report();
+    forkscan_retention_collect();
+    forkscan_domain_note_results(working_data);
+    forkscan_callsite_note_results(working_data);
+
     // Make the unreferenced nodes, here, available for free'ing.
     forkscan_buffer_push_back(working_data);
 
     // Pull out all the externally-referenced addresses so they can be
     // included in the next collection round.
+    uint64_t extract_start = forkscan_util_nanotime();
     assert(g_uncollected_data == NULL);
     g_uncollected_data =
         forkscan_make_aggregate_buffer(working_data->capacity);
@@ -242,10 +336,24 @@ static void reclaim_iteration (addr_buffer_t *ab)
         g_uncollected_data->addrs[g_uncollected_data->n_addrs++] =
             PTR_MASK(working_data->addrs[i]);
     }
+    forkscan_record_phase(PHASE_SURVIVORS,
+                          forkscan_util_nanotime() - extract_start);
+    it.survivors = g_uncollected_data->n_addrs;
+    forkscan_stats_end_iteration(&it);
+    TRACE(ITERATION, TRACE_END, it.survivors);
 
     forkscan_buffer_unref_buffer(working_data);
 }
 
+/** Return an address below the whole of the caller's frame, including the
+ *  registers it saved.  Must not be inlined.
+ */
+__attribute__((noinline))
+static char *stack_bottom ()
+{
+    return (char*)__builtin_frame_address(0);
+}
+
 /****************************************************************************/
 /*                            Exported functions                            */
 /****************************************************************************/
@@ -255,12 +363,32 @@ static void reclaim_iteration (addr_buffer_t *ab)
  */
 void forkscan_acknowledge_signal ()
 {
+    thread_data_t *td = forkscan_thread_get_td();
     size_t old_counter;
+    LATENCY_BEGIN(start);
+    TRACE(ACK, TRACE_BEGIN, 0);
 
     // Acknowledge the signal and wait for the snapshot to complete.
     old_counter = g_cleanup_counter;
+    if (td) {
+        // Everything the thread can still reach on its stack is above what
+        // stack_bottom() returns: the registers saved for a signal, and,
+        // once they are spilled here, the callee-saved registers our
+        // callers are still using.  The child scans no further down.
+        __builtin_unwind_init();
+        td->stack_sp = stack_bottom();
+        td->stack_sp_seq = old_counter;
+    }
     __sync_fetch_and_add(&g_received_signal, 1);
     while (old_counter == g_cleanup_counter) usleep(1);
+    TRACE(ACK, TRACE_END, 0);
+    if (td && td->stack_is_ours) {
+        // Deep calls leave pages behind that every fork would copy.  Now
+        // that the snapshot is taken, give them back.
+        forkscan_buffer_trimstack(td->user_stack_low, td->stack_sp);
+    }
+    // td is NULL if a thread is signalled before it has finished starting.
+    if (td) LATENCY_END(td, LATENCY_SIGNAL, start);
 }
 
 /**
@@ -285,6 +413,8 @@ void forkscan_initiate_collection (addr_buffer_t *ab, int auto_run, int force)
         // provides memory limit guarantees.  If the user is manually
         // controlling reclamation iterations, all memory guarantees are out
         // the window.
+        if (g_waiting_collects < g_forkscan_throttling_queue) return;
+        TRACE(THROTTLE, TRACE_BEGIN, g_waiting_collects);
         while (g_waiting_collects >= g_forkscan_throttling_queue) {
             pthread_mutex_lock(&g_client_waiting_lock);
             if (g_waiting_collects >= g_forkscan_throttling_queue) {
@@ -293,9 +423,32 @@ void forkscan_initiate_collection (addr_buffer_t *ab, int auto_run, int force)
             }
             pthread_mutex_unlock(&g_client_waiting_lock);
         }
+        TRACE(THROTTLE, TRACE_END, 0);
     }
 }
 
+/** Wait on g_gc_cond for work, waking up to export statistics if that's
+ *  turned on.  Called with g_gc_mutex held.
+ */
+static void wait_for_work ()
+{
+    int interval_ms = forkscan_stats_export_interval();
+    if (0 == interval_ms) {
+        pthread_cond_wait(&g_gc_cond, &g_gc_mutex);
+        return;
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += interval_ms / 1000;
+    deadline.tv_nsec += (interval_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        ++deadline.tv_sec;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&g_gc_cond, &g_gc_mutex, &deadline);
+}
+
 /**
  * Garbage-collector thread.
  */
@@ -309,9 +462,15 @@ void *forkscan_thread (void *ignored)
             // Wait for somebody to come up with a set of addresses for us to
             // collect.
             g_gc_waiting = GC_WAITING_FOR_WORK;
-            pthread_cond_wait(&g_gc_cond, &g_gc_mutex);
+            wait_for_work();
             g_gc_waiting = GC_NOT_WAITING;
         }
+        if (g_waiting_collects < 1) {
+            // Woke up without work.  Time to export statistics, or spurious.
+            pthread_mutex_unlock(&g_gc_mutex);
+            forkscan_stats_export_tick();
+            continue;
+        }
 
         assert(g_addr_buffer);
         ab = g_addr_buffer;
@@ -325,24 +484,20 @@ void *forkscan_thread (void *ignored)
 
         pthread_mutex_unlock(&g_gc_mutex);
 
+        size_t seq = ab->done_seq;
         reclaim_iteration(ab);
+
+        // Everything submitted up to seq has been scanned, and the dead
+        // pointers are available for freeing.
+        __sync_synchronize();
+        g_completed_seq = seq;
+
+        forkscan_stats_export_tick();
     }
 
     return NULL;
 }
 
-/**
- * Set the allocator for Forkscan to use: malloc, free, malloc_usable_size.
- */
-void forkscan_set_allocator (void *(*alloc) (size_t),
-                             void (*dealloc) (void *),
-                             size_t (*usable_size) (void *))
-{
-    __forkscan_alloc = alloc;
-    __forkscan_free = dealloc;
-    __forkscan_usable_size = usable_size;
-}
-
 /**
  * Print program statistics to stdout.
  */
@@ -365,11 +520,16 @@ void forkscan_print_statistics ()
 
     printf("statm: %s\n", statm);
     printf("fork-count: %zu\n", g_cleanup_counter);
-    printf("scan-max: %zu\n", g_scan_max);
-    printf("ave-fork-time: %d\n",
-           g_cleanup_counter == 0 ? 0
-           : ((int)(g_total_fork_time / g_cleanup_counter)));
-    printf("wait-time: %zu\n", g_total_wait_time_ms);
+    forkscan_stats_print();
+    if (g_forkscan_epoch_mode) {
+        printf("epoch-freed: %zu\n", forkscan_epoch_freed());
+        printf("epoch-handed-off: %zu\n", forkscan_epoch_handed_off());
+    }
+    if (g_forkscan_report_regions) {
+        forkscan_policy_print_report();
+    }
+    forkscan_retention_print();
+    forkscan_callsite_print();
 }
 
 __attribute__((destructor))
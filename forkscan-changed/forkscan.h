@@ -29,6 +29,15 @@ THE SOFTWARE.
 
 #define SIGFORKSCAN SIGUSR1
 
+// Submissions of retired pointers to the GC thread are numbered from 1.
+// A submission is complete once an iteration has scanned it.
+extern volatile size_t g_submit_seq;
+extern volatile size_t g_completed_seq;
+
+// Counts snapshots.  In the child, it's the number of the snapshot being
+// scanned.
+extern volatile size_t g_cleanup_counter;
+
 /**
  * Acknowledge the signal sent by the GC thread and perform any work required.
  */
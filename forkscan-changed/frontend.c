@@ -23,13 +23,19 @@ THE SOFTWARE.
 #define _GNU_SOURCE // For pthread_yield().
 #include "alloc.h"
 #include <assert.h>
+#include "callsite.h"
 #include "child.h"
+#include "domain.h"
 #include "env.h"
+#include "epoch.h"
+#include "finalize.h"
 #include "forkscan.h"
 #include "proc.h"
 #include <pthread.h>
+#include "stats.h"
 #include <string.h>
 #include "thread.h"
+#include "trace.h"
 #include <unistd.h>
 #include "util.h"
 
@@ -54,6 +60,8 @@ struct config_t {
 
 static config_t g_config;
 
+// Depth of calls into the allocator.  Nonzero defers the fork signal.
+// Calls nest when a finalizer allocates or frees.
 static volatile __thread int g_in_malloc = 0;
 static __thread int g_waiting_to_fork = 0;
 static volatile int g_force_iteration = 0;
@@ -78,6 +86,9 @@ static void generate_working_pointers_list (addr_buffer_t *ab)
 
     ab->n_addrs = n;
     assert(!forkscan_queue_is_full(&forkscan_thread_get_td()->ptr_list));
+
+    // Service every reclamation domain that is due with the same snapshot.
+    forkscan_domain_drain(ab);
 }
 
 static void become_reclaimer ()
@@ -96,8 +107,14 @@ static void become_reclaimer ()
     // Get memory to store the list of pointers:
     ab = forkscan_make_reclaimer_buffer();
 
+    // Number the submission before taking any pointers.  A thread that
+    // sees its queue non-empty and then reads g_submit_seq can only
+    // overestimate the submission its pointers end up in.
+    ab->seq = __sync_add_and_fetch(&g_submit_seq, 1);
+
     // Copy the pointers into the list.
     generate_working_pointers_list(ab);
+    TRACE(RECLAIMER, TRACE_INSTANT, ab->seq);
 
     // Give the list to the gc thread, signaling it if it's asleep.
     forkscan_initiate_collection(ab, g_config.auto_run, force_iteration);
@@ -108,18 +125,35 @@ static void become_reclaimer ()
 /*                            Bystander threads.                            */
 /****************************************************************************/
 
+/**
+ * Queue what finalizers run by this thread retired, as long as td's list has
+ * room.  Whatever doesn't fit waits for the next call.
+ */
+static void queue_deferred (thread_data_t *td)
+{
+    void *ptr;
+
+    while (!forkscan_queue_is_full(&td->ptr_list)
+           && NULL != (ptr = forkscan_finalize_pop_deferred())) {
+        forkscan_queue_push(&td->ptr_list, (size_t)ptr);
+    }
+}
+
 static void yield (size_t n_yields)
 {
     // FIXME: There's performance here... sure of it!
     //if (n_yields > 10) usleep(MIN_OF(n_yields, 100));
     //else pthread_yield();
-    g_in_malloc = 1;
-    forkscan_util_free_ptrs(forkscan_thread_get_td());
-    g_in_malloc = 0;
-    if (g_waiting_to_fork) {
+    thread_data_t *td = forkscan_thread_get_td();
+    ++g_in_malloc;
+    forkscan_util_free_ptrs(td);
+    --g_in_malloc;
+    if (0 == g_in_malloc && g_waiting_to_fork) {
         g_waiting_to_fork = 0;
         forkscan_acknowledge_signal();
     }
+    // Our callers are waiting for reclamation, so don't start one here.
+    queue_deferred(td);
     pthread_yield();
 }
 
@@ -169,11 +203,11 @@ __attribute__((visibility("default")))
 void *forkscan_malloc (size_t size)
 {
     void *p;
-    g_in_malloc = 1;
+    ++g_in_malloc;
     p = MALLOC(size);
-    g_in_malloc = 0;
+    --g_in_malloc;
 
-    if (g_waiting_to_fork) {
+    if (0 == g_in_malloc && g_waiting_to_fork) {
         // Sadly, TC-Malloc has a deadlock bug when interacting with fork().
         // We need to make sure it isn't holding the global lock when we
         // initiate cleanup.
@@ -183,6 +217,102 @@ void *forkscan_malloc (size_t size)
     return p;
 }
 
+/**
+ * Add ptr to this thread's list of retired pointers, starting an iteration
+ * of reclamation if the list is full.
+ */
+static void retire_ptr (thread_data_t *td, void *ptr)
+{
+    forkscan_queue_push(&td->ptr_list, (size_t)ptr); // Add the pointer.
+    if (forkscan_queue_is_full(&td->ptr_list)) {
+        uint64_t start;
+        size_t n_loops = 0;
+
+        start = forkscan_util_nanotime();
+        TRACE(QUEUE_FULL, TRACE_BEGIN, 0);
+        do {
+            // While this thread's local queue of pointers is full, try to
+            // initiate reclamation.
+
+            forkscan_thread_cleanup_try_acquire()
+                ? become_reclaimer() // this releases the cleanup lock.
+                : yield(n_loops);
+        } while (forkscan_queue_is_full(&td->ptr_list));
+        TRACE(QUEUE_FULL, TRACE_END, 0);
+        forkscan_stats_add_wait(forkscan_util_nanotime() - start);
+    }
+}
+
+/**
+ * Hand a retiree the epoch fast path couldn't free to the scanner.
+ */
+static void handoff_ptr (void *ptr)
+{
+    retire_ptr(forkscan_thread_get_td(), ptr);
+}
+
+/**
+ * Charge ptr to the caller of the retire function, returning to pc, for
+ * call-site profiling.
+ */
+static void sample_retire (void *ptr, void *pc)
+{
+    ++g_in_malloc;
+    forkscan_callsite_sample(ptr, pc);
+    --g_in_malloc;
+    if (0 == g_in_malloc && g_waiting_to_fork) {
+        g_waiting_to_fork = 0;
+        forkscan_acknowledge_signal();
+    }
+}
+
+/**
+ * Retire n non-NULL pointers, once they have had their chance to be sampled.
+ */
+static void retire (void **ptrs, size_t n)
+{
+    void *ptr;
+    size_t i;
+
+    if (forkscan_finalize_in_progress()) {
+        // A finalizer is retiring something it owned.  We're in the middle
+        // of freeing and can't start an iteration from here.
+        for (i = 0; i < n; ++i) forkscan_finalize_defer_retire(ptrs[i]);
+        return;
+    }
+
+    thread_data_t *td = forkscan_thread_get_td();
+    // forkscan_set_epoch_mode() may flip the mode under us.  Every pointer
+    // has to take exactly one of the two paths.
+    int epoch = g_forkscan_epoch_mode;
+    int stalled = 0;
+    LATENCY_BEGIN(retire_start);
+    ++g_in_malloc;
+    for (i = 0; i < n; ++i) {
+        // Free a couple pointers, if we have them.
+        forkscan_util_free_ptrs(td);
+        if (epoch) stalled |= forkscan_epoch_retire(ptrs[i]);
+    }
+    // The fast path was turned off with pointers still in our limbo bags.
+    // Nobody else will hand them off while this thread lives.
+    if (!epoch && forkscan_epoch_pending()) stalled = forkscan_epoch_flush();
+    --g_in_malloc;
+    if (0 == g_in_malloc && g_waiting_to_fork) {
+        g_waiting_to_fork = 0;
+        forkscan_acknowledge_signal();
+    }
+    if (!epoch) {
+        for (i = 0; i < n; ++i) retire_ptr(td, ptrs[i]);
+    }
+    if (stalled) forkscan_epoch_handoff(handoff_ptr);
+
+    // Now that finalizers are done, retire what they retired.
+    while (NULL != (ptr = forkscan_finalize_pop_deferred())) {
+        retire_ptr(td, ptr);
+    }
+    LATENCY_END(td, LATENCY_RETIRE, retire_start);
+}
+
 /**
  * Retire a pointer allocated by Forkscan so that it will be free'd for reuse
  * when no remaining references to it exist.
@@ -194,33 +324,155 @@ void forkscan_retire (void *ptr)
         forkscan_diagnostic("Tried to collect NULL.\n");
         return;
     }
+    if (forkscan_callsite_due()) {
+        sample_retire(ptr, __builtin_return_address(0));
+    }
+    retire(&ptr, 1);
+}
+
+/**
+ * Retire a pointer into reclamation domain d.  It is scanned by the first
+ * snapshot taken after the domain goes over its byte budget.
+ */
+__attribute__((visibility("default")))
+void forkscan_domain_retire (struct forkscan_domain *d, void *ptr)
+{
+    if (NULL == ptr) {
+        forkscan_diagnostic("Tried to collect NULL.\n");
+        return;
+    }
+    if (forkscan_callsite_due()) {
+        sample_retire(ptr, __builtin_return_address(0));
+    }
+
+    if (forkscan_finalize_in_progress()) {
+        // Can't start an iteration from here.  The domain's next snapshot
+        // will pick it up.
+        forkscan_domain_push(d, ptr);
+        return;
+    }
 
     thread_data_t *td = forkscan_thread_get_td();
-    // Free a couple pointers, if we have them.
-    g_in_malloc = 1;
+    LATENCY_BEGIN(retire_start);
+    ++g_in_malloc;
     forkscan_util_free_ptrs(td);
-    g_in_malloc = 0;
-    if (g_waiting_to_fork) {
+    --g_in_malloc;
+    if (0 == g_in_malloc && g_waiting_to_fork) {
         g_waiting_to_fork = 0;
         forkscan_acknowledge_signal();
     }
-    forkscan_queue_push(&td->ptr_list, (size_t)ptr); // Add the pointer.
-    if (forkscan_queue_is_full(&td->ptr_list)) {
-        size_t start, end;
-        size_t n_loops = 0;
 
-        start = forkscan_rdtsc();
-        do {
-            // While this thread's local queue of pointers is full, try to
-            // initiate reclamation.
+    int due = forkscan_domain_push(d, ptr);
+    if (due && forkscan_thread_cleanup_try_acquire()) {
+        // Kick off a snapshot.  If somebody else is already reclaiming, the
+        // domain waits for the next one.
+        become_reclaimer(); // this releases the cleanup lock.
+    }
+    if (due > 1) {
+        // Way over budget.  Don't let this domain run away.
+        uint64_t start;
+        size_t n_loops = 0;
 
+        start = forkscan_util_nanotime();
+        while (forkscan_domain_over_limit(d)) {
             forkscan_thread_cleanup_try_acquire()
                 ? become_reclaimer() // this releases the cleanup lock.
-                : yield(n_loops);
-        } while (forkscan_queue_is_full(&td->ptr_list));
-        end = forkscan_rdtsc();
-        td->wait_time_ms += end - start;
+                : yield(n_loops++);
+        }
+        forkscan_stats_add_wait(forkscan_util_nanotime() - start);
+    }
+
+    while (NULL != (ptr = forkscan_finalize_pop_deferred())) {
+        retire_ptr(td, ptr);
+    }
+    LATENCY_END(td, LATENCY_RETIRE, retire_start);
+}
+
+/**
+ * Retire a pointer like forkscan_retire(), but call fn(ptr, ctx) just before
+ * the memory is freed.  Returns zero on success.  If too many distinct
+ * finalizer functions are in use, returns non-zero and does not retire ptr.
+ */
+__attribute__((visibility("default")))
+int forkscan_retire_with_finalizer (void *ptr,
+                                    void (*fn) (void *ptr, void *ctx),
+                                    void *ctx)
+{
+    int err;
+
+    if (NULL == ptr) {
+        forkscan_diagnostic("Tried to collect NULL.\n");
+        return 0;
+    }
+    if (forkscan_callsite_due()) {
+        sample_retire(ptr, __builtin_return_address(0));
+    }
+    if (NULL == fn) {
+        retire(&ptr, 1);
+        return 0;
+    }
+
+    ++g_in_malloc;
+    err = forkscan_finalize_register(ptr, fn, ctx);
+    --g_in_malloc;
+    if (0 == g_in_malloc && g_waiting_to_fork) {
+        g_waiting_to_fork = 0;
+        forkscan_acknowledge_signal();
+    }
+    if (err) return err;
+
+    retire(&ptr, 1);
+    return 0;
+}
+
+/**
+ * Retire the n pointers in ptrs, as if by forkscan_retire_with_finalizer()
+ * with the same fn and ctx (or forkscan_retire() if fn is NULL), but paying
+ * for the call once.  NULL entries are skipped.  On success, returns zero
+ * and clears the array.  If fn can't be registered, returns non-zero and
+ * retires none of them.
+ */
+__attribute__((visibility("default")))
+int forkscan_retire_bulk (void **ptrs, size_t n,
+                          void (*fn) (void *ptr, void *ctx), void *ctx)
+{
+    size_t i, n_ptrs = 0;
+    int err = 0;
+
+    // Squeeze out the NULLs.
+    for (i = 0; i < n; ++i) {
+        if (NULL == ptrs[i]) {
+            forkscan_diagnostic("Tried to collect NULL.\n");
+            continue;
+        }
+        ptrs[n_ptrs++] = ptrs[i];
     }
+    if (0 == n_ptrs) return 0;
+
+    if (NULL != fn) {
+        ++g_in_malloc;
+        // Every pointer shares fn, so only the first can fail.
+        for (i = 0; i < n_ptrs && 0 == err; ++i) {
+            err = forkscan_finalize_register(ptrs[i], fn, ctx);
+        }
+        --g_in_malloc;
+        if (0 == g_in_malloc && g_waiting_to_fork) {
+            g_waiting_to_fork = 0;
+            forkscan_acknowledge_signal();
+        }
+        if (err) return err;
+    }
+
+    for (i = 0; i < n_ptrs; ++i) {
+        if (forkscan_callsite_due()) {
+            sample_retire(ptrs[i], __builtin_return_address(0));
+        }
+    }
+    retire(ptrs, n_ptrs);
+
+    // Otherwise the caller's array would keep them all alive.
+    memset(ptrs, 0, n * sizeof(void*));
+    return 0;
 }
 
 /**
@@ -231,11 +483,11 @@ void forkscan_retire (void *ptr)
 __attribute__((visibility("default")))
 void forkscan_free (void *ptr)
 {
-    g_in_malloc = 1;
+    ++g_in_malloc;
     FREE(ptr);
-    g_in_malloc = 0;
+    --g_in_malloc;
 
-    if (g_waiting_to_fork) {
+    if (0 == g_in_malloc && g_waiting_to_fork) {
         g_waiting_to_fork = 0;
         forkscan_acknowledge_signal();
     }
@@ -263,6 +515,99 @@ int forkscan_force_reclaim ()
     return 1; // Reclamation was already in progress.
 }
 
+/**
+ * Return a ticket for everything the calling thread has retired so far.
+ * Pass it to forkscan_poll() to find out whether those pointers have been
+ * scanned.
+ */
+__attribute__((visibility("default")))
+size_t forkscan_retire_ticket ()
+{
+    thread_data_t *td = forkscan_thread_get_td();
+    // Whatever is still in limbo goes to the scanner, so the ticket covers
+    // it.
+    ++g_in_malloc;
+    int stalled = forkscan_epoch_flush();
+    --g_in_malloc;
+    if (0 == g_in_malloc && g_waiting_to_fork) {
+        g_waiting_to_fork = 0;
+        forkscan_acknowledge_signal();
+    }
+    if (stalled) forkscan_epoch_handoff(handoff_ptr);
+    // Our domain retirees get drained by the next snapshot, whether or not
+    // their domains are due.
+    int queued = forkscan_domain_flush_thread();
+    queued |= !forkscan_queue_is_empty(&td->ptr_list);
+    __sync_synchronize();
+    // Pointers still queued go out with the next submission.
+    return g_submit_seq + queued;
+}
+
+/**
+ * Return 1 if every pointer retired before the ticket was taken has been
+ * scanned (and freed, or found to be still referenced), zero otherwise.
+ * Doesn't block.
+ */
+__attribute__((visibility("default")))
+int forkscan_poll (size_t ticket)
+{
+    return g_completed_seq >= ticket;
+}
+
+/**
+ * Wait until every pointer the calling thread has retired has been scanned,
+ * starting an iteration only if one is needed, then help free the memory
+ * those iterations found unreferenced.  Like synchronize_rcu().
+ */
+__attribute__((visibility("default")))
+void forkscan_synchronize ()
+{
+    size_t ticket = forkscan_retire_ticket();
+    size_t n_loops = 0;
+    int forced = 0;
+
+    while (!forkscan_poll(ticket)) {
+        if (g_submit_seq < ticket || (!g_config.auto_run && !forced)) {
+            // Our pointers haven't been handed to the GC thread yet, or they
+            // have but nothing will tell it to run.
+            forkscan_force_reclaim();
+            forced = g_submit_seq >= ticket;
+        } else {
+            yield(n_loops++);
+        }
+    }
+
+    // The dead pointers are now waiting to be freed.  Help free them so
+    // the memory is actually back before we return.
+    thread_data_t *td = forkscan_thread_get_td();
+    n_loops = 0;
+    while (forkscan_buffer_oldest_retiree_seq() <= ticket) {
+        size_t n_freed;
+        ++g_in_malloc;
+        n_freed = forkscan_util_free_ptrs(td);
+        --g_in_malloc;
+        if (0 == g_in_malloc && g_waiting_to_fork) {
+            g_waiting_to_fork = 0;
+            forkscan_acknowledge_signal();
+        }
+        // Other threads still hold the last ranges of the buffer.
+        if (0 == n_freed) yield(n_loops++);
+    }
+    ++g_in_malloc;
+    forkscan_util_finish_free_ptrs(td);
+    --g_in_malloc;
+    if (0 == g_in_malloc && g_waiting_to_fork) {
+        g_waiting_to_fork = 0;
+        forkscan_acknowledge_signal();
+    }
+
+    // Retire what the finalizers we ran retired.
+    void *ptr;
+    while (NULL != (ptr = forkscan_finalize_pop_deferred())) {
+        retire_ptr(td, ptr);
+    }
+}
+
 /**
  * auto_run = 1 (enable) or 0 (disable) automatic iterations of reclamation.
  * If the automatic system is disabled, it is up to the user to force
@@ -273,6 +618,33 @@ void forkscan_set_auto_run (int auto_run)
     g_config.auto_run = auto_run;
 }
 
+/**
+ * enable = 1 (on) or 0 (off) interior-pointer recognition.  Takes effect
+ * with the next snapshot.
+ */
+__attribute__((visibility("default")))
+void forkscan_set_interior_pointers (int enable)
+{
+    g_forkscan_interior_pointers = enable != 0;
+}
+
+/**
+ * Set which tag bits the scan strips from a word before comparing it with
+ * retirees.  Returns zero on success, non-zero if a count is out of range.
+ */
+__attribute__((visibility("default")))
+int forkscan_set_tag_bits (int low_bits, int high_bits, int sign_extend)
+{
+    if (low_bits < 0 || low_bits > MAX_TAG_LOW_BITS
+        || high_bits < 0 || high_bits > MAX_TAG_HIGH_BITS) {
+        return 1;
+    }
+    g_forkscan_tag_low_bits = low_bits;
+    g_forkscan_tag_high_bits = high_bits;
+    g_forkscan_tag_sign_extend = sign_extend != 0;
+    return 0;
+}
+
 /**
  * Allocate a buffer of "size" bytes and return a pointer to it.  This memory
  * will be tracked by the garbage collector, so free() should never be called
@@ -0,0 +1,676 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "alloc.h"
+#include <assert.h>
+#include "env.h"
+#include "heap.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "util.h"
+
+/****************************************************************************/
+/*                         Defines, typedefs, etc.                          */
+/****************************************************************************/
+
+#define CHUNKSIZE HUGEPAGESIZE
+
+// 16-byte steps up to 128, then four steps per power of 2 up to 128K.
+#define N_CLASSES 48
+#define SMALL_MAX ((size_t)128 * 1024)
+
+// A thread moves about this many bytes at a time between its cache and the
+// shared pool.
+#define CACHE_BATCH_BYTES (64 * 1024)
+#define MAX_CACHE_BATCH 64
+
+#define BITS_PER_WORD (8 * sizeof(unsigned long))
+
+#define CHUNK_OF(addr) ((span_t*)HUGEALIGN((size_t)(addr)))
+
+typedef enum span_kind_t span_kind_t;
+
+enum span_kind_t { SPAN_SMALL = 1,  // Objects of one size class.
+                   SPAN_LARGE,      // A single object, one or more chunks.
+                   SPAN_FREE };     // Unused chunks, one or more.
+
+typedef struct span_t span_t;
+
+/** Header at the start of each run of chunks.  Every object's header is at
+ *  the start of the chunk the object begins in.
+ */
+struct span_t {
+    span_kind_t kind;
+    int size_class;
+    size_t n_chunks;
+    size_t obj_size;
+    size_t n_objs;       // Capacity.
+    size_t n_carved;     // Objects handed out at least once.
+    char *objs;          // First object.
+    span_t *next;        // Free spans.
+    unsigned long live[]; // Bit per object, set while allocated.
+};
+
+typedef struct class_pool_t class_pool_t;
+
+struct class_pool_t {
+    pthread_mutex_t lock;
+    void *free_list;     // Linked through the first word of each object.
+    span_t *current;     // Span being carved.
+} __attribute__((aligned(64)));
+
+typedef struct thread_cache_t thread_cache_t;
+
+struct thread_cache_t {
+    void *head[N_CLASSES];
+    int count[N_CLASSES];
+};
+
+/****************************************************************************/
+/*                                 Globals                                  */
+/****************************************************************************/
+
+static char *g_heap_base;
+static char *volatile g_heap_top;
+static char *g_heap_end;
+static pthread_once_t g_heap_once = PTHREAD_ONCE_INIT;
+
+static pthread_mutex_t g_chunk_lock = PTHREAD_MUTEX_INITIALIZER;
+static span_t *g_free_spans;
+
+// For each chunk handed out, the index of the first chunk of its span.  A
+// large object covers the headers of all but its first chunk, so this is
+// the only way back to its span from an address past the first 2 MB.
+static uint32_t *g_chunk_span;
+
+static size_t g_class_size[N_CLASSES];
+static int g_class_batch[N_CLASSES];
+static class_pool_t g_pools[N_CLASSES];
+
+static __thread thread_cache_t t_cache;
+
+/****************************************************************************/
+/*                              Size classes.                               */
+/****************************************************************************/
+
+static inline int size_to_class (size_t size)
+{
+    if (size <= 128) return size == 0 ? 0 : (int)((size - 1) >> 4);
+    // 2^k < size <= 2^(k+1), split into quarters.
+    int k = 63 - __builtin_clzl(size - 1);
+    return 8 + (k - 7) * 4 + (int)(((size - 1) >> (k - 2)) & 3);
+}
+
+static size_t class_to_size (int c)
+{
+    if (c < 8) return (c + 1) * 16;
+    int k = 7 + (c - 8) / 4;
+    return ((size_t)1 << k) + ((c - 8) % 4 + 1) * ((size_t)1 << (k - 2));
+}
+
+/****************************************************************************/
+/*                                 Chunks.                                  */
+/****************************************************************************/
+
+static void heap_init ()
+{
+    size_t reserve = (size_t)g_forkscan_heap_reserve_gb << 30;
+    char *p;
+    int c;
+
+    // Reserve address space only.  Pages are committed as they are touched,
+    // and fork() only copies page tables for what has been touched.
+    p = mmap(NULL, reserve + CHUNKSIZE,
+             PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+             -1, 0);
+    if (MAP_FAILED == p) {
+        forkscan_fatal("unable to reserve %d GB for the heap.\n",
+                       g_forkscan_heap_reserve_gb);
+    }
+
+    // Chunks are 2 MB-aligned so an object's header can be found by
+    // masking.  Trim the ends.
+    g_heap_base = (char*)HUGEALIGN((size_t)p + CHUNKSIZE - 1);
+    if (g_heap_base > p) munmap(p, g_heap_base - p);
+    munmap(g_heap_base + reserve, (p + CHUNKSIZE) - g_heap_base);
+    g_heap_end = g_heap_base + reserve;
+    g_heap_top = g_heap_base;
+
+    // Forkscan's own memory, so the child reads it but doesn't scan it.
+    g_chunk_span = forkscan_alloc_mmap(PAGEALIGN(reserve / CHUNKSIZE
+                                                 * sizeof(uint32_t)
+                                                 + PAGESIZE - 1),
+                                       "heap chunk table");
+
+    if (HUGE_PAGES_OFF != g_forkscan_huge_pages) {
+        // 2 MB pages mean one page table entry per chunk instead of 512.
+        madvise(g_heap_base, reserve, MADV_HUGEPAGE);
+    }
+
+    for (c = 0; c < N_CLASSES; ++c) {
+        g_class_size[c] = class_to_size(c);
+        g_class_batch[c] = MAX_OF(1, MIN_OF(MAX_CACHE_BATCH,
+                                            CACHE_BATCH_BYTES
+                                            / (int)g_class_size[c]));
+        pthread_mutex_init(&g_pools[c].lock, NULL);
+    }
+}
+
+/**
+ * Record that the n_chunks chunks at span belong to it.  Called with
+ * g_chunk_lock held, before the caller publishes the span's kind.
+ */
+static void chunks_own (span_t *span, size_t n_chunks)
+{
+    size_t first = ((char*)span - g_heap_base) / CHUNKSIZE;
+    size_t i;
+    for (i = 0; i < n_chunks; ++i) g_chunk_span[first + i] = (uint32_t)first;
+}
+
+/**
+ * Tag a free span's first and last chunks with its first, so a span freed
+ * right after it can find it.  Called with g_chunk_lock held.
+ */
+static void span_tag (span_t *span)
+{
+    size_t first = ((char*)span - g_heap_base) / CHUNKSIZE;
+    g_chunk_span[first] = (uint32_t)first;
+    g_chunk_span[first + span->n_chunks - 1] = (uint32_t)first;
+}
+
+/**
+ * Take span off the free list.  Returns 1 if it was there, zero if it
+ * wasn't (it is allocated, or being filled in).  Called with g_chunk_lock
+ * held.
+ */
+static int free_list_remove (span_t *span)
+{
+    span_t **prev;
+    for (prev = &g_free_spans; NULL != *prev; prev = &(*prev)->next) {
+        if (*prev == span) {
+            *prev = span->next;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Return the span that addr, anywhere inside an allocated span, belongs
+ * to.
+ */
+static inline span_t *span_of (size_t addr)
+{
+    size_t chunk = (addr - (size_t)g_heap_base) / CHUNKSIZE;
+    return (span_t*)(g_heap_base + (size_t)g_chunk_span[chunk] * CHUNKSIZE);
+}
+
+static inline void ensure_init ()
+{
+    if (__builtin_expect(NULL == g_heap_base, 0)) {
+        pthread_once(&g_heap_once, heap_init);
+    }
+}
+
+/**
+ * Get n_chunks contiguous chunks, either from a free span or from the top
+ * of the arena.  The caller fills in the header.
+ */
+static span_t *chunks_alloc (size_t n_chunks)
+{
+    span_t *span, **prev;
+
+    pthread_mutex_lock(&g_chunk_lock);
+    for (prev = &g_free_spans; NULL != (span = *prev); prev = &span->next) {
+        if (span->n_chunks < n_chunks) continue;
+        *prev = span->next;
+        if (span->n_chunks > n_chunks) {
+            // Split off the tail and keep it free.
+            span_t *rest = (span_t*)((char*)span + n_chunks * CHUNKSIZE);
+            rest->kind = SPAN_FREE;
+            rest->n_chunks = span->n_chunks - n_chunks;
+            rest->next = g_free_spans;
+            g_free_spans = rest;
+            span_tag(rest);
+        }
+        chunks_own(span, n_chunks);
+        pthread_mutex_unlock(&g_chunk_lock);
+        return span;
+    }
+
+    if (g_heap_top + n_chunks * CHUNKSIZE > g_heap_end) {
+        pthread_mutex_unlock(&g_chunk_lock);
+        forkscan_fatal("heap reserve exhausted (%d GB).  "
+                       "Raise FORKSCAN_HEAP_RESERVE_GB.\n",
+                       g_forkscan_heap_reserve_gb);
+    }
+    span = (span_t*)g_heap_top;
+    // Headers must be in place before the child can see the new top.  Mark
+    // the span free until the caller fills it in.
+    span->kind = SPAN_FREE;
+    span->n_chunks = n_chunks;
+    chunks_own(span, n_chunks);
+    __sync_synchronize();
+    g_heap_top += n_chunks * CHUNKSIZE;
+    pthread_mutex_unlock(&g_chunk_lock);
+
+    return span;
+}
+
+static void chunks_free (span_t *span)
+{
+    // Give the memory back to the OS but keep the header page, which the
+    // child needs to walk the arena.
+    madvise((char*)span + PAGESIZE, span->n_chunks * CHUNKSIZE - PAGESIZE,
+            MADV_DONTNEED);
+
+    pthread_mutex_lock(&g_chunk_lock);
+    span->kind = SPAN_FREE;
+
+    // Merge with free neighbors, or the free list fills up with runs too
+    // short for a large object and the top keeps growing.  The child walks
+    // the arena by headers, so grow the surviving span before dropping the
+    // header it now covers.
+    span_t *next = (span_t*)((char*)span + span->n_chunks * CHUNKSIZE);
+    if ((char*)next < g_heap_top && SPAN_FREE == next->kind
+        && free_list_remove(next)) {
+        span->n_chunks += next->n_chunks;
+        madvise(next, PAGESIZE, MADV_DONTNEED);
+    }
+    if ((char*)span > g_heap_base) {
+        span_t *prev = span_of((size_t)span - 1);
+        if (SPAN_FREE == prev->kind && free_list_remove(prev)) {
+            prev->n_chunks += span->n_chunks;
+            madvise(span, PAGESIZE, MADV_DONTNEED);
+            span = prev;
+        }
+    }
+
+    if ((char*)span + span->n_chunks * CHUNKSIZE == g_heap_top) {
+        // Hand it back to the top of the arena.
+        g_heap_top = (char*)span;
+        madvise(span, PAGESIZE, MADV_DONTNEED);
+    } else {
+        span_tag(span);
+        span->next = g_free_spans;
+        g_free_spans = span;
+    }
+    pthread_mutex_unlock(&g_chunk_lock);
+}
+
+static span_t *small_span_new (int c)
+{
+    span_t *span = chunks_alloc(1);
+    size_t obj_size = g_class_size[c];
+
+    // Solve for the object count with the bitmap in the header:
+    // sizeof(span_t) + n / 8 + n * obj_size <= CHUNKSIZE (less alignment).
+    size_t n_objs = (CHUNKSIZE - sizeof(span_t) - 2 * CACHELINESIZE) * 8
+        / (8 * obj_size + 1);
+    size_t header = sizeof(span_t)
+        + (n_objs + BITS_PER_WORD - 1) / BITS_PER_WORD * sizeof(unsigned long);
+    header = (header + CACHELINESIZE - 1) & ~(CACHELINESIZE - 1);
+
+    memset(span->live, 0, header - sizeof(span_t));
+    span->size_class = c;
+    span->n_chunks = 1;
+    span->obj_size = obj_size;
+    span->n_objs = n_objs;
+    span->n_carved = 0;
+    span->objs = (char*)span + header;
+    span->next = NULL;
+    __sync_synchronize();
+    span->kind = SPAN_SMALL;
+
+    return span;
+}
+
+/****************************************************************************/
+/*                               Live bitmap.                               */
+/****************************************************************************/
+
+static inline size_t obj_index (span_t *span, void *ptr)
+{
+    return ((char*)ptr - span->objs) / span->obj_size;
+}
+
+static inline void set_live (span_t *span, size_t idx)
+{
+    __sync_fetch_and_or(&span->live[idx / BITS_PER_WORD],
+                        1UL << (idx % BITS_PER_WORD));
+}
+
+static inline void clear_live (span_t *span, size_t idx)
+{
+    __sync_fetch_and_and(&span->live[idx / BITS_PER_WORD],
+                         ~(1UL << (idx % BITS_PER_WORD)));
+}
+
+static inline int is_live (span_t *span, size_t idx)
+{
+    return (span->live[idx / BITS_PER_WORD] >> (idx % BITS_PER_WORD)) & 1;
+}
+
+/****************************************************************************/
+/*                         Per-thread object caches.                        */
+/****************************************************************************/
+
+/**
+ * Fill the thread's cache for class c with a batch of free objects and
+ * return one of them.  The cache is empty on entry.
+ */
+static void *cache_refill (int c)
+{
+    class_pool_t *pool = &g_pools[c];
+    int batch = g_class_batch[c];
+    void *head = NULL;
+    int count = 0;
+
+    pthread_mutex_lock(&pool->lock);
+
+    // Recycled objects first.
+    while (count < batch && pool->free_list) {
+        void *p = pool->free_list;
+        pool->free_list = *(void**)p;
+        *(void**)p = head;
+        head = p;
+        ++count;
+    }
+
+    // Then fresh ones.
+    while (count < batch) {
+        span_t *span = pool->current;
+        if (NULL == span || span->n_carved == span->n_objs) {
+            span = pool->current = small_span_new(c);
+        }
+        void *p = span->objs + span->n_carved * span->obj_size;
+        ++span->n_carved;
+        *(void**)p = head;
+        head = p;
+        ++count;
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    t_cache.head[c] = *(void**)head;
+    t_cache.count[c] = count - 1;
+    return head;
+}
+
+/**
+ * Move count objects from the front of the thread's cache for class c to
+ * the shared pool.
+ */
+static void cache_flush (int c, int count)
+{
+    class_pool_t *pool = &g_pools[c];
+    void *head = t_cache.head[c], *tail = head;
+    int i;
+
+    if (count <= 0) return;
+    for (i = 1; i < count; ++i) tail = *(void**)tail;
+    t_cache.head[c] = *(void**)tail;
+    t_cache.count[c] -= count;
+
+    pthread_mutex_lock(&pool->lock);
+    *(void**)tail = pool->free_list;
+    pool->free_list = head;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/****************************************************************************/
+/*                              Large objects.                              */
+/****************************************************************************/
+
+static void *large_alloc (size_t size)
+{
+    size_t n_chunks = (size + PAGESIZE + CHUNKSIZE - 1) / CHUNKSIZE;
+    span_t *span = chunks_alloc(n_chunks);
+
+    // The header gets a page to itself.  The object follows.  Its usable
+    // size stops at a page boundary rather than the end of the chunk so the
+    // child doesn't scan pages that were never touched.
+    span->size_class = -1;
+    span->n_chunks = n_chunks;
+    span->obj_size = PAGEALIGN(size + PAGESIZE - 1);
+    span->n_objs = 1;
+    span->n_carved = 1;
+    span->objs = (char*)span + PAGESIZE;
+    span->next = NULL;
+    span->live[0] = 1;
+    __sync_synchronize();
+    span->kind = SPAN_LARGE;
+
+    return span->objs;
+}
+
+/****************************************************************************/
+/*                                Interface                                 */
+/****************************************************************************/
+
+/**
+ * Allocate size bytes from the Forkscan heap.
+ */
+void *forkscan_heap_malloc (size_t size)
+{
+    void *p;
+    int c;
+
+    ensure_init();
+    if (size > SMALL_MAX) return large_alloc(size);
+
+    c = size_to_class(size);
+    p = t_cache.head[c];
+    if (NULL == p) {
+        p = cache_refill(c);
+    } else {
+        t_cache.head[c] = *(void**)p;
+        --t_cache.count[c];
+    }
+
+    span_t *span = CHUNK_OF(p);
+    set_live(span, obj_index(span, p));
+    return p;
+}
+
+/**
+ * Return ptr to the Forkscan heap.  ptr may be NULL.
+ */
+void forkscan_heap_free (void *ptr)
+{
+    span_t *span;
+    int c;
+
+    if (NULL == ptr) return;
+    if ((char*)ptr < g_heap_base || (char*)ptr >= g_heap_top) {
+        forkscan_fatal("free() of %p, which Forkscan did not allocate.\n",
+                       ptr);
+    }
+
+    span = CHUNK_OF(ptr);
+    if (SPAN_LARGE == span->kind) {
+        span->live[0] = 0;
+        chunks_free(span);
+        return;
+    }
+
+    assert(SPAN_SMALL == span->kind);
+    clear_live(span, obj_index(span, ptr));
+
+    c = span->size_class;
+    *(void**)ptr = t_cache.head[c];
+    t_cache.head[c] = ptr;
+    if (++t_cache.count[c] > 2 * g_class_batch[c]) {
+        cache_flush(c, g_class_batch[c]);
+    }
+}
+
+/**
+ * Return the number of bytes usable in the block at ptr.
+ */
+size_t forkscan_heap_usable_size (void *ptr)
+{
+    if (NULL == ptr) return 0;
+    return span_of((size_t)ptr)->obj_size;
+}
+
+/**
+ * Free the n blocks in ptrs.
+ */
+void forkscan_heap_free_batch (void **ptrs, size_t n)
+{
+    size_t i;
+    // Freeing touches the object's chunk header.  Fetch the next one while
+    // this one is being freed.
+    for (i = 0; i < n; ++i) {
+        if (i + 1 < n) __builtin_prefetch(CHUNK_OF(ptrs[i + 1]));
+        forkscan_heap_free(ptrs[i]);
+    }
+}
+
+/**
+ * Store the usable size of each of the n blocks in ptrs in sizes.
+ */
+void forkscan_heap_usable_size_batch (void **ptrs, size_t *sizes, size_t n)
+{
+    size_t i;
+    for (i = 0; i < n; ++i) sizes[i] = span_of((size_t)ptrs[i])->obj_size;
+}
+
+/**
+ * Hand the calling thread's cached objects back to the shared pool.  Called
+ * when a thread exits.
+ */
+void forkscan_heap_thread_flush ()
+{
+    int c;
+    for (c = 0; c < N_CLASSES; ++c) {
+        cache_flush(c, t_cache.count[c]);
+    }
+}
+
+/**
+ * Return 1 if addr lies in the part of the arena that has been handed out,
+ * zero otherwise.
+ */
+int forkscan_heap_contains (size_t addr)
+{
+    return addr >= (size_t)g_heap_base && addr < (size_t)g_heap_top;
+}
+
+/**
+ * Return how many bytes of the arena have been handed out, up to the top.
+ */
+size_t forkscan_heap_used ()
+{
+    return g_heap_top - g_heap_base;
+}
+
+/**
+ * Return the address range reserved for the arena.  Nothing in it but the
+ * heap's own chunks should be scanned.
+ */
+mem_range_t forkscan_heap_range ()
+{
+    mem_range_t ret = { (size_t)g_heap_base, (size_t)g_heap_end };
+    return ret;
+}
+
+/**
+ * Apply f to each extent in [low, high) that may hold allocated objects:
+ * the carved-out part of each small-object chunk and the body of each
+ * allocated large object.  Chunk headers and free chunks are skipped.
+ * Ranges outside the arena are ignored.  This is for the child; it takes
+ * no locks.
+ */
+void forkscan_heap_for_each_extent (size_t low, size_t high,
+                                    void (*f) (size_t, size_t, void *),
+                                    void *arg)
+{
+    char *chunk;
+
+    low = MAX_OF(low, (size_t)g_heap_base);
+    high = MIN_OF(high, (size_t)g_heap_top);
+
+    // Walk the arena from the bottom.  Headers chain from one run of chunks
+    // to the next, so there is no way to start in the middle.
+    for (chunk = g_heap_base; (size_t)chunk < high; ) {
+        span_t *span = (span_t*)chunk;
+        size_t span_end = (size_t)chunk + span->n_chunks * CHUNKSIZE;
+        if (span_end > low && SPAN_FREE != span->kind) {
+            size_t ext_low = (size_t)span->objs;
+            size_t ext_high = ext_low + span->n_carved * span->obj_size;
+            if (SPAN_LARGE == span->kind && !span->live[0]) ext_high = ext_low;
+            ext_low = MAX_OF(ext_low, low);
+            ext_high = MIN_OF(ext_high, high);
+            if (ext_low < ext_high) f(ext_low, ext_high, arg);
+        }
+        chunk = (char*)span_end;
+    }
+}
+
+/**
+ * Apply f to each maximal run of live objects within [low, high), which
+ * must lie inside a single extent from forkscan_heap_for_each_extent(),
+ * though not necessarily at its start.  Free objects are skipped.  This is
+ * for the child; it takes no locks.
+ */
+void forkscan_heap_for_each_live_run (size_t low, size_t high,
+                                      void (*f) (size_t, size_t, void *),
+                                      void *arg)
+{
+    span_t *span = span_of(low);
+    size_t idx, end_idx;
+
+    if (SPAN_LARGE == span->kind) {
+        // One object, and it's live or we wouldn't be here.
+        f(low, high, arg);
+        return;
+    }
+
+    assert(SPAN_SMALL == span->kind);
+    idx = obj_index(span, (void*)low);
+    end_idx = obj_index(span, (void*)(high - 1)) + 1;
+
+    while (idx < end_idx) {
+        // Skip free objects a word at a time where possible.
+        if (0 == idx % BITS_PER_WORD && 0 == span->live[idx / BITS_PER_WORD]) {
+            idx += BITS_PER_WORD;
+            continue;
+        }
+        if (!is_live(span, idx)) {
+            ++idx;
+            continue;
+        }
+        size_t run_start = idx;
+        while (idx < end_idx && is_live(span, idx)) ++idx;
+
+        size_t run_low = (size_t)(span->objs + run_start * span->obj_size);
+        size_t run_high = (size_t)(span->objs + idx * span->obj_size);
+        run_low = MAX_OF(run_low, low);
+        run_high = MIN_OF(run_high, high);
+        if (run_low < run_high) f(run_low, run_high, arg);
+    }
+}
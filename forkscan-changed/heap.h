@@ -0,0 +1,107 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/* Module Description:
+   Forkscan's built-in allocator.  Memory comes from one big reserved arena
+   that is carved into 2 MB chunks and advised for transparent huge pages,
+   so the page tables fork() has to copy stay small.  Small requests are
+   served from per-thread caches of size-classed objects; each chunk of
+   small objects has a header with the object size and a bitmap of live
+   objects.  That lets the snapshot child find chunk boundaries and skip
+   free memory instead of scanning it.
+ */
+
+#ifndef _HEAP_H_
+#define _HEAP_H_
+
+#include "alloc.h"
+#include <stddef.h>
+
+/**
+ * Allocate size bytes from the Forkscan heap.
+ */
+void *forkscan_heap_malloc (size_t size);
+
+/**
+ * Return ptr to the Forkscan heap.  ptr may be NULL.
+ */
+void forkscan_heap_free (void *ptr);
+
+/**
+ * Return the number of bytes usable in the block at ptr.
+ */
+size_t forkscan_heap_usable_size (void *ptr);
+
+/**
+ * Free the n blocks in ptrs.
+ */
+void forkscan_heap_free_batch (void **ptrs, size_t n);
+
+/**
+ * Store the usable size of each of the n blocks in ptrs in sizes.
+ */
+void forkscan_heap_usable_size_batch (void **ptrs, size_t *sizes, size_t n);
+
+/**
+ * Hand the calling thread's cached objects back to the shared pool.  Called
+ * when a thread exits.
+ */
+void forkscan_heap_thread_flush ();
+
+/**
+ * Return 1 if addr lies in the part of the arena that has been handed out,
+ * zero otherwise.
+ */
+int forkscan_heap_contains (size_t addr);
+
+/**
+ * Return how many bytes of the arena have been handed out, up to the top.
+ */
+size_t forkscan_heap_used ();
+
+/**
+ * Return the address range reserved for the arena.  Nothing in it but the
+ * heap's own chunks should be scanned.
+ */
+mem_range_t forkscan_heap_range ();
+
+/**
+ * Apply f to each extent in [low, high) that may hold allocated objects:
+ * the carved-out part of each small-object chunk and the body of each
+ * allocated large object.  Chunk headers and free chunks are skipped.
+ * Ranges outside the arena are ignored.  This is for the child; it takes
+ * no locks.
+ */
+void forkscan_heap_for_each_extent (size_t low, size_t high,
+                                    void (*f) (size_t, size_t, void *),
+                                    void *arg);
+
+/**
+ * Apply f to each maximal run of live objects within [low, high), which
+ * must lie inside a single extent from forkscan_heap_for_each_extent().
+ * Free objects are skipped.  This is for the child; it takes no locks.
+ */
+void forkscan_heap_for_each_live_run (size_t low, size_t high,
+                                      void (*f) (size_t, size_t, void *),
+                                      void *arg);
+
+#endif // !defined _HEAP_H_
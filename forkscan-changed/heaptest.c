@@ -0,0 +1,85 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/* Check that the heap reuses the chunks large objects give back.  It
+   alternates large objects of varying sizes with small ones, frees the
+   large ones, and fails if the top of the arena keeps climbing while the
+   live set stays the same size.  Build and run with "make check". */
+
+#include "heap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "util.h"
+
+/****************************************************************************/
+/*                         Defines, typedefs, etc.                          */
+/****************************************************************************/
+
+#define ROUNDS 2000
+#define N_LARGE 8
+#define MAX_LARGE_CHUNKS 16
+#define N_SMALL 256
+
+/****************************************************************************/
+/*                                  Main                                    */
+/****************************************************************************/
+
+int main ()
+{
+    void *large[N_LARGE];
+    void *small[N_SMALL] = { NULL };
+    size_t peak_live = 0, first_used = 0;
+    int r, i;
+
+    srand(1);
+    for (r = 0; r < ROUNDS; ++r) {
+        size_t live = 0;
+        for (i = 0; i < N_LARGE; ++i) {
+            size_t n_chunks = 1 + rand() % MAX_LARGE_CHUNKS;
+            size_t size = n_chunks * HUGEPAGESIZE - 2 * PAGESIZE;
+            large[i] = forkscan_heap_malloc(size);
+            live += size;
+
+            // A small object in between, in a size class that may need a
+            // chunk of its own.
+            int j = rand() % N_SMALL;
+            forkscan_heap_free(small[j]);
+            small[j] = forkscan_heap_malloc(16 + rand() % (64 * 1024));
+        }
+        for (i = 0; i < N_LARGE; ++i) forkscan_heap_free(large[i]);
+        if (live > peak_live) peak_live = live;
+        if (r == ROUNDS / 10) first_used = forkscan_heap_used();
+    }
+
+    // The top settles once every size has been seen.  After that it may
+    // only grow by what one more round's large objects could need.
+    size_t used = forkscan_heap_used();
+    printf("heap top %zu MB after %d rounds (%zu MB at round %d), "
+           "peak live %zu MB\n", used >> 20, ROUNDS, first_used >> 20,
+           ROUNDS / 10, peak_live >> 20);
+    if (used > first_used + peak_live) {
+        printf("FAIL: the heap top keeps growing\n");
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
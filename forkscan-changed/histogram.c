@@ -0,0 +1,139 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "histogram.h"
+
+/****************************************************************************/
+/*                            Helper functions.                             */
+/****************************************************************************/
+
+static inline int bucket_of (uint64_t value)
+{
+    if (value < HIST_SUB_BUCKETS) return (int)value;
+    int e = 63 - __builtin_clzl(value);
+    int sub = (int)(value >> (e - HIST_SUB_BITS)) & (HIST_SUB_BUCKETS - 1);
+    return (e - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS + sub;
+}
+
+/** Largest value that lands in bucket b.
+ */
+static uint64_t bucket_high (int b)
+{
+    if (b < HIST_SUB_BUCKETS) return (uint64_t)b;
+    int e = b / HIST_SUB_BUCKETS + HIST_SUB_BITS - 1;
+    uint64_t sub = (uint64_t)(b % HIST_SUB_BUCKETS);
+    uint64_t width = (uint64_t)1 << (e - HIST_SUB_BITS);
+    return ((HIST_SUB_BUCKETS + sub) << (e - HIST_SUB_BITS)) + width - 1;
+}
+
+/****************************************************************************/
+/*                                Interface                                 */
+/****************************************************************************/
+
+void forkscan_hist_record (forkscan_hist_t *h, uint64_t value)
+{
+    uint64_t max;
+
+    __sync_fetch_and_add(&h->buckets[bucket_of(value)], 1);
+    __sync_fetch_and_add(&h->sum, value);
+    while (value > (max = h->max)) {
+        if (__sync_bool_compare_and_swap(&h->max, max, value)) break;
+    }
+    // Last, so a reader that sees the count sees the bucket.
+    __sync_fetch_and_add(&h->count, 1);
+}
+
+void forkscan_hist_record_local (forkscan_hist_t *h, uint64_t value)
+{
+    ++h->buckets[bucket_of(value)];
+    h->sum += value;
+    if (value > h->max) h->max = value;
+    __asm__ __volatile__("" ::: "memory");
+    ++h->count;
+}
+
+uint64_t forkscan_hist_percentile (const forkscan_hist_t *h, double p)
+{
+    uint64_t count = h->count, seen = 0, rank;
+    int b;
+
+    if (0 == count) return 0;
+    rank = (uint64_t)(p * count + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > count) rank = count;
+
+    for (b = 0; b < HIST_BUCKETS; ++b) {
+        seen += h->buckets[b];
+        if (seen >= rank) {
+            uint64_t high = bucket_high(b);
+            return high < h->max ? high : h->max;
+        }
+    }
+    return h->max;
+}
+
+double forkscan_hist_mean (const forkscan_hist_t *h)
+{
+    uint64_t count = h->count;
+    return 0 == count ? 0.0 : (double)h->sum / count;
+}
+
+void forkscan_hist_merge (forkscan_hist_t *dst, const forkscan_hist_t *src)
+{
+    uint64_t max;
+    int b;
+
+    for (b = 0; b < HIST_BUCKETS; ++b) {
+        if (src->buckets[b]) {
+            __sync_fetch_and_add(&dst->buckets[b], src->buckets[b]);
+        }
+    }
+    __sync_fetch_and_add(&dst->sum, src->sum);
+    while (src->max > (max = dst->max)) {
+        if (__sync_bool_compare_and_swap(&dst->max, max, src->max)) break;
+    }
+    __sync_fetch_and_add(&dst->count, src->count);
+}
+
+void forkscan_hist_merge_scaled (forkscan_hist_t *dst,
+                                 const forkscan_hist_t *src,
+                                 double scale)
+{
+    uint64_t low = 0, max, src_max = (uint64_t)(src->max * scale);
+    int b;
+
+    for (b = 0; b < HIST_BUCKETS; ++b) {
+        uint64_t high = bucket_high(b);
+        if (src->buckets[b]) {
+            // Move the bucket by its midpoint.
+            uint64_t mid = (uint64_t)((low + (high - low) / 2) * scale);
+            __sync_fetch_and_add(&dst->buckets[bucket_of(mid)],
+                                 src->buckets[b]);
+        }
+        low = high + 1;
+    }
+    __sync_fetch_and_add(&dst->sum, (uint64_t)(src->sum * scale));
+    while (src_max > (max = dst->max)) {
+        if (__sync_bool_compare_and_swap(&dst->max, max, src_max)) break;
+    }
+    __sync_fetch_and_add(&dst->count, src->count);
+}
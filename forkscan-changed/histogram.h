@@ -0,0 +1,88 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/* Module Description:
+   Fixed-size log-linear histograms of durations (or any other unsigned
+   quantity).  Values below 16 get a bucket each; every power of two above
+   that is split into 16 equal buckets, so a reported percentile is within
+   about 6% of the true value.  Recording is lock-free and safe from any
+   thread.
+ */
+
+#ifndef _HISTOGRAM_H_
+#define _HISTOGRAM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HIST_SUB_BITS 4
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+
+typedef struct forkscan_hist_t forkscan_hist_t;
+
+struct forkscan_hist_t {
+    volatile uint64_t count;
+    volatile uint64_t sum;
+    volatile uint64_t max;
+    volatile uint64_t buckets[HIST_BUCKETS];
+};
+
+/**
+ * Add one value to the histogram.
+ */
+void forkscan_hist_record (forkscan_hist_t *h, uint64_t value);
+
+/**
+ * Add one value to a histogram that only the calling thread writes.  No
+ * atomic operations, so it's cheap enough for hot paths.  Readers on other
+ * threads may see it a moment late.
+ */
+void forkscan_hist_record_local (forkscan_hist_t *h, uint64_t value);
+
+/**
+ * Return the smallest value v such that at least fraction p (0 to 1) of
+ * the recorded values are <= v, rounded up to its bucket.  Zero if the
+ * histogram is empty.
+ */
+uint64_t forkscan_hist_percentile (const forkscan_hist_t *h, double p);
+
+/**
+ * Return the mean of the recorded values, or zero if there are none.
+ */
+double forkscan_hist_mean (const forkscan_hist_t *h);
+
+/**
+ * Add the contents of src to dst.
+ */
+void forkscan_hist_merge (forkscan_hist_t *dst, const forkscan_hist_t *src);
+
+/**
+ * Add the contents of src to dst with every value multiplied by scale, e.g.
+ * to convert ticks to ns.  Buckets move whole, so this can add up to one
+ * more bucket's worth of error.
+ */
+void forkscan_hist_merge_scaled (forkscan_hist_t *dst,
+                                 const forkscan_hist_t *src,
+                                 double scale);
+
+#endif // !defined _HISTOGRAM_H_
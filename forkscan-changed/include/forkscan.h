@@ -24,7 +24,7 @@ THE SOFTWARE.
 #define _FORKSCAN_H_
 
 #ifdef __cplusplus
-#include <cstddef.h>
+#include <cstddef>
 extern "C" {
 #else
 #include <stddef.h>
@@ -42,6 +42,28 @@ void *forkscan_malloc (size_t size);
  */
 void forkscan_retire (void *ptr);
 
+/**
+ * Retire a pointer like forkscan_retire(), but call fn(ptr, ctx) on the
+ * thread that frees it, just before the memory is freed.  Use this to
+ * release resources the object owns.  fn must not make ptr reachable again.
+ * It may free memory and retire other objects.  Returns zero on success.
+ * If too many distinct finalizer functions (256) are in use, returns
+ * non-zero and does not retire ptr.
+ */
+int forkscan_retire_with_finalizer (void *ptr,
+                                    void (*fn) (void *ptr, void *ctx),
+                                    void *ctx);
+
+/**
+ * Retire the n pointers in ptrs as if by forkscan_retire_with_finalizer()
+ * with the same fn and ctx (or forkscan_retire() if fn is NULL), but pay for
+ * one call instead of n.  NULL entries are skipped.  On success, returns
+ * zero and clears the array, so it doesn't keep the pointers alive.  If fn
+ * can't be registered, returns non-zero and retires none of them.
+ */
+int forkscan_retire_bulk (void **ptrs, size_t n,
+                          void (*fn) (void *ptr, void *ctx), void *ctx);
+
 /**
  * Free a pointer allocated by Forkscan.  The memory may be immediately reused,
  * so if there is any possibility another thread may know about this memory
@@ -60,6 +82,106 @@ void forkscan_free (void *ptr);
  */
 int forkscan_force_reclaim ();
 
+/**
+ * A reclamation domain: a separate retire queue with its own byte budget,
+ * priority, and statistics.  Use one per data structure to reclaim a busy
+ * structure eagerly while a quiet one waits.  Every snapshot services all
+ * domains that are due, so domains never cost extra forks.
+ */
+typedef struct forkscan_domain forkscan_domain_t;
+
+/**
+ * Statistics for one domain.  "freed" counts pointers found unreferenced
+ * by the first snapshot that scanned them; "survived" counts the rest.
+ * Retirees are counted once the retiring thread hands them to the domain,
+ * in blocks of up to ~500.
+ */
+struct forkscan_domain_stats {
+    char name[32];
+    size_t retired;
+    size_t retired_bytes;
+    size_t pending_bytes;
+    size_t snapshots;
+    size_t scanned;
+    size_t freed;
+    size_t survived;
+};
+
+/**
+ * Create a reclamation domain.  Its retirees are scanned by the first
+ * snapshot after more than byte_budget bytes of them are waiting.  A budget
+ * of 0 never starts an iteration: the domain's retirees wait, a block of
+ * ~500 at a time, for a snapshot taken for some other reason (or for
+ * forkscan_synchronize()).  When several domains are due and the snapshot is short
+ * on room, higher priorities go first.  Up to 7 domains can exist, and they
+ * last for the life of the process.  Returns NULL if there are too many.
+ */
+forkscan_domain_t *forkscan_domain_create (const char *name,
+                                           size_t byte_budget,
+                                           int priority);
+
+/**
+ * Change a domain's byte budget and priority.
+ */
+void forkscan_domain_set_budget (forkscan_domain_t *d,
+                                 size_t byte_budget,
+                                 int priority);
+
+/**
+ * Retire a pointer into domain d.  Otherwise like forkscan_retire().
+ */
+void forkscan_domain_retire (forkscan_domain_t *d, void *ptr);
+
+/**
+ * Copy the domain's statistics into *stats.
+ */
+void forkscan_domain_get_stats (forkscan_domain_t *d,
+                                struct forkscan_domain_stats *stats);
+
+/**
+ * Return a ticket for everything the calling thread has retired so far,
+ * including into domains.  Pass it to forkscan_poll() to find out whether
+ * those pointers have been scanned.
+ */
+size_t forkscan_retire_ticket ();
+
+/**
+ * Return 1 if every pointer retired before the ticket was taken has been
+ * scanned (and freed, or found to be still referenced), zero otherwise.
+ * Doesn't block, and doesn't start an iteration.
+ */
+int forkscan_poll (size_t ticket);
+
+/**
+ * Wait until every pointer the calling thread has retired has been scanned,
+ * starting an iteration only if one is needed, and help free the ones that
+ * were unreferenced.  Like synchronize_rcu().  Don't call this from a
+ * finalizer.
+ */
+void forkscan_synchronize ();
+
+/**
+ * Begin a read-side critical section for the epoch fast path.  Calls nest.
+ * With epoch mode on, every thread that reads shared nodes must do so
+ * between forkscan_enter() and forkscan_exit().
+ */
+void forkscan_enter ();
+
+/**
+ * End a read-side critical section.
+ */
+void forkscan_exit ();
+
+/**
+ * enable = 1 (on) or 0 (off) the epoch fast path.  When it's on,
+ * forkscan_retire() frees a node once every thread has left the critical
+ * sections that were active when it was retired, without a scan.  Nodes
+ * held back by a thread that stays in a critical section too long are
+ * handed to the scanner instead.  Domains always use the scanner.  Also
+ * set by FORKSCAN_EPOCH=1.
+ */
+void forkscan_set_epoch_mode (int enable);
+
 /**
  * auto_run = 1 (enable) or 0 (disable) automatic iterations of reclamation.
  * If the automatic system is disabled, it is up to the user to force
@@ -67,6 +189,28 @@ int forkscan_force_reclaim ();
  */
 void forkscan_set_auto_run (int auto_run);
 
+/**
+ * enable = 1 (on) or 0 (off) interior-pointer recognition.  Normally only a
+ * pointer to the start of a retired node keeps it alive.  With this on, a
+ * pointer anywhere inside it does too (embedded list links, C++ base
+ * subobjects, iterators into inline arrays).  It makes the scan a bit
+ * slower.  Also set by FORKSCAN_INTERIOR_POINTERS=1.
+ */
+void forkscan_set_interior_pointers (int enable);
+
+/**
+ * Set which tag bits the scan ignores when it looks for references.  The
+ * low_bits low-order bits (0-4, default 2) and high_bits high-order bits
+ * (0-16, default 0) of every word are cleared before it is compared with
+ * retired nodes, so pointers carrying mark bits, ABA counters, or type tags
+ * still count.  With sign_extend, the high bits are filled with copies of
+ * the highest remaining bit instead, giving a canonical x86-64 address.
+ * Returns zero on success, non-zero if a count is out of range.  Takes
+ * effect with the next snapshot.  Also set by FORKSCAN_TAG_LOW_BITS,
+ * FORKSCAN_TAG_HIGH_BITS, and FORKSCAN_TAG_SIGN_EXTEND.
+ */
+int forkscan_set_tag_bits (int low_bits, int high_bits, int sign_extend);
+
 /**
  * Allocate a buffer of "size" bytes and return a pointer to it.  This memory
  * will be tracked by the garbage collector, so free() should never be called
@@ -81,6 +225,289 @@ extern void forkscan_set_allocator (void *(*alloc) (size_t),
                                     void (*dealloc) (void *),
                                     size_t (*usable_size) (void *));
 
+/**
+ * An allocator for forkscan_set_allocator_ex().  malloc, free, and
+ * usable_size are required.  The rest may be NULL.  free_sized is passed
+ * the usable size of the block.  free_batch frees n blocks at once, and
+ * usable_size_batch stores the usable sizes of n blocks in sizes.
+ */
+struct forkscan_allocator {
+    const char *name;
+    void *(*malloc) (size_t size);
+    void (*free) (void *ptr);
+    size_t (*usable_size) (void *ptr);
+    void (*free_sized) (void *ptr, size_t size);
+    void (*free_batch) (void **ptrs, size_t n);
+    void (*usable_size_batch) (void **ptrs, size_t *sizes, size_t n);
+};
+
+/**
+ * Set the allocator for Forkscan to use, including the optional batch and
+ * sized entry points.  Call this before allocating anything through
+ * Forkscan.  Returns zero on success, non-zero if a required entry is
+ * missing.
+ */
+extern int forkscan_set_allocator_ex (const struct forkscan_allocator *a);
+
+/**
+ * Return the name of the allocator Forkscan is using: "forkscan" (the
+ * built-in heap), "glibc", "jemalloc", "tcmalloc", "mimalloc",
+ * "supermalloc", or the name given to forkscan_set_allocator_ex().
+ */
+extern const char *forkscan_get_allocator_name ();
+
+
+/**
+ * Actions for forkscan_scan_policy_add().
+ */
+#define FORKSCAN_SCAN_EXCLUDE 0
+#define FORKSCAN_SCAN_INCLUDE 1
+
+/**
+ * Add a rule that decides whether matching memory mappings are scanned for
+ * references.  A mapping matches if its path matches path_glob (fnmatch(3)
+ * syntax; NULL or "" matches anything, including anonymous memory), its
+ * size is in [min_size, max_size] (max_size 0 means unbounded), and its
+ * permission bits, as in /proc/self/maps, match perms ('?' matches any
+ * bit; NULL or "" matches anything).  Rules are checked in the order they
+ * were added, and the first match decides.  Rules in FORKSCAN_SCAN_POLICY
+ * come first.  Non-writable, executable, and Forkscan-owned memory is
+ * never scanned, regardless of the rules.
+ *
+ * Returns zero on success, non-zero if the rule is malformed or the rule
+ * table is full.
+ */
+extern int forkscan_scan_policy_add (int action,
+                                     const char *path_glob,
+                                     size_t min_size,
+                                     size_t max_size,
+                                     const char *perms);
+
+/**
+ * Remove all rules added through the environment or
+ * forkscan_scan_policy_add().  The built-in defaults remain.
+ */
+extern void forkscan_scan_policy_clear ();
+
+/**
+ * Bytes scanned in one memory mapping during the last iteration.
+ */
+struct forkscan_region {
+    size_t low, high;
+    size_t bytes_scanned;
+    char path[128];
+};
+
+/**
+ * Copy up to max entries of the last iteration's per-region scan report
+ * into regions and return the number copied.  Reporting is turned on by
+ * FORKSCAN_REPORT_REGIONS=1 or by the first call to this function.
+ */
+extern int forkscan_get_region_report (struct forkscan_region *regions,
+                                       int max);
+
+/**
+ * Process-wide reclamation statistics.  Times are in nanoseconds.
+ * "retired" counts pointers handed to the scanner, as the GC thread picks
+ * them up, and "reclaimed" counts the ones freed after a scan.  Retirees
+ * freed by the epoch fast path are counted only in epoch_freed.
+ */
+struct forkscan_stats {
+    size_t iterations;
+    size_t retired;
+    size_t retired_bytes;
+    size_t reclaimed;
+    size_t reclaimed_bytes;
+    size_t survivors;          // Times a scan found a retiree referenced.
+    size_t pending;            // Survivors of the last scan.
+    size_t bytes_scanned;
+    size_t last_bytes_scanned;
+    size_t max_bytes_scanned;
+    size_t pause_ns;           // Threads stopped, from signal to fork.
+    size_t last_pause_ns;
+    size_t max_pause_ns;
+    size_t throttle_wait_ns;   // Retiring threads reclaiming or throttled.
+    size_t epoch_freed;
+    size_t epoch_handed_off;
+    size_t candidates;         // Scanned words in range of a retiree.
+    size_t candidate_hits;     // Distinct ones that referred to one.
+    size_t lookaside_flushes;  // Batched lookups of candidates.
+    size_t marks;              // Retirees marked, directly or by tracing.
+    size_t scan_busy_ns;       // Summed over scanner processes.
+    size_t last_siblings;      // Scanner processes in the last iteration.
+    size_t last_imbalance_pct; // How much longer the slowest one took
+                               // than the average, in percent.
+};
+
+/**
+ * What one scanner process did during an iteration.
+ */
+struct forkscan_sibling_stats {
+    size_t bytes_scanned;
+    size_t ranges;
+    size_t candidates;
+    size_t hits;
+    size_t flushes;
+    size_t marks;
+    size_t busy_ns;
+};
+
+/**
+ * Copy the current statistics into *stats.  Never blocks the collector,
+ * and is cheap enough to poll.  FORKSCAN_STATS_FILE or
+ * FORKSCAN_STATS_SOCKET export the same numbers in the Prometheus text
+ * format every FORKSCAN_STATS_INTERVAL_MS.
+ */
+extern void forkscan_get_stats (struct forkscan_stats *stats);
+
+/**
+ * Copy what each scanner process did in the last iteration, up to max of
+ * them (16 at most are used), into siblings and return the number copied.
+ * Compare busy_ns across them to spot load imbalance.
+ */
+extern int forkscan_get_sibling_stats (struct forkscan_sibling_stats *siblings,
+                                       int max);
+
+/**
+ * Where the time went in one iteration, in ns.  The threads are stopped
+ * for signal_ns + quiesce_ns + fork_ns.
+ */
+struct forkscan_iteration {
+    size_t retired;
+    size_t survivors;
+    size_t bytes_scanned;
+    size_t siblings;
+    size_t signal_ns;      // Sending the signal to every thread.
+    size_t quiesce_ns;     // Waiting for them all to stop.
+    size_t fork_ns;        // fork() in the parent, mostly copying page
+                           // tables.
+    size_t child_start_ns; // From calling fork() to the child running.
+    size_t sort_ns;        // The child's sort of the retirees.
+    size_t root_scan_ns;   // The slowest sibling's scan, less its marking,
+    size_t mark_ns;        // ...and its marking.
+    size_t scan_ns;        // From the child starting to it finishing.
+    size_t result_ns;      // From the child finishing to the parent hearing.
+    size_t parent_faults;  // Minor faults in the parent while the child
+                           // ran: mostly copy-on-write.
+};
+
+/**
+ * Copy the breakdown of the last completed iteration into *it and return
+ * its number (counting from 1), or zero if there hasn't been one.
+ */
+extern size_t forkscan_get_last_iteration (struct forkscan_iteration *it);
+
+/**
+ * Operations forkscan_get_latency() reports on.
+ */
+#define FORKSCAN_LATENCY_RETIRE 0 // Each call to a retire function.
+#define FORKSCAN_LATENCY_SIGNAL 1 // Threads stopped for a snapshot.
+#define FORKSCAN_LATENCY_FREE 2   // Freeing reclaimed pointers inline.
+
+/**
+ * The distribution of one operation's latency over all threads, in ns.
+ * Percentiles are accurate to within about 12%.
+ */
+struct forkscan_latency {
+    size_t count;
+    size_t mean_ns;
+    size_t p50_ns;
+    size_t p90_ns;
+    size_t p99_ns;
+    size_t p999_ns;
+    size_t max_ns;
+};
+
+/**
+ * Merge every thread's histogram for operation which (FORKSCAN_LATENCY_*)
+ * into *latency.  Threads record with no atomic operations, so numbers
+ * from running threads may trail by a few samples.  Returns zero on
+ * success, non-zero if which is out of range or Forkscan was built with
+ * NO_RETIRE_HISTOGRAMS.
+ */
+extern int forkscan_get_latency (int which, struct forkscan_latency *latency);
+
+/**
+ * Where the first word found referring to a surviving retiree lives.
+ */
+#define FORKSCAN_RETAINED_BY_UNKNOWN 0 // Nothing found.
+#define FORKSCAN_RETAINED_BY_STACK 1   // A thread's stack.
+#define FORKSCAN_RETAINED_BY_DATA 2    // A library's or the program's data.
+#define FORKSCAN_RETAINED_BY_HEAP 3    // A heap object.
+#define FORKSCAN_RETAINED_BY_ANON 4    // Other anonymous memory.
+#define FORKSCAN_RETAINED_BY_RETIREE 5 // Only another surviving retiree.
+
+/**
+ * One sampled survivor and the first word found referring to it.
+ */
+struct forkscan_retention {
+    void *retiree;
+    size_t size;
+    void *root;           // Address of the referring word, or NULL.
+    int kind;             // FORKSCAN_RETAINED_BY_*
+    unsigned long thread; // The pthread_t whose stack holds root, or 0.
+    char region[64];      // The mapping root is in, e.g., a library path.
+};
+
+/**
+ * Copy up to max survivors sampled in the last diagnostic iteration into
+ * samples and return the number copied.  Sampling is turned on by
+ * FORKSCAN_RETENTION=n, for every nth iteration, and costs those
+ * iterations a second scan of memory.
+ */
+extern int forkscan_get_retention (struct forkscan_retention *samples,
+                                   int max);
+
+/**
+ * Sampled retires from one call site.  retired and bytes are estimates:
+ * the samples scaled by FORKSCAN_RETIRE_SAMPLING.  survivals counts the
+ * iterations that sampled retirees survived, so survivals / freed is the
+ * mean number of scans before one is freed.
+ */
+struct forkscan_callsite {
+    void *pc;            // Return address of the call to the retire function.
+    size_t samples;
+    size_t retired;
+    size_t bytes;
+    size_t freed;        // Sampled retirees freed so far.
+    size_t survivals;
+    size_t max_survived; // Most iterations one sampled retiree survived.
+    char symbol[128];    // e.g., "list_remove+0x4c (liblist.so)"
+};
+
+/**
+ * Copy up to max of the call sites that retired the most, busiest first,
+ * into sites and return the number copied.  Sampling is turned on by
+ * FORKSCAN_RETIRE_SAMPLING=n, which samples about one retire in n.
+ */
+extern int forkscan_get_callsites (struct forkscan_callsite *sites, int max);
+
+/**
+ * Write the timeline recorded since FORKSCAN_TRACE was set to path (or, if
+ * path is NULL, to the FORKSCAN_TRACE path) in the Chrome trace-event JSON
+ * format.  Timestamps are CLOCK_MONOTONIC microseconds.  Returns zero on
+ * success, non-zero if tracing is off or the file can't be written.
+ */
+extern int forkscan_trace_dump (const char *path);
+
+/**
+ * Call fn(arg) when the calling thread exits, before it stops being able to
+ * retire pointers.  Meant for code that batches retires per thread.  Hooks
+ * run in reverse order of registration.  They don't run for the main
+ * thread, whose exit ends the process.  Returns non-zero if the thread
+ * already has 8 hooks.
+ */
+extern int forkscan_thread_atexit (void (*fn) (void *arg), void *arg);
+
+/**
+ * Have the next iteration's scanner write its inputs and results to path:
+ * the retirees, the memory ranges it scans and their contents, and which
+ * retirees it found referenced.  The replay tool scans the file again
+ * offline.  FORKSCAN_SNAPSHOT (and FORKSCAN_SNAPSHOT_ITERATION) capture
+ * one iteration without calling this.  Returns zero if the request was
+ * taken.
+ */
+extern int forkscan_snapshot (const char *path);
 
 /**
  * Robust sleep with whole-second intervals.  This won't exit when there's
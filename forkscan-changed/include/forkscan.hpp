@@ -0,0 +1,385 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/* C++17 layer over the C API in forkscan.h:
+
+   - forkscan::make<T>() and forkscan::retire(), which runs ~T() when
+     Forkscan frees the object.  Retires are batched per thread and handed
+     over with forkscan_retire_bulk().
+   - forkscan::retired<T>, an owning handle that retires its object when it
+     is dropped.
+   - forkscan::resource(), a std::pmr::memory_resource, and
+     forkscan::allocator<T>, for containers.
+ */
+
+#ifndef _FORKSCAN_HPP_
+#define _FORKSCAN_HPP_
+
+#include <cstddef>
+#include <exception>
+#include "forkscan.h"
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace forkscan {
+
+/**
+ * Forkscan allocations are aligned at least this much.
+ */
+inline constexpr std::size_t max_alignment = alignof(std::max_align_t);
+
+namespace detail {
+
+using finalizer_t = void (*) (void *ptr, void *ctx);
+
+template <class T>
+void run_destructor (void *ptr, void *)
+{
+    static_cast<T*>(ptr)->~T();
+}
+
+/**
+ * The finalizer forkscan::retire() registers for a T: its destructor, or
+ * nothing at all if the destructor is trivial.
+ */
+template <class T, bool = std::is_trivially_destructible_v<T>>
+struct finalizer {
+    static constexpr finalizer_t value = &run_destructor<T>;
+};
+
+template <class T>
+struct finalizer<T, true> {
+    static constexpr finalizer_t value = nullptr;
+};
+
+// Retires a thread holds, per finalizer, before handing them to Forkscan.
+inline constexpr std::size_t batch_size = 64;
+
+struct batch;
+
+/**
+ * The calling thread's batches.  They are flushed by a
+ * forkscan_thread_atexit() hook, so a thread that can't register one
+ * doesn't batch at all.
+ */
+struct thread_batches {
+    batch *head;
+    bool registered;
+    bool can_batch;
+
+    void flush () noexcept;
+};
+
+inline thread_local thread_batches t_batches = { nullptr, false, false };
+
+inline void flush_at_exit (void *)
+{
+    // Anything retired after this, e.g., by a later hook, goes straight
+    // through.
+    t_batches.can_batch = false;
+    t_batches.flush();
+}
+
+struct batch {
+    const finalizer_t fn;
+    batch *next;
+    bool linked;
+    std::size_t n;
+    void *ptrs[batch_size];
+
+    constexpr explicit batch (finalizer_t fn) noexcept
+        : fn(fn), next(nullptr), linked(false), n(0), ptrs{}
+    {}
+
+    void flush () noexcept
+    {
+        if (0 == n) return;
+        // Every T has its own finalizer, and Forkscan has room for 256.
+        // Past that, there is no safe way to dispose of the objects.
+        if (0 != forkscan_retire_bulk(ptrs, n, fn, nullptr)) {
+            std::terminate();
+        }
+        n = 0;
+    }
+
+    void push (void *ptr) noexcept
+    {
+        thread_batches &tb = t_batches;
+        if (!tb.registered) {
+            tb.registered = true;
+            tb.can_batch = 0 == forkscan_thread_atexit(&flush_at_exit,
+                                                       nullptr);
+        }
+        if (!tb.can_batch) {
+            ptrs[n++] = ptr;
+            flush();
+            return;
+        }
+        if (!linked) {
+            next = tb.head;
+            tb.head = this;
+            linked = true;
+        }
+        ptrs[n++] = ptr;
+        if (batch_size == n) flush();
+    }
+};
+
+inline void thread_batches::flush () noexcept
+{
+    for (batch *b = head; nullptr != b; b = b->next) b->flush();
+}
+
+template <finalizer_t Fn>
+batch &local_batch () noexcept
+{
+    static thread_local batch b(Fn);
+    return b;
+}
+
+} // namespace detail
+
+/**
+ * Allocate a T from Forkscan and construct it with args.  Throws
+ * std::bad_alloc if there is no memory, or whatever the constructor throws.
+ */
+template <class T, class... Args>
+T *make (Args &&...args)
+{
+    static_assert(alignof(T) <= max_alignment,
+                  "Forkscan doesn't allocate over-aligned types");
+    void *ptr = forkscan_malloc(sizeof(T));
+    if (nullptr == ptr) throw std::bad_alloc();
+    try {
+        return ::new (ptr) T(std::forward<Args>(args)...);
+    } catch (...) {
+        forkscan_free(ptr);
+        throw;
+    }
+}
+
+/**
+ * Destroy and free an object from make() right away.  Only for objects no
+ * other thread can have seen.
+ */
+template <class T>
+void destroy (T *ptr) noexcept
+{
+    if (nullptr == ptr) return;
+    ptr->~T();
+    forkscan_free(ptr);
+}
+
+/**
+ * Retire an object from make<T>(): ~T() runs, and the memory is freed, once
+ * no references to it remain.  T must be the type it was made as, or a base
+ * with a virtual destructor at the same address.  The retire reaches
+ * Forkscan when this thread's batch for T fills, at flush(), or when the
+ * thread exits.
+ */
+template <class T>
+void retire (T *ptr) noexcept
+{
+    if (nullptr == ptr) return;
+    using U = std::remove_cv_t<T>;
+    detail::local_batch<detail::finalizer<U>::value>()
+        .push(const_cast<U*>(ptr));
+}
+
+/**
+ * Hand the calling thread's batched retires to Forkscan now.
+ */
+inline void flush () noexcept
+{
+    detail::t_batches.flush();
+}
+
+/**
+ * forkscan_retire_ticket(), counting this thread's batched retires.
+ */
+inline std::size_t retire_ticket () noexcept
+{
+    flush();
+    return forkscan_retire_ticket();
+}
+
+/**
+ * forkscan_synchronize(), counting this thread's batched retires.
+ */
+inline void synchronize () noexcept
+{
+    flush();
+    forkscan_synchronize();
+}
+
+/**
+ * Owns an object from make<T>() and retires it when dropped, rather than
+ * deleting it.  Move-only, like std::unique_ptr.
+ */
+template <class T>
+class retired {
+  public:
+    using element_type = T;
+
+    constexpr retired () noexcept = default;
+    constexpr retired (std::nullptr_t) noexcept {}
+    explicit retired (T *ptr) noexcept : m_ptr(ptr) {}
+
+    retired (retired &&other) noexcept : m_ptr(other.release()) {}
+
+    retired &operator= (retired &&other) noexcept
+    {
+        reset(other.release());
+        return *this;
+    }
+
+    retired (const retired &) = delete;
+    retired &operator= (const retired &) = delete;
+
+    ~retired () { reset(); }
+
+    T *get () const noexcept { return m_ptr; }
+    T &operator* () const noexcept { return *m_ptr; }
+    T *operator-> () const noexcept { return m_ptr; }
+    explicit operator bool () const noexcept { return nullptr != m_ptr; }
+
+    /**
+     * Give up ownership without retiring.
+     */
+    T *release () noexcept
+    {
+        T *ptr = m_ptr;
+        m_ptr = nullptr;
+        return ptr;
+    }
+
+    /**
+     * Retire the current object, if any, and take ownership of ptr.
+     */
+    void reset (T *ptr = nullptr) noexcept
+    {
+        T *old = m_ptr;
+        m_ptr = ptr;
+        forkscan::retire(old);
+    }
+
+  private:
+    T *m_ptr = nullptr;
+};
+
+/**
+ * make<T>(args...), owned by a retired<T>.
+ */
+template <class T, class... Args>
+retired<T> make_retired (Args &&...args)
+{
+    return retired<T>(make<T>(std::forward<Args>(args)...));
+}
+
+/**
+ * A std::pmr::memory_resource over forkscan_malloc() and forkscan_free().
+ * Deallocation frees immediately; memory other threads may still read has
+ * to be retired instead.  Every instance is interchangeable.
+ */
+class memory_resource final : public std::pmr::memory_resource {
+  protected:
+    void *do_allocate (std::size_t bytes, std::size_t alignment) override
+    {
+        if (alignment > max_alignment) throw std::bad_alloc();
+        void *ptr = forkscan_malloc(bytes);
+        if (nullptr == ptr) throw std::bad_alloc();
+        return ptr;
+    }
+
+    void do_deallocate (void *ptr, std::size_t, std::size_t) override
+    {
+        forkscan_free(ptr);
+    }
+
+    bool do_is_equal (const std::pmr::memory_resource &other)
+        const noexcept override
+    {
+        return nullptr != dynamic_cast<const memory_resource*>(&other);
+    }
+};
+
+/**
+ * The process's forkscan::memory_resource.  It is never destroyed, so
+ * containers with static storage can use it until the very end.
+ */
+inline std::pmr::memory_resource *resource () noexcept
+{
+    alignas(memory_resource)
+        static unsigned char storage[sizeof(memory_resource)];
+    static memory_resource *r = ::new (storage) memory_resource();
+    return r;
+}
+
+/**
+ * An allocator for standard containers, over forkscan_malloc() and
+ * forkscan_free().
+ */
+template <class T>
+class allocator {
+  public:
+    using value_type = T;
+
+    constexpr allocator () noexcept = default;
+
+    template <class U>
+    constexpr allocator (const allocator<U> &) noexcept {}
+
+    T *allocate (std::size_t n)
+    {
+        static_assert(alignof(T) <= max_alignment,
+                      "Forkscan doesn't allocate over-aligned types");
+        if (n > static_cast<std::size_t>(-1) / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        void *ptr = forkscan_malloc(n * sizeof(T));
+        if (nullptr == ptr) throw std::bad_alloc();
+        return static_cast<T*>(ptr);
+    }
+
+    void deallocate (T *ptr, std::size_t) noexcept
+    {
+        forkscan_free(ptr);
+    }
+};
+
+template <class T, class U>
+constexpr bool operator== (const allocator<T> &, const allocator<U> &) noexcept
+{
+    return true;
+}
+
+template <class T, class U>
+constexpr bool operator!= (const allocator<T> &, const allocator<U> &) noexcept
+{
+    return false;
+}
+
+} // namespace forkscan
+
+#endif // !defined _FORKSCAN_HPP_
@@ -0,0 +1,234 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _FORKSCAN_DS_H_
+#define _FORKSCAN_DS_H_
+
+#ifdef __cplusplus
+#include <cstddef>
+extern "C" {
+#else
+#include <stddef.h>
+#endif
+
+#include "forkscan.h"
+
+/**
+ * libforkscan_ds: lock-free data structures built on Forkscan.  Readers
+ * take no hazard pointers and write nothing shared; a node that has been
+ * unlinked is retired, and Forkscan frees it once no thread can still
+ * reach it.  Link with -lforkscan_ds -lforkscan.
+ *
+ * All structures are safe for any number of concurrent threads.  Keys
+ * are longs, values are opaque pointers the structures never dereference
+ * or free.  Under FORKSCAN_EPOCH, or with a reclaimer that needs it, the
+ * caller brackets each operation with forkscan_enter() and
+ * forkscan_exit() (or the reclaimer's own equivalent).
+ */
+
+/**
+ * How a structure hands over the nodes it unlinks.  retire(ptr, ctx) is
+ * called for one node, retire_bulk(ptrs, n, ctx) for several unlinked
+ * together; if retire_bulk is NULL, retire is called for each.  The
+ * structures pass NULL for the defaults, forkscan_retire() and
+ * forkscan_retire_bulk().  Nodes are always allocated with
+ * forkscan_malloc().
+ */
+struct forkscan_ds_reclaimer {
+    void (*retire) (void *ptr, void *ctx);
+    void (*retire_bulk) (void **ptrs, size_t n, void *ctx);
+    void *ctx;
+};
+
+/**
+ * Fill *r with a reclaimer that retires into domain d, so a structure's
+ * nodes are reclaimed on that domain's byte budget.
+ */
+void forkscan_ds_domain_reclaimer (struct forkscan_ds_reclaimer *r,
+                                   forkscan_domain_t *d);
+
+/****************************************************************************/
+/*                            Sorted linked list                            */
+/****************************************************************************/
+
+/**
+ * Harris-Michael sorted list.  A removed node is marked in its next
+ * pointer and unlinked by whichever thread passes it next; runs of marked
+ * nodes are cut out with one CAS and retired together.  Lookups are
+ * wait-free and never unlink.  O(n) per operation: use it for short sets
+ * or as a building block.
+ */
+typedef struct forkscan_ds_list forkscan_ds_list_t;
+
+/**
+ * Create an empty list.  r may be NULL for the Forkscan defaults.
+ * Returns NULL if out of memory.
+ */
+forkscan_ds_list_t *forkscan_ds_list_create
+(const struct forkscan_ds_reclaimer *r);
+
+/**
+ * Free the list and every node in it, at once.  No other thread may be
+ * using the list, or still hold a pointer into it.
+ */
+void forkscan_ds_list_destroy (forkscan_ds_list_t *l);
+
+/**
+ * Insert key with the given value.  Returns 1 if it was inserted, 0 if
+ * the key was already present, and -1 if out of memory.
+ */
+int forkscan_ds_list_insert (forkscan_ds_list_t *l, long key, void *value);
+
+/**
+ * Remove key.  Returns 1 and stores its value in *value (if value isn't
+ * NULL) if it was present, 0 otherwise.
+ */
+int forkscan_ds_list_remove (forkscan_ds_list_t *l, long key, void **value);
+
+/**
+ * Look up key.  Returns 1 and stores its value in *value (if value isn't
+ * NULL) if it is present, 0 otherwise.
+ */
+int forkscan_ds_list_lookup (forkscan_ds_list_t *l, long key, void **value);
+
+/****************************************************************************/
+/*                                 Hash map                                 */
+/****************************************************************************/
+
+/**
+ * Split-ordered hash map (Shalev and Shavit).  All entries live in one
+ * Harris-Michael list sorted by bit-reversed hash, and buckets are
+ * shortcuts into it, so the table doubles without moving or retiring any
+ * node.  Bucket arrays are allocated as the table grows and kept until
+ * the map is destroyed.
+ */
+typedef struct forkscan_ds_hash forkscan_ds_hash_t;
+
+/**
+ * Create an empty map sized for about capacity entries; it grows past
+ * that as needed.  r may be NULL for the Forkscan defaults.  Returns NULL
+ * if out of memory.
+ */
+forkscan_ds_hash_t *forkscan_ds_hash_create
+(size_t capacity, const struct forkscan_ds_reclaimer *r);
+
+/**
+ * Free the map and every entry in it, at once.  No other thread may be
+ * using the map, or still hold a pointer into it.
+ */
+void forkscan_ds_hash_destroy (forkscan_ds_hash_t *h);
+
+/**
+ * As forkscan_ds_list_insert(), forkscan_ds_list_remove() and
+ * forkscan_ds_list_lookup(), in expected O(1).
+ */
+int forkscan_ds_hash_insert (forkscan_ds_hash_t *h, long key, void *value);
+int forkscan_ds_hash_remove (forkscan_ds_hash_t *h, long key, void **value);
+int forkscan_ds_hash_lookup (forkscan_ds_hash_t *h, long key, void **value);
+
+/**
+ * The number of entries, which is only exact while no update is in
+ * flight.
+ */
+size_t forkscan_ds_hash_count (forkscan_ds_hash_t *h);
+
+/****************************************************************************/
+/*                                 Skiplist                                 */
+/****************************************************************************/
+
+/**
+ * Lock-free skiplist (Fraser; Herlihy and Shavit).  A node is removed by
+ * marking its next pointers from the top level down; the thread that
+ * marks level 0 has removed it, unlinks it from every level, and retires
+ * it.  Lookups never write.  Keys LONG_MIN and LONG_MAX are reserved.
+ */
+typedef struct forkscan_ds_skiplist forkscan_ds_skiplist_t;
+
+/**
+ * Create an empty skiplist.  r may be NULL for the Forkscan defaults.
+ * Returns NULL if out of memory.
+ */
+forkscan_ds_skiplist_t *forkscan_ds_skiplist_create
+(const struct forkscan_ds_reclaimer *r);
+
+/**
+ * Free the skiplist and every node in it, at once.  No other thread may
+ * be using it, or still hold a pointer into it.
+ */
+void forkscan_ds_skiplist_destroy (forkscan_ds_skiplist_t *sl);
+
+/**
+ * As forkscan_ds_list_insert(), forkscan_ds_list_remove() and
+ * forkscan_ds_list_lookup(), in expected O(log n).
+ */
+int forkscan_ds_skiplist_insert (forkscan_ds_skiplist_t *sl, long key,
+                                 void *value);
+int forkscan_ds_skiplist_remove (forkscan_ds_skiplist_t *sl, long key,
+                                 void **value);
+int forkscan_ds_skiplist_lookup (forkscan_ds_skiplist_t *sl, long key,
+                                 void **value);
+
+/****************************************************************************/
+/*                                MPMC queue                                */
+/****************************************************************************/
+
+/**
+ * Unbounded multi-producer, multi-consumer FIFO queue.  It is a linked
+ * list of arrays of slots (Ramalhete and Correia's FAAArrayQueue):
+ * producers and consumers claim slots with a fetch-and-add, and a
+ * segment is retired once every slot in it has been consumed, so there
+ * is one retire per FORKSCAN_DS_QUEUE_SEGMENT items instead of one per
+ * item.
+ */
+typedef struct forkscan_ds_queue forkscan_ds_queue_t;
+
+#define FORKSCAN_DS_QUEUE_SEGMENT 64
+
+/**
+ * Create an empty queue.  r may be NULL for the Forkscan defaults.
+ * Returns NULL if out of memory.
+ */
+forkscan_ds_queue_t *forkscan_ds_queue_create
+(const struct forkscan_ds_reclaimer *r);
+
+/**
+ * Free the queue.  Items still in it are dropped, not freed.  No other
+ * thread may be using the queue.
+ */
+void forkscan_ds_queue_destroy (forkscan_ds_queue_t *q);
+
+/**
+ * Append item, which must not be NULL or (void*)1.  Returns 0, or -1 if
+ * out of memory.
+ */
+int forkscan_ds_queue_enqueue (forkscan_ds_queue_t *q, void *item);
+
+/**
+ * Take the oldest item.  Returns NULL if the queue is empty.
+ */
+void *forkscan_ds_queue_dequeue (forkscan_ds_queue_t *q);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // !defined _FORKSCAN_DS_H_
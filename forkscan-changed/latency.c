@@ -0,0 +1,164 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "alloc.h"
+#include "latency.h"
+#include "metautil.h"
+#include "proc.h"
+#include <pthread.h>
+#include <string.h>
+#include "util.h"
+
+/****************************************************************************/
+/*                         Defines, typedefs, etc.                          */
+/****************************************************************************/
+
+#define LATENCY_BLOCK_SIZE PAGEALIGN(sizeof(thread_latency_t) + PAGESIZE - 1)
+
+// Least time to measure the tick rate over, in ns.
+#define CALIBRATION_NS 1000000
+
+/****************************************************************************/
+/*                                 Globals                                  */
+/****************************************************************************/
+
+// Histograms of threads that have exited.
+static thread_latency_t g_exited;
+
+#ifndef NO_RETIRE_HISTOGRAMS
+
+DEFINE_POOL_ALLOC(latency, LATENCY_BLOCK_SIZE, 4,
+                  forkscan_alloc_mmap_parent)
+
+// When the library was loaded, in ticks and ns, to measure the tick rate.
+static uint64_t g_ticks0, g_ns0;
+
+#endif // !defined NO_RETIRE_HISTOGRAMS
+
+static const char *g_names[N_LATENCIES] = {
+    [LATENCY_RETIRE] = "retire",
+    [LATENCY_SIGNAL] = "signal",
+    [LATENCY_FREE] = "free",
+};
+
+/****************************************************************************/
+/*                             Helper functions                             */
+/****************************************************************************/
+
+#ifndef NO_RETIRE_HISTOGRAMS
+
+__attribute__((constructor (102)))
+static void latency_init ()
+{
+    g_ticks0 = forkscan_latency_now();
+    g_ns0 = forkscan_util_nanotime();
+}
+
+/** ns per tick, measured since the library was loaded.  That's long enough
+ *  to be accurate by the time anybody asks, except right at start-up,
+ *  where we wait for a short baseline.
+ */
+static double ns_per_tick ()
+{
+    uint64_t ns, ticks;
+    do {
+        ticks = forkscan_latency_now() - g_ticks0;
+        ns = forkscan_util_nanotime() - g_ns0;
+    } while (ns < CALIBRATION_NS);
+    return (double)ns / ticks;
+}
+
+#endif // !defined NO_RETIRE_HISTOGRAMS
+
+/****************************************************************************/
+/*                            Internal interface                            */
+/****************************************************************************/
+
+/**
+ * Return zeroed histograms for a new thread, or NULL if they're compiled
+ * out.
+ */
+thread_latency_t *forkscan_latency_new ()
+{
+#ifndef NO_RETIRE_HISTOGRAMS
+    thread_latency_t *l = (thread_latency_t*)pool_alloc_latency();
+    memset(l, 0, sizeof(thread_latency_t));
+    return l;
+#else
+    return NULL;
+#endif
+}
+
+/**
+ * Add an exiting thread's histograms to the totals kept for dead threads.
+ */
+void forkscan_latency_thread_exit (thread_latency_t *l)
+{
+    int kind;
+
+    if (NULL == l) return;
+    for (kind = 0; kind < N_LATENCIES; ++kind) {
+        forkscan_hist_merge(&g_exited.hist[kind], &l->hist[kind]);
+    }
+}
+
+/**
+ * Give back a thread's histograms.
+ */
+void forkscan_latency_free (thread_latency_t *l)
+{
+#ifndef NO_RETIRE_HISTOGRAMS
+    if (l) pool_free_latency(l);
+#endif
+}
+
+/**
+ * Merge every thread's histogram for kind into *dst, in ns.  Returns
+ * non-zero if the histograms are compiled out.  Not reentrant.
+ */
+int forkscan_latency_merge (latency_kind_t kind, forkscan_hist_t *dst)
+{
+#ifndef NO_RETIRE_HISTOGRAMS
+    thread_list_t *thread_list = forkscan_proc_get_thread_list();
+    thread_data_t *td;
+    static forkscan_hist_t ticks; // Callers serialize.
+
+    // Merge in ticks, then convert once.
+    memset(&ticks, 0, sizeof(ticks));
+    forkscan_hist_merge(&ticks, &g_exited.hist[kind]);
+    FOREACH_IN_THREAD_LIST(td, thread_list)
+        if (td->latency) forkscan_hist_merge(&ticks, &td->latency->hist[kind]);
+    ENDFOREACH_IN_THREAD_LIST(td, thread_list);
+    forkscan_hist_merge_scaled(dst, &ticks, ns_per_tick());
+    return 0;
+#else
+    return 1;
+#endif
+}
+
+/**
+ * Return the name of kind, for reports.
+ */
+const char *forkscan_latency_name (latency_kind_t kind)
+{
+    return g_names[kind];
+}
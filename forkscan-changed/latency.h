@@ -0,0 +1,106 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/* Module Description:
+   Per-thread latency histograms for what application threads pay for:
+   forkscan_retire() as a whole (inline frees and throttling included),
+   answering the snapshot signal, and freeing pointers other threads
+   retired.  Each thread records into its own histograms, timed with the
+   TSC and without atomics.  They're merged, and ticks converted to ns, only
+   when somebody asks.  Build with -DNO_RETIRE_HISTOGRAMS to compile the
+   recording out.
+ */
+
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+#include "histogram.h"
+#include <stdint.h>
+#include <time.h>
+
+typedef enum {
+    LATENCY_RETIRE,  // A call to forkscan_retire() or a domain retire.
+    LATENCY_SIGNAL,  // From the snapshot signal to the threads' release.
+    LATENCY_FREE,    // Freeing pointers, possibly retired by other threads.
+    N_LATENCIES
+} latency_kind_t;
+
+typedef struct thread_latency_t thread_latency_t;
+
+struct thread_latency_t {
+    forkscan_hist_t hist[N_LATENCIES];
+};
+
+#ifndef NO_RETIRE_HISTOGRAMS
+
+static inline uint64_t forkscan_latency_now ()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+// Time a stretch of code into the calling thread's (td's) histogram.
+#define LATENCY_BEGIN(start) uint64_t start = forkscan_latency_now()
+#define LATENCY_END(td, kind, start)                                    \
+    forkscan_hist_record_local(&(td)->latency->hist[kind],              \
+                               forkscan_latency_now() - (start))
+
+#else
+
+#define LATENCY_BEGIN(start)
+#define LATENCY_END(td, kind, start) do {} while (0)
+
+#endif // !defined NO_RETIRE_HISTOGRAMS
+
+/**
+ * Return zeroed histograms for a new thread, or NULL if they're compiled
+ * out.
+ */
+thread_latency_t *forkscan_latency_new ();
+
+/**
+ * Add an exiting thread's histograms to the totals kept for dead threads.
+ */
+void forkscan_latency_thread_exit (thread_latency_t *l);
+
+/**
+ * Give back a thread's histograms.
+ */
+void forkscan_latency_free (thread_latency_t *l);
+
+/**
+ * Merge every thread's histogram for kind into *dst, in ns.  Returns
+ * non-zero if the histograms are compiled out.  Not reentrant.
+ */
+int forkscan_latency_merge (latency_kind_t kind, forkscan_hist_t *dst);
+
+/**
+ * Return the name of kind, for reports.
+ */
+const char *forkscan_latency_name (latency_kind_t kind);
+
+#endif // !defined _LATENCY_H_
@@ -0,0 +1,483 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/* Microbenchmark for the scanner's kernels.  It builds a synthetic heap
+   with the Forkscan allocator, picks some of its objects as retirees, and
+   times the real sort, compaction, search, root-scanning and lookaside
+   routines from util.c and child.c against it, in this process, without
+   forking.  Build with "make microbench"; run "./microbench -h" for the
+   knobs.  The FORKSCAN_* environment variables that pick a scanning mode
+   (interior pointers, tag bits) apply here as well. */
+
+#define _GNU_SOURCE
+#include "alloc.h"
+#include "buffer.h"
+#include "child.h"
+#include <getopt.h>
+#include "heap.h"
+#include "include/forkscan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+
+/****************************************************************************/
+/*                         Defines, typedefs, etc.                          */
+/****************************************************************************/
+
+#define DEFAULT_HEAP_BYTES ((size_t)256 << 20)
+#define DEFAULT_OBJECT_BYTES 64
+#define DEFAULT_RETIRED 0.01
+#define DEFAULT_POINTERS 0.25
+#define DEFAULT_SECONDS 0.5
+
+// Lookups timed by the search kernels, and candidates fed to compaction
+// and the lookaside list.
+#define N_PROBES (1 << 20)
+
+// The clustered distribution retires runs of this many neighboring
+// objects, and its pointers only reach this many objects either way.
+#define CLUSTER_RUN 64
+#define CLUSTER_WINDOW 4096
+
+typedef enum dist_t dist_t;
+typedef struct kernel_t kernel_t;
+
+enum dist_t { DIST_UNIFORM, DIST_CLUSTERED };
+
+struct kernel_t {
+    const char *name;
+    void (*prepare) ();          // Untimed, before every repetition.
+    void (*run) ();
+    size_t (*ops) ();            // Per repetition.
+    size_t (*bytes) ();          // Per repetition, or 0 if it isn't a
+                                 // bandwidth measure.
+};
+
+/****************************************************************************/
+/*                                 Globals                                  */
+/****************************************************************************/
+
+static size_t g_heap_bytes = DEFAULT_HEAP_BYTES;
+static size_t g_object_bytes = DEFAULT_OBJECT_BYTES;
+static double g_retired = DEFAULT_RETIRED;
+static double g_pointers = DEFAULT_POINTERS;
+static dist_t g_dist = DIST_UNIFORM;
+static double g_seconds = DEFAULT_SECONDS;
+static uint64_t g_seed = 1;
+static int g_csv;
+
+static size_t **g_objects;
+static size_t g_n_objects;
+
+// The retirees, sorted with a minimap, as the scanner sees them.
+static addr_buffer_t *g_ab;
+static addr_buffer_t *g_deadrefs;
+
+// The retirees in shuffled order, and space to sort or compact a copy.
+static size_t *g_unsorted;
+static size_t *g_work;
+
+// Values to look up: half are retirees, the rest anywhere in their range.
+static size_t *g_probes;
+static size_t *g_sorted_probes;
+
+// What a root scan puts on the lookaside list: probes, with repeats.
+static size_t *g_candidates;
+static size_t *g_sorted_candidates;
+
+static mem_range_t *g_extents;
+static int g_n_extents;
+static size_t g_extent_bytes;
+
+static volatile size_t g_sink;
+
+/****************************************************************************/
+/*                             Helper functions                             */
+/****************************************************************************/
+
+static void usage (const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -H BYTES   synthetic heap size, with K, M or G (default 256M)\n"
+            "  -b BYTES   object size (default %d)\n"
+            "  -r FRAC    fraction of objects retired (default %g)\n"
+            "  -p FRAC    fraction of words that are pointers (default %g)\n"
+            "  -d DIST    uniform or clustered retirees and pointers"
+            " (default uniform)\n"
+            "  -k LIST    comma-separated kernels (default all):\n"
+            "             sort,avl_sort,compact,find,find_hint,roots,"
+            "lookaside\n"
+            "  -t SECS    minimum time per kernel (default %g)\n"
+            "  -s SEED    random seed (default 1)\n"
+            "  -c         CSV output\n",
+            prog, DEFAULT_OBJECT_BYTES, DEFAULT_RETIRED, DEFAULT_POINTERS,
+            DEFAULT_SECONDS);
+    exit(1);
+}
+
+static uint64_t next_rand ()
+{
+    // xorshift64*
+    g_seed ^= g_seed >> 12;
+    g_seed ^= g_seed << 25;
+    g_seed ^= g_seed >> 27;
+    return g_seed * 0x2545F4914F6CDD1DULL;
+}
+
+static size_t parse_bytes (const char *s)
+{
+    char *end;
+    size_t n = strtoull(s, &end, 0);
+    switch (*end) {
+    case 'G': case 'g': n <<= 10; // Fall through.
+    case 'M': case 'm': n <<= 10; // Fall through.
+    case 'K': case 'k': n <<= 10;
+    }
+    return n;
+}
+
+static void *checked_malloc (size_t size)
+{
+    void *p = malloc(size);
+    if (NULL == p) {
+        forkscan_fatal("microbench: out of memory\n");
+    }
+    return p;
+}
+
+static int compare_addrs (const void *a, const void *b)
+{
+    size_t x = *(const size_t*)a, y = *(const size_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void add_extent (size_t low, size_t high, void *arg)
+{
+    static int capacity;
+    if (g_n_extents == capacity) {
+        capacity = capacity ? capacity * 2 : 256;
+        g_extents = realloc(g_extents, capacity * sizeof(mem_range_t));
+        if (NULL == g_extents) {
+            forkscan_fatal("microbench: out of memory\n");
+        }
+    }
+    g_extents[g_n_extents].low = low;
+    g_extents[g_n_extents].high = high;
+    ++g_n_extents;
+    g_extent_bytes += high - low;
+}
+
+/** The object a pointer in object i should refer to.
+ */
+static size_t *pick_target (size_t i)
+{
+    if (DIST_UNIFORM == g_dist) {
+        return g_objects[next_rand() % g_n_objects];
+    }
+    size_t lo = i > CLUSTER_WINDOW ? i - CLUSTER_WINDOW : 0;
+    size_t hi = MIN_OF(g_n_objects, i + CLUSTER_WINDOW);
+    return g_objects[lo + next_rand() % (hi - lo)];
+}
+
+/** Allocate the heap, fill it in, and build the retiree buffer.
+ */
+static void build_heap ()
+{
+    size_t i, j;
+
+    g_n_objects = g_heap_bytes / g_object_bytes;
+    if (g_n_objects < 2) usage("microbench");
+    g_objects = checked_malloc(g_n_objects * sizeof(size_t*));
+    for (i = 0; i < g_n_objects; ++i) {
+        g_objects[i] = forkscan_malloc(g_object_bytes);
+        if (NULL == g_objects[i]) {
+            forkscan_fatal("microbench: forkscan_malloc failed\n");
+        }
+    }
+
+    // Choose the retirees.
+    char *retired = calloc(g_n_objects, 1);
+    size_t n_retired = MAX_OF(1, (size_t)(g_retired * g_n_objects));
+    size_t chosen = 0;
+    while (chosen < n_retired) {
+        size_t run = DIST_CLUSTERED == g_dist ? CLUSTER_RUN : 1;
+        size_t start = next_rand() % g_n_objects;
+        for (i = start; i < start + run && i < g_n_objects
+                 && chosen < n_retired; ++i) {
+            if (!retired[i]) {
+                retired[i] = 1;
+                ++chosen;
+            }
+        }
+    }
+
+    // Fill in the objects: pointers to other objects, and small integers
+    // that are never in range of a retiree.
+    size_t words = g_object_bytes / sizeof(size_t);
+    uint64_t threshold = (uint64_t)(g_pointers * (double)UINT64_MAX);
+    for (i = 0; i < g_n_objects; ++i) {
+        for (j = 0; j < words; ++j) {
+            g_objects[i][j] = next_rand() < threshold
+                ? (size_t)pick_target(i) : j;
+        }
+    }
+
+    g_ab = forkscan_make_aggregate_buffer(n_retired);
+    g_unsorted = checked_malloc(n_retired * sizeof(size_t));
+    g_work = checked_malloc(MAX_OF(n_retired, N_PROBES) * sizeof(size_t));
+    for (i = 0, j = 0; i < g_n_objects; ++i) {
+        if (retired[i]) g_unsorted[j++] = (size_t)g_objects[i];
+    }
+    free(retired);
+    forkscan_util_randomize(g_unsorted, n_retired);
+    memcpy(g_ab->addrs, g_unsorted, n_retired * sizeof(size_t));
+    g_ab->n_addrs = n_retired;
+    forkscan_util_avl_sort(g_ab->addrs, g_ab->n_addrs);
+    forkscan_buffer_generate_minimap(g_ab);
+
+    g_deadrefs = forkscan_make_aggregate_buffer(1);
+    g_deadrefs->n_addrs = 0;
+
+    // Probes and lookaside candidates.
+    size_t low = g_ab->addrs[0];
+    size_t span = g_ab->addrs[g_ab->n_addrs - 1] - low + 1;
+    g_probes = checked_malloc(N_PROBES * sizeof(size_t));
+    g_sorted_probes = checked_malloc(N_PROBES * sizeof(size_t));
+    g_candidates = checked_malloc(N_PROBES * sizeof(size_t));
+    g_sorted_candidates = checked_malloc(N_PROBES * sizeof(size_t));
+    for (i = 0; i < N_PROBES; ++i) {
+        g_probes[i] = i & 1
+            ? g_ab->addrs[next_rand() % g_ab->n_addrs]
+            : PTR_MASK(low + next_rand() % span);
+    }
+    memcpy(g_sorted_probes, g_probes, N_PROBES * sizeof(size_t));
+    qsort(g_sorted_probes, N_PROBES, sizeof(size_t), compare_addrs);
+    for (i = 0; i < N_PROBES; ++i) {
+        g_candidates[i] = g_probes[next_rand() % (N_PROBES / 2)];
+    }
+    memcpy(g_sorted_candidates, g_candidates, N_PROBES * sizeof(size_t));
+    qsort(g_sorted_candidates, N_PROBES, sizeof(size_t), compare_addrs);
+
+    // What a scanner process would walk.
+    mem_range_t heap = forkscan_heap_range();
+    forkscan_heap_for_each_extent(heap.low, heap.high, add_extent, NULL);
+    if (0 == g_n_extents) {
+        // Not the built-in heap: walk the span of the objects instead.
+        size_t lo = (size_t)-1, hi = 0;
+        for (i = 0; i < g_n_objects; ++i) {
+            lo = MIN_OF(lo, (size_t)g_objects[i]);
+            hi = MAX_OF(hi, (size_t)g_objects[i] + g_object_bytes);
+        }
+        add_extent(lo, hi, NULL);
+    }
+
+    forkscan_child_kernels_init(g_ab, g_deadrefs);
+}
+
+/****************************************************************************/
+/*                                 Kernels                                  */
+/****************************************************************************/
+
+static void nothing () {}
+
+static void clear_marks ()
+{
+    int i;
+    for (i = 0; i < g_ab->n_addrs; ++i) g_ab->addrs[i] &= ~(size_t)0x1;
+}
+
+static void copy_unsorted ()
+{
+    memcpy(g_work, g_unsorted, g_ab->n_addrs * sizeof(size_t));
+}
+
+static void copy_candidates ()
+{
+    memcpy(g_work, g_sorted_candidates, N_PROBES * sizeof(size_t));
+}
+
+static void run_sort () { forkscan_util_sort(g_work, g_ab->n_addrs); }
+
+static void run_avl_sort () { forkscan_util_avl_sort(g_work, g_ab->n_addrs); }
+
+static void run_compact ()
+{
+    g_sink += forkscan_util_compact(g_work, N_PROBES);
+}
+
+static void run_find ()
+{
+    size_t i, sum = 0;
+    for (i = 0; i < N_PROBES; ++i) {
+        sum += forkscan_child_addr_find(g_probes[i], g_ab);
+    }
+    g_sink += sum;
+}
+
+static void run_find_hint ()
+{
+    size_t i, sum = 0;
+    int loc = 0;
+    for (i = 0; i < N_PROBES; ++i) {
+        loc = forkscan_child_addr_find_hint(g_sorted_probes[i], g_ab, loc);
+        sum += loc;
+    }
+    g_sink += sum;
+}
+
+static void run_roots ()
+{
+    int i;
+    for (i = 0; i < g_n_extents; ++i) {
+        forkscan_child_find_roots(g_extents[i].low, g_extents[i].high,
+                                  g_ab, g_deadrefs);
+    }
+}
+
+static void run_lookaside ()
+{
+    forkscan_child_lookup_lookaside(g_ab, g_candidates, N_PROBES);
+}
+
+static size_t retirees () { return g_ab->n_addrs; }
+static size_t retiree_bytes () { return g_ab->n_addrs * sizeof(size_t); }
+static size_t probes () { return N_PROBES; }
+static size_t probe_bytes () { return N_PROBES * sizeof(size_t); }
+static size_t no_bytes () { return 0; }
+static size_t scanned_words () { return g_extent_bytes / sizeof(size_t); }
+static size_t scanned_bytes () { return g_extent_bytes; }
+
+static const kernel_t g_kernels[] = {
+    { "sort", copy_unsorted, run_sort, retirees, retiree_bytes },
+    { "avl_sort", copy_unsorted, run_avl_sort, retirees, retiree_bytes },
+    { "compact", copy_candidates, run_compact, probes, probe_bytes },
+    { "find", nothing, run_find, probes, no_bytes },
+    { "find_hint", nothing, run_find_hint, probes, no_bytes },
+    { "roots", clear_marks, run_roots, scanned_words, scanned_bytes },
+    { "lookaside", clear_marks, run_lookaside, probes, no_bytes },
+};
+
+#define N_KERNELS (sizeof(g_kernels) / sizeof(g_kernels[0]))
+
+/** Repeat k until it has run for at least g_seconds, then report.
+ */
+static void time_kernel (const kernel_t *k)
+{
+    uint64_t elapsed = 0;
+    size_t reps = 0;
+
+    while (elapsed < (uint64_t)(g_seconds * 1e9) || reps == 0) {
+        k->prepare();
+        uint64_t start = forkscan_util_nanotime();
+        k->run();
+        elapsed += forkscan_util_nanotime() - start;
+        ++reps;
+    }
+
+    double ops = (double)k->ops() * reps;
+    double bytes = (double)k->bytes() * reps;
+    double ns_per_op = ops > 0 ? elapsed / ops : 0;
+    double gb_per_s = elapsed > 0 ? bytes / elapsed : 0;
+
+    if (g_csv) {
+        printf("%s,%zu,%zu,%g,%g,%s,%zu,%.0f,%.3f,",
+               k->name, g_heap_bytes, g_object_bytes, g_retired, g_pointers,
+               DIST_UNIFORM == g_dist ? "uniform" : "clustered",
+               reps, ops, ns_per_op);
+        if (bytes > 0) printf("%.3f", gb_per_s);
+        printf("\n");
+    } else if (bytes > 0) {
+        printf("%-10s %6zu %14.0f %10.3f %8.3f\n",
+               k->name, reps, ops, ns_per_op, gb_per_s);
+    } else {
+        printf("%-10s %6zu %14.0f %10.3f %8s\n",
+               k->name, reps, ops, ns_per_op, "-");
+    }
+}
+
+/****************************************************************************/
+/*                                   Main                                   */
+/****************************************************************************/
+
+int main (int argc, char **argv)
+{
+    const char *kernels = NULL;
+    int opt;
+    size_t i;
+
+    while ((opt = getopt(argc, argv, "H:b:r:p:d:k:t:s:ch")) != -1) {
+        switch (opt) {
+        case 'H': g_heap_bytes = parse_bytes(optarg); break;
+        case 'b': g_object_bytes = parse_bytes(optarg); break;
+        case 'r': g_retired = atof(optarg); break;
+        case 'p': g_pointers = atof(optarg); break;
+        case 'd':
+            if (0 == strcmp(optarg, "uniform")) g_dist = DIST_UNIFORM;
+            else if (0 == strcmp(optarg, "clustered")) g_dist = DIST_CLUSTERED;
+            else usage(argv[0]);
+            break;
+        case 'k': kernels = optarg; break;
+        case 't': g_seconds = atof(optarg); break;
+        case 's': g_seed = strtoull(optarg, NULL, 0) | 1; break;
+        case 'c': g_csv = 1; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (optind != argc || g_object_bytes < sizeof(size_t)
+        || g_retired <= 0 || g_retired > 1
+        || g_pointers < 0 || g_pointers > 1 || g_seconds <= 0) {
+        usage(argv[0]);
+    }
+
+    build_heap();
+
+    if (g_csv) {
+        printf("kernel,heap_bytes,object_bytes,retired,pointers,dist,"
+               "reps,ops,ns_per_op,gb_per_s\n");
+    } else {
+        printf("%zu objects of %zu bytes, %d retired, %zu bytes to scan in"
+               " %d extents\n",
+               g_n_objects, g_object_bytes, g_ab->n_addrs, g_extent_bytes,
+               g_n_extents);
+        printf("%-10s %6s %14s %10s %8s\n",
+               "kernel", "reps", "ops", "ns/op", "GB/s");
+    }
+
+    for (i = 0; i < N_KERNELS; ++i) {
+        const char *name = g_kernels[i].name;
+        if (kernels) {
+            // Match whole names in the comma-separated list.
+            const char *p = strstr(kernels, name);
+            size_t len = strlen(name);
+            while (p && ((p != kernels && p[-1] != ',')
+                         || (p[len] != '\0' && p[len] != ','))) {
+                p = strstr(p + 1, name);
+            }
+            if (!p) continue;
+        }
+        time_kernel(&g_kernels[i]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,408 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "alloc.h"
+#include <assert.h>
+#include "env.h"
+#include <fnmatch.h>
+#include "include/forkscan.h"
+#include "policy.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+
+/****************************************************************************/
+/*                         Defines, typedefs, etc.                          */
+/****************************************************************************/
+
+#define MAX_SCAN_RULES 64
+#define RULE_GLOB_SIZE 256
+
+// Must match FORKSCAN_SCAN_EXCLUDE/FORKSCAN_SCAN_INCLUDE in forkscan.h.
+#define RULE_EXCLUDE 0
+#define RULE_INCLUDE 1
+
+typedef struct scan_rule_t scan_rule_t;
+
+/** A rule matches a mapping if every field matches.  An empty glob or
+ *  perms string matches anything, as does a zero max_size.
+ */
+struct scan_rule_t {
+    int action;
+    char glob[RULE_GLOB_SIZE];
+    char perms[5];     // e.g., "rw?p".  '?' matches any bit.
+    size_t min_size;
+    size_t max_size;
+};
+
+typedef struct region_table_t region_table_t;
+
+struct region_table_t {
+    int n_regions;
+    int truncated;
+    region_report_t regions[MAX_REPORTED_REGIONS];
+};
+
+static const char env_scan_policy[] = "FORKSCAN_SCAN_POLICY";
+
+/****************************************************************************/
+/*                                 Globals                                  */
+/****************************************************************************/
+
+// User rules.  Checked first, in order.
+static scan_rule_t g_user_rules[MAX_SCAN_RULES];
+static volatile int g_n_user_rules;
+static pthread_mutex_t g_rules_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Defaults that apply when no user rule matches.  Part of the Forkscan
+// module memory or otherwise known to be clean.
+static const scan_rule_t g_default_rules[] = {
+    { RULE_EXCLUDE, "*/libc[.-]*", "", 0, 0 },
+    { RULE_EXCLUDE, "*/libdl[.-]*", "", 0, 0 },
+    { RULE_EXCLUDE, "*/libforkscan[.-]*", "", 0, 0 },
+    // Shared writable memory.  This is probably the commq.
+    { RULE_EXCLUDE, "", "???s", 0, 0 },
+};
+
+// Written by the child, read by the GC thread after the iteration.
+static region_table_t *g_shared_report;
+// Copy of the last complete report, for the user.
+static region_table_t *g_last_report;
+static pthread_mutex_t g_report_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/****************************************************************************/
+/*                             Rule matching.                               */
+/****************************************************************************/
+
+static int perms_match (const char *pattern, const char *bits)
+{
+    int i;
+    for (i = 0; pattern[i] != '\0' && i < 4; ++i) {
+        if ('?' != pattern[i] && bits[i] != pattern[i]) return 0;
+    }
+    return 1;
+}
+
+static int rule_matches (const scan_rule_t *rule,
+                         size_t size,
+                         const char *bits,
+                         const char *path)
+{
+    if (size < rule->min_size) return 0;
+    if (rule->max_size != 0 && size > rule->max_size) return 0;
+    if (!perms_match(rule->perms, bits)) return 0;
+    if (rule->glob[0] != '\0' && 0 != fnmatch(rule->glob, path, 0)) return 0;
+    return 1;
+}
+
+static int add_rule (int action,
+                     const char *glob,
+                     size_t min_size,
+                     size_t max_size,
+                     const char *perms)
+{
+    scan_rule_t *rule;
+    int ret = 0;
+
+    if (action != RULE_EXCLUDE && action != RULE_INCLUDE) return 1;
+    if (glob && strlen(glob) >= RULE_GLOB_SIZE) return 1;
+    if (perms && strlen(perms) > 4) return 1;
+
+    pthread_mutex_lock(&g_rules_lock);
+    if (g_n_user_rules >= MAX_SCAN_RULES) {
+        ret = 1;
+    } else {
+        // Fill in the rule before publishing it.  A snapshot could be taken
+        // at any point, and the child reads the list without the lock.
+        rule = &g_user_rules[g_n_user_rules];
+        rule->action = action;
+        strcpy(rule->glob, glob ? glob : "");
+        strcpy(rule->perms, perms ? perms : "");
+        rule->min_size = min_size;
+        rule->max_size = max_size;
+        __sync_synchronize();
+        ++g_n_user_rules;
+    }
+    pthread_mutex_unlock(&g_rules_lock);
+
+    return ret;
+}
+
+/****************************************************************************/
+/*                          Environment parsing.                            */
+/****************************************************************************/
+
+/** Parse a size with an optional K, M, or G suffix.
+ */
+static size_t parse_size (const char *s)
+{
+    char *end;
+    size_t ret = strtoull(s, &end, 0);
+    switch (*end) {
+    case 'g': case 'G': ret <<= 10; // Fall through.
+    case 'm': case 'M': ret <<= 10; // Fall through.
+    case 'k': case 'K': ret <<= 10;
+    }
+    return ret;
+}
+
+/** Parse one rule: [+-]GLOB[,min=SIZE][,max=SIZE][,perms=PPPP]
+ */
+static void parse_rule (char *text)
+{
+    int action;
+    char *field, *save;
+    const char *glob = "", *perms = "";
+    size_t min_size = 0, max_size = 0;
+
+    if ('+' == text[0]) action = RULE_INCLUDE;
+    else if ('-' == text[0]) action = RULE_EXCLUDE;
+    else {
+        forkscan_diagnostic("warning: %s rule \"%s\" must begin with "
+                            "'+' or '-'.  Ignored.\n",
+                            env_scan_policy, text);
+        return;
+    }
+    ++text;
+
+    // The glob is everything up to the first comma.  It may be empty.
+    field = strchr(text, ',');
+    if (field) *field++ = '\0';
+    glob = text;
+
+    for (field = field ? strtok_r(field, ",", &save) : NULL;
+         field != NULL;
+         field = strtok_r(NULL, ",", &save)) {
+        if (0 == strncmp(field, "min=", 4)) {
+            min_size = parse_size(field + 4);
+        } else if (0 == strncmp(field, "max=", 4)) {
+            max_size = parse_size(field + 4);
+        } else if (0 == strncmp(field, "perms=", 6)) {
+            perms = field + 6;
+        } else {
+            forkscan_diagnostic("warning: %s: unknown field \"%s\".\n",
+                                env_scan_policy, field);
+        }
+    }
+
+    if (0 != add_rule(action, glob, min_size, max_size, perms)) {
+        forkscan_diagnostic("warning: %s: could not add rule for \"%s\".\n",
+                            env_scan_policy, glob);
+    }
+}
+
+__attribute__((constructor (102)))
+static void policy_init ()
+{
+    // Rules are separated by semicolons, e.g.,
+    //   FORKSCAN_SCAN_POLICY="-*/libssl*;-*/libstdc++*;-,min=1G"
+    const char *env = getenv(env_scan_policy);
+    char *copy, *rule, *save;
+
+    if (NULL == env) return;
+
+    copy = strdup(env);
+    for (rule = strtok_r(copy, ";", &save);
+         rule != NULL;
+         rule = strtok_r(NULL, ";", &save)) {
+        parse_rule(rule);
+    }
+    free(copy);
+}
+
+/****************************************************************************/
+/*                                Interface                                 */
+/****************************************************************************/
+
+/**
+ * Return 1 if the mapping [low, high) with the given permission bits and
+ * path should be scanned, zero otherwise.
+ */
+int forkscan_policy_should_scan (size_t low, size_t high,
+                                 const char *bits, const char *path)
+{
+    size_t size = high - low;
+    int i, n_rules = g_n_user_rules;
+
+    for (i = 0; i < n_rules; ++i) {
+        if (rule_matches(&g_user_rules[i], size, bits, path)) {
+            return g_user_rules[i].action == RULE_INCLUDE;
+        }
+    }
+
+    for (i = 0; i < sizeof(g_default_rules) / sizeof(g_default_rules[0]);
+         ++i) {
+        if (rule_matches(&g_default_rules[i], size, bits, path)) {
+            return g_default_rules[i].action == RULE_INCLUDE;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * Make sure the shared region report is ready for the next iteration.
+ * Called by the GC thread before forking.  Does nothing unless region
+ * reporting is enabled.
+ */
+void forkscan_policy_prepare_report ()
+{
+    if (!g_forkscan_report_regions) return;
+
+    if (NULL == g_shared_report) {
+        size_t sz = (sizeof(region_table_t) + PAGESIZE - 1) & ~(PAGESIZE - 1);
+        g_shared_report = forkscan_alloc_mmap_shared(sz, "region report");
+        g_last_report = forkscan_alloc_mmap_parent(sz, "region report");
+    }
+    g_shared_report->n_regions = 0;
+    g_shared_report->truncated = 0;
+}
+
+/**
+ * Record, from the child, that bytes_scanned bytes of [low, high) will be
+ * scanned.
+ */
+void forkscan_policy_report_region (size_t low, size_t high,
+                                    size_t bytes_scanned, const char *path)
+{
+    region_table_t *table = g_shared_report;
+    region_report_t *r;
+
+    if (NULL == table) return;
+    if (table->n_regions >= MAX_REPORTED_REGIONS) {
+        table->truncated = 1;
+        return;
+    }
+
+    r = &table->regions[table->n_regions++];
+    r->low = low;
+    r->high = high;
+    r->bytes_scanned = bytes_scanned;
+    strncpy(r->path, path, REGION_PATH_SIZE - 1);
+    r->path[REGION_PATH_SIZE - 1] = '\0';
+}
+
+/**
+ * Take a private copy of the report the child just wrote.  Called by the GC
+ * thread once the child has finished.
+ */
+void forkscan_policy_collect_report ()
+{
+    if (NULL == g_shared_report) return;
+
+    pthread_mutex_lock(&g_report_lock);
+    g_last_report->truncated = g_shared_report->truncated;
+    g_last_report->n_regions = g_shared_report->n_regions;
+    memcpy(g_last_report->regions, g_shared_report->regions,
+           g_shared_report->n_regions * sizeof(region_report_t));
+    pthread_mutex_unlock(&g_report_lock);
+}
+
+static int compare_bytes_scanned (const void *a, const void *b)
+{
+    size_t x = ((const region_report_t*)a)->bytes_scanned;
+    size_t y = ((const region_report_t*)b)->bytes_scanned;
+    return x < y ? 1 : (x > y ? -1 : 0);
+}
+
+/**
+ * Print the regions from the last iteration, heaviest first.
+ */
+void forkscan_policy_print_report ()
+{
+    int i;
+
+    if (NULL == g_last_report) return;
+
+    pthread_mutex_lock(&g_report_lock);
+    qsort(g_last_report->regions, g_last_report->n_regions,
+          sizeof(region_report_t), compare_bytes_scanned);
+    for (i = 0; i < g_last_report->n_regions; ++i) {
+        region_report_t *r = &g_last_report->regions[i];
+        printf("region: %zu 0x%zx-0x%zx %s\n",
+               r->bytes_scanned, r->low, r->high,
+               r->path[0] ? r->path : "[anon]");
+    }
+    if (g_last_report->truncated) {
+        printf("region: (report truncated at %d regions)\n",
+               MAX_REPORTED_REGIONS);
+    }
+    pthread_mutex_unlock(&g_report_lock);
+}
+
+/****************************************************************************/
+/*                            Exported functions                            */
+/****************************************************************************/
+
+/**
+ * Add a rule that decides whether matching memory mappings are scanned.
+ */
+__attribute__((visibility("default")))
+int forkscan_scan_policy_add (int action,
+                              const char *path_glob,
+                              size_t min_size,
+                              size_t max_size,
+                              const char *perms)
+{
+    return add_rule(action, path_glob, min_size, max_size, perms);
+}
+
+/**
+ * Remove all rules added through the environment or
+ * forkscan_scan_policy_add().  The built-in defaults remain.
+ */
+__attribute__((visibility("default")))
+void forkscan_scan_policy_clear ()
+{
+    pthread_mutex_lock(&g_rules_lock);
+    g_n_user_rules = 0;
+    pthread_mutex_unlock(&g_rules_lock);
+}
+
+/**
+ * Copy up to max entries of the last iteration's per-region scan report
+ * into regions and return the number copied.
+ */
+__attribute__((visibility("default")))
+int forkscan_get_region_report (struct forkscan_region *regions, int max)
+{
+    int i, n;
+
+    // Asking for a report turns on reporting for later iterations.
+    g_forkscan_report_regions = 1;
+    if (NULL == g_last_report) return 0;
+
+    pthread_mutex_lock(&g_report_lock);
+    n = MIN_OF(max, g_last_report->n_regions);
+    for (i = 0; i < n; ++i) {
+        region_report_t *r = &g_last_report->regions[i];
+        regions[i].low = r->low;
+        regions[i].high = r->high;
+        regions[i].bytes_scanned = r->bytes_scanned;
+        memcpy(regions[i].path, r->path, sizeof(regions[i].path));
+    }
+    pthread_mutex_unlock(&g_report_lock);
+
+    return n;
+}
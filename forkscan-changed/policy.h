@@ -0,0 +1,83 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/* Module Description:
+   Decide which memory mappings the snapshot child scans for references.
+   A few exclusions are hard-wired because scanning those regions is either
+   useless or unsafe.  Everything else goes through an ordered list of
+   include/exclude rules that match on path (glob), mapping size, and
+   permission bits.  User rules come from the FORKSCAN_SCAN_POLICY
+   environment variable or forkscan_scan_policy_add(), and take precedence
+   over the built-in defaults (libc, libdl, libforkscan, shared mappings).
+ */
+
+#ifndef _POLICY_H_
+#define _POLICY_H_
+
+#include <stddef.h>
+
+#define MAX_REPORTED_REGIONS 1024
+#define REGION_PATH_SIZE 128
+
+typedef struct region_report_t region_report_t;
+
+/** Bytes scanned in one mapping during the last iteration.
+ */
+struct region_report_t {
+    size_t low, high;
+    size_t bytes_scanned;
+    char path[REGION_PATH_SIZE];
+};
+
+/**
+ * Return 1 if the mapping [low, high) with the given permission bits and
+ * path should be scanned, zero otherwise.
+ */
+int forkscan_policy_should_scan (size_t low, size_t high,
+                                 const char *bits, const char *path);
+
+/**
+ * Make sure the shared region report is ready for the next iteration.
+ * Called by the GC thread before forking.  Does nothing unless region
+ * reporting is enabled.
+ */
+void forkscan_policy_prepare_report ();
+
+/**
+ * Record, from the child, that bytes_scanned bytes of [low, high) will be
+ * scanned.
+ */
+void forkscan_policy_report_region (size_t low, size_t high,
+                                    size_t bytes_scanned, const char *path);
+
+/**
+ * Take a private copy of the report the child just wrote.  Called by the GC
+ * thread once the child has finished.
+ */
+void forkscan_policy_collect_report ();
+
+/**
+ * Print the regions from the last iteration, heaviest first.
+ */
+void forkscan_policy_print_report ();
+
+#endif // !defined _POLICY_H_
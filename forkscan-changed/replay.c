@@ -0,0 +1,248 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/* Offline replay of a scanner snapshot (see snapshot.h).  It maps the
+   snapshot's memory back at its original addresses and runs the real
+   root-scanning and marking loops from child.c over it, with the scanning
+   loops and numbers of scanner processes asked for, and checks that each
+   run marks exactly the retirees the original scan did.  Build with "make
+   replay"; capture a snapshot by running a program with
+   FORKSCAN_SNAPSHOT=path, or by calling forkscan_snapshot(). */
+
+#define _GNU_SOURCE
+#include "buffer.h"
+#include "child.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "snapshot.h"
+#include "util.h"
+
+/****************************************************************************/
+/*                         Defines, typedefs, etc.                          */
+/****************************************************************************/
+
+#define DEFAULT_REPS 5
+#define MAX_LIST 32
+
+// Our own mappings land somewhere else on every run, so a snapshot that
+// collides with them is retried in a fresh process this many times.
+#define MAX_ATTEMPTS 16
+
+static const char env_attempt[] = "FORKSCAN_REPLAY_ATTEMPT";
+static const char env_heap_reserve_gb[] = "FORKSCAN_HEAP_RESERVE_GB";
+
+/****************************************************************************/
+/*                                 Globals                                  */
+/****************************************************************************/
+
+static snapshot_t *g_snapshot;
+static int g_reps = DEFAULT_REPS;
+static int g_csv;
+static int g_mismatches;
+
+/****************************************************************************/
+/*                             Helper functions                             */
+/****************************************************************************/
+
+static void usage (const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options] SNAPSHOT\n"
+            "  -k LIST    comma-separated scanning loops (default: the"
+            " snapshot's):\n"
+            "             exact,interior,masked,masked_interior,canonical,"
+            "canonical_interior\n"
+            "  -j LIST    comma-separated numbers of scanner processes"
+            " (default: the\n"
+            "             snapshot's)\n"
+            "  -n REPS    runs of each combination (default %d)\n"
+            "  -c         CSV output\n",
+            prog, DEFAULT_REPS);
+    exit(1);
+}
+
+/** Split a comma-separated list in place.  Returns the number of items.
+ */
+static int split_list (char *list, char **items)
+{
+    int n = 0;
+    char *item;
+
+    for (item = strtok(list, ","); item; item = strtok(NULL, ",")) {
+        if (MAX_LIST == n) usage("replay");
+        items[n++] = item;
+    }
+    return n;
+}
+
+static int compare_u64 (const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+/** Load the snapshot, starting over in a new process if it overlaps our
+ *  own memory.
+ */
+static void load (const char *path, char **argv)
+{
+    int ret = forkscan_snapshot_load(path, &g_snapshot);
+    if (SNAPSHOT_LOAD_OK == ret) return;
+    if (SNAPSHOT_LOAD_CONFLICT != ret) exit(1);
+
+    const char *s = getenv(env_attempt);
+    int attempt = s ? atoi(s) : 0;
+    if (attempt + 1 >= MAX_ATTEMPTS) {
+        forkscan_fatal("replay: %s overlaps this process's memory.\n", path);
+    }
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%d", attempt + 1);
+    setenv(env_attempt, buf, 1);
+    // A smaller heap reservation leaves more room for the snapshot.
+    setenv(env_heap_reserve_gb, "1", 0);
+    execv("/proc/self/exe", argv);
+    forkscan_fatal("replay: unable to restart.\n");
+}
+
+/** Run one combination g_reps times and report it.
+ */
+static void replay (const char *kernel, int n_siblings)
+{
+    snapshot_t *s = g_snapshot;
+    uint64_t wall[g_reps], scan[g_reps], mark[g_reps];
+    size_t missing = 0, extra = 0, marks = 0, candidates = 0;
+    int used = 0, r, i;
+
+    for (r = 0; r < g_reps; ++r) {
+        forkscan_snapshot_reset(s);
+        uint64_t start = forkscan_util_nanotime();
+        used = forkscan_child_replay(s, kernel, n_siblings);
+        wall[r] = forkscan_util_nanotime() - start;
+        if (used < 0) {
+            forkscan_fatal("replay: unknown scanning loops \"%s\".\n",
+                           kernel);
+        }
+        scan[r] = s->ab->root_scan_ns;
+        mark[r] = s->ab->mark_ns;
+
+        size_t m, e;
+        forkscan_snapshot_compare(s, &m, &e);
+        missing = MAX_OF(missing, m);
+        extra = MAX_OF(extra, e);
+    }
+    for (i = 0; i < used; ++i) {
+        marks += s->ab->siblings[i].marks;
+        candidates += s->ab->siblings[i].candidates;
+    }
+    if (missing || extra) ++g_mismatches;
+
+    qsort(wall, g_reps, sizeof(uint64_t), compare_u64);
+    qsort(scan, g_reps, sizeof(uint64_t), compare_u64);
+    qsort(mark, g_reps, sizeof(uint64_t), compare_u64);
+    uint64_t median = wall[g_reps / 2];
+    double gb_per_s = median > 0
+        ? (double)s->header.bytes_to_scan / median : 0;
+    if (NULL == kernel) kernel = forkscan_child_kernel_name(s->header.mode);
+
+    if (g_csv) {
+        printf("%s,%d,%d,%llu,%llu,%llu,%llu,%.3f,%zu,%zu,%zu,%zu\n",
+               kernel, used, g_reps, (unsigned long long)wall[0],
+               (unsigned long long)median,
+               (unsigned long long)scan[g_reps / 2],
+               (unsigned long long)mark[g_reps / 2], gb_per_s,
+               candidates, marks, missing, extra);
+    } else {
+        printf("%-18s %4d %9.3f %9.3f %9.3f %9.3f %7.3f %10zu %s\n",
+               kernel, used, wall[0] / 1e6, median / 1e6,
+               scan[g_reps / 2] / 1e6, mark[g_reps / 2] / 1e6, gb_per_s,
+               marks, missing || extra ? "DIFFERS" : "same");
+        if (missing || extra) {
+            printf("  %zu recorded marks missing, %zu extra\n",
+                   missing, extra);
+        }
+    }
+}
+
+/****************************************************************************/
+/*                                   Main                                   */
+/****************************************************************************/
+
+int main (int argc, char **argv)
+{
+    char *kernel_list = NULL, *sibling_list = NULL;
+    char *kernels[MAX_LIST], *siblings[MAX_LIST];
+    int n_kernels = 1, n_siblings = 1;
+    int opt, i, j;
+
+    while ((opt = getopt(argc, argv, "k:j:n:ch")) != -1) {
+        switch (opt) {
+        case 'k': kernel_list = optarg; break;
+        case 'j': sibling_list = optarg; break;
+        case 'n': g_reps = atoi(optarg); break;
+        case 'c': g_csv = 1; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1 || g_reps <= 0) usage(argv[0]);
+
+    load(argv[optind], argv);
+    snapshot_t *s = g_snapshot;
+
+    // NULL stands for what the snapshot was taken with.
+    kernels[0] = siblings[0] = NULL;
+    if (kernel_list) n_kernels = split_list(kernel_list, kernels);
+    if (sibling_list) n_siblings = split_list(sibling_list, siblings);
+
+    if (g_csv) {
+        printf("kernel,siblings,reps,best_ns,median_ns,root_scan_ns,mark_ns,"
+               "gb_per_s,candidates,marks,missing,extra\n");
+    } else {
+        size_t recorded = 0;
+        for (i = 0; i < (int)s->header.n_addrs; ++i) {
+            recorded += (s->marks[i / 64] >> (i % 64)) & 1;
+        }
+        printf("%llu retirees (%zu marked), %llu dead references, %llu bytes"
+               " in %llu ranges\n"
+               "taken with %s, %llu scanner processes\n",
+               (unsigned long long)s->header.n_addrs, recorded,
+               (unsigned long long)s->header.n_deadrefs,
+               (unsigned long long)s->header.bytes_to_scan,
+               (unsigned long long)s->header.n_ranges,
+               forkscan_child_kernel_name(s->header.mode),
+               (unsigned long long)s->header.n_siblings);
+        printf("%-18s %4s %9s %9s %9s %9s %7s %10s %s\n",
+               "kernel", "jobs", "best_ms", "median_ms", "scan_ms",
+               "mark_ms", "GB/s", "marks", "vs. recorded");
+    }
+
+    for (i = 0; i < n_kernels; ++i) {
+        for (j = 0; j < n_siblings; ++j) {
+            int n = siblings[j] ? atoi(siblings[j]) : s->header.n_siblings;
+            replay(kernels[i], n);
+        }
+    }
+
+    return g_mismatches ? 1 : 0;
+}
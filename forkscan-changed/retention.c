@@ -0,0 +1,185 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "alloc.h"
+#include "env.h"
+#include "include/forkscan.h"
+#include <pthread.h>
+#include "retention.h"
+#include <stdio.h>
+#include <string.h>
+#include "util.h"
+
+/****************************************************************************/
+/*                                 Globals                                  */
+/****************************************************************************/
+
+static const char *g_kind_names[N_RETENTION_KINDS] = {
+    [RETAINED_BY_UNKNOWN] = "unknown",
+    [RETAINED_BY_STACK] = "stack",
+    [RETAINED_BY_DATA] = "data",
+    [RETAINED_BY_HEAP] = "heap",
+    [RETAINED_BY_ANON] = "anon",
+    [RETAINED_BY_RETIREE] = "retiree",
+};
+
+// Shared with the child.
+static retention_table_t *g_shared_table;
+
+// The GC thread's copy of the last sample, and the counts.
+static retention_table_t *g_last_table;
+static size_t g_counts[N_RETENTION_KINDS];
+static size_t g_iterations, g_sampled_iterations;
+static pthread_mutex_t g_table_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/****************************************************************************/
+/*                            Internal interface                            */
+/****************************************************************************/
+
+/**
+ * Decide whether the coming iteration is sampled, and make sure the shared
+ * table is ready if it is.  Called by the GC thread before forking.
+ */
+void forkscan_retention_prepare ()
+{
+    if (0 == g_forkscan_retention) return;
+
+    if (NULL == g_shared_table) {
+        size_t sz = PAGEALIGN(sizeof(retention_table_t) + PAGESIZE - 1);
+        g_shared_table = forkscan_alloc_mmap_shared(sz, "retention table");
+        g_last_table = forkscan_alloc_mmap_parent(sz, "retention table");
+    }
+    g_shared_table->requested = 0 == g_iterations++ % g_forkscan_retention;
+    g_shared_table->n_samples = 0;
+    g_shared_table->survivors = 0;
+}
+
+/**
+ * Return the table the child should fill in, or NULL if this iteration
+ * isn't sampled.
+ */
+retention_table_t *forkscan_retention_table ()
+{
+    if (NULL == g_shared_table || !g_shared_table->requested) return NULL;
+    return g_shared_table;
+}
+
+/**
+ * Take a private copy of the sample the child just wrote and add it to the
+ * counts.  Called by the GC thread once the child has finished.
+ */
+void forkscan_retention_collect ()
+{
+    int i;
+
+    if (NULL == forkscan_retention_table()) return;
+
+    pthread_mutex_lock(&g_table_lock);
+    memcpy(g_last_table, g_shared_table, sizeof(retention_table_t));
+    for (i = 0; i < g_last_table->n_samples; ++i) {
+        ++g_counts[g_last_table->samples[i].kind];
+    }
+    ++g_sampled_iterations;
+    pthread_mutex_unlock(&g_table_lock);
+}
+
+/**
+ * Print the counts by kind and the last sample.
+ */
+void forkscan_retention_print ()
+{
+    int i;
+
+    if (NULL == g_last_table) return;
+
+    pthread_mutex_lock(&g_table_lock);
+    printf("retention-iterations: %zu\n", g_sampled_iterations);
+    for (i = 0; i < N_RETENTION_KINDS; ++i) {
+        printf("retained-by-%s: %zu\n", g_kind_names[i], g_counts[i]);
+    }
+    printf("retention-sample: %d of %zu survivors\n",
+           g_last_table->n_samples, g_last_table->survivors);
+    for (i = 0; i < g_last_table->n_samples; ++i) {
+        retention_sample_t *s = &g_last_table->samples[i];
+        printf("retained: 0x%zx (%zu bytes) by 0x%zx %s %s",
+               s->retiree, s->size, s->root, g_kind_names[s->kind],
+               s->region[0] ? s->region : "-");
+        if (s->thread) printf(" thread 0x%lx", s->thread);
+        printf("\n");
+    }
+    pthread_mutex_unlock(&g_table_lock);
+}
+
+/**
+ * Copy the number of sampled survivors of each kind so far into counts.
+ * Returns the number of sampled iterations.
+ */
+size_t forkscan_retention_counts (size_t counts[N_RETENTION_KINDS])
+{
+    size_t n;
+
+    pthread_mutex_lock(&g_table_lock);
+    memcpy(counts, g_counts, sizeof(g_counts));
+    n = g_sampled_iterations;
+    pthread_mutex_unlock(&g_table_lock);
+
+    return n;
+}
+
+/**
+ * Return the name of kind, for reports.
+ */
+const char *forkscan_retention_kind_name (retention_kind_t kind)
+{
+    return g_kind_names[kind];
+}
+
+/****************************************************************************/
+/*                            Exported functions                            */
+/****************************************************************************/
+
+/**
+ * Copy up to max survivors from the last sampled iteration into samples
+ * and return the number copied.
+ */
+__attribute__((visibility("default")))
+int forkscan_get_retention (struct forkscan_retention *samples, int max)
+{
+    int i, n;
+
+    if (NULL == g_last_table) return 0;
+
+    pthread_mutex_lock(&g_table_lock);
+    n = MIN_OF(max, g_last_table->n_samples);
+    for (i = 0; i < n; ++i) {
+        retention_sample_t *s = &g_last_table->samples[i];
+        samples[i].retiree = (void*)s->retiree;
+        samples[i].size = s->size;
+        samples[i].root = (void*)s->root;
+        samples[i].kind = s->kind;
+        samples[i].thread = s->thread;
+        memcpy(samples[i].region, s->region, sizeof(samples[i].region));
+    }
+    pthread_mutex_unlock(&g_table_lock);
+
+    return n;
+}
@@ -0,0 +1,107 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/* Module Description:
+   Retention diagnostics: why do retirees survive?  Every
+   FORKSCAN_RETENTION'th iteration, once marking is done, the child takes
+   an evenly spaced sample of the survivors and scans memory once more for
+   the first word that refers to each of them.  It records where that word
+   lives: a thread's stack, a library's data, a heap object, other
+   anonymous memory, or another surviving retiree.  The GC thread keeps the
+   last sample and running counts by kind for the statistics.
+ */
+
+#ifndef _RETENTION_H_
+#define _RETENTION_H_
+
+#include <stddef.h>
+
+#define MAX_RETENTION_SAMPLES 64
+#define RETENTION_REGION_SIZE 64
+
+// Must match FORKSCAN_RETAINED_BY_* in forkscan.h.
+typedef enum {
+    RETAINED_BY_UNKNOWN, // No referring word found.
+    RETAINED_BY_STACK,
+    RETAINED_BY_DATA,    // A file-backed mapping: a library's .data/.bss.
+    RETAINED_BY_HEAP,    // An object in the Forkscan heap or the brk heap.
+    RETAINED_BY_ANON,    // Other anonymous memory.
+    RETAINED_BY_RETIREE, // Only another surviving retiree refers to it.
+    N_RETENTION_KINDS
+} retention_kind_t;
+
+typedef struct retention_sample_t retention_sample_t;
+typedef struct retention_table_t retention_table_t;
+
+struct retention_sample_t {
+    size_t retiree;
+    size_t size;
+    size_t root;            // Address of the referring word, or 0.
+    retention_kind_t kind;
+    unsigned long thread;   // pthread_t of the stack holding root, or 0.
+    char region[RETENTION_REGION_SIZE];
+};
+
+/** Written by the child, in memory shared with the GC thread.
+ */
+struct retention_table_t {
+    int requested;          // This iteration is sampled.
+    int n_samples;
+    size_t survivors;
+    retention_sample_t samples[MAX_RETENTION_SAMPLES];
+};
+
+/**
+ * Decide whether the coming iteration is sampled, and make sure the shared
+ * table is ready if it is.  Called by the GC thread before forking.
+ */
+void forkscan_retention_prepare ();
+
+/**
+ * Return the table the child should fill in, or NULL if this iteration
+ * isn't sampled.
+ */
+retention_table_t *forkscan_retention_table ();
+
+/**
+ * Take a private copy of the sample the child just wrote and add it to the
+ * counts.  Called by the GC thread once the child has finished.
+ */
+void forkscan_retention_collect ();
+
+/**
+ * Print the counts by kind and the last sample.
+ */
+void forkscan_retention_print ();
+
+/**
+ * Copy the number of sampled survivors of each kind so far into counts.
+ * Returns the number of sampled iterations.
+ */
+size_t forkscan_retention_counts (size_t counts[N_RETENTION_KINDS]);
+
+/**
+ * Return the name of kind, for reports.
+ */
+const char *forkscan_retention_kind_name (retention_kind_t kind);
+
+#endif // !defined _RETENTION_H_
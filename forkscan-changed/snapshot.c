@@ -0,0 +1,516 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#define _GNU_SOURCE // For MAP_FIXED_NOREPLACE.
+#include "alloc.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include "heap.h"
+#include "include/forkscan.h"
+#include <limits.h>
+#include <pthread.h>
+#include "snapshot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "util.h"
+
+/****************************************************************************/
+/*                         Defines, typedefs, etc.                          */
+/****************************************************************************/
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+#define OUT_BUFFER_SIZE (1024 * 1024)
+
+static const char env_snapshot[] = "FORKSCAN_SNAPSHOT";
+
+static const char env_snapshot_iteration[] = "FORKSCAN_SNAPSHOT_ITERATION";
+
+typedef struct out_t out_t;
+
+/** Buffered output for the child, which can't count on malloc() or stdio:
+ *  another thread may have held their locks when the parent forked.
+ */
+struct out_t {
+    int fd;
+    int failed;
+    size_t n;
+    char *buf;
+};
+
+/****************************************************************************/
+/*                                 Globals                                  */
+/****************************************************************************/
+
+// The pending request, from the environment or forkscan_snapshot().  It's
+// taken by the first iteration at or after g_requested_iteration.
+static pthread_mutex_t g_request_lock = PTHREAD_MUTEX_INITIALIZER;
+static char g_requested[PATH_MAX];
+static size_t g_requested_iteration;
+static size_t g_iterations;
+
+// Where the current iteration's child writes its snapshot, or "".
+static char g_path[PATH_MAX];
+
+// The child's output buffer.  Allocated by the GC thread, since the child
+// can't take the lock forkscan_alloc_mmap() needs: a thread that was
+// stopped for the fork may have been holding it.
+static char *g_out_buf;
+
+/****************************************************************************/
+/*                             Helper functions                             */
+/****************************************************************************/
+
+static void write_all (out_t *o, const void *p, size_t n)
+{
+    const char *c = (const char*)p;
+    while (n > 0 && !o->failed) {
+        ssize_t ret = write(o->fd, c, n);
+        if (ret < 0) {
+            if (EINTR == errno) continue;
+            o->failed = 1;
+            return;
+        }
+        c += ret;
+        n -= ret;
+    }
+}
+
+static void out_flush (out_t *o)
+{
+    write_all(o, o->buf, o->n);
+    o->n = 0;
+}
+
+static void out_write (out_t *o, const void *p, size_t n)
+{
+    if (o->n + n > OUT_BUFFER_SIZE) {
+        out_flush(o);
+        if (n >= OUT_BUFFER_SIZE) {
+            // Big enough to go straight from where it is.
+            write_all(o, p, n);
+            return;
+        }
+    }
+    memcpy(o->buf + o->n, p, n);
+    o->n += n;
+}
+
+static void out_word (out_t *o, uint64_t w)
+{
+    out_write(o, &w, sizeof(w));
+}
+
+static int is_zero (size_t low, size_t high)
+{
+    for ( ; low < high; low += sizeof(size_t)) {
+        if (*(size_t*)low) return 0;
+    }
+    return 1;
+}
+
+/** Write [low, high) as extents, leaving out the pages that are all zeroes.
+ */
+static void write_sparse (size_t low, size_t high, void *arg)
+{
+    out_t *o = (out_t*)arg;
+
+    while (low < high) {
+        size_t end = MIN_OF(PAGEALIGN(low) + PAGESIZE, high);
+        if (is_zero(low, end)) {
+            low = end;
+            continue;
+        }
+
+        // Extend the extent up to the next zero page.
+        size_t start = low;
+        do {
+            low = end;
+            end = MIN_OF(low + PAGESIZE, high);
+        } while (low < high && !is_zero(low, end));
+
+        out_word(o, start);
+        out_word(o, low - start);
+        out_write(o, (void*)start, low - start);
+        low = end;
+    }
+}
+
+static void count_run (size_t low, size_t high, void *arg)
+{
+    ++*(uint64_t*)arg;
+}
+
+static void write_run (size_t low, size_t high, void *arg)
+{
+    out_word((out_t*)arg, low);
+    out_word((out_t*)arg, high);
+}
+
+static int read_bytes (FILE *f, void *p, size_t n)
+{
+    return n == fread(p, 1, n, f);
+}
+
+static int compare_spans (const void *a, const void *b)
+{
+    const mem_range_t *x = (const mem_range_t*)a;
+    const mem_range_t *y = (const mem_range_t*)b;
+    return x->low < y->low ? -1 : x->low > y->low;
+}
+
+/** Map page-rounded, merged copies of the snapshot's ranges at their
+ *  original addresses.  Returns SNAPSHOT_LOAD_OK, or
+ *  SNAPSHOT_LOAD_CONFLICT with nothing left mapped.
+ */
+static int map_ranges (snapshot_t *s)
+{
+    size_t n = s->header.n_ranges, n_spans = 0, i;
+    mem_range_t *spans = malloc(MAX_OF(n, 1) * sizeof(mem_range_t));
+    int ret = SNAPSHOT_LOAD_OK;
+
+    if (NULL == spans) forkscan_fatal("Out of memory.\n");
+    for (i = 0; i < n; ++i) {
+        spans[i].low = PAGEALIGN(s->ranges[i].low);
+        spans[i].high = PAGEALIGN(s->ranges[i].high + PAGESIZE - 1);
+    }
+    qsort(spans, n, sizeof(mem_range_t), compare_spans);
+    for (i = 0; i < n; ++i) {
+        if (n_spans > 0 && spans[i].low <= spans[n_spans - 1].high) {
+            spans[n_spans - 1].high = MAX_OF(spans[n_spans - 1].high,
+                                             spans[i].high);
+        } else {
+            spans[n_spans++] = spans[i];
+        }
+    }
+
+    for (i = 0; i < n_spans; ++i) {
+        size_t len = spans[i].high - spans[i].low;
+        void *p = mmap((void*)spans[i].low, len, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE
+                       | MAP_FIXED_NOREPLACE, -1, 0);
+        if (MAP_FAILED == p || (size_t)p != spans[i].low) {
+            // Kernels before 4.17 treat the flag as a hint.
+            if (MAP_FAILED != p) munmap(p, len);
+            ret = SNAPSHOT_LOAD_CONFLICT;
+            break;
+        }
+    }
+    if (SNAPSHOT_LOAD_CONFLICT == ret) {
+        while (i-- > 0) {
+            munmap((void*)spans[i].low, spans[i].high - spans[i].low);
+        }
+    }
+    free(spans);
+    return ret;
+}
+
+/** Read the live runs and the contents of range r.
+ */
+static int read_range (FILE *f, snapshot_range_t *r)
+{
+    uint64_t w[2];
+
+    if (r->flags & SNAPSHOT_RANGE_HEAP) {
+        uint64_t n_runs;
+        if (!read_bytes(f, &n_runs, sizeof(n_runs))) return -1;
+        r->n_runs = n_runs;
+        r->runs = malloc(MAX_OF(n_runs, 1) * sizeof(mem_range_t));
+        if (NULL == r->runs) forkscan_fatal("Out of memory.\n");
+        if (!read_bytes(f, r->runs, n_runs * sizeof(mem_range_t))) return -1;
+    }
+
+    for (;;) {
+        if (!read_bytes(f, w, sizeof(w))) return -1;
+        if (0 == w[0] && 0 == w[1]) return 0;
+        if (w[0] < r->low || w[1] > r->high - w[0]) return -1;
+        if (!read_bytes(f, (void*)w[0], w[1])) return -1;
+    }
+}
+
+/****************************************************************************/
+/*                            Internal interface                            */
+/****************************************************************************/
+
+/**
+ * Return the path the current child should write a snapshot to, or NULL
+ * if this iteration isn't being captured.
+ */
+const char *forkscan_snapshot_path ()
+{
+    return g_path[0] ? g_path : NULL;
+}
+
+/**
+ * Decide whether the coming iteration is captured.  Called by the GC thread
+ * before it stops the other threads for the fork.
+ */
+void forkscan_snapshot_prepare ()
+{
+    ++g_iterations;
+    g_path[0] = '\0';
+    pthread_mutex_lock(&g_request_lock);
+    if (g_requested[0] && g_iterations >= g_requested_iteration) {
+        strcpy(g_path, g_requested);
+        g_requested[0] = '\0';
+    }
+    pthread_mutex_unlock(&g_request_lock);
+    if (g_path[0] && NULL == g_out_buf) {
+        g_out_buf = forkscan_alloc_mmap(OUT_BUFFER_SIZE, "snapshot buffer");
+    }
+}
+
+/**
+ * Write a snapshot of a finished scan to path.  ab holds the marks.  The
+ * header's scan configuration has to be filled in; the counts are filled in
+ * here.  Returns 0 on success.
+ */
+int forkscan_snapshot_write (const char *path,
+                             snapshot_header_t *header,
+                             addr_buffer_t *ab,
+                             const size_t *sizes,
+                             addr_buffer_t *deadrefs,
+                             const size_t *dead_sizes,
+                             const mem_range_t *ranges,
+                             int n_ranges)
+{
+    out_t o;
+    int i, j;
+
+    o.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (o.fd < 0) {
+        forkscan_diagnostic("warning: %s = %s\n  Unable to write the"
+                            " snapshot.\n", env_snapshot, path);
+        return -1;
+    }
+    o.failed = 0;
+    o.n = 0;
+    o.buf = g_out_buf;
+    assert(o.buf);
+
+    memcpy(header->magic, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE);
+    header->n_addrs = ab->n_addrs;
+    header->n_deadrefs = deadrefs->n_addrs;
+    header->n_ranges = n_ranges;
+    out_write(&o, header, sizeof(*header));
+
+    for (i = 0; i < ab->n_addrs; ++i) out_word(&o, PTR_MASK(ab->addrs[i]));
+    out_write(&o, sizes, ab->n_addrs * sizeof(size_t));
+    out_write(&o, deadrefs->addrs, deadrefs->n_addrs * sizeof(size_t));
+    out_write(&o, dead_sizes, deadrefs->n_addrs * sizeof(size_t));
+
+    for (i = 0; i < n_ranges; ++i) {
+        snapshot_range_record_t r = { ranges[i].low, ranges[i].high, 0 };
+        if (forkscan_heap_contains(ranges[i].low)) {
+            r.flags |= SNAPSHOT_RANGE_HEAP;
+        }
+        out_write(&o, &r, sizeof(r));
+    }
+
+    for (i = 0; i < ab->n_addrs; i += 64) {
+        uint64_t bits = 0;
+        for (j = 0; j < 64 && i + j < ab->n_addrs; ++j) {
+            if (ab->addrs[i + j] & 0x1) bits |= (uint64_t)1 << j;
+        }
+        out_word(&o, bits);
+    }
+
+    for (i = 0; i < n_ranges; ++i) {
+        size_t low = ranges[i].low, high = ranges[i].high;
+        if (forkscan_heap_contains(low)) {
+            uint64_t n_runs = 0;
+            forkscan_heap_for_each_live_run(low, high, count_run, &n_runs);
+            out_word(&o, n_runs);
+            forkscan_heap_for_each_live_run(low, high, write_run, &o);
+            forkscan_heap_for_each_live_run(low, high, write_sparse, &o);
+        } else {
+            write_sparse(low, high, &o);
+        }
+        out_word(&o, 0);
+        out_word(&o, 0);
+    }
+
+    out_flush(&o);
+    if (0 != close(o.fd)) o.failed = 1;
+    if (o.failed) {
+        forkscan_diagnostic("warning: %s = %s\n  Unable to write the"
+                            " snapshot.\n", env_snapshot, path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Read the snapshot at path and map its contents back where they were.
+ */
+int forkscan_snapshot_load (const char *path, snapshot_t **sp)
+{
+    snapshot_t *s;
+    size_t *deadrefs = NULL;
+    size_t i, n_marks;
+    int ret = SNAPSHOT_LOAD_ERROR;
+    FILE *f;
+
+    if (NULL == (f = fopen(path, "r"))) {
+        forkscan_diagnostic("error: unable to open %s.\n", path);
+        return SNAPSHOT_LOAD_ERROR;
+    }
+    if (NULL == (s = calloc(1, sizeof(snapshot_t)))) {
+        forkscan_fatal("Out of memory.\n");
+    }
+
+    if (!read_bytes(f, &s->header, sizeof(s->header))
+        || 0 != memcmp(s->header.magic, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE)
+        || 0 == s->header.n_addrs) {
+        forkscan_diagnostic("error: %s is not a Forkscan snapshot.\n", path);
+        goto out;
+    }
+
+    size_t n = s->header.n_addrs, n_dead = s->header.n_deadrefs;
+    n_marks = (n + 63) / 64;
+    s->addrs = malloc(n * sizeof(size_t));
+    s->sizes = malloc((n + n_dead) * sizeof(size_t));
+    s->dead_sizes = s->sizes + n;
+    deadrefs = malloc(MAX_OF(n_dead, 1) * sizeof(size_t));
+    s->marks = malloc(n_marks * sizeof(uint64_t));
+    s->ranges = calloc(MAX_OF(s->header.n_ranges, 1),
+                       sizeof(snapshot_range_t));
+    if (!s->addrs || !s->sizes || !deadrefs || !s->marks || !s->ranges) {
+        forkscan_fatal("Out of memory.\n");
+    }
+    if (!read_bytes(f, s->addrs, n * sizeof(size_t))
+        || !read_bytes(f, s->sizes, n * sizeof(size_t))
+        || !read_bytes(f, deadrefs, n_dead * sizeof(size_t))
+        || !read_bytes(f, s->dead_sizes, n_dead * sizeof(size_t))) {
+        goto truncated;
+    }
+    for (i = 0; i < s->header.n_ranges; ++i) {
+        snapshot_range_record_t r;
+        if (!read_bytes(f, &r, sizeof(r))) goto truncated;
+        s->ranges[i].low = r.low;
+        s->ranges[i].high = r.high;
+        s->ranges[i].flags = r.flags;
+    }
+    if (!read_bytes(f, s->marks, n_marks * sizeof(uint64_t))) {
+        goto truncated;
+    }
+
+    if (SNAPSHOT_LOAD_OK != (ret = map_ranges(s))) goto out;
+    for (i = 0; i < s->header.n_ranges; ++i) {
+        // The memory stays mapped, but the caller won't get far anyway.
+        if (0 != read_range(f, &s->ranges[i])) goto truncated;
+    }
+
+    s->ab = forkscan_make_aggregate_buffer(n);
+    memcpy(s->ab->addrs, s->addrs, n * sizeof(size_t));
+    s->ab->n_addrs = n;
+    forkscan_buffer_generate_minimap(s->ab);
+    s->deadrefs = forkscan_make_aggregate_buffer(MAX_OF(n_dead, 1));
+    memcpy(s->deadrefs->addrs, deadrefs, n_dead * sizeof(size_t));
+    s->deadrefs->n_addrs = n_dead;
+
+    free(deadrefs);
+    fclose(f);
+    *sp = s;
+    return SNAPSHOT_LOAD_OK;
+
+ truncated:
+    forkscan_diagnostic("error: %s is truncated or corrupt.\n", path);
+    ret = SNAPSHOT_LOAD_ERROR;
+ out:
+    for (i = 0; s->ranges && i < s->header.n_ranges; ++i) {
+        free(s->ranges[i].runs);
+    }
+    free(s->ranges);
+    free(s->marks);
+    free(s->sizes);
+    free(s->addrs);
+    free(deadrefs);
+    free(s);
+    fclose(f);
+    return ret;
+}
+
+/**
+ * Clear the marks of a replay, so it can be scanned again.
+ */
+void forkscan_snapshot_reset (snapshot_t *s)
+{
+    memcpy(s->ab->addrs, s->addrs, s->header.n_addrs * sizeof(size_t));
+}
+
+/**
+ * Compare a replay's marks with the recorded ones.
+ */
+void forkscan_snapshot_compare (snapshot_t *s, size_t *missing,
+                                size_t *extra)
+{
+    size_t i;
+
+    *missing = *extra = 0;
+    for (i = 0; i < s->header.n_addrs; ++i) {
+        int recorded = (s->marks[i / 64] >> (i % 64)) & 1;
+        int marked = s->ab->addrs[i] & 0x1;
+        if (recorded && !marked) ++*missing;
+        if (marked && !recorded) ++*extra;
+    }
+}
+
+__attribute__((constructor (102)))
+static void snapshot_init ()
+{
+    const char *path = getenv(env_snapshot);
+    const char *iteration = getenv(env_snapshot_iteration);
+
+    if (NULL == path || !path[0]) return;
+    if (strlen(path) >= PATH_MAX) {
+        forkscan_diagnostic("warning: %s is too long.\n", env_snapshot);
+        return;
+    }
+    strcpy(g_requested, path);
+    g_requested_iteration = iteration ? atoi(iteration) : 1;
+}
+
+/****************************************************************************/
+/*                            Exported functions                            */
+/****************************************************************************/
+
+/**
+ * Write the scanner's inputs for the next iteration to path.
+ */
+__attribute__((visibility("default")))
+int forkscan_snapshot (const char *path)
+{
+    if (NULL == path || !path[0] || strlen(path) >= PATH_MAX) return -1;
+
+    pthread_mutex_lock(&g_request_lock);
+    strcpy(g_requested, path);
+    g_requested_iteration = 0;
+    pthread_mutex_unlock(&g_request_lock);
+    return 0;
+}
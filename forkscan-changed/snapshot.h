@@ -0,0 +1,150 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/* Module Description:
+   Snapshots of the scanner's inputs, for tuning and checking the scanner
+   offline.  When a snapshot is requested (FORKSCAN_SNAPSHOT, or
+   forkscan_snapshot()), the child that finishes the last range writes out
+   everything the scan depended on: the sorted retirees and dead references
+   with their sizes, the ranges it collected, the contents of those ranges,
+   and which retirees it marked.  The replay tool maps the contents back at
+   their original addresses and scans them again in one process.
+
+   The file is a snapshot_header_t followed by, in order:
+     - the retirees' addresses, sorted and unmarked, then their sizes;
+     - the dead references, sorted, then their sizes;
+     - n_ranges snapshot_range_record_t;
+     - a bitmap, one bit per retiree, of the ones the scan marked;
+     - for each range, if it's part of the Forkscan heap, a count and that
+       many { low, high } live runs, the parts the scanner walks; then the
+       range's contents as { low, length } extents, each followed by its
+       bytes, ended by a { 0, 0 }.  Pages that are all zeroes are left out.
+   Every field is a native-endian 64-bit word unless noted.
+ */
+
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include "alloc.h"
+#include "buffer.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define SNAPSHOT_MAGIC "FKSNAP01"
+#define SNAPSHOT_MAGIC_SIZE 8
+
+#define SNAPSHOT_RANGE_HEAP 0x1 // Only the live runs are scanned.
+
+typedef struct snapshot_header_t snapshot_header_t;
+typedef struct snapshot_range_record_t snapshot_range_record_t;
+typedef struct snapshot_range_t snapshot_range_t;
+typedef struct snapshot_t snapshot_t;
+
+struct snapshot_header_t {
+    char magic[SNAPSHOT_MAGIC_SIZE];
+    uint32_t mode;       // The scanning loops the child used.
+    uint32_t tag_shift;  // ...and their tag configuration.
+    uint64_t tag_mask;
+    uint64_t n_siblings;
+    uint64_t n_addrs;
+    uint64_t n_deadrefs;
+    uint64_t n_ranges;
+    uint64_t bytes_to_scan;
+};
+
+struct snapshot_range_record_t {
+    uint64_t low, high;
+    uint64_t flags;
+};
+
+/** A loaded snapshot.  Its ranges are mapped at their original addresses.
+ */
+struct snapshot_t {
+    snapshot_header_t header;
+    size_t *addrs;            // As recorded: sorted, unmarked.
+    size_t *sizes;
+    size_t *dead_sizes;
+    uint64_t *marks;          // What the child marked.
+    snapshot_range_t *ranges;
+    addr_buffer_t *ab;        // The buffers a replay scans with.
+    addr_buffer_t *deadrefs;
+};
+
+struct snapshot_range_t {
+    size_t low, high;
+    int flags;
+    int n_runs;
+    mem_range_t *runs;
+};
+
+/**
+ * Return the path the current child should write a snapshot to, or NULL
+ * if this iteration isn't being captured.
+ */
+const char *forkscan_snapshot_path ();
+
+/**
+ * Decide whether the coming iteration is captured.  Called by the GC thread
+ * before it stops the other threads for the fork.
+ */
+void forkscan_snapshot_prepare ();
+
+/**
+ * Write a snapshot of a finished scan to path.  ab holds the marks.  The
+ * header's scan configuration has to be filled in; the counts are filled in
+ * here.  Returns 0 on success.
+ */
+int forkscan_snapshot_write (const char *path,
+                             snapshot_header_t *header,
+                             addr_buffer_t *ab,
+                             const size_t *sizes,
+                             addr_buffer_t *deadrefs,
+                             const size_t *dead_sizes,
+                             const mem_range_t *ranges,
+                             int n_ranges);
+
+#define SNAPSHOT_LOAD_OK 0
+#define SNAPSHOT_LOAD_ERROR -1
+#define SNAPSHOT_LOAD_CONFLICT -2 // Its memory overlaps this process's.
+
+/**
+ * Read the snapshot at path and map its contents back where they were.
+ * On success, *s is set and SNAPSHOT_LOAD_OK returned.  Otherwise a
+ * message has been printed and nothing is left mapped.  A conflict
+ * depends on where this process's own mappings landed, so running it
+ * again may succeed.
+ */
+int forkscan_snapshot_load (const char *path, snapshot_t **s);
+
+/**
+ * Clear the marks of a replay, so it can be scanned again.
+ */
+void forkscan_snapshot_reset (snapshot_t *s);
+
+/**
+ * Compare a replay's marks with the recorded ones: *missing is set to the
+ * number the child marked and the replay didn't, *extra to the reverse.
+ */
+void forkscan_snapshot_compare (snapshot_t *s, size_t *missing,
+                                size_t *extra);
+
+#endif // !defined _SNAPSHOT_H_
@@ -0,0 +1,670 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#define _GNU_SOURCE // For accept4().
+#include <errno.h>
+#include <fcntl.h>
+#include "epoch.h"
+#include "include/forkscan.h"
+#include "latency.h"
+#include <pthread.h>
+#include "retention.h"
+#include <sched.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stats.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "util.h"
+
+/****************************************************************************/
+/*                         Defines, typedefs, etc.                          */
+/****************************************************************************/
+
+#define DEFAULT_EXPORT_INTERVAL_MS 1000
+#define EXPORT_BUFFER_SIZE (16 * 1024)
+#define EXPORTED_CALLSITES 10
+
+static const char env_stats_file[] = "FORKSCAN_STATS_FILE";
+
+static const char env_stats_socket[] = "FORKSCAN_STATS_SOCKET";
+
+static const char env_stats_interval_ms[] = "FORKSCAN_STATS_INTERVAL_MS";
+
+typedef struct totals_t totals_t;
+
+struct totals_t {
+    size_t iterations;
+    size_t retired;
+    size_t retired_bytes;
+    size_t survivors;
+    size_t pending;
+    size_t bytes_scanned;
+    size_t last_bytes_scanned;
+    size_t max_bytes_scanned;
+    uint64_t pause_ns;
+    uint64_t last_pause_ns;
+    uint64_t max_pause_ns;
+    size_t candidates;
+    size_t candidate_hits;
+    size_t lookaside_flushes;
+    size_t marks;
+    uint64_t scan_busy_ns;
+    size_t last_imbalance_pct;
+    int n_siblings;
+    sibling_stats_t siblings[MAX_CHILDREN]; // From the last iteration.
+    struct forkscan_iteration last;
+};
+
+typedef struct out_t out_t;
+
+struct out_t {
+    char *p;
+    size_t left;
+};
+
+/****************************************************************************/
+/*                                 Globals                                  */
+/****************************************************************************/
+
+// Written only by the GC thread.  g_seq is odd while an update is in
+// progress.
+static totals_t g_totals;
+static volatile size_t g_seq;
+
+// Bumped by whichever thread does the work.
+static volatile size_t g_reclaimed;
+static volatile size_t g_reclaimed_bytes;
+static volatile uint64_t g_wait_ns;
+
+static forkscan_hist_t g_phase_hist[N_PHASES];
+static const char *g_phase_names[N_PHASES] = {
+    [PHASE_SIGNAL] = "signal",
+    [PHASE_QUIESCE] = "quiesce",
+    [PHASE_FORK] = "fork",
+    [PHASE_SORT] = "sort",
+    [PHASE_ROOT_SCAN] = "root-scan",
+    [PHASE_MARK] = "mark",
+    [PHASE_RESULT] = "result",
+    [PHASE_SURVIVORS] = "survivors",
+    [PHASE_FREE] = "free",
+};
+
+// The exporter.  Only the GC thread touches these after start-up.
+static char *g_export_file, *g_export_tmp;
+static char *g_export_socket_path;
+static int g_export_socket = -1;
+static int g_export_interval_ms;
+static uint64_t g_next_export_ns;
+static char g_export_buf[EXPORT_BUFFER_SIZE];
+
+/****************************************************************************/
+/*                             Helper functions                             */
+/****************************************************************************/
+
+static void emit (out_t *o, const char *format, ...)
+{
+    va_list args;
+    int n;
+
+    va_start(args, format);
+    n = vsnprintf(o->p, o->left, format, args);
+    va_end(args);
+    if (n < 0) return;
+    if ((size_t)n >= o->left) n = o->left > 0 ? o->left - 1 : 0;
+    o->p += n;
+    o->left -= n;
+}
+
+static void metric (out_t *o, const char *name, const char *type,
+                    const char *help, double value)
+{
+    emit(o, "# HELP %s %s\n# TYPE %s %s\n%s %.15g\n",
+         name, help, name, type, name, value);
+}
+
+/** Render the statistics in the Prometheus text format into buf and return
+ *  the length.
+ */
+static size_t render (char *buf, size_t size)
+{
+    struct forkscan_stats s;
+    out_t o = { buf, size };
+    int phase;
+
+    forkscan_get_stats(&s);
+
+    metric(&o, "forkscan_iterations_total", "counter",
+           "Iterations of reclamation (snapshots).", s.iterations);
+    metric(&o, "forkscan_retired_total", "counter",
+           "Pointers handed to the scanner.", s.retired);
+    metric(&o, "forkscan_retired_bytes_total", "counter",
+           "Bytes handed to the scanner.", s.retired_bytes);
+    metric(&o, "forkscan_reclaimed_total", "counter",
+           "Pointers freed after a scan.", s.reclaimed);
+    metric(&o, "forkscan_reclaimed_bytes_total", "counter",
+           "Bytes freed after a scan.", s.reclaimed_bytes);
+    metric(&o, "forkscan_survivors_total", "counter",
+           "Retirees a scan found still referenced.", s.survivors);
+    metric(&o, "forkscan_pending", "gauge",
+           "Survivors of the last scan, waiting for the next.", s.pending);
+    metric(&o, "forkscan_scanned_bytes_total", "counter",
+           "Bytes of memory scanned for references.", s.bytes_scanned);
+    metric(&o, "forkscan_scanned_bytes_last", "gauge",
+           "Bytes scanned by the last iteration.", s.last_bytes_scanned);
+    metric(&o, "forkscan_scanned_bytes_max", "gauge",
+           "Most bytes scanned by one iteration.", s.max_bytes_scanned);
+    metric(&o, "forkscan_pause_seconds_total", "counter",
+           "Time application threads were stopped for snapshots.",
+           s.pause_ns / 1e9);
+    metric(&o, "forkscan_pause_seconds_last", "gauge",
+           "Length of the last pause.", s.last_pause_ns / 1e9);
+    metric(&o, "forkscan_pause_seconds_max", "gauge",
+           "Longest pause.", s.max_pause_ns / 1e9);
+    metric(&o, "forkscan_throttle_wait_seconds_total", "counter",
+           "Time retiring threads spent reclaiming or throttled.",
+           s.throttle_wait_ns / 1e9);
+    metric(&o, "forkscan_epoch_freed_total", "counter",
+           "Retirees freed by the epoch fast path.", s.epoch_freed);
+    metric(&o, "forkscan_epoch_handed_off_total", "counter",
+           "Retirees the epoch fast path handed to the scanner.",
+           s.epoch_handed_off);
+
+    metric(&o, "forkscan_scan_candidates_total", "counter",
+           "Scanned words in range of a retiree.", s.candidates);
+    metric(&o, "forkscan_scan_candidate_hits_total", "counter",
+           "Distinct candidates that referred to a retiree.",
+           s.candidate_hits);
+    metric(&o, "forkscan_scan_lookaside_flushes_total", "counter",
+           "Batched lookups of candidates.", s.lookaside_flushes);
+    metric(&o, "forkscan_scan_marks_total", "counter",
+           "Retirees marked, directly or by tracing.", s.marks);
+    metric(&o, "forkscan_scan_busy_seconds_total", "counter",
+           "Time scanner processes spent scanning, summed.",
+           s.scan_busy_ns / 1e9);
+    metric(&o, "forkscan_scan_siblings", "gauge",
+           "Scanner processes in the last iteration.", s.last_siblings);
+    metric(&o, "forkscan_scan_imbalance_ratio", "gauge",
+           "How much longer the slowest scanner took than the average.",
+           s.last_imbalance_pct / 100.0);
+
+    emit(&o, "# HELP forkscan_phase_seconds"
+         " Time spent in each phase of an iteration.\n"
+         "# TYPE forkscan_phase_seconds summary\n");
+    for (phase = 0; phase < N_PHASES; ++phase) {
+        const forkscan_hist_t *h = &g_phase_hist[phase];
+        const char *name = g_phase_names[phase];
+        emit(&o, "forkscan_phase_seconds{phase=\"%s\",quantile=\"0.5\"}"
+             " %.9f\n", name, forkscan_hist_percentile(h, 0.50) / 1e9);
+        emit(&o, "forkscan_phase_seconds{phase=\"%s\",quantile=\"0.99\"}"
+             " %.9f\n", name, forkscan_hist_percentile(h, 0.99) / 1e9);
+        emit(&o, "forkscan_phase_seconds_sum{phase=\"%s\"} %.9f\n",
+             name, h->sum / 1e9);
+        emit(&o, "forkscan_phase_seconds_count{phase=\"%s\"} %zu\n",
+             name, (size_t)h->count);
+    }
+
+    for (phase = 0; phase < N_LATENCIES; ++phase) {
+        struct forkscan_latency l;
+        const char *name = forkscan_latency_name(phase);
+        if (0 != forkscan_get_latency(phase, &l)) break;
+        if (LATENCY_RETIRE == phase) {
+            emit(&o, "# HELP forkscan_latency_seconds"
+                 " Latency application threads see, by operation.\n"
+                 "# TYPE forkscan_latency_seconds summary\n");
+        }
+        emit(&o, "forkscan_latency_seconds{op=\"%s\",quantile=\"0.5\"}"
+             " %.9f\n", name, l.p50_ns / 1e9);
+        emit(&o, "forkscan_latency_seconds{op=\"%s\",quantile=\"0.99\"}"
+             " %.9f\n", name, l.p99_ns / 1e9);
+        emit(&o, "forkscan_latency_seconds{op=\"%s\",quantile=\"0.999\"}"
+             " %.9f\n", name, l.p999_ns / 1e9);
+        emit(&o, "forkscan_latency_seconds_sum{op=\"%s\"} %.9f\n",
+             name, (double)l.mean_ns * l.count / 1e9);
+        emit(&o, "forkscan_latency_seconds_count{op=\"%s\"} %zu\n",
+             name, l.count);
+    }
+
+    struct forkscan_callsite sites[EXPORTED_CALLSITES];
+    int n_sites = forkscan_get_callsites(sites, EXPORTED_CALLSITES);
+    if (n_sites > 0) {
+        emit(&o, "# HELP forkscan_callsite_retired_total"
+             " Estimated retires from the busiest call sites.\n"
+             "# TYPE forkscan_callsite_retired_total counter\n");
+        for (phase = 0; phase < n_sites; ++phase) {
+            emit(&o, "forkscan_callsite_retired_total{site=\"%s\"} %zu\n",
+                 sites[phase].symbol, sites[phase].retired);
+        }
+        emit(&o, "# HELP forkscan_callsite_survivals_total"
+             " Iterations sampled retirees from the site survived.\n"
+             "# TYPE forkscan_callsite_survivals_total counter\n");
+        for (phase = 0; phase < n_sites; ++phase) {
+            emit(&o, "forkscan_callsite_survivals_total{site=\"%s\"} %zu\n",
+                 sites[phase].symbol, sites[phase].survivals);
+        }
+    }
+
+    size_t retained[N_RETENTION_KINDS];
+    if (forkscan_retention_counts(retained) > 0) {
+        emit(&o, "# HELP forkscan_retained_samples_total"
+             " Sampled survivors, by where the first reference was found.\n"
+             "# TYPE forkscan_retained_samples_total counter\n");
+        for (phase = 0; phase < N_RETENTION_KINDS; ++phase) {
+            emit(&o, "forkscan_retained_samples_total{kind=\"%s\"} %zu\n",
+                 forkscan_retention_kind_name(phase), retained[phase]);
+        }
+    }
+
+    return o.p - buf;
+}
+
+static int write_all (int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (EINTR == errno) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/** Replace the stats file, so readers never see a partial one.
+ */
+static void export_file (const char *buf, size_t len)
+{
+    int fd = open(g_export_tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  0644);
+    if (fd < 0) return;
+    int failed = write_all(fd, buf, len);
+    close(fd);
+    if (failed || 0 != rename(g_export_tmp, g_export_file)) {
+        unlink(g_export_tmp);
+    }
+}
+
+/** Answer everybody waiting on the socket and hang up.
+ */
+static void export_socket (const char *buf, size_t len)
+{
+    int fd;
+    while ((fd = accept4(g_export_socket, NULL, NULL,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        write_all(fd, buf, len);
+        close(fd);
+    }
+}
+
+static int open_socket (const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        forkscan_diagnostic("warning: %s = %s\n  Path is too long.\n",
+                            env_stats_socket, path);
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    unlink(path); // Left over from an earlier run.
+    if (0 != bind(fd, (struct sockaddr*)&addr, sizeof(addr))
+        || 0 != listen(fd, 16)) {
+        forkscan_diagnostic("warning: %s = %s\n  Unable to listen there.\n",
+                            env_stats_socket, path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+__attribute__((constructor (102)))
+static void stats_init ()
+{
+    const char *file = getenv(env_stats_file);
+    const char *socket_path = getenv(env_stats_socket);
+    const char *interval = getenv(env_stats_interval_ms);
+
+    if (file && file[0]) {
+        size_t len = strlen(file);
+        g_export_file = strdup(file);
+        g_export_tmp = malloc(len + sizeof(".tmp"));
+        memcpy(g_export_tmp, file, len);
+        memcpy(g_export_tmp + len, ".tmp", sizeof(".tmp"));
+    }
+    if (socket_path && socket_path[0]) {
+        g_export_socket = open_socket(socket_path);
+        if (g_export_socket >= 0) g_export_socket_path = strdup(socket_path);
+    }
+    if (NULL == g_export_file && g_export_socket < 0) return;
+
+    g_export_interval_ms = interval ? atoi(interval) : 0;
+    if (g_export_interval_ms <= 0) {
+        g_export_interval_ms = DEFAULT_EXPORT_INTERVAL_MS;
+    }
+}
+
+__attribute__((destructor))
+static void stats_fini ()
+{
+    if (g_export_file) {
+        // One last time, so short runs leave something behind.  The GC
+        // thread may still be using g_export_buf.
+        char buf[EXPORT_BUFFER_SIZE];
+        export_file(buf, render(buf, sizeof(buf)));
+    }
+    if (g_export_socket_path) unlink(g_export_socket_path);
+}
+
+/****************************************************************************/
+/*                            Internal interface                            */
+/****************************************************************************/
+
+/**
+ * Add an iteration's results to the totals.  GC thread only.
+ */
+void forkscan_stats_end_iteration (const iteration_stats_t *it)
+{
+    ++g_seq;
+    __sync_synchronize();
+    ++g_totals.iterations;
+    g_totals.retired += it->retired;
+    g_totals.retired_bytes += it->retired_bytes;
+    g_totals.survivors += it->survivors;
+    g_totals.pending = it->survivors;
+    g_totals.bytes_scanned += it->bytes_scanned;
+    g_totals.last_bytes_scanned = it->bytes_scanned;
+    g_totals.max_bytes_scanned =
+        MAX_OF(g_totals.max_bytes_scanned, it->bytes_scanned);
+    g_totals.pause_ns += it->pause_ns;
+    g_totals.last_pause_ns = it->pause_ns;
+    g_totals.max_pause_ns = MAX_OF(g_totals.max_pause_ns, it->pause_ns);
+
+    uint64_t busy = 0, slowest = 0;
+    int i;
+    for (i = 0; i < it->n_siblings; ++i) {
+        const sibling_stats_t *sib = &it->siblings[i];
+        g_totals.candidates += sib->candidates;
+        g_totals.candidate_hits += sib->hits;
+        g_totals.lookaside_flushes += sib->flushes;
+        g_totals.marks += sib->marks;
+        busy += sib->busy_ns;
+        slowest = MAX_OF(slowest, sib->busy_ns);
+        g_totals.siblings[i] = *sib;
+    }
+    g_totals.scan_busy_ns += busy;
+    g_totals.n_siblings = it->n_siblings;
+    g_totals.last_imbalance_pct = 0 == busy ? 0
+        : slowest * 100 * it->n_siblings / busy - 100;
+
+    struct forkscan_iteration *last = &g_totals.last;
+    last->retired = it->retired;
+    last->survivors = it->survivors;
+    last->bytes_scanned = it->bytes_scanned;
+    last->siblings = it->n_siblings;
+    last->signal_ns = it->signal_ns;
+    last->quiesce_ns = it->quiesce_ns;
+    last->fork_ns = it->fork_ns;
+    last->child_start_ns = it->child_start_ns;
+    last->sort_ns = it->sort_ns;
+    last->root_scan_ns = it->root_scan_ns;
+    last->mark_ns = it->mark_ns;
+    last->scan_ns = it->scan_ns;
+    last->result_ns = it->result_ns;
+    last->parent_faults = it->parent_faults;
+    __sync_synchronize();
+    ++g_seq;
+}
+
+/**
+ * Add the duration of one phase of an iteration, in ns, to its histogram.
+ */
+void forkscan_record_phase (forkscan_phase_t phase, uint64_t ns)
+{
+    forkscan_hist_record(&g_phase_hist[phase], ns);
+}
+
+/**
+ * Print the totals and phase times to stdout, for FORKSCAN_REPORT_STATS.
+ */
+void forkscan_stats_print ()
+{
+    struct forkscan_stats s;
+    int phase;
+
+    forkscan_get_stats(&s);
+    printf("scan-max: %zu\n", s.max_bytes_scanned);
+    printf("ave-fork-time: %.3f\n",
+           s.iterations == 0 ? 0.0
+           : (double)s.pause_ns / s.iterations / 1e6);
+    printf("wait-time: %zu\n", s.throttle_wait_ns / 1000000);
+    printf("retired: %zu (%zu bytes)\n", s.retired, s.retired_bytes);
+    printf("reclaimed: %zu (%zu bytes)\n", s.reclaimed, s.reclaimed_bytes);
+    printf("scan: candidates %zu, hit-rate %.1f%%, flushes %zu, marks %zu,"
+           " busy %.3f, last-siblings %zu, last-imbalance %zu%%\n",
+           s.candidates,
+           0 == s.candidates ? 0.0 : 100.0 * s.candidate_hits / s.candidates,
+           s.lookaside_flushes, s.marks, s.scan_busy_ns / 1e6,
+           s.last_siblings, s.last_imbalance_pct);
+    for (phase = 0; phase < N_PHASES; ++phase) {
+        const forkscan_hist_t *h = &g_phase_hist[phase];
+        if (0 == h->count) continue;
+        // In us.
+        printf("phase-%s: n %zu, mean %.1f, p50 %.1f, p99 %.1f, max %.1f\n",
+               g_phase_names[phase],
+               (size_t)h->count,
+               forkscan_hist_mean(h) / 1e3,
+               forkscan_hist_percentile(h, 0.50) / 1e3,
+               forkscan_hist_percentile(h, 0.99) / 1e3,
+               h->max / 1e3);
+    }
+    for (phase = 0; phase < N_LATENCIES; ++phase) {
+        struct forkscan_latency l;
+        if (0 != forkscan_get_latency(phase, &l)) break;
+        if (0 == l.count) continue;
+        // In ns.
+        printf("latency-%s: n %zu, mean %zu, p50 %zu, p99 %zu, p999 %zu,"
+               " max %zu\n",
+               forkscan_latency_name(phase), l.count, l.mean_ns,
+               l.p50_ns, l.p99_ns, l.p999_ns, l.max_ns);
+    }
+}
+
+/**
+ * Count n retirees, bytes in all, freed after a scan.
+ */
+void forkscan_stats_add_reclaimed (size_t n, size_t bytes)
+{
+    __sync_fetch_and_add(&g_reclaimed, n);
+    __sync_fetch_and_add(&g_reclaimed_bytes, bytes);
+}
+
+/**
+ * Count time an application thread spent throttled or reclaiming.
+ */
+void forkscan_stats_add_wait (uint64_t ns)
+{
+    __sync_fetch_and_add(&g_wait_ns, ns);
+}
+
+/**
+ * Return the interval, in ms, at which forkscan_stats_export_tick() should
+ * be called, or zero if nothing is being exported.
+ */
+int forkscan_stats_export_interval ()
+{
+    return g_export_interval_ms;
+}
+
+/**
+ * Write the statistics out if an export is due.  GC thread only.
+ */
+void forkscan_stats_export_tick ()
+{
+    uint64_t now;
+    size_t len;
+
+    if (0 == g_export_interval_ms) return;
+    now = forkscan_util_nanotime();
+    if (now < g_next_export_ns) return;
+    g_next_export_ns = now + g_export_interval_ms * 1000000ULL;
+
+    len = render(g_export_buf, sizeof(g_export_buf));
+    if (g_export_file) export_file(g_export_buf, len);
+    if (g_export_socket >= 0) export_socket(g_export_buf, len);
+}
+
+/****************************************************************************/
+/*                            Exported functions                            */
+/****************************************************************************/
+
+/**
+ * Copy the process-wide reclamation statistics into *stats.
+ */
+__attribute__((visibility("default")))
+void forkscan_get_stats (struct forkscan_stats *stats)
+{
+    size_t seq;
+
+    // Retry until we've read the totals without the GC thread changing
+    // them underneath us.
+    do {
+        while ((seq = g_seq) & 1) sched_yield();
+        __sync_synchronize();
+        stats->iterations = g_totals.iterations;
+        stats->retired = g_totals.retired;
+        stats->retired_bytes = g_totals.retired_bytes;
+        stats->survivors = g_totals.survivors;
+        stats->pending = g_totals.pending;
+        stats->bytes_scanned = g_totals.bytes_scanned;
+        stats->last_bytes_scanned = g_totals.last_bytes_scanned;
+        stats->max_bytes_scanned = g_totals.max_bytes_scanned;
+        stats->pause_ns = g_totals.pause_ns;
+        stats->last_pause_ns = g_totals.last_pause_ns;
+        stats->max_pause_ns = g_totals.max_pause_ns;
+        stats->candidates = g_totals.candidates;
+        stats->candidate_hits = g_totals.candidate_hits;
+        stats->lookaside_flushes = g_totals.lookaside_flushes;
+        stats->marks = g_totals.marks;
+        stats->scan_busy_ns = g_totals.scan_busy_ns;
+        stats->last_siblings = g_totals.n_siblings;
+        stats->last_imbalance_pct = g_totals.last_imbalance_pct;
+        __sync_synchronize();
+    } while (seq != g_seq);
+
+    stats->reclaimed = g_reclaimed;
+    stats->reclaimed_bytes = g_reclaimed_bytes;
+    stats->throttle_wait_ns = g_wait_ns;
+    stats->epoch_freed = forkscan_epoch_freed();
+    stats->epoch_handed_off = forkscan_epoch_handed_off();
+}
+
+/**
+ * Copy what each scanner process did in the last iteration, up to max of
+ * them, into siblings and return the number copied.
+ */
+__attribute__((visibility("default")))
+int forkscan_get_sibling_stats (struct forkscan_sibling_stats *siblings,
+                                int max)
+{
+    size_t seq;
+    int i, n;
+
+    do {
+        while ((seq = g_seq) & 1) sched_yield();
+        __sync_synchronize();
+        n = MIN_OF(max, g_totals.n_siblings);
+        for (i = 0; i < n; ++i) {
+            const sibling_stats_t *sib = &g_totals.siblings[i];
+            siblings[i].bytes_scanned = sib->bytes_scanned;
+            siblings[i].ranges = sib->ranges;
+            siblings[i].candidates = sib->candidates;
+            siblings[i].hits = sib->hits;
+            siblings[i].flushes = sib->flushes;
+            siblings[i].marks = sib->marks;
+            siblings[i].busy_ns = sib->busy_ns;
+        }
+        __sync_synchronize();
+    } while (seq != g_seq);
+
+    return n;
+}
+
+/**
+ * Copy the breakdown of the last completed iteration into *it and return
+ * its number, or zero if there hasn't been one.
+ */
+__attribute__((visibility("default")))
+size_t forkscan_get_last_iteration (struct forkscan_iteration *it)
+{
+    size_t seq, n;
+
+    do {
+        while ((seq = g_seq) & 1) sched_yield();
+        __sync_synchronize();
+        n = g_totals.iterations;
+        *it = g_totals.last;
+        __sync_synchronize();
+    } while (seq != g_seq);
+
+    return n;
+}
+
+/**
+ * Merge every thread's histogram for operation which (FORKSCAN_LATENCY_*)
+ * into *latency.  Returns zero on success, non-zero if which is out of
+ * range or the histograms are compiled out.
+ */
+__attribute__((visibility("default")))
+int forkscan_get_latency (int which, struct forkscan_latency *latency)
+{
+    static forkscan_hist_t h; // Too big for a small thread stack.
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    int ret;
+
+    if (which < 0 || which >= N_LATENCIES) return 1;
+
+    pthread_mutex_lock(&lock);
+    memset(&h, 0, sizeof(h));
+    ret = forkscan_latency_merge(which, &h);
+    if (0 == ret) {
+        latency->count = h.count;
+        latency->mean_ns = (size_t)forkscan_hist_mean(&h);
+        latency->p50_ns = forkscan_hist_percentile(&h, 0.50);
+        latency->p90_ns = forkscan_hist_percentile(&h, 0.90);
+        latency->p99_ns = forkscan_hist_percentile(&h, 0.99);
+        latency->p999_ns = forkscan_hist_percentile(&h, 0.999);
+        latency->max_ns = h.max;
+    }
+    pthread_mutex_unlock(&lock);
+    return ret;
+}
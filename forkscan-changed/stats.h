@@ -0,0 +1,114 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/* Module Description:
+   Running totals for the whole process: what was retired, what was freed,
+   and what each iteration cost.  The GC thread is the only writer of the
+   per-iteration totals and publishes them under a sequence lock, so
+   forkscan_get_stats() reads a consistent set without taking a lock.
+   Counters that application threads bump (frees, throttling) are plain
+   atomics.
+
+   The same numbers can be exported periodically in the Prometheus text
+   format, to a file (FORKSCAN_STATS_FILE, replaced atomically each time) or
+   to anybody who connects to a Unix socket (FORKSCAN_STATS_SOCKET).  The GC
+   thread does the exporting every FORKSCAN_STATS_INTERVAL_MS.
+ */
+
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stddef.h>
+#include "buffer.h"
+#include <stdint.h>
+#include "histogram.h"
+
+// The phases of a reclamation iteration, each timed into its own histogram.
+typedef enum {
+    PHASE_SIGNAL,    // Sending the signal to every thread.
+    PHASE_QUIESCE,   // Waiting for them all to acknowledge it.
+    PHASE_FORK,      // fork(), in the parent.
+    PHASE_SORT,      // Child: sorting the retirees.
+    PHASE_ROOT_SCAN, // Child: scanning memory for references.
+    PHASE_MARK,      // Child: looking up references and marking retirees.
+    PHASE_RESULT,    // From the child finishing to the parent hearing it.
+    PHASE_SURVIVORS, // Pulling out the retirees that are still referenced.
+    PHASE_FREE,      // From results being ready to the last one freed.
+    N_PHASES
+} forkscan_phase_t;
+
+typedef struct iteration_stats_t iteration_stats_t;
+
+/** What one iteration of reclamation did, as seen by the GC thread.
+ */
+struct iteration_stats_t {
+    size_t retired;       // Pointers submitted since the last iteration.
+    size_t retired_bytes;
+    size_t bytes_scanned;
+    size_t survivors;     // Retirees found to be still referenced.
+    uint64_t pause_ns;    // From signalling the threads to the fork.
+    int n_siblings;       // Scanner processes, and what each one did.
+    const sibling_stats_t *siblings;
+
+    // The breakdown forkscan_get_last_iteration() reports, in ns.
+    uint64_t signal_ns, quiesce_ns, fork_ns, child_start_ns;
+    uint64_t sort_ns, root_scan_ns, mark_ns, scan_ns, result_ns;
+    size_t parent_faults; // Minor faults while the child ran.
+};
+
+/**
+ * Add an iteration's results to the totals.  GC thread only.
+ */
+void forkscan_stats_end_iteration (const iteration_stats_t *it);
+
+/**
+ * Add the duration of one phase of an iteration, in ns, to its histogram.
+ */
+void forkscan_record_phase (forkscan_phase_t phase, uint64_t ns);
+
+/**
+ * Print the totals and phase times to stdout, for FORKSCAN_REPORT_STATS.
+ */
+void forkscan_stats_print ();
+
+/**
+ * Count n retirees, bytes in all, freed after a scan.
+ */
+void forkscan_stats_add_reclaimed (size_t n, size_t bytes);
+
+/**
+ * Count time an application thread spent throttled or reclaiming.
+ */
+void forkscan_stats_add_wait (uint64_t ns);
+
+/**
+ * Return the interval, in ms, at which forkscan_stats_export_tick() should
+ * be called, or zero if nothing is being exported.
+ */
+int forkscan_stats_export_interval ();
+
+/**
+ * Write the statistics out if an export is due.  GC thread only.
+ */
+void forkscan_stats_export_tick ();
+
+#endif // !defined _STATS_H_
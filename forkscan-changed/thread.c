@@ -23,6 +23,10 @@ THE SOFTWARE.
 #include "alloc.h"
 #include <alloca.h>
 #include <assert.h>
+#include "domain.h"
+#include "epoch.h"
+#include "finalize.h"
+#include "heap.h"
 #include "proc.h"
 #include <pthread.h>
 #include <setjmp.h>
@@ -96,12 +100,47 @@ void *forkscan_thread_base (void *arg)
 void forkscan_thread_cleanup ()
 {
     thread_data_t *td = forkscan_local_td;
+    void *ptr;
     assert(td);
+    // Hooks may still retire pointers, so they go first.
+    while (td->n_exit_hooks > 0) {
+        int i = --td->n_exit_hooks;
+        td->exit_hooks[i].fn(td->exit_hooks[i].arg);
+    }
     td->is_active = 0;
     forkscan_proc_remove_thread_data(td);
-    extern size_t g_total_wait_time_ms; // FIXME: Bad, bad, bad!
-    __sync_fetch_and_add(&g_total_wait_time_ms, td->wait_time_ms);
+    // Free the rest of the reclaimed pointers this thread claimed.  Nobody
+    // else will.
+    forkscan_util_finish_free_ptrs(td);
+    // Snapshots no longer drain our ptr_list, and the finalizers that just
+    // ran may have retired more.  Hand it all to the next snapshot.
+    while (!forkscan_queue_is_empty(&td->ptr_list)) {
+        forkscan_domain_orphan((void*)forkscan_queue_pop(&td->ptr_list));
+    }
+    while (NULL != (ptr = forkscan_finalize_pop_deferred())) {
+        forkscan_domain_orphan(ptr);
+    }
+    forkscan_domain_flush_thread();
+    forkscan_epoch_thread_exit();
+    forkscan_latency_thread_exit(td->latency);
     forkscan_util_thread_data_decr_ref(td);
+    forkscan_heap_thread_flush();
+}
+
+/**
+ * Call fn(arg) when the calling thread exits, while it can still retire
+ * pointers.  Returns non-zero if the thread isn't known to Forkscan or
+ * already has MAX_EXIT_HOOKS hooks.
+ */
+__attribute__((visibility("default")))
+int forkscan_thread_atexit (void (*fn) (void *arg), void *arg)
+{
+    thread_data_t *td = forkscan_local_td;
+    if (NULL == td || td->n_exit_hooks >= MAX_EXIT_HOOKS) return -1;
+    td->exit_hooks[td->n_exit_hooks].fn = fn;
+    td->exit_hooks[td->n_exit_hooks].arg = arg;
+    ++td->n_exit_hooks;
+    return 0;
 }
 
 /**
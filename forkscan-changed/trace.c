@@ -0,0 +1,285 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#define _GNU_SOURCE // For syscall().
+#include "alloc.h"
+#include "include/forkscan.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include "trace.h"
+#include <unistd.h>
+#include "util.h"
+
+/****************************************************************************/
+/*                         Defines, typedefs, etc.                          */
+/****************************************************************************/
+
+#define DEFAULT_TRACE_EVENTS (256 * 1024)
+#define MIN_TRACE_EVENTS 1024
+#define MAX_TRACE_EVENTS (64 * 1024 * 1024)
+
+// Snapshot processes named in a dump.  Any beyond this go unnamed.
+#define MAX_NAMED_PROCESSES 64
+
+static const char env_trace[] = "FORKSCAN_TRACE";
+
+static const char env_trace_events[] = "FORKSCAN_TRACE_EVENTS";
+
+typedef struct trace_record_t trace_record_t;
+typedef struct trace_ring_t trace_ring_t;
+
+struct trace_record_t {
+    volatile uint64_t seq; // Index + 1, once the record is complete.
+    uint64_t ts_ns;
+    uint64_t arg;
+    int32_t pid;
+    int32_t tid;
+    uint16_t type;
+    char ph;
+};
+
+struct trace_ring_t {
+    volatile uint64_t head; // Index of the next record.
+    uint64_t mask;
+    char pad[48];
+    trace_record_t records[];
+};
+
+// How each event is shown, and what its argument is called at the
+// beginning (or instant) and at the end.  NULL for no argument.
+static const struct {
+    const char *name;
+    const char *begin_arg;
+    const char *end_arg;
+} g_events[N_TRACE_EVENTS] = {
+    [TRACE_ITERATION]  = { "iteration", "retirees", "survivors" },
+    [TRACE_QUEUE_FULL] = { "retire-queue-full", NULL, NULL },
+    [TRACE_RECLAIMER]  = { "reclaimer", "submission", NULL },
+    [TRACE_THROTTLE]   = { "throttled", "queued", NULL },
+    [TRACE_SIGNAL]     = { "signal", "threads", NULL },
+    [TRACE_ACK]        = { "snapshot-pause", NULL, NULL },
+    [TRACE_QUIESCE]    = { "quiesce", NULL, NULL },
+    [TRACE_FORK]       = { "fork", NULL, "child" },
+    [TRACE_SORT]       = { "sort", "retirees", NULL },
+    [TRACE_SCAN]       = { "scan", "sibling", "bytes" },
+    [TRACE_LOOKASIDE]  = { "lookaside", "candidates", NULL },
+    [TRACE_RESULT]     = { "result", "bytes_scanned", NULL },
+    [TRACE_FREE_BATCH] = { "free-batch", "pointers", NULL },
+    [TRACE_RETENTION]  = { "retention", NULL, "samples" },
+};
+
+/****************************************************************************/
+/*                                 Globals                                  */
+/****************************************************************************/
+
+void *g_forkscan_trace_ring;
+
+static char *g_trace_path;
+static pthread_mutex_t g_dump_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread int32_t t_pid, t_tid;
+
+/****************************************************************************/
+/*                             Helper functions                             */
+/****************************************************************************/
+
+/** CLOCK_MONOTONIC rather than the raw clock the statistics use, so the
+ *  timeline lines up with traces the application takes itself.
+ */
+static uint64_t trace_now ()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/** Copy record idx out of the ring.  Returns zero if it's been overwritten
+ *  or is still being written.
+ */
+static int read_record (trace_ring_t *ring, uint64_t idx, trace_record_t *r)
+{
+    trace_record_t *src = &ring->records[idx & ring->mask];
+
+    if (src->seq != idx + 1) return 0;
+    __sync_synchronize();
+    r->ts_ns = src->ts_ns;
+    r->arg = src->arg;
+    r->pid = src->pid;
+    r->tid = src->tid;
+    r->type = src->type;
+    r->ph = src->ph;
+    __sync_synchronize();
+    return src->seq == idx + 1 && r->type < N_TRACE_EVENTS;
+}
+
+static void write_event (FILE *f, const trace_record_t *r)
+{
+    const char *arg = TRACE_END == r->ph
+        ? g_events[r->type].end_arg : g_events[r->type].begin_arg;
+
+    fprintf(f, "{\"name\":\"%s\",\"cat\":\"forkscan\",\"ph\":\"%c\","
+            "\"ts\":%llu.%03llu,\"pid\":%d,\"tid\":%d",
+            g_events[r->type].name, r->ph,
+            (unsigned long long)(r->ts_ns / 1000),
+            (unsigned long long)(r->ts_ns % 1000),
+            (int)r->pid, (int)r->tid);
+    if (TRACE_INSTANT == r->ph) fprintf(f, ",\"s\":\"t\"");
+    if (arg) {
+        fprintf(f, ",\"args\":{\"%s\":%llu}", arg,
+                (unsigned long long)r->arg);
+    }
+    fprintf(f, "}");
+}
+
+static void write_name (FILE *f, const char *what, int pid, int tid,
+                        const char *name)
+{
+    fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+            "\"args\":{\"name\":\"%s\"}}", what, pid, tid, name);
+}
+
+__attribute__((constructor (102)))
+static void trace_init ()
+{
+    const char *path = getenv(env_trace);
+    const char *events = getenv(env_trace_events);
+    size_t n, size;
+
+    if (NULL == path || !path[0]) return;
+    g_trace_path = strdup(path);
+
+    n = events ? atoi(events) : 0;
+    if (0 == n) n = DEFAULT_TRACE_EVENTS;
+    n = MAX_OF(n, MIN_TRACE_EVENTS);
+    n = MIN_OF(n, MAX_TRACE_EVENTS);
+    // Round up to a power of 2, for masking.
+    while (n & (n - 1)) n = (n | (n - 1)) + 1;
+
+    size = PAGEALIGN(sizeof(trace_ring_t) + n * sizeof(trace_record_t)
+                     + PAGESIZE - 1);
+    trace_ring_t *ring = forkscan_alloc_mmap_shared(size, "trace ring");
+    ring->head = 0;
+    ring->mask = n - 1;
+    __sync_synchronize();
+    g_forkscan_trace_ring = ring;
+}
+
+__attribute__((destructor))
+static void trace_fini ()
+{
+    if (g_trace_path && 0 != forkscan_trace_dump(g_trace_path)) {
+        forkscan_diagnostic("warning: %s = %s\n  Unable to write the trace.\n",
+                            env_trace, g_trace_path);
+    }
+}
+
+/****************************************************************************/
+/*                            Internal interface                            */
+/****************************************************************************/
+
+void forkscan_trace_record (trace_event_t type, char ph, uint64_t arg)
+{
+    trace_ring_t *ring = g_forkscan_trace_ring;
+    uint64_t idx = __sync_fetch_and_add(&ring->head, 1);
+    trace_record_t *r = &ring->records[idx & ring->mask];
+
+    if (0 == t_tid) {
+        t_pid = getpid();
+        t_tid = syscall(SYS_gettid);
+    }
+
+    // Readers skip a record whose seq doesn't match the index they expect.
+    r->seq = 0;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    r->ts_ns = trace_now();
+    r->arg = arg;
+    r->pid = t_pid;
+    r->tid = t_tid;
+    r->type = type;
+    r->ph = ph;
+    __atomic_store_n(&r->seq, idx + 1, __ATOMIC_RELEASE);
+}
+
+void forkscan_trace_forked ()
+{
+    t_pid = t_tid = 0;
+}
+
+/****************************************************************************/
+/*                            Exported functions                            */
+/****************************************************************************/
+
+/**
+ * Write the events in the trace ring to path as Chrome trace-event JSON.
+ */
+__attribute__((visibility("default")))
+int forkscan_trace_dump (const char *path)
+{
+    trace_ring_t *ring = g_forkscan_trace_ring;
+    int32_t pids[MAX_NAMED_PROCESSES];
+    int n_pids = 0, gc_pid = 0, gc_tid = 0;
+    int32_t self = getpid();
+    uint64_t head, idx;
+    FILE *f;
+    int i, ret;
+
+    if (NULL == ring) return -1;
+    if (NULL == path) path = g_trace_path;
+    if (NULL == (f = fopen(path, "w"))) return -1;
+
+    pthread_mutex_lock(&g_dump_lock);
+    head = ring->head;
+    idx = head > ring->mask + 1 ? head - (ring->mask + 1) : 0;
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+            "\"args\":{\"name\":\"%s\"}}", (int)self, "application");
+    for (; idx < head; ++idx) {
+        trace_record_t r;
+        if (!read_record(ring, idx, &r)) continue;
+        fprintf(f, ",\n");
+        write_event(f, &r);
+
+        if (TRACE_ITERATION == r.type) {
+            gc_pid = r.pid;
+            gc_tid = r.tid;
+        }
+        if (r.pid == self) continue;
+        for (i = 0; i < n_pids && pids[i] != r.pid; ++i);
+        if (i == n_pids && n_pids < MAX_NAMED_PROCESSES) {
+            pids[n_pids++] = r.pid;
+        }
+    }
+    if (gc_tid) write_name(f, "thread_name", gc_pid, gc_tid, "forkscan-gc");
+    for (i = 0; i < n_pids; ++i) {
+        write_name(f, "process_name", pids[i], pids[i], "forkscan snapshot");
+    }
+    fprintf(f, "\n]}\n");
+    pthread_mutex_unlock(&g_dump_lock);
+
+    ret = ferror(f) ? -1 : 0;
+    if (0 != fclose(f)) ret = -1;
+    return ret;
+}
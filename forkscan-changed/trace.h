@@ -0,0 +1,95 @@
+/*
+Copyright (c) 2026 Forkscan authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/* Module Description:
+   An optional timeline of what Forkscan is doing, for lining application
+   stalls up against reclamation phases.  Events go into a fixed-size ring
+   in memory shared with the snapshot processes, so the child and its
+   siblings record their phases alongside the parent's threads.  When the
+   ring wraps, the oldest events are overwritten.  The ring is written out
+   in the Chrome trace-event JSON format, which chrome://tracing and
+   Perfetto both read.  Build with -DFORKSCAN_USDT to also get a USDT probe
+   at every trace point, whether the ring is on or not.
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdint.h>
+
+#ifdef FORKSCAN_USDT
+#include <sys/sdt.h>
+#endif
+
+typedef enum {
+    TRACE_ITERATION,   // GC thread: a whole reclamation iteration.
+    TRACE_QUEUE_FULL,  // A thread's retire queue filled up.
+    TRACE_RECLAIMER,   // A thread handed its queues to the GC thread.
+    TRACE_THROTTLE,    // A thread waiting for the GC thread to catch up.
+    TRACE_SIGNAL,      // GC thread: signals sent to the threads.
+    TRACE_ACK,         // A thread stopped for the snapshot.
+    TRACE_QUIESCE,     // GC thread: waiting for the threads to stop.
+    TRACE_FORK,        // GC thread: the fork() itself.
+    TRACE_SORT,        // Child: sorting the retirees.
+    TRACE_SCAN,        // Child or sibling: scanning for references.
+    TRACE_LOOKASIDE,   // Child or sibling: looking candidates up.
+    TRACE_RESULT,      // GC thread: heard from the child.
+    TRACE_FREE_BATCH,  // A thread freeing a batch of reclaimed pointers.
+    TRACE_RETENTION,   // Child: finding what refers to sampled survivors.
+    N_TRACE_EVENTS
+} trace_event_t;
+
+#define TRACE_BEGIN   'B'
+#define TRACE_END     'E'
+#define TRACE_INSTANT 'i'
+
+// NULL unless FORKSCAN_TRACE is set.
+extern void *g_forkscan_trace_ring;
+
+#ifdef FORKSCAN_USDT
+#define TRACE_PROBE(name, ph, arg) DTRACE_PROBE2(forkscan, name, ph, arg)
+#else
+#define TRACE_PROBE(name, ph, arg) do {} while (0)
+#endif
+
+// Record an event, e.g., TRACE(FORK, TRACE_BEGIN, 0).  Costs a predictable
+// branch when tracing is off.
+#define TRACE(name, ph, arg) do {                                       \
+        TRACE_PROBE(name, ph, arg);                                     \
+        if (__builtin_expect(NULL != g_forkscan_trace_ring, 0)) {       \
+            forkscan_trace_record(TRACE_##name, ph, (uint64_t)(arg));   \
+        }                                                               \
+    } while (0)
+
+/**
+ * Append an event to the ring, stamped with the time and the calling
+ * process and thread.  Use TRACE() instead.
+ */
+void forkscan_trace_record (trace_event_t type, char ph, uint64_t arg);
+
+/**
+ * Forget the cached process and thread ids.  Call in a new process right
+ * after fork().
+ */
+void forkscan_trace_forked ();
+
+#endif // !defined _TRACE_H_
@@ -25,12 +25,15 @@ THE SOFTWARE.
 #include "alloc.h"
 #include "env.h"
 #include <errno.h>
+#include "finalize.h"
 #include <pthread.h>
+#include "stats.h"
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include "trace.h"
 #include "util.h"
 
 /****************************************************************************/
@@ -86,6 +89,10 @@ thread_data_t *forkscan_util_thread_data_new ()
     td->local_block.low = td->local_block.high = 0;
     td->ref_count = 1;
     td->retiree_buffer = NULL;
+    td->latency = forkscan_latency_new();
+    td->stack_sp = NULL;
+    td->stack_sp_seq = 0;
+    td->n_exit_hooks = 0;
     return td;
 }
 
@@ -104,9 +111,10 @@ void forkscan_util_thread_data_free (thread_data_t *td)
     assert(td);
     assert(td->ref_count == 0);
 
-    // FIXME: Should do something about any possible remaining pointers in this
-    // thread's ptr_list!  Right now, they're getting leaked.
+    // forkscan_thread_cleanup() handed whatever was left in ptr_list to
+    // the next snapshot.
     pool_free_ptrlist(td->ptr_list.e);
+    forkscan_latency_free(td->latency);
 
     pool_free_threaddata(td);
 }
@@ -229,11 +237,49 @@ free_t *forkscan_util_pop_free_list ()
     return free_list;
 }
 
-void forkscan_util_free_ptrs (thread_data_t *td)
+size_t forkscan_util_release_batch (void **batch, size_t n)
 {
-    int i;
+    if (g_finalizers_pending > 0) forkscan_finalize_run(batch, n);
+    return forkscan_backend_release(batch, n);
+}
+
+/** Release a batch of retirees a scan found unreferenced.
+ */
+static void release_scanned (void **batch, size_t n)
+{
+    TRACE(FREE_BATCH, TRACE_BEGIN, n);
+    forkscan_stats_add_reclaimed(n, forkscan_util_release_batch(batch, n));
+    TRACE(FREE_BATCH, TRACE_END, 0);
+}
+
+/** Add the pointer at ab->addrs[idx] to the batch, unless the scan found a
+ *  reference to it, and release the batch if it is full.
+ */
+static void free_one (addr_buffer_t *ab, int idx,
+                      void **batch, size_t *n_batch)
+{
+    size_t s = ab->addrs[idx];
+    if (s & 0x1) {
+        // Don't free it!  It may still be alive.
+        return;
+    }
+    assert(0 == (s & 0x3));
+    ab->addrs[idx] = 0x2; // Remove from set.
+    batch[(*n_batch)++] = (void*)s;
+    if (*n_batch == RELEASE_BATCH) {
+        release_scanned(batch, *n_batch);
+        *n_batch = 0;
+    }
+}
+
+size_t forkscan_util_free_ptrs (thread_data_t *td)
+{
+    void *batch[RELEASE_BATCH];
+    size_t n_batch = 0, n_visited = 0;
+    int i, busy = 0;
 
     assert(td);
+    LATENCY_BEGIN(start);
 
     extern int g_frees_required; // FIXME: Bad, bad, bad.
     for (i = 0; i < g_frees_required; ++i) {
@@ -243,7 +289,8 @@ void forkscan_util_free_ptrs (thread_data_t *td)
             td->begin_retiree_idx = td->end_retiree_idx = 0;
             ab = td->retiree_buffer;
         }
-        if (NULL == ab) return; // Nothing to free.
+        if (NULL == ab) break; // Nothing to free.
+        busy = 1;
 
         if (td->begin_retiree_idx == td->end_retiree_idx) {
             // Get another range to free.
@@ -263,19 +310,29 @@ void forkscan_util_free_ptrs (thread_data_t *td)
             } else continue;
         }
 
-        size_t s = ab->addrs[td->begin_retiree_idx++];
-        if (s & 0x1) {
-            // Don't free it!  It may still be alive.
-            continue;
-        }
-        assert(0 == (s & 0x3));
-        ab->addrs[td->begin_retiree_idx - 1] = 0x2; // Remove from set.
-        void *ptr = (void*)s;
-        // FIXME: What about this memset?  Does it save time
-        // to have it on or off?
-        memset(ptr, 0x0, MALLOC_USABLE_SIZE(ptr));
-        FREE(ptr);
+        free_one(ab, td->begin_retiree_idx++, batch, &n_batch);
+        ++n_visited;
     }
+
+    if (n_batch > 0) release_scanned(batch, n_batch);
+    if (busy) LATENCY_END(td, LATENCY_FREE, start);
+    return n_visited;
+}
+
+void forkscan_util_finish_free_ptrs (thread_data_t *td)
+{
+    void *batch[RELEASE_BATCH];
+    size_t n_batch = 0;
+    addr_buffer_t *ab = td->retiree_buffer;
+
+    if (NULL == ab) return;
+    while (td->begin_retiree_idx < td->end_retiree_idx) {
+        free_one(ab, td->begin_retiree_idx++, batch, &n_batch);
+    }
+    if (n_batch > 0) release_scanned(batch, n_batch);
+
+    forkscan_buffer_unref_buffer(ab);
+    td->retiree_buffer = NULL;
 }
 
 /****************************************************************************/
@@ -427,17 +484,18 @@ int forkscan_util_compact (size_t *a, int length)
 size_t forkscan_rdtsc ()
 {
     struct timespec ts;
-    clock_gettime(CLOCK_REALTIME, &ts);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
     size_t ret = (size_t)(ts.tv_sec * (1000));
     ret += (size_t)(ts.tv_nsec / (1000 * 1000));
     return ret;
 }
 
-extern void *__super_malloc (size_t);
-extern void __super_free (void *);
-extern size_t __super_malloc_usable_size (void *);
-
-/* Allocator Functions */
-void *(*__forkscan_alloc) (size_t) = __super_malloc;
-void (*__forkscan_free) (void *) = __super_free;
-size_t (*__forkscan_usable_size) (void *) = __super_malloc_usable_size;
+/**
+ * Get a timestamp in ns from a clock that never jumps or slews.
+ */
+uint64_t forkscan_util_nanotime ()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
@@ -24,9 +24,12 @@ THE SOFTWARE.
 #define _UTIL_H_
 
 #include "alloc.h"
+#include "backend.h"
 #include "buffer.h"
+#include "latency.h"
 #include "metautil.h"
 #include <pthread.h>
+#include <stdint.h>
 #include "queue.h"
 #include <signal.h>
 
@@ -34,9 +37,9 @@ THE SOFTWARE.
 /*                         Defines, typedefs, etc.                          */
 /****************************************************************************/
 
-#define MALLOC(sz) __forkscan_alloc(sz)
-#define FREE(ptr) __forkscan_free(ptr)
-#define MALLOC_USABLE_SIZE(ptr) __forkscan_usable_size(ptr)
+#define MALLOC(sz) g_forkscan_allocator.malloc(sz)
+#define FREE(ptr) g_forkscan_allocator.free(ptr)
+#define MALLOC_USABLE_SIZE(ptr) g_forkscan_allocator.usable_size(ptr)
 
 #define FOREACH_IN_THREAD_LIST(td, tl) do { \
     pthread_mutex_lock(&(tl)->lock);        \
@@ -59,6 +62,10 @@ THE SOFTWARE.
 
 #define PAGEALIGN(addr) ((addr) & ~(PAGESIZE - 1))
 
+#define HUGEPAGESIZE ((size_t)0x200000)
+
+#define HUGEALIGN(addr) ((addr) & ~(HUGEPAGESIZE - 1))
+
 #define MIN_OF(a, b) ((a) < (b) ? (a) : (b))
 #define MAX_OF(a, b) ((a) < (b) ? (b) : (a))
 
@@ -73,6 +80,9 @@ THE SOFTWARE.
 #define TIMESTAMP_IS_ACTIVE(field) ((field) & _TIMESTAMP_FLAG)
 #define TIMESTAMP_SET_ACTIVE(field) TIMESTAMP_RAISE_FLAG(field)
 
+// Per-thread callbacks for forkscan_thread_atexit().
+#define MAX_EXIT_HOOKS 8
+
 typedef struct free_t free_t;
 
 typedef struct thread_data_t thread_data_t;
@@ -100,12 +110,15 @@ struct thread_data_t {
     char *user_stack_high;    // Actually, just the high address to lock.
 
     int stack_is_ours;        // Whether Forkscan allocated the stack.
+
+    // Where the thread's stack ended when it stopped for a snapshot, and
+    // the g_cleanup_counter of that snapshot.
+    char *stack_sp;
+    size_t stack_sp_seq;
     int is_active;            // The thread is running user code.
 
     queue_t ptr_list;         // Local list of pointers to be collected.
 
-    size_t wait_time_ms;      // reclamation time + throttling.
-
     addr_buffer_t *retiree_buffer;
     int begin_retiree_idx;
     int end_retiree_idx;
@@ -115,6 +128,15 @@ struct thread_data_t {
 
     mem_range_t local_block;  // Non-stack memory local to this thread.
 
+    thread_latency_t *latency; // Time spent in Forkscan, by operation.
+
+    // Registered with forkscan_thread_atexit(), run in reverse order.
+    struct {
+        void (*fn) (void *arg);
+        void *arg;
+    } exit_hooks[MAX_EXIT_HOOKS];
+    int n_exit_hooks;
+
     // Reference count prevents premature free'ing of the structure while
     // other threads are looking at it.
     int ref_count;
@@ -138,7 +160,23 @@ thread_data_t *forkscan_util_thread_list_find (thread_list_t *tl,
                                                size_t addr);
 void forkscan_util_push_free_list (free_t *free_list);
 free_t *forkscan_util_pop_free_list ();
-void forkscan_util_free_ptrs (thread_data_t *td);
+
+/**
+ * Free a few of the retirees the last scan found unreferenced.  Returns the
+ * number of retirees examined, so 0 means there was no work left to claim.
+ */
+size_t forkscan_util_free_ptrs (thread_data_t *td);
+
+/**
+ * Free what is left of the range of reclaimed pointers td has claimed, and
+ * let go of its retiree buffer.
+ */
+void forkscan_util_finish_free_ptrs (thread_data_t *td);
+
+/**
+ * Run any finalizers for, zero, and free the n pointers in batch.
+ */
+size_t forkscan_util_release_batch (void **batch, size_t n);
 
 /****************************************************************************/
 /*                              I/O functions.                              */
@@ -161,8 +199,9 @@ int forkscan_util_compact (size_t *a, int length);
  */
 size_t forkscan_rdtsc ();
 
-extern void *(*__forkscan_alloc) (size_t);
-extern void (*__forkscan_free) (void *);
-extern size_t (*__forkscan_usable_size) (void *);
+/**
+ * Get a timestamp in ns from a clock that never jumps or slews.
+ */
+uint64_t forkscan_util_nanotime ();
 
 #endif // !defined _UTIL_H_
@@ -0,0 +1,544 @@
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "forkscan.h"
+#include "forkscan_ds.h"
+#include "bench.h"
+#include "ebr.h"
+
+// -------------------------------------------------------------------------
+// Concurrent set benchmark.  Each run fills a structure to half its key
+// range, then lets the worker threads run a random mix of insert, remove
+// and contains for a fixed time.  It reports throughput, sampled operation
+// latency, RSS over the run and the Forkscan counters for the run, as text,
+// CSV or JSON.
+// -------------------------------------------------------------------------
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -s STRUCT    list, hash, skiplist, bst or queue (default hash)\n"
+            "  -r RECLAIM   forkscan, forkscan-epoch, ebr or none"
+            " (default forkscan)\n"
+            "  -t THREADS   worker threads (default 4)\n"
+            "  -k RANGE     keys are drawn from [0, RANGE)"
+            " (default 65536, 1024 for list)\n"
+            "  -i INITIAL   keys inserted before the run (default RANGE/2)\n"
+            "  -u PERCENT   share of updates, split evenly between insert"
+            " and remove (default 20)\n"
+            "  -d SECONDS   run length (default 5)\n"
+            "  -l N         time one operation in N (default 8)\n"
+            "  -m MS        RSS sampling interval (default 100)\n"
+            "  -o FORMAT    text, csv or json (default text)\n"
+            "  -H           leave out the CSV header, for appending runs\n"
+            "  -T FILE      also write the RSS samples to FILE as CSV\n"
+            "  -S SEED      random seed (default: from the clock)\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
+
+// -------------------------------------------------------------------------
+// Clock
+// -------------------------------------------------------------------------
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Sleep until an absolute CLOCK_MONOTONIC time.  Forkscan's signals may
+// interrupt us, so keep going until it is reached.
+static void sleep_until(uint64_t deadline) {
+    struct timespec ts = { deadline / 1000000000ULL, deadline % 1000000000ULL };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+// -------------------------------------------------------------------------
+// Reclaimers
+// -------------------------------------------------------------------------
+
+typedef struct reclaimer_t {
+    const char *name;
+    void (*setup)(void);
+    void (*enter)(void);
+    void (*exit)(void);
+    void (*retire)(void *ptr);
+    void (*thread_exit)(void);
+    const struct forkscan_ds_reclaimer *ds; // NULL: Forkscan's defaults.
+} reclaimer_t;
+
+static void nothing(void) {}
+static void leak(void *ptr) { (void)ptr; }
+static void epoch_mode(void) { forkscan_set_epoch_mode(1); }
+
+static void ds_ebr_retire(void *ptr, void *ctx) { (void)ctx; ebr_retire(ptr); }
+static void ds_leak(void *ptr, void *ctx) { (void)ptr; (void)ctx; }
+
+static const struct forkscan_ds_reclaimer ds_ebr = {
+    ds_ebr_retire, NULL, NULL
+};
+static const struct forkscan_ds_reclaimer ds_none = { ds_leak, NULL, NULL };
+
+static const reclaimer_t reclaimers[] = {
+    { "forkscan", nothing, nothing, nothing, forkscan_retire, nothing, NULL },
+    { "forkscan-epoch", epoch_mode, forkscan_enter, forkscan_exit,
+      forkscan_retire, nothing, NULL },
+    { "ebr", nothing, ebr_enter, ebr_exit, ebr_retire, ebr_thread_exit,
+      &ds_ebr },
+    { "none", nothing, nothing, nothing, leak, nothing, &ds_none },
+};
+
+void (*bench_retire)(void *ptr);
+
+void *bench_alloc(size_t size) {
+    void *ptr = forkscan_malloc(size);
+    if (!ptr) {
+        perror("forkscan_malloc");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+void bench_free(void *ptr) {
+    forkscan_free(ptr);
+}
+
+// -------------------------------------------------------------------------
+// Latency histogram: 16 linear sub-buckets per power of two, so a reported
+// percentile is within about 6% of the true value.
+// -------------------------------------------------------------------------
+
+#define SUB_BITS 4
+#define SUB_BUCKETS (1 << SUB_BITS)
+#define MAX_POW 40 // ~18 minutes; anything longer lands in the last bucket.
+#define N_BUCKETS ((MAX_POW - SUB_BITS + 2) * SUB_BUCKETS)
+
+static int bucket_of(uint64_t ns) {
+    if (ns < SUB_BUCKETS) return (int)ns;
+    int pow = 63 - __builtin_clzll(ns);
+    if (pow > MAX_POW) return N_BUCKETS - 1;
+    int sub = (int)(ns >> (pow - SUB_BITS)) & (SUB_BUCKETS - 1);
+    return (pow - SUB_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+static uint64_t bucket_value(int b) {
+    if (b < SUB_BUCKETS) return (uint64_t)b;
+    int pow = b / SUB_BUCKETS + SUB_BITS - 1;
+    uint64_t sub = (uint64_t)(b % SUB_BUCKETS);
+    return (1ULL << pow) + (sub << (pow - SUB_BITS));
+}
+
+static uint64_t percentile(const uint64_t *hist, uint64_t total, double p) {
+    if (total == 0) return 0;
+    uint64_t rank = (uint64_t)(p * (double)total);
+    if (rank >= total) rank = total - 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < N_BUCKETS; ++b) {
+        seen += hist[b];
+        if (seen > rank) return bucket_value(b);
+    }
+    return bucket_value(N_BUCKETS - 1);
+}
+
+// -------------------------------------------------------------------------
+// Configuration and per-thread state
+// -------------------------------------------------------------------------
+
+static const bench_ds_t *ds_ops;
+static const reclaimer_t *reclaimer;
+static void *ds;
+
+static int num_threads = 4;
+static long key_range = -1;
+static long initial = -1;
+static int update_pct = 20;
+static double duration = 5.0;
+static int sample_every = 8;
+static int rss_interval_ms = 100;
+static const char *format = "text";
+static bool csv_header = true;
+static const char *rss_file = NULL;
+static uint64_t seed = 0;
+
+static atomic_bool go;
+static atomic_bool stop;
+static atomic_int ready;
+
+typedef struct worker_t {
+    int id;
+    uint64_t rng;
+    uint64_t ops;
+    uint64_t samples;
+    uint64_t max_ns;
+    uint64_t hist[N_BUCKETS];
+} __attribute__((aligned(64))) worker_t;
+
+static uint64_t next_rand(uint64_t *state) {
+    // xorshift64*
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+// Inserts and removes each get half of update_pct.
+static void run_op(uint64_t r) {
+    long key = (long)((r >> 16) % (uint64_t)key_range);
+    int dice = (int)(r % 200);
+
+    reclaimer->enter();
+    if (dice < update_pct) {
+        ds_ops->insert(ds, key);
+    } else if (dice < 2 * update_pct) {
+        ds_ops->remove(ds, key);
+    } else {
+        ds_ops->contains(ds, key);
+    }
+    reclaimer->exit();
+}
+
+static void *worker_thread(void *arg) {
+    worker_t *w = arg;
+    int countdown = 1 + (int)(next_rand(&w->rng) % sample_every);
+
+    atomic_fetch_add(&ready, 1);
+    while (!atomic_load_explicit(&go, memory_order_acquire))
+        ;
+
+    while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+        uint64_t r = next_rand(&w->rng);
+        if (--countdown == 0) {
+            countdown = sample_every;
+            uint64_t start = now_ns();
+            run_op(r);
+            uint64_t ns = now_ns() - start;
+            ++w->hist[bucket_of(ns)];
+            ++w->samples;
+            if (ns > w->max_ns) w->max_ns = ns;
+        } else {
+            run_op(r);
+        }
+        ++w->ops;
+    }
+
+    reclaimer->thread_exit();
+    return NULL;
+}
+
+// -------------------------------------------------------------------------
+// RSS sampling
+// -------------------------------------------------------------------------
+
+typedef struct rss_sample_t {
+    uint64_t t_ms;
+    uint64_t rss_kb;
+} rss_sample_t;
+
+static rss_sample_t *rss_samples;
+static size_t n_rss_samples;
+static size_t max_rss_samples;
+
+static uint64_t read_rss_kb(void) {
+    unsigned long size, resident;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    int n = fscanf(f, "%lu %lu", &size, &resident);
+    fclose(f);
+    if (n != 2) return 0;
+    return (uint64_t)resident * (uint64_t)sysconf(_SC_PAGESIZE) / 1024;
+}
+
+static void *rss_thread(void *arg) {
+    uint64_t start = *(uint64_t*)arg;
+    uint64_t next = start;
+    while (!atomic_load(&stop) && n_rss_samples < max_rss_samples) {
+        uint64_t t = now_ns();
+        rss_samples[n_rss_samples].t_ms = (t - start) / 1000000;
+        rss_samples[n_rss_samples].rss_kb = read_rss_kb();
+        ++n_rss_samples;
+        next += (uint64_t)rss_interval_ms * 1000000;
+        sleep_until(next);
+    }
+    return NULL;
+}
+
+// -------------------------------------------------------------------------
+// Reporting
+// -------------------------------------------------------------------------
+
+typedef struct result_t {
+    double elapsed_s;
+    uint64_t ops;
+    uint64_t p50, p99, p999, max;
+    uint64_t rss_start_kb, rss_max_kb, rss_end_kb;
+    struct forkscan_stats fs; // Deltas over the run, maxima as of the end.
+} result_t;
+
+#define FS_DELTA(field) r->fs.field = after->field - before->field
+
+static void forkscan_delta(result_t *r, const struct forkscan_stats *before,
+                           const struct forkscan_stats *after) {
+    r->fs = *after;
+    FS_DELTA(iterations);
+    FS_DELTA(retired);
+    FS_DELTA(retired_bytes);
+    FS_DELTA(reclaimed);
+    FS_DELTA(reclaimed_bytes);
+    FS_DELTA(bytes_scanned);
+    FS_DELTA(pause_ns);
+    FS_DELTA(throttle_wait_ns);
+    FS_DELTA(epoch_freed);
+}
+
+static const char *csv_fields =
+    "structure,reclaimer,threads,key_range,initial,update_pct,duration_s,"
+    "ops,ops_per_sec,p50_ns,p99_ns,p999_ns,max_ns,"
+    "rss_start_kb,rss_max_kb,rss_end_kb,"
+    "fs_iterations,fs_retired,fs_reclaimed,fs_pending,fs_epoch_freed,"
+    "fs_bytes_scanned,fs_pause_ns,fs_max_pause_ns,fs_throttle_wait_ns";
+
+static void print_csv(const result_t *r) {
+    if (csv_header) printf("%s\n", csv_fields);
+    printf("%s,%s,%d,%ld,%ld,%d,%.3f,"
+           "%llu,%.0f,%llu,%llu,%llu,%llu,"
+           "%llu,%llu,%llu,"
+           "%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu\n",
+           ds_ops->name, reclaimer->name, num_threads, key_range, initial,
+           update_pct, r->elapsed_s,
+           (unsigned long long)r->ops, r->ops / r->elapsed_s,
+           (unsigned long long)r->p50, (unsigned long long)r->p99,
+           (unsigned long long)r->p999, (unsigned long long)r->max,
+           (unsigned long long)r->rss_start_kb,
+           (unsigned long long)r->rss_max_kb,
+           (unsigned long long)r->rss_end_kb,
+           r->fs.iterations, r->fs.retired, r->fs.reclaimed, r->fs.pending,
+           r->fs.epoch_freed, r->fs.bytes_scanned, r->fs.pause_ns,
+           r->fs.max_pause_ns, r->fs.throttle_wait_ns);
+}
+
+static void print_json(const result_t *r) {
+    printf("{\"structure\": \"%s\", \"reclaimer\": \"%s\", \"threads\": %d, "
+           "\"key_range\": %ld, \"initial\": %ld, \"update_pct\": %d, "
+           "\"duration_s\": %.3f, \"ops\": %llu, \"ops_per_sec\": %.0f, "
+           "\"latency_ns\": {\"p50\": %llu, \"p99\": %llu, \"p999\": %llu, "
+           "\"max\": %llu}, ",
+           ds_ops->name, reclaimer->name, num_threads, key_range, initial,
+           update_pct, r->elapsed_s, (unsigned long long)r->ops,
+           r->ops / r->elapsed_s,
+           (unsigned long long)r->p50, (unsigned long long)r->p99,
+           (unsigned long long)r->p999, (unsigned long long)r->max);
+    printf("\"forkscan\": {\"iterations\": %zu, \"retired\": %zu, "
+           "\"reclaimed\": %zu, \"pending\": %zu, \"epoch_freed\": %zu, "
+           "\"bytes_scanned\": %zu, \"pause_ns\": %zu, \"max_pause_ns\": %zu, "
+           "\"throttle_wait_ns\": %zu}, ",
+           r->fs.iterations, r->fs.retired, r->fs.reclaimed, r->fs.pending,
+           r->fs.epoch_freed, r->fs.bytes_scanned, r->fs.pause_ns,
+           r->fs.max_pause_ns, r->fs.throttle_wait_ns);
+    printf("\"rss_kb\": {\"start\": %llu, \"max\": %llu, \"end\": %llu, "
+           "\"samples\": [",
+           (unsigned long long)r->rss_start_kb,
+           (unsigned long long)r->rss_max_kb,
+           (unsigned long long)r->rss_end_kb);
+    for (size_t i = 0; i < n_rss_samples; ++i) {
+        printf("%s[%llu, %llu]", i ? ", " : "",
+               (unsigned long long)rss_samples[i].t_ms,
+               (unsigned long long)rss_samples[i].rss_kb);
+    }
+    printf("]}}\n");
+}
+
+static void print_text(const result_t *r) {
+    printf("[BENCH] %s / %s, %d threads, key range %ld, %ld initial, "
+           "%d%% updates, %.3f s\n",
+           ds_ops->name, reclaimer->name, num_threads, key_range, initial,
+           update_pct, r->elapsed_s);
+    printf("[BENCH] Throughput: %.0f ops/sec (%llu ops)\n",
+           r->ops / r->elapsed_s, (unsigned long long)r->ops);
+    printf("[BENCH] Latency: p50 %llu ns, p99 %llu ns, p999 %llu ns, "
+           "max %llu ns\n",
+           (unsigned long long)r->p50, (unsigned long long)r->p99,
+           (unsigned long long)r->p999, (unsigned long long)r->max);
+    printf("[BENCH] RSS: start %llu kB, max %llu kB, end %llu kB\n",
+           (unsigned long long)r->rss_start_kb,
+           (unsigned long long)r->rss_max_kb,
+           (unsigned long long)r->rss_end_kb);
+    printf("[BENCH] Forkscan: %zu iterations, %zu retired, %zu reclaimed, "
+           "%zu pending, %zu freed by epochs, max pause %zu ns\n",
+           r->fs.iterations, r->fs.retired, r->fs.reclaimed, r->fs.pending,
+           r->fs.epoch_freed, r->fs.max_pause_ns);
+}
+
+static void write_rss_file(void) {
+    FILE *f = fopen(rss_file, "w");
+    if (!f) {
+        perror(rss_file);
+        return;
+    }
+    fprintf(f, "t_ms,rss_kb\n");
+    for (size_t i = 0; i < n_rss_samples; ++i) {
+        fprintf(f, "%llu,%llu\n", (unsigned long long)rss_samples[i].t_ms,
+                (unsigned long long)rss_samples[i].rss_kb);
+    }
+    fclose(f);
+}
+
+// -------------------------------------------------------------------------
+// Main
+// -------------------------------------------------------------------------
+
+static void parse_args(int argc, char **argv) {
+    const char *ds_name = "hash";
+    const char *reclaimer_name = "forkscan";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:r:t:k:i:u:d:l:m:o:HT:S:")) != -1) {
+        switch (opt) {
+        case 's': ds_name = optarg; break;
+        case 'r': reclaimer_name = optarg; break;
+        case 't': num_threads = atoi(optarg); break;
+        case 'k': key_range = atol(optarg); break;
+        case 'i': initial = atol(optarg); break;
+        case 'u': update_pct = atoi(optarg); break;
+        case 'd': duration = atof(optarg); break;
+        case 'l': sample_every = atoi(optarg); break;
+        case 'm': rss_interval_ms = atoi(optarg); break;
+        case 'o': format = optarg; break;
+        case 'H': csv_header = false; break;
+        case 'T': rss_file = optarg; break;
+        case 'S': seed = strtoull(optarg, NULL, 0); break;
+        default: usage(argv[0]);
+        }
+    }
+    if (optind != argc) usage(argv[0]);
+
+    const bench_ds_t *all[] = { &bench_list, &bench_hash, &bench_skiplist,
+                                &bench_bst, &bench_queue };
+    for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); ++i) {
+        if (strcmp(ds_name, all[i]->name) == 0) ds_ops = all[i];
+    }
+    for (size_t i = 0; i < sizeof(reclaimers) / sizeof(reclaimers[0]); ++i) {
+        if (strcmp(reclaimer_name, reclaimers[i].name) == 0) {
+            reclaimer = &reclaimers[i];
+        }
+    }
+    if (!ds_ops || !reclaimer) usage(argv[0]);
+
+    if (key_range < 0) key_range = ds_ops == &bench_list ? 1024 : 65536;
+    if (initial < 0) initial = key_range / 2;
+    if (num_threads < 1 || key_range < 1 || key_range > BENCH_KEY_MAX
+        || initial > key_range || update_pct < 0 || update_pct > 100
+        || duration <= 0 || sample_every < 1 || rss_interval_ms < 1
+        || (strcmp(format, "text") && strcmp(format, "csv")
+            && strcmp(format, "json"))) {
+        usage(argv[0]);
+    }
+    if (seed == 0) seed = now_ns();
+}
+
+int main(int argc, char **argv) {
+    parse_args(argc, argv);
+
+    reclaimer->setup();
+    bench_retire = reclaimer->retire;
+    bench_reclaimer = reclaimer->ds;
+    ds = ds_ops->create(key_range);
+
+    // Fill to the initial size.
+    uint64_t rng = seed | 1;
+    for (long inserted = 0; inserted < initial; ) {
+        long key = (long)((next_rand(&rng) >> 16) % (uint64_t)key_range);
+        reclaimer->enter();
+        inserted += ds_ops->insert(ds, key);
+        reclaimer->exit();
+    }
+    reclaimer->thread_exit();
+
+    worker_t *workers = aligned_alloc(64, num_threads * sizeof(worker_t));
+    pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+    if (!workers || !threads) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    memset(workers, 0, num_threads * sizeof(worker_t));
+
+    max_rss_samples = (size_t)(duration * 1000 / rss_interval_ms) + 2;
+    rss_samples = calloc(max_rss_samples, sizeof(rss_sample_t));
+    if (!rss_samples) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < num_threads; ++i) {
+        workers[i].id = i;
+        workers[i].rng = (seed ^ ((uint64_t)(i + 1) * 0x9E3779B97F4A7C15ULL))
+            | 1;
+        pthread_create(&threads[i], NULL, worker_thread, &workers[i]);
+    }
+    while (atomic_load(&ready) < num_threads)
+        ;
+
+    result_t r;
+    memset(&r, 0, sizeof(r));
+    struct forkscan_stats before, after;
+    forkscan_get_stats(&before);
+
+    uint64_t start = now_ns();
+    pthread_t sampler;
+    pthread_create(&sampler, NULL, rss_thread, &start);
+    atomic_store_explicit(&go, true, memory_order_release);
+
+    sleep_until(start + (uint64_t)(duration * 1e9));
+    atomic_store(&stop, true);
+    uint64_t end = now_ns();
+
+    for (int i = 0; i < num_threads; ++i) pthread_join(threads[i], NULL);
+    pthread_join(sampler, NULL);
+    forkscan_get_stats(&after);
+
+    uint64_t *hist = calloc(N_BUCKETS, sizeof(uint64_t));
+    uint64_t samples = 0;
+    for (int i = 0; i < num_threads; ++i) {
+        r.ops += workers[i].ops;
+        samples += workers[i].samples;
+        if (workers[i].max_ns > r.max) r.max = workers[i].max_ns;
+        for (int b = 0; b < N_BUCKETS; ++b) hist[b] += workers[i].hist[b];
+    }
+    r.elapsed_s = (double)(end - start) / 1e9;
+    r.p50 = percentile(hist, samples, 0.50);
+    r.p99 = percentile(hist, samples, 0.99);
+    r.p999 = percentile(hist, samples, 0.999);
+
+    r.rss_end_kb = read_rss_kb();
+    r.rss_start_kb = n_rss_samples ? rss_samples[0].rss_kb : r.rss_end_kb;
+    r.rss_max_kb = r.rss_end_kb;
+    for (size_t i = 0; i < n_rss_samples; ++i) {
+        if (rss_samples[i].rss_kb > r.rss_max_kb) {
+            r.rss_max_kb = rss_samples[i].rss_kb;
+        }
+    }
+    forkscan_delta(&r, &before, &after);
+
+    if (strcmp(format, "csv") == 0) print_csv(&r);
+    else if (strcmp(format, "json") == 0) print_json(&r);
+    else print_text(&r);
+    if (rss_file) write_rss_file();
+
+    free(hist);
+    free(rss_samples);
+    free(threads);
+    free(workers);
+    return 0;
+}
@@ -0,0 +1,49 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// -------------------------------------------------------------------------
+// Shared pieces of the data-structure benchmark (bench.c).
+//
+// Every structure is a set of long keys in [0, key_range).  Keys at and
+// above BENCH_KEY_MAX are reserved for sentinels.  Operations are run
+// between the reclaimer's enter() and exit(), and unlinked nodes are handed
+// to bench_retire(), so the same code runs under Forkscan, epochs, or no
+// reclamation at all.  The list, hash map, skiplist and queue come from
+// libforkscan_ds (ds_lib.c), and retire through bench_reclaimer instead.
+// -------------------------------------------------------------------------
+
+#define BENCH_KEY_MAX (LONG_MAX - 8)
+
+typedef struct bench_ds_t {
+    const char *name;
+    void *(*create)(long key_range);
+    int (*insert)(void *ds, long key);
+    int (*remove)(void *ds, long key);
+    int (*contains)(void *ds, long key);
+} bench_ds_t;
+
+extern const bench_ds_t bench_list;
+extern const bench_ds_t bench_hash;
+extern const bench_ds_t bench_skiplist;
+extern const bench_ds_t bench_bst;
+extern const bench_ds_t bench_queue;
+
+// Node memory.  bench_free() is only for nodes that were never published.
+void *bench_alloc(size_t size);
+void bench_free(void *ptr);
+
+// Set by the driver to the selected reclaimer's retire function, and to
+// its libforkscan_ds equivalent (NULL for Forkscan's own).
+extern void (*bench_retire)(void *ptr);
+extern const struct forkscan_ds_reclaimer *bench_reclaimer;
+
+// Low pointer bits used as marks by the BST.
+#define BENCH_MARK 0x1UL
+#define BENCH_TAG  0x2UL
+#define BENCH_PTR(v) ((void*)((uintptr_t)(v) & ~(BENCH_MARK | BENCH_TAG)))
+
+#endif // BENCH_H
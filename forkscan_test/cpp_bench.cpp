@@ -0,0 +1,253 @@
+#include <getopt.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "forkscan.hpp"
+
+// -------------------------------------------------------------------------
+// C++ layer benchmark.  Each variant has threads allocate and retire (or
+// free) nodes as fast as they can for a fixed time, once through the C API
+// and once through forkscan.hpp, so the cost of the layer shows up as the
+// difference between paired rows:
+//
+//   c / cpp          trivially destructible node, retired
+//   c-fin / cpp-fin  node with a destructor that must run at reclaim time
+//   c-free / pmr     allocate and free right away, through the
+//                    std::pmr::memory_resource
+// -------------------------------------------------------------------------
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -v VARIANTS  c, cpp, c-fin, cpp-fin, c-free and pmr"
+            " (default all)\n"
+            "  -t THREADS   thread counts (default 1,2,4)\n"
+            "  -d SECONDS   duration of each run (default 1)\n"
+            "  -o FORMAT    text or csv (default text)\n"
+            "  -H           leave out the CSV header, for appending runs\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
+
+// -------------------------------------------------------------------------
+// Nodes
+// -------------------------------------------------------------------------
+
+struct plain_node {
+    uint64_t key;
+    uint64_t value;
+    plain_node *next;
+};
+
+// Counts destructor calls, so a run can show finalization happened.
+static std::atomic<uint64_t> destroyed{0};
+
+struct fat_node {
+    uint64_t key;
+    uint64_t value;
+    fat_node *next;
+
+    fat_node(uint64_t k, uint64_t v) : key(k), value(v), next(nullptr) {}
+    ~fat_node() { destroyed.fetch_add(1, std::memory_order_relaxed); }
+};
+
+static void destroy_fat_node(void *ptr, void *) {
+    static_cast<fat_node *>(ptr)->~fat_node();
+}
+
+// -------------------------------------------------------------------------
+// Variants.  Each does one operation per call.
+// -------------------------------------------------------------------------
+
+static void op_c(uint64_t i) {
+    plain_node *n = static_cast<plain_node *>(
+        forkscan_malloc(sizeof(plain_node)));
+    n->key = i;
+    n->value = i;
+    n->next = nullptr;
+    forkscan_retire(n);
+}
+
+static void op_cpp(uint64_t i) {
+    plain_node *n = forkscan::make<plain_node>(plain_node{i, i, nullptr});
+    forkscan::retire(n);
+}
+
+static void op_c_fin(uint64_t i) {
+    void *mem = forkscan_malloc(sizeof(fat_node));
+    fat_node *n = new (mem) fat_node(i, i);
+    forkscan_retire_with_finalizer(n, destroy_fat_node, nullptr);
+}
+
+static void op_cpp_fin(uint64_t i) {
+    forkscan::retired<fat_node> n = forkscan::make_retired<fat_node>(i, i);
+    n->next = nullptr;
+}
+
+static void op_c_free(uint64_t i) {
+    plain_node *n = static_cast<plain_node *>(
+        forkscan_malloc(sizeof(plain_node)));
+    n->key = i;
+    forkscan_free(n);
+}
+
+static void op_pmr(uint64_t i) {
+    std::pmr::memory_resource *r = forkscan::resource();
+    plain_node *n = static_cast<plain_node *>(
+        r->allocate(sizeof(plain_node), alignof(plain_node)));
+    n->key = i;
+    r->deallocate(n, sizeof(plain_node), alignof(plain_node));
+}
+
+struct variant_t {
+    const char *name;
+    void (*op)(uint64_t);
+};
+
+static const variant_t all_variants[] = {
+    {"c", op_c},
+    {"cpp", op_cpp},
+    {"c-fin", op_c_fin},
+    {"cpp-fin", op_cpp_fin},
+    {"c-free", op_c_free},
+    {"pmr", op_pmr},
+};
+
+// -------------------------------------------------------------------------
+// Options
+// -------------------------------------------------------------------------
+
+static std::vector<const variant_t *> variants;
+static std::vector<int> thread_counts = {1, 2, 4};
+static double duration = 1.0;
+static bool csv = false;
+static bool header = true;
+
+static std::vector<std::string> split(const char *arg) {
+    std::vector<std::string> parts;
+    std::string s(arg);
+    size_t start = 0;
+    for (;;) {
+        size_t comma = s.find(',', start);
+        parts.push_back(s.substr(start, comma - start));
+        if (comma == std::string::npos) break;
+        start = comma + 1;
+    }
+    return parts;
+}
+
+static void parse_args(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "v:t:d:o:H")) != -1) {
+        switch (opt) {
+        case 'v':
+            variants.clear();
+            for (const std::string &name : split(optarg)) {
+                const variant_t *v = nullptr;
+                for (const variant_t &c : all_variants) {
+                    if (name == c.name) v = &c;
+                }
+                if (!v) usage(argv[0]);
+                variants.push_back(v);
+            }
+            break;
+        case 't':
+            thread_counts.clear();
+            for (const std::string &n : split(optarg)) {
+                int t = atoi(n.c_str());
+                if (t <= 0) usage(argv[0]);
+                thread_counts.push_back(t);
+            }
+            break;
+        case 'd': duration = atof(optarg); break;
+        case 'o':
+            if (strcmp(optarg, "csv") == 0) csv = true;
+            else if (strcmp(optarg, "text") != 0) usage(argv[0]);
+            break;
+        case 'H': header = false; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (optind != argc || duration <= 0) usage(argv[0]);
+    if (variants.empty()) {
+        for (const variant_t &v : all_variants) variants.push_back(&v);
+    }
+}
+
+// -------------------------------------------------------------------------
+// Runs
+// -------------------------------------------------------------------------
+
+static std::atomic<bool> stop{false};
+
+static void worker(const variant_t *v, uint64_t *ops) {
+    uint64_t i = 0;
+    while (!stop.load(std::memory_order_relaxed)) {
+        // Check the clock's flag only every so often.
+        for (int k = 0; k < 64; ++k) v->op(i++);
+    }
+    // Hand over this thread's batch before the totals are taken.
+    forkscan::flush();
+    *ops = i;
+}
+
+static void run(const variant_t *v, int threads) {
+    std::vector<std::thread> pool;
+    std::vector<uint64_t> ops(threads, 0);
+    uint64_t destroyed_before = destroyed.load();
+
+    stop = false;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; ++t) {
+        pool.emplace_back(worker, v, &ops[t]);
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(duration));
+    stop = true;
+    for (std::thread &t : pool) t.join();
+    double secs = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    // Let what's left be reclaimed, so the next run starts even.
+    forkscan::synchronize();
+
+    uint64_t total = 0;
+    for (uint64_t n : ops) total += n;
+    double ops_per_sec = total / secs;
+    uint64_t finalized = destroyed.load() - destroyed_before;
+
+    if (csv) {
+        printf("%s,%d,%.0f,%.1f,%llu,%llu\n", v->name, threads, ops_per_sec,
+               1e9 * threads / ops_per_sec, (unsigned long long)total,
+               (unsigned long long)finalized);
+    } else {
+        printf("%-8s %7d %14.0f %10.1f %14llu %14llu\n", v->name, threads,
+               ops_per_sec, 1e9 * threads / ops_per_sec,
+               (unsigned long long)total, (unsigned long long)finalized);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    parse_args(argc, argv);
+
+    if (csv) {
+        if (header) printf("variant,threads,ops_per_sec,ns_per_op,ops,"
+                           "finalized\n");
+    } else {
+        printf("%-8s %7s %14s %10s %14s %14s\n", "variant", "threads",
+               "ops/s", "ns/op", "ops", "finalized");
+    }
+    for (const variant_t *v : variants) {
+        for (int threads : thread_counts) run(v, threads);
+    }
+    return 0;
+}
@@ -0,0 +1,207 @@
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "bench.h"
+
+// -------------------------------------------------------------------------
+// Lock-free external binary search tree (Natarajan & Mittal, PPoPP '14).
+// Keys live in the leaves.  A delete flags the edge to its leaf and then
+// tags the sibling edge; one CAS on the edge above the topmost tagged node
+// then splices out the whole chain, and the thread whose CAS succeeded
+// retires everything that was cut off.
+// -------------------------------------------------------------------------
+
+#define FLAG BENCH_MARK
+#define TAG  BENCH_TAG
+
+#define INF0 (BENCH_KEY_MAX + 1)
+#define INF1 (BENCH_KEY_MAX + 2)
+#define INF2 (BENCH_KEY_MAX + 3)
+
+typedef struct tnode {
+    long key;
+    _Atomic(uintptr_t) left;  // Both NULL in a leaf.
+    _Atomic(uintptr_t) right;
+} tnode_t;
+
+typedef struct seek_record_t {
+    tnode_t *ancestor;
+    tnode_t *successor;
+    tnode_t *parent;
+    tnode_t *leaf;
+} seek_record_t;
+
+static tnode_t *new_node(long key, tnode_t *left, tnode_t *right) {
+    tnode_t *node = bench_alloc(sizeof(tnode_t));
+    node->key = key;
+    atomic_init(&node->left, (uintptr_t)left);
+    atomic_init(&node->right, (uintptr_t)right);
+    return node;
+}
+
+static _Atomic(uintptr_t) *child_edge(tnode_t *node, long key) {
+    return key < node->key ? &node->left : &node->right;
+}
+
+static _Atomic(uintptr_t) *other_edge(tnode_t *node, long key) {
+    return key < node->key ? &node->right : &node->left;
+}
+
+static void seek(tnode_t *root, long key, seek_record_t *sr) {
+    tnode_t *s = BENCH_PTR(atomic_load(&root->left));
+    sr->ancestor = root;
+    sr->successor = s;
+    sr->parent = s;
+
+    uintptr_t parent_field = atomic_load(&s->left);
+    tnode_t *cur = BENCH_PTR(parent_field);
+    uintptr_t cur_field = atomic_load(child_edge(cur, key));
+
+    while (BENCH_PTR(cur_field) != NULL) {
+        if (!(parent_field & TAG)) {
+            sr->ancestor = sr->parent;
+            sr->successor = cur;
+        }
+        sr->parent = cur;
+        cur = BENCH_PTR(cur_field);
+        parent_field = cur_field;
+        cur_field = atomic_load(child_edge(cur, key));
+    }
+    sr->leaf = cur;
+}
+
+// Splice out the parent of a flagged leaf.  Return true if this thread's
+// CAS did it, in which case the removed nodes have been retired.
+static int cleanup(long key, seek_record_t *sr) {
+    tnode_t *ancestor = sr->ancestor;
+    tnode_t *successor = sr->successor;
+    tnode_t *parent = sr->parent;
+
+    _Atomic(uintptr_t) *successor_edge = child_edge(ancestor, key);
+    _Atomic(uintptr_t) *child = child_edge(parent, key);
+    _Atomic(uintptr_t) *sibling = other_edge(parent, key);
+
+    if (!(atomic_load(child) & FLAG)) {
+        // Our leaf is not the one being deleted; its sibling is.
+        sibling = child;
+        child = other_edge(parent, key);
+    }
+
+    atomic_fetch_or(sibling, TAG);
+    uintptr_t moved = atomic_load(sibling);
+
+    uintptr_t expected = (uintptr_t)successor;
+    if (!atomic_compare_exchange_strong(successor_edge, &expected,
+                                        (uintptr_t)BENCH_PTR(moved)
+                                        | (moved & FLAG))) {
+        return 0;
+    }
+
+    // Everything from successor down to parent is now unreachable, along
+    // with the flagged leaf hanging off each of those nodes.
+    tnode_t *node = successor;
+    while (node != parent) {
+        bench_retire(BENCH_PTR(atomic_load(other_edge(node, key))));
+        tnode_t *next = BENCH_PTR(atomic_load(child_edge(node, key)));
+        bench_retire(node);
+        node = next;
+    }
+    bench_retire(BENCH_PTR(atomic_load(child)));
+    bench_retire(parent);
+    return 1;
+}
+
+static void *bst_create(long key_range) {
+    (void)key_range;
+    tnode_t *s = new_node(INF1, new_node(INF0, NULL, NULL),
+                          new_node(INF1, NULL, NULL));
+    return new_node(INF2, s, new_node(INF2, NULL, NULL));
+}
+
+static int bst_insert(void *ds, long key) {
+    tnode_t *root = ds;
+    tnode_t *leaf_node = NULL;
+    tnode_t *internal = NULL;
+    seek_record_t sr;
+
+    for (;;) {
+        seek(root, key, &sr);
+        tnode_t *leaf = sr.leaf;
+        if (leaf->key == key) {
+            if (leaf_node) {
+                bench_free(leaf_node);
+                bench_free(internal);
+            }
+            return 0;
+        }
+
+        if (!leaf_node) {
+            leaf_node = new_node(key, NULL, NULL);
+            internal = new_node(0, NULL, NULL);
+        }
+        if (key < leaf->key) {
+            internal->key = leaf->key;
+            atomic_store(&internal->left, (uintptr_t)leaf_node);
+            atomic_store(&internal->right, (uintptr_t)leaf);
+        } else {
+            internal->key = key;
+            atomic_store(&internal->left, (uintptr_t)leaf);
+            atomic_store(&internal->right, (uintptr_t)leaf_node);
+        }
+
+        _Atomic(uintptr_t) *edge = child_edge(sr.parent, key);
+        uintptr_t expected = (uintptr_t)leaf;
+        if (atomic_compare_exchange_strong(edge, &expected,
+                                           (uintptr_t)internal)) {
+            return 1;
+        }
+        if (BENCH_PTR(expected) == leaf && (expected & (FLAG | TAG))) {
+            cleanup(key, &sr);
+        }
+    }
+}
+
+static int bst_remove(void *ds, long key) {
+    tnode_t *root = ds;
+    tnode_t *leaf = NULL;
+    seek_record_t sr;
+
+    // Inject: flag the edge to the leaf.
+    for (;;) {
+        seek(root, key, &sr);
+        if (sr.leaf->key != key) return 0;
+        leaf = sr.leaf;
+
+        _Atomic(uintptr_t) *edge = child_edge(sr.parent, key);
+        uintptr_t expected = (uintptr_t)leaf;
+        if (atomic_compare_exchange_strong(edge, &expected,
+                                           (uintptr_t)leaf | FLAG)) {
+            break;
+        }
+        if (BENCH_PTR(expected) == leaf && (expected & (FLAG | TAG))) {
+            cleanup(key, &sr);
+        }
+    }
+
+    // Cleanup: until the leaf is out of the tree.
+    if (cleanup(key, &sr)) return 1;
+    for (;;) {
+        seek(root, key, &sr);
+        if (sr.leaf != leaf) return 1;
+        if (cleanup(key, &sr)) return 1;
+    }
+}
+
+static int bst_contains(void *ds, long key) {
+    tnode_t *node = ds;
+    for (;;) {
+        tnode_t *next = BENCH_PTR(atomic_load(child_edge(node, key)));
+        if (next == NULL) return node->key == key;
+        node = next;
+    }
+}
+
+const bench_ds_t bench_bst = {
+    "bst", bst_create, bst_insert, bst_remove, bst_contains
+};
@@ -0,0 +1,115 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "forkscan_ds.h"
+#include "bench.h"
+
+// -------------------------------------------------------------------------
+// The libforkscan_ds structures as benchmark sets.  Their nodes are
+// retired through bench_reclaimer, so they run under the same reclaimers
+// as the structures kept here.
+// -------------------------------------------------------------------------
+
+const struct forkscan_ds_reclaimer *bench_reclaimer;
+
+// An insert can only fail for lack of memory, and bench_alloc() exits on
+// that too.
+static int checked(int ret) {
+    if (ret < 0) {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    return ret;
+}
+
+static void *list_create(long key_range) {
+    (void)key_range;
+    return forkscan_ds_list_create(bench_reclaimer);
+}
+
+static int list_insert(void *ds, long key) {
+    return checked(forkscan_ds_list_insert(ds, key, NULL));
+}
+
+static int list_remove(void *ds, long key) {
+    return forkscan_ds_list_remove(ds, key, NULL);
+}
+
+static int list_contains(void *ds, long key) {
+    return forkscan_ds_list_lookup(ds, key, NULL);
+}
+
+const bench_ds_t bench_list = {
+    "list", list_create, list_insert, list_remove, list_contains
+};
+
+static void *hash_create(long key_range) {
+    // Start at full size, so the run measures lookups, not growth.
+    return forkscan_ds_hash_create((size_t)key_range, bench_reclaimer);
+}
+
+static int hash_insert(void *ds, long key) {
+    return checked(forkscan_ds_hash_insert(ds, key, NULL));
+}
+
+static int hash_remove(void *ds, long key) {
+    return forkscan_ds_hash_remove(ds, key, NULL);
+}
+
+static int hash_contains(void *ds, long key) {
+    return forkscan_ds_hash_lookup(ds, key, NULL);
+}
+
+const bench_ds_t bench_hash = {
+    "hash", hash_create, hash_insert, hash_remove, hash_contains
+};
+
+static void *skiplist_create(long key_range) {
+    (void)key_range;
+    return forkscan_ds_skiplist_create(bench_reclaimer);
+}
+
+static int skiplist_insert(void *ds, long key) {
+    return checked(forkscan_ds_skiplist_insert(ds, key, NULL));
+}
+
+static int skiplist_remove(void *ds, long key) {
+    return forkscan_ds_skiplist_remove(ds, key, NULL);
+}
+
+static int skiplist_contains(void *ds, long key) {
+    return forkscan_ds_skiplist_lookup(ds, key, NULL);
+}
+
+const bench_ds_t bench_skiplist = {
+    "skiplist", skiplist_create, skiplist_insert, skiplist_remove,
+    skiplist_contains
+};
+
+// The queue isn't a set: inserts enqueue and removes dequeue, and the
+// reads are split between the two by key, so its length stays near the
+// initial fill.  Items are keys offset past the values the queue
+// reserves.
+static void *queue_create(long key_range) {
+    (void)key_range;
+    return forkscan_ds_queue_create(bench_reclaimer);
+}
+
+static int queue_insert(void *ds, long key) {
+    checked(forkscan_ds_queue_enqueue(ds, (void*)(uintptr_t)(key + 2)));
+    return 1;
+}
+
+static int queue_remove(void *ds, long key) {
+    (void)key;
+    return forkscan_ds_queue_dequeue(ds) != NULL;
+}
+
+static int queue_contains(void *ds, long key) {
+    return key & 1 ? queue_insert(ds, key) : queue_remove(ds, key);
+}
+
+const bench_ds_t bench_queue = {
+    "queue", queue_create, queue_insert, queue_remove, queue_contains
+};
@@ -0,0 +1,186 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "ebr.h"
+
+#define EBR_MAX_THREADS 512
+#define EBR_ADVANCE_EVERY 128 // Retires between attempts to advance.
+
+typedef struct bag_t {
+    uint64_t epoch;
+    void **ptrs;
+    size_t count;
+    size_t cap;
+} bag_t;
+
+// The limbo bags of a thread that has exited, waiting for the epoch to move
+// on.
+typedef struct orphan_t {
+    uint64_t epoch;
+    void **ptrs;
+    size_t count;
+    struct orphan_t *next;
+} orphan_t;
+
+typedef struct ebr_thread_t {
+    // (epoch << 1) | 1 while inside a critical section, 0 outside.
+    _Atomic(uint64_t) local;
+    _Atomic(int) in_use;
+    size_t since_advance;
+    bag_t bags[3];
+} __attribute__((aligned(64))) ebr_thread_t;
+
+static _Atomic(uint64_t) global_epoch = 1;
+static ebr_thread_t slots[EBR_MAX_THREADS];
+static _Atomic(int) n_slots;
+static _Thread_local ebr_thread_t *self;
+static orphan_t *orphans; // Guarded by orphans_lock.
+static _Atomic(int) n_orphans;
+static pthread_mutex_t orphans_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static ebr_thread_t *get_self(void) {
+    if (self) return self;
+    for (int i = 0; i < EBR_MAX_THREADS; ++i) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&slots[i].in_use, &expected, 1)) {
+            int n = atomic_load(&n_slots);
+            while (n <= i && !atomic_compare_exchange_weak(&n_slots, &n, i + 1))
+                ;
+            self = &slots[i];
+            return self;
+        }
+    }
+    fprintf(stderr, "ebr: more than %d threads\n", EBR_MAX_THREADS);
+    exit(EXIT_FAILURE);
+}
+
+static void free_bag(bag_t *bag) {
+    for (size_t i = 0; i < bag->count; ++i) bench_free(bag->ptrs[i]);
+    bag->count = 0;
+}
+
+// Free the orphans that are two epochs older than e.
+static void free_orphans(uint64_t e) {
+    orphan_t *ready = NULL;
+    pthread_mutex_lock(&orphans_lock);
+    orphan_t **prev = &orphans;
+    while (*prev) {
+        orphan_t *o = *prev;
+        if (o->epoch + 2 <= e) {
+            *prev = o->next;
+            o->next = ready;
+            ready = o;
+            atomic_fetch_sub(&n_orphans, 1);
+        } else {
+            prev = &o->next;
+        }
+    }
+    pthread_mutex_unlock(&orphans_lock);
+
+    while (ready) {
+        orphan_t *o = ready;
+        ready = o->next;
+        for (size_t i = 0; i < o->count; ++i) bench_free(o->ptrs[i]);
+        free(o->ptrs);
+        free(o);
+    }
+}
+
+static void try_advance(void) {
+    uint64_t e = atomic_load(&global_epoch);
+    int n = atomic_load(&n_slots);
+    for (int i = 0; i < n; ++i) {
+        uint64_t v = atomic_load(&slots[i].local);
+        if ((v & 1) && (v >> 1) != e) return;
+    }
+    if (atomic_compare_exchange_strong(&global_epoch, &e, e + 1)
+        && atomic_load(&n_orphans)) {
+        free_orphans(e + 1);
+    }
+}
+
+void ebr_enter(void) {
+    ebr_thread_t *t = get_self();
+    uint64_t e = atomic_load(&global_epoch);
+    for (;;) {
+        atomic_store(&t->local, (e << 1) | 1);
+        uint64_t now = atomic_load(&global_epoch);
+        if (now == e) break;
+        e = now;
+    }
+
+    // Anything retired two epochs ago can no longer be reached.
+    for (int i = 0; i < 3; ++i) {
+        if (t->bags[i].count && t->bags[i].epoch + 2 <= e) {
+            free_bag(&t->bags[i]);
+        }
+    }
+}
+
+void ebr_exit(void) {
+    atomic_store_explicit(&self->local, 0, memory_order_release);
+}
+
+void ebr_retire(void *ptr) {
+    ebr_thread_t *t = self;
+    uint64_t e = atomic_load_explicit(&t->local, memory_order_relaxed) >> 1;
+    bag_t *bag = &t->bags[e % 3];
+
+    if (bag->epoch != e) {
+        // Same slot, at least three epochs older: safe.
+        free_bag(bag);
+        bag->epoch = e;
+    }
+    if (bag->count == bag->cap) {
+        bag->cap = bag->cap ? bag->cap * 2 : 256;
+        bag->ptrs = realloc(bag->ptrs, bag->cap * sizeof(void*));
+        if (!bag->ptrs) {
+            perror("ebr: realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    bag->ptrs[bag->count++] = ptr;
+
+    if (++t->since_advance >= EBR_ADVANCE_EVERY) {
+        t->since_advance = 0;
+        try_advance();
+    }
+}
+
+void ebr_thread_exit(void) {
+    ebr_thread_t *t = self;
+    if (!t) return;
+    // Other threads may still hold what's in our bags, so they wait on the
+    // orphan list until the epoch has advanced twice past now.
+    uint64_t e = atomic_load(&global_epoch);
+    for (int i = 0; i < 3; ++i) {
+        bag_t *bag = &t->bags[i];
+        if (bag->count == 0) {
+            free(bag->ptrs);
+            continue;
+        }
+        orphan_t *o = malloc(sizeof(orphan_t));
+        if (!o) {
+            perror("ebr: malloc");
+            exit(EXIT_FAILURE);
+        }
+        o->epoch = e;
+        o->ptrs = bag->ptrs;
+        o->count = bag->count;
+        pthread_mutex_lock(&orphans_lock);
+        o->next = orphans;
+        orphans = o;
+        atomic_fetch_add(&n_orphans, 1);
+        pthread_mutex_unlock(&orphans_lock);
+    }
+    memset(t->bags, 0, sizeof(t->bags));
+    t->since_advance = 0;
+    atomic_store(&t->local, 0);
+    self = NULL;
+    atomic_store(&t->in_use, 0);
+}
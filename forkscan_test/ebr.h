@@ -0,0 +1,19 @@
+#ifndef EBR_H
+#define EBR_H
+
+// -------------------------------------------------------------------------
+// A minimal epoch-based reclamation scheme, used by the benchmark as a
+// baseline for Forkscan.  Threads announce the global epoch on enter and
+// clear it on exit; retired nodes wait in one of three per-thread limbo
+// bags and are freed once the epoch has advanced twice past them.
+// -------------------------------------------------------------------------
+
+void ebr_enter(void);
+void ebr_exit(void);
+void ebr_retire(void *ptr);
+
+// Release the calling thread's slot.  Whatever is still in its limbo bags
+// is freed by whichever thread advances the epoch far enough.
+void ebr_thread_exit(void);
+
+#endif // EBR_H
@@ -56,7 +56,8 @@ bool add(int key) {
     if (success) {
         return true;
     } else {
-        free(newNode);
+        // Never published, so it can go straight back.
+        forkscan_free(newNode);
         return false;
     }
 }
@@ -90,13 +91,8 @@ bool remove_node(int key) {
 // contains(key): return true if key is present, else false
 // -------------------------------------------------------------------------
 bool contains(int key) {
-    fflush(stdout);
-
     Node* n = atomic_load_explicit(&array[key], memory_order_acquire);
-    bool present = (n != NULL);
-    fflush(stdout);
-
-    return present;
+    return n != NULL;
 }
 
 // -------------------------------------------------------------------------
@@ -116,6 +112,12 @@ typedef struct {
     long long operations;
 } thread_arg_t;
 
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
 void* worker_thread(void* arg) {
     thread_arg_t* targs = (thread_arg_t*) arg;
     int tid = targs->thread_id;
@@ -123,8 +125,8 @@ void* worker_thread(void* arg) {
     // Per-thread random seed.
     unsigned int seed = (unsigned int)(time(NULL) ^ (tid * 123456789ULL));
 
-    time_t start = time(NULL);
-    while ((time(NULL) - start) < RUNTIME_SEC) {
+    uint64_t deadline = now_ns() + RUNTIME_SEC * 1000000000ULL;
+    while (now_ns() < deadline) {
         int r   = rand_r(&seed) % 100;   // random number 0..99
         int key = rand_r(&seed) % KEY_RANGE;
         if (r < UPDATE_RATIO) {
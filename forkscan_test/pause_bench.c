@@ -0,0 +1,411 @@
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "forkscan.h"
+
+// -------------------------------------------------------------------------
+// Pause-time and fork-cost benchmark.  For every combination of heap size,
+// heap contents and thread count it maps and fills a heap, starts the
+// threads, then forces Forkscan iterations one at a time and reports the
+// median of each phase: how long the threads were stopped, what fork()
+// cost, how many copy-on-write faults the parent took while the child ran
+// and how long the scan itself took.  One row per configuration, so the
+// CSV output can be kept and diffed from one version to the next.
+// -------------------------------------------------------------------------
+
+#define MAX_CONFIGS 32
+#define OBJECT_SIZE 64
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -s SIZES     heap sizes, with K, M or G suffixes"
+            " (default 1G,4G,16G,64G)\n"
+            "  -k KIND      pointers, flat or both (default both)\n"
+            "  -t THREADS   thread counts (default 1,4,16,64,256)\n"
+            "  -n ITERS     iterations per configuration (default 5)\n"
+            "  -r RETIREES  objects retired before each iteration"
+            " (default 4096)\n"
+            "  -w           threads keep writing to the heap while the child"
+            " scans\n"
+            "  -P on|off    ask for transparent huge pages on the heap, or"
+            " forbid them (default: the system setting)\n"
+            "  -o FORMAT    text or csv (default text)\n"
+            "  -H           leave out the CSV header, for appending runs\n"
+            "  -a           print every iteration, not just the medians\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
+
+// -------------------------------------------------------------------------
+// Options
+// -------------------------------------------------------------------------
+
+enum { KIND_POINTERS = 1, KIND_FLAT = 2 };
+
+static size_t sizes[MAX_CONFIGS] = { 1UL << 30, 4UL << 30, 16UL << 30,
+                                     64UL << 30 };
+static int n_sizes = 4;
+static int kinds = KIND_POINTERS | KIND_FLAT;
+static size_t thread_counts[MAX_CONFIGS] = { 1, 4, 16, 64, 256 };
+static int n_thread_counts = 5;
+static int iterations = 5;
+static int retirees = 4096;
+static bool writers = false;
+static int thp = -1; // -1: leave alone, 0: forbid, 1: ask for them.
+static bool csv = false;
+static bool header = true;
+static bool every_iteration = false;
+
+static size_t parse_size(const char *s) {
+    char *end;
+    size_t n = strtoull(s, &end, 10);
+    switch (*end) {
+    case 'k': case 'K': n <<= 10; ++end; break;
+    case 'm': case 'M': n <<= 20; ++end; break;
+    case 'g': case 'G': n <<= 30; ++end; break;
+    }
+    return *end == '\0' ? n : 0;
+}
+
+static int parse_list(char *arg, size_t *list, bool suffixes) {
+    int n = 0;
+    for (char *tok = strtok(arg, ","); tok; tok = strtok(NULL, ",")) {
+        if (n == MAX_CONFIGS) return -1;
+        list[n] = suffixes ? parse_size(tok) : strtoull(tok, NULL, 10);
+        if (list[n] == 0) return -1;
+        ++n;
+    }
+    return n;
+}
+
+static void parse_args(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "s:k:t:n:r:wP:o:Ha")) != -1) {
+        switch (opt) {
+        case 's':
+            n_sizes = parse_list(optarg, sizes, true);
+            if (n_sizes <= 0) usage(argv[0]);
+            break;
+        case 'k':
+            if (strcmp(optarg, "pointers") == 0) kinds = KIND_POINTERS;
+            else if (strcmp(optarg, "flat") == 0) kinds = KIND_FLAT;
+            else if (strcmp(optarg, "both") == 0)
+                kinds = KIND_POINTERS | KIND_FLAT;
+            else usage(argv[0]);
+            break;
+        case 't':
+            n_thread_counts = parse_list(optarg, thread_counts, false);
+            if (n_thread_counts <= 0) usage(argv[0]);
+            break;
+        case 'n': iterations = atoi(optarg); break;
+        case 'r': retirees = atoi(optarg); break;
+        case 'w': writers = true; break;
+        case 'P':
+            if (strcmp(optarg, "on") == 0) thp = 1;
+            else if (strcmp(optarg, "off") == 0) thp = 0;
+            else usage(argv[0]);
+            break;
+        case 'o':
+            if (strcmp(optarg, "csv") == 0) csv = true;
+            else if (strcmp(optarg, "text") != 0) usage(argv[0]);
+            break;
+        case 'H': header = false; break;
+        case 'a': every_iteration = true; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (iterations <= 0 || retirees <= 0) usage(argv[0]);
+}
+
+// -------------------------------------------------------------------------
+// Clock
+// -------------------------------------------------------------------------
+
+static void sleep_ns(uint64_t ns) {
+    struct timespec ts = { ns / 1000000000ULL, ns % 1000000000ULL };
+    while (nanosleep(&ts, &ts) == EINTR)
+        ;
+}
+
+static uint64_t next_rand(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+// -------------------------------------------------------------------------
+// Heap
+// -------------------------------------------------------------------------
+
+// Objects the pointer-rich heap points at.  They are allocated between
+// objects that get retired straight away, so the retirees of the measured
+// iterations tend to land among them and the heap's pointers fall inside
+// the retired range, where each costs the child a search.
+static void **targets;
+static int n_targets;
+
+// Fresh objects can still hold the allocator's free list links, which
+// would keep their neighbours alive, so clear them the way a program
+// would by writing its own data.
+static void *alloc_object(void) {
+    void *p = forkscan_malloc(OBJECT_SIZE);
+    memset(p, 0, OBJECT_SIZE);
+    return p;
+}
+
+static void make_targets(void) {
+    n_targets = retirees;
+    targets = malloc(n_targets * sizeof(void*));
+    if (!targets) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < n_targets; ++i) {
+        forkscan_retire(alloc_object());
+        targets[i] = alloc_object();
+    }
+}
+
+static uintptr_t *map_heap(size_t bytes, int kind) {
+    uintptr_t *heap = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (heap == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    if (thp >= 0) {
+        madvise(heap, bytes, thp ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+    }
+
+    // Touch every page, so each has a page table entry for fork() to copy.
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    size_t words = bytes / sizeof(uintptr_t);
+    for (size_t i = 0; i < words; ++i) {
+        heap[i] = kind == KIND_POINTERS
+            ? (uintptr_t)targets[next_rand(&seed) % n_targets]
+            : i;
+    }
+    return heap;
+}
+
+// -------------------------------------------------------------------------
+// Threads
+// -------------------------------------------------------------------------
+
+typedef struct thread_arg_t {
+    uintptr_t *start;
+    size_t words;
+} thread_arg_t;
+
+static _Atomic(bool) stop;
+static _Atomic(size_t) running;
+
+// Threads either sleep, so they only cost a signal each, or keep writing
+// one word to every page of their share of the heap, so the parent takes
+// copy-on-write faults while the child has it mapped.
+static void *thread_fn(void *arg) {
+    thread_arg_t *ta = arg;
+    size_t stride = 4096 / sizeof(uintptr_t);
+    atomic_fetch_add(&running, 1);
+    while (!atomic_load(&stop)) {
+        if (writers) {
+            for (size_t i = 0; i < ta->words && !atomic_load(&stop);
+                 i += stride) {
+                ((volatile uintptr_t*)ta->start)[i] = ta->start[i];
+            }
+        }
+        sleep_ns(1000000);
+    }
+    return NULL;
+}
+
+// -------------------------------------------------------------------------
+// Results
+// -------------------------------------------------------------------------
+
+typedef struct row_t {
+    size_t heap;
+    const char *kind;
+    size_t threads;
+    int iteration; // -1 for the medians.
+    struct forkscan_iteration it;
+} row_t;
+
+static size_t total_ns(const struct forkscan_iteration *it) {
+    return it->signal_ns + it->quiesce_ns + it->child_start_ns + it->scan_ns
+        + it->result_ns;
+}
+
+static size_t pause_ns(const struct forkscan_iteration *it) {
+    return it->signal_ns + it->quiesce_ns + it->fork_ns;
+}
+
+static int cmp_size(const void *a, const void *b) {
+    size_t x = *(const size_t*)a, y = *(const size_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// The median of one field across the iterations.
+static size_t median(const struct forkscan_iteration *its, int n,
+                     size_t offset) {
+    size_t vals[n];
+    for (int i = 0; i < n; ++i) {
+        vals[i] = *(const size_t*)((const char*)&its[i] + offset);
+    }
+    qsort(vals, n, sizeof(size_t), cmp_size);
+    return vals[n / 2];
+}
+
+static void print_header(void) {
+    if (csv) {
+        if (header) {
+            printf("heap_bytes,kind,threads,thp,writers,iteration,retired,"
+                   "survivors,bytes_scanned,siblings,signal_ns,quiesce_ns,"
+                   "fork_ns,pause_ns,child_start_ns,sort_ns,root_scan_ns,"
+                   "mark_ns,scan_ns,result_ns,total_ns,parent_faults\n");
+        }
+    } else {
+        printf("%8s %-8s %7s %4s %10s %10s %10s %10s %10s %10s %8s\n",
+               "heap", "kind", "threads", "iter", "quiesce_us", "fork_us",
+               "pause_us", "child_us", "scan_ms", "total_ms", "faults");
+    }
+}
+
+static void print_row(const row_t *r) {
+    const struct forkscan_iteration *it = &r->it;
+    if (csv) {
+        printf("%zu,%s,%zu,%s,%d,", r->heap, r->kind, r->threads,
+               thp < 0 ? "default" : thp ? "on" : "off", writers);
+        if (r->iteration < 0) printf("median,");
+        else printf("%d,", r->iteration);
+        printf("%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,"
+               "%zu,%zu\n",
+               it->retired, it->survivors, it->bytes_scanned, it->siblings,
+               it->signal_ns, it->quiesce_ns, it->fork_ns, pause_ns(it),
+               it->child_start_ns, it->sort_ns, it->root_scan_ns,
+               it->mark_ns, it->scan_ns, it->result_ns, total_ns(it),
+               it->parent_faults);
+    } else {
+        char heap[16], iter[16];
+        if (r->heap >= 1UL << 30) {
+            snprintf(heap, sizeof(heap), "%zuG", r->heap >> 30);
+        } else {
+            snprintf(heap, sizeof(heap), "%zuM", r->heap >> 20);
+        }
+        if (r->iteration < 0) snprintf(iter, sizeof(iter), "med");
+        else snprintf(iter, sizeof(iter), "%d", r->iteration);
+        printf("%8s %-8s %7zu %4s %10.1f %10.1f %10.1f %10.1f %10.2f %10.2f"
+               " %8zu\n",
+               heap, r->kind, r->threads, iter, it->quiesce_ns / 1e3,
+               it->fork_ns / 1e3, pause_ns(it) / 1e3,
+               it->child_start_ns / 1e3, it->scan_ns / 1e6,
+               total_ns(it) / 1e6, it->parent_faults);
+    }
+    fflush(stdout);
+}
+
+// -------------------------------------------------------------------------
+// Driver
+// -------------------------------------------------------------------------
+
+// Retire a batch and force one iteration to scan it, then read back what
+// that iteration did.
+static void one_iteration(struct forkscan_iteration *it) {
+    for (int i = 0; i < retirees; ++i) {
+        forkscan_retire(alloc_object());
+    }
+    size_t ticket = forkscan_retire_ticket();
+    while (!forkscan_poll(ticket)) {
+        forkscan_force_reclaim();
+        while (!forkscan_poll(ticket)) {
+            sleep_ns(100000);
+        }
+    }
+    forkscan_get_last_iteration(it);
+}
+
+static void run_config(uintptr_t *heap, size_t bytes, const char *kind,
+                       size_t n_threads) {
+    pthread_t threads[n_threads];
+    thread_arg_t args[n_threads];
+    size_t words = bytes / sizeof(uintptr_t);
+    size_t share = words / n_threads;
+
+    atomic_store(&stop, false);
+    atomic_store(&running, 0);
+    for (size_t i = 0; i < n_threads; ++i) {
+        args[i].start = heap + i * share;
+        args[i].words = share;
+        if (pthread_create(&threads[i], NULL, thread_fn, &args[i]) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+    while (atomic_load(&running) < n_threads) sleep_ns(100000);
+
+    // The first iteration after the threads start pays for things the
+    // rest don't, so leave it out.
+    struct forkscan_iteration its[iterations];
+    one_iteration(&its[0]);
+    for (int i = 0; i < iterations; ++i) {
+        one_iteration(&its[i]);
+        if (every_iteration) {
+            row_t r = { bytes, kind, n_threads, i, its[i] };
+            print_row(&r);
+        }
+    }
+
+    row_t r = { bytes, kind, n_threads, -1, { 0 } };
+#define MEDIAN(field)                                                   \
+    r.it.field = median(its, iterations,                                \
+                        offsetof(struct forkscan_iteration, field))
+    MEDIAN(retired); MEDIAN(survivors); MEDIAN(bytes_scanned);
+    MEDIAN(siblings); MEDIAN(signal_ns); MEDIAN(quiesce_ns);
+    MEDIAN(fork_ns); MEDIAN(child_start_ns); MEDIAN(sort_ns);
+    MEDIAN(root_scan_ns); MEDIAN(mark_ns); MEDIAN(scan_ns);
+    MEDIAN(result_ns); MEDIAN(parent_faults);
+#undef MEDIAN
+    print_row(&r);
+
+    atomic_store(&stop, true);
+    for (size_t i = 0; i < n_threads; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+int main(int argc, char **argv) {
+    parse_args(argc, argv);
+
+    // Iterations happen only when asked for, so each measures one batch.
+    forkscan_set_auto_run(0);
+    make_targets();
+
+    print_header();
+    for (int kind = KIND_POINTERS; kind <= KIND_FLAT; kind <<= 1) {
+        if (!(kinds & kind)) continue;
+        for (int s = 0; s < n_sizes; ++s) {
+            uintptr_t *heap = map_heap(sizes[s], kind);
+            for (int t = 0; t < n_thread_counts; ++t) {
+                run_config(heap, sizes[s],
+                           kind == KIND_POINTERS ? "pointers" : "flat",
+                           thread_counts[t]);
+            }
+            munmap(heap, sizes[s]);
+        }
+    }
+    return 0;
+}
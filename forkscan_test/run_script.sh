@@ -1,16 +1,20 @@
 #!/bin/bash
+# Sweep the benchmark over structures, reclaimers and thread counts, one
+# CSV row per run, so results can be compared with a spreadsheet or a
+# script instead of by diffing text logs.
+#
+#   ./run_script.sh [output.csv] [bench binary]
+OUT=${1:-bench_results.csv}
+BENCH=${2:-./bench}
 export FORKSCAN_PTRS_PER_THREAD=1
-export FORKSCAN_REPORT_STATS=1
-./main 2 1024 2048
-./main 4 1024 2048
-./main 8 1024 2048
-./main 16 1024 2048
-./main 32 1024 2048
-./main 64 1024 2048
 
-./main 2 131072 262144
-./main 4 131072 262144
-./main 8 131072 262144
-./main 16 131072 262144
-./main 32 131072 262144
-./main 64 131072 262144
+: > "$OUT"
+HEADER=
+for ds in list hash skiplist bst queue; do
+    for reclaimer in forkscan ebr; do
+        for threads in 2 4 8 16 32 64; do
+            $BENCH -s $ds -r $reclaimer -t $threads -u 20 -o csv $HEADER >> "$OUT"
+            HEADER=-H
+        done
+    done
+done